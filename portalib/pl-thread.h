@@ -0,0 +1,34 @@
+/*
+
+Thread-local storage qualifier
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of Portalib.
+
+Portalib is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.LGPL and COPYING.GPL for redistribution conditions.
+
+C11 provides _Thread_local, but most compilers supported an extension
+long before that.  THREAD_LOCAL expands to whichever is available.
+
+*/
+
+#ifndef PORTALIB_PL_THREAD_H_
+#define PORTALIB_PL_THREAD_H_
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#define THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__)
+#define THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL
+#endif
+
+#endif
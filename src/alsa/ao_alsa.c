@@ -36,6 +36,7 @@ See COPYING.GPL for redistribution conditions.
 #include "logging.h"
 #include "module.h"
 #include "sound.h"
+#include "stats.h"
 #include "xroar.h"
 
 static void *new(void *cfg);
@@ -267,6 +268,7 @@ static void *ao_alsa_write_buffer(void *sptr, void *buffer) {
 	if (!aoalsa->public.sound_interface->ratelimit)
 		return buffer;
 	if (snd_pcm_writei(aoalsa->pcm_handle, buffer, aoalsa->fragment_nframes) < 0) {
+		STATS_ADD(STATS_AO_UNDERRUN, 1);
 		snd_pcm_prepare(aoalsa->pcm_handle);
 		snd_pcm_writei(aoalsa->pcm_handle, buffer, aoalsa->fragment_nframes);
 	}
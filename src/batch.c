@@ -0,0 +1,546 @@
+/*
+
+Batch job runner
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+Reads a manifest of headless jobs and runs them across a pool of worker
+threads, each job getting its own emulated machine in its own emulation
+context.  The manifest uses the same syntax as the configuration file:
+
+    job NAME            start a new job
+    machine NAME        machine configuration (default: as for the emulator)
+    cart NAME           cartridge configuration
+    load FILE           load or attach FILE (may be repeated)
+    run FILE            load or attach FILE and attempt autorun
+    type STRING         queue STRING to be typed at the BASIC prompt
+    timeout SECONDS     stop after SECONDS of emulated time
+    frames N            stop after N video frames
+    exit-pc ADDRESS     stop when the CPU reaches ADDRESS
+
+Each result is written as a single line JSON object.  Lines are written in
+order of completion, so each includes the job's index within the manifest.
+
+Machine setup and teardown share a lot of global configuration, so they are
+serialised; only the emulation itself runs in parallel.
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+// For clock_gettime(), sysconf(_SC_NPROCESSORS_ONLN)
+#define _DEFAULT_SOURCE
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sds.h"
+#include "slist.h"
+#include "xalloc.h"
+
+#include "ao.h"
+#include "batch.h"
+#include "bootcache.h"
+#include "crc32.h"
+#include "events.h"
+#include "keyboard.h"
+#include "logging.h"
+#include "machine.h"
+#include "mc6809.h"
+#include "mc6847/mc6847.h"
+#include "part.h"
+#include "sound.h"
+#include "tape.h"
+#include "vdrive.h"
+#include "vo.h"
+#include "xconfig.h"
+#include "xroar.h"
+
+#ifdef WANT_SIMULATED_NTSC
+#define SCALE_PIXELS (1)
+#else
+#define SCALE_PIXELS (2)
+#endif
+
+// Default budget for jobs that specify neither timeout nor frames.
+#define BATCH_DEFAULT_TIMEOUT (60.0)
+
+struct batch_job {
+	int index;
+
+	// From manifest
+	char *name;
+	char *machine;
+	char *cart;
+	struct slist *load_list;
+	char *run;
+	struct slist *type_list;
+	double timeout;
+	int frames;
+	int exit_pc;
+
+	// Run state
+	struct machine *machine_ptr;
+	struct machine_bp exit_bp;
+	const char *exit_reason;
+
+	// Results
+	unsigned pc;
+	unsigned nframes;
+	uint64_t nticks;
+	uint32_t ram_crc;
+	uint32_t screen_crc;
+	double wall_time;
+};
+
+// Video output: rather than drawing anything, each frame is checksummed.
+
+struct batch_vo {
+	struct vo_interface public;
+	struct batch_job *job;
+	uint32_t crc;
+	uint32_t frame_crc;
+	unsigned nframes;
+};
+
+// Audio output is discarded.
+
+struct batch_ao {
+	struct ao_interface public;
+};
+
+struct batch_state {
+	struct batch_job **jobs;
+	int njobs;
+	int next_job;
+	pthread_mutex_t queue_mt;
+	pthread_mutex_t setup_mt;
+	pthread_mutex_t output_mt;
+	FILE *output;
+	struct ui_interface *ui;
+	struct machine_config *default_mc;
+	int nfailed;
+};
+
+// Original standard out, if claimed for results
+
+static FILE *results_out = NULL;
+
+void batch_claim_stdout(void) {
+	fflush(stdout);
+	int fd = dup(fileno(stdout));
+	if (fd < 0)
+		return;
+	if (!(results_out = fdopen(fd, "w"))) {
+		close(fd);
+		return;
+	}
+	dup2(fileno(stderr), fileno(stdout));
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Manifest parsing.  As with machine & cart configs in the main config, each
+// "job" line completes the job in progress and starts a new one.
+
+static struct batch_job job_cfg = { .exit_pc = -1 };
+static struct slist *job_list = NULL;
+static int job_count = 0;
+
+static void set_job(const char *name);
+
+static struct xconfig_option const batch_options[] = {
+	{ XC_CALL_STRING("job", &set_job) },
+	{ XC_SET_STRING("machine", &job_cfg.machine) },
+	{ XC_SET_STRING("cart", &job_cfg.cart) },
+	{ XC_SET_STRING_LIST_F("load", &job_cfg.load_list) },
+	{ XC_SET_STRING_F("run", &job_cfg.run) },
+	{ XC_SET_STRING_LIST("type", &job_cfg.type_list) },
+	{ XC_SET_DOUBLE("timeout", &job_cfg.timeout) },
+	{ XC_SET_INT("frames", &job_cfg.frames) },
+	{ XC_SET_INT("exit-pc", &job_cfg.exit_pc) },
+	{ XC_OPT_END() }
+};
+
+static void set_job(const char *name) {
+	if (job_cfg.name) {
+		struct batch_job *job = xmalloc(sizeof(*job));
+		*job = job_cfg;
+		job->index = job_count++;
+		if (job->timeout <= 0.0 && job->frames <= 0)
+			job->timeout = BATCH_DEFAULT_TIMEOUT;
+		job_list = slist_append(job_list, job);
+		job_cfg = (struct batch_job){ .exit_pc = -1 };
+	}
+	if (name) {
+		job_cfg.name = xstrdup(name);
+	}
+}
+
+static void job_free(struct batch_job *job) {
+	free(job->name);
+	free(job->machine);
+	free(job->cart);
+	slist_free_full(job->load_list, (slist_free_func)sdsfree);
+	free(job->run);
+	slist_free_full(job->type_list, (slist_free_func)sdsfree);
+	free(job);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void job_stop(struct batch_job *job, const char *reason) {
+	if (!job->exit_reason)
+		job->exit_reason = reason;
+	job->machine_ptr->signal(job->machine_ptr, MACHINE_SIGINT);
+}
+
+static void job_exit_pc(void *sptr) {
+	struct batch_job *job = sptr;
+	job_stop(job, "pc");
+}
+
+static void batch_vo_render_scanline(void *sptr, uint8_t const *scanline_data,
+				     struct ntsc_burst *burst, unsigned phase) {
+	struct batch_vo *bvo = sptr;
+	(void)burst;
+	(void)phase;
+	bvo->crc = crc32_block(bvo->crc, (uint8_t *)scanline_data + VDG_LEFT_BORDER_START/SCALE_PIXELS,
+			       (VDG_RIGHT_BORDER_END - VDG_LEFT_BORDER_START) / SCALE_PIXELS);
+}
+
+static void batch_vo_vsync(void *sptr) {
+	struct batch_vo *bvo = sptr;
+	bvo->frame_crc = bvo->crc;
+	bvo->crc = CRC32_RESET;
+	bvo->nframes++;
+	if (bvo->job->frames > 0 && bvo->nframes >= (unsigned)bvo->job->frames)
+		job_stop(bvo->job, "frames");
+}
+
+static void *batch_ao_write_buffer(void *sptr, void *buffer) {
+	(void)sptr;
+	return buffer;
+}
+
+// Binary files are loaded two seconds in, to give the ROM time to
+// initialise, as when loaded from the command line.  Immediately if the
+// machine was restored to the BASIC prompt from the boot cache.
+
+static void job_load_binaries(void *sptr) {
+	struct batch_job *job = sptr;
+	for (struct slist *l = job->load_list; l; l = l->next) {
+		int type = xroar_filetype_by_ext(l->data);
+		if (type == FILETYPE_BIN || type == FILETYPE_HEX)
+			xroar_load_file_by_type(l->data, 0);
+	}
+	if (job->run) {
+		int type = xroar_filetype_by_ext(job->run);
+		if (type == FILETYPE_BIN || type == FILETYPE_HEX)
+			xroar_load_file_by_type(job->run, !job->type_list);
+	}
+}
+
+static _Bool job_setup(struct batch_state *bs, struct batch_job *job,
+		       struct machine_config *mc) {
+	struct machine_config *base = bs->default_mc;
+	if (job->machine) {
+		base = machine_config_by_name(job->machine);
+		if (!base) {
+			LOG_WARN("batch: %s: machine '%s' not found\n", job->name, job->machine);
+			return 0;
+		}
+	}
+	// Work on a copy, as setting up the machine modifies its config.
+	*mc = *base;
+	mc->default_cart = base->default_cart ? xstrdup(base->default_cart) : NULL;
+
+	xroar_context->tape_interface = tape_interface_new(bs->ui);
+	xroar_context->vdrive_interface = vdrive_interface_new();
+	xroar_configure_machine(mc);
+	if (job->cart) {
+		xroar_set_cart(0, job->cart);
+	} else if (mc->cart_enabled) {
+		xroar_set_cart(0, mc->default_cart);
+	} else {
+		xroar_set_cart(0, NULL);
+	}
+	xroar_hard_reset();
+	job->machine_ptr = xroar_context->machine;
+	_Bool booted = bootcache_boot(xroar_context->machine, xroar_cfg.boot_cache);
+
+	int drive = 0;
+	_Bool delayed_load = 0;
+	for (struct slist *l = job->load_list; l; l = l->next) {
+		switch (xroar_filetype_by_ext(l->data)) {
+		case FILETYPE_VDK: case FILETYPE_JVC:
+		case FILETYPE_OS9: case FILETYPE_DMK:
+			if (drive < 4)
+				xroar_insert_disk_file(drive++, l->data);
+			break;
+		case FILETYPE_BIN: case FILETYPE_HEX:
+			delayed_load = 1;
+			break;
+		default:
+			xroar_load_file_by_type(l->data, 0);
+			break;
+		}
+	}
+	if (job->run) {
+		switch (xroar_filetype_by_ext(job->run)) {
+		case FILETYPE_BIN: case FILETYPE_HEX:
+			delayed_load = 1;
+			break;
+		default:
+			// Typed input inhibits autorun, as with -type
+			xroar_load_file_by_type(job->run, !job->type_list);
+			break;
+		}
+	}
+	if (delayed_load) {
+		event_queue_auto(&xroar_context->ui_events, DELEGATE_AS0(void, job_load_binaries, job), booted ? 0 : EVENT_MS(2000));
+	}
+	for (struct slist *l = job->type_list; l; l = l->next) {
+		keyboard_queue_basic_sds(xroar_context->keyboard_interface, l->data);
+	}
+
+	if (job->exit_pc >= 0) {
+		job->exit_bp = (struct machine_bp){
+			.bp.address = job->exit_pc & 0xffff,
+			.bp.handler = DELEGATE_INIT(job_exit_pc, NULL),
+		};
+		xroar_context->machine->bp_add_n(xroar_context->machine, &job->exit_bp, 1, job);
+	}
+	return 1;
+}
+
+static void job_teardown(struct machine_config *mc) {
+	if (xroar_context->machine) {
+		part_free((struct part *)xroar_context->machine);
+		xroar_context->machine = NULL;
+	}
+	xroar_context->keyboard_interface = NULL;
+	xroar_context->printer_interface = NULL;
+	if (xroar_context->vdrive_interface) {
+		vdrive_interface_free(xroar_context->vdrive_interface);
+		xroar_context->vdrive_interface = NULL;
+	}
+	if (xroar_context->tape_interface) {
+		tape_interface_free(xroar_context->tape_interface);
+		xroar_context->tape_interface = NULL;
+	}
+	xroar_context->machine_config = NULL;
+	free(mc->default_cart);
+	mc->default_cart = NULL;
+}
+
+static void job_run(struct batch_state *bs, struct batch_job *job) {
+	struct xroar_context *ctx = xroar_context_new();
+	xroar_context_set(ctx);
+
+	struct batch_vo bvo = { .job = job };
+	bvo.public.render_scanline = DELEGATE_AS3(void, uint8cp, ntscburst, unsigned, batch_vo_render_scanline, &bvo);
+	bvo.public.vsync = DELEGATE_AS0(void, batch_vo_vsync, &bvo);
+	xroar_context->vo_interface = &bvo.public;
+
+	struct batch_ao bao = {0};
+	bao.public.sound_interface = sound_interface_new(NULL, SOUND_FMT_NULL, 44100, 1, 1024);
+	bao.public.sound_interface->write_buffer = DELEGATE_AS1(voidp, voidp, batch_ao_write_buffer, &bao);
+	xroar_context->ao_interface = &bao.public;
+
+	struct machine_config mc = {0};
+	double t0 = now();
+
+	pthread_mutex_lock(&bs->setup_mt);
+	_Bool ok = job_setup(bs, job, &mc);
+	pthread_mutex_unlock(&bs->setup_mt);
+	// Don't count anything run to fill the boot cache
+	bvo.crc = bvo.frame_crc = 0;
+	bvo.nframes = 0;
+	job->exit_reason = NULL;
+
+	if (ok) {
+		// Budget is tracked in 64 bits, as event ticks wrap after a
+		// few minutes of emulated time.
+		uint64_t budget = job->timeout > 0.0 ? (uint64_t)EVENT_S(job->timeout) : UINT64_MAX;
+		while (!job->exit_reason && job->nticks < budget) {
+			uint64_t remaining = budget - job->nticks;
+			int ncycles = remaining < EVENT_MS(10) ? (int)remaining : (int)EVENT_MS(10);
+			event_ticks start = xroar_context->current_tick;
+			event_run_queue(&xroar_context->ui_events);
+			xroar_context->machine->run(xroar_context->machine, ncycles);
+			job->nticks += (event_ticks)(xroar_context->current_tick - start);
+		}
+		if (!job->exit_reason)
+			job->exit_reason = "timeout";
+
+		struct MC6809 *cpu = xroar_context->machine->get_component(xroar_context->machine, "CPU0");
+		job->pc = cpu->reg_pc;
+		job->ram_crc = CRC32_RESET;
+		struct machine_memory *ram0 = xroar_context->machine->get_component(xroar_context->machine, "RAM0");
+		struct machine_memory *ram1 = xroar_context->machine->get_component(xroar_context->machine, "RAM1");
+		if (ram0 && ram0->size)
+			job->ram_crc = crc32_block(job->ram_crc, ram0->data, ram0->size);
+		if (ram1 && ram1->size)
+			job->ram_crc = crc32_block(job->ram_crc, ram1->data, ram1->size);
+		job->nframes = bvo.nframes;
+		job->screen_crc = bvo.nframes ? bvo.frame_crc : bvo.crc;
+	} else {
+		job->exit_reason = "error";
+	}
+	job->wall_time = now() - t0;
+
+	pthread_mutex_lock(&bs->setup_mt);
+	job_teardown(&mc);
+	pthread_mutex_unlock(&bs->setup_mt);
+
+	sound_interface_free(bao.public.sound_interface);
+	xroar_context_set(NULL);
+	xroar_context_free(ctx);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void fput_json_string(const char *s, FILE *f) {
+	fputc('"', f);
+	for (; *s; s++) {
+		unsigned char c = *s;
+		if (c == '"' || c == '\\') {
+			fputc('\\', f);
+			fputc(c, f);
+		} else if (c < 0x20) {
+			fprintf(f, "\\u%04x", c);
+		} else {
+			fputc(c, f);
+		}
+	}
+	fputc('"', f);
+}
+
+static void job_write_result(struct batch_state *bs, struct batch_job *job) {
+	FILE *f = bs->output;
+	pthread_mutex_lock(&bs->output_mt);
+	fprintf(f, "{\"job\":%d,\"name\":", job->index);
+	fput_json_string(job->name, f);
+	fprintf(f, ",\"exit\":\"%s\"", job->exit_reason);
+	if (strcmp(job->exit_reason, "error") != 0) {
+		fprintf(f, ",\"pc\":%u,\"frames\":%u,\"time\":%.6f", job->pc, job->nframes, (double)job->nticks / EVENT_TICK_RATE);
+		fprintf(f, ",\"ram_crc32\":\"%08" PRIx32 "\",\"screen_crc32\":\"%08" PRIx32 "\"", job->ram_crc, job->screen_crc);
+	}
+	fprintf(f, ",\"wall\":%.3f}\n", job->wall_time);
+	fflush(f);
+	if (strcmp(job->exit_reason, "error") == 0)
+		bs->nfailed++;
+	pthread_mutex_unlock(&bs->output_mt);
+}
+
+static void *batch_worker(void *sptr) {
+	struct batch_state *bs = sptr;
+	for (;;) {
+		pthread_mutex_lock(&bs->queue_mt);
+		int i = bs->next_job;
+		if (i < bs->njobs)
+			bs->next_job++;
+		pthread_mutex_unlock(&bs->queue_mt);
+		if (i >= bs->njobs)
+			break;
+		job_run(bs, bs->jobs[i]);
+		job_write_result(bs, bs->jobs[i]);
+	}
+	return NULL;
+}
+
+int batch_run(const char *manifest, const char *output, int nworkers,
+	      struct ui_interface *ui) {
+	if (xconfig_parse_file(batch_options, manifest) != XCONFIG_OK) {
+		LOG_ERROR("batch: failed to read manifest '%s'\n", manifest);
+		return 1;
+	}
+	set_job(NULL);
+	xconfig_shutdown(batch_options);
+
+	struct batch_state bs = {0};
+	bs.njobs = job_count;
+	bs.jobs = xmalloc((job_count ? job_count : 1) * sizeof(*bs.jobs));
+	for (struct slist *l = job_list; l; l = l->next) {
+		struct batch_job *job = l->data;
+		bs.jobs[job->index] = job;
+	}
+	bs.ui = ui;
+	bs.default_mc = xroar_context->machine_config;
+	bs.output = results_out ? results_out : stdout;
+	if (output) {
+		if (!(bs.output = fopen(output, "w"))) {
+			LOG_ERROR("batch: failed to open '%s' for writing\n", output);
+			return 1;
+		}
+	}
+
+	if (nworkers <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+		nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		if (nworkers <= 0)
+			nworkers = 1;
+	}
+	if (nworkers > bs.njobs)
+		nworkers = bs.njobs;
+	LOG_DEBUG(1, "batch: %d jobs, %d workers\n", bs.njobs, nworkers);
+
+	// Each job machine would otherwise try to open the same GDB port, or
+	// write the same profile or trace.  Nothing can rewind a job, so
+	// don't keep history either.
+	xroar_cfg.gdb = 0;
+	xroar_cfg.profile_file = NULL;
+	xroar_cfg.trace_file = NULL;
+	xroar_cfg.rewind_memory = 0;
+
+	pthread_mutex_init(&bs.queue_mt, NULL);
+	pthread_mutex_init(&bs.setup_mt, NULL);
+	pthread_mutex_init(&bs.output_mt, NULL);
+	pthread_t *threads = xmalloc((nworkers ? nworkers : 1) * sizeof(*threads));
+	for (int i = 0; i < nworkers; i++) {
+		pthread_create(&threads[i], NULL, batch_worker, &bs);
+	}
+	for (int i = 0; i < nworkers; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	pthread_mutex_destroy(&bs.queue_mt);
+	pthread_mutex_destroy(&bs.setup_mt);
+	pthread_mutex_destroy(&bs.output_mt);
+
+	if (bs.output != stdout)
+		fclose(bs.output);
+	if (results_out && results_out != bs.output)
+		fclose(results_out);
+	results_out = NULL;
+	slist_free_full(job_list, (slist_free_func)job_free);
+	job_list = NULL;
+	job_count = 0;
+	free(bs.jobs);
+	return bs.nfailed ? 1 : 0;
+}
@@ -0,0 +1,36 @@
+/*
+
+Batch job runner
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifndef XROAR_BATCH_H_
+#define XROAR_BATCH_H_
+
+struct ui_interface;
+
+/* Call early in batch mode.  Standard out is kept for results, and anything
+ * else written there (i.e., logging) goes to standard error instead. */
+
+void batch_claim_stdout(void);
+
+/* Run every job listed in a manifest file, using a pool of nworkers threads
+ * (one per online CPU if <= 0).  Results are written to the named output
+ * file, or standard out if NULL (as claimed by batch_claim_stdout()).  Returns non-zero if the manifest could not
+ * be read or any job failed to start. */
+
+int batch_run(const char *manifest, const char *output, int nworkers,
+	      struct ui_interface *ui);
+
+#endif
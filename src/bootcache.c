@@ -0,0 +1,223 @@
+/*
+
+Boot state cache
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+Snapshots are keyed on a CRC of the machine and cartridge configuration and
+the CRCs of the ROMs loaded.  A key for which the prompt was never reached is
+recorded as an empty file, so that the attempt isn't repeated every time.
+Delete the cache directory's contents to start over.
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "delegate.h"
+#include "sds.h"
+#include "xalloc.h"
+
+#include "bootcache.h"
+#include "breakpoint.h"
+#include "cart.h"
+#include "crc32.h"
+#include "events.h"
+#include "hd6309.h"
+#include "logging.h"
+#include "machine.h"
+#include "mc6809.h"
+#include "snapshot.h"
+#include "sound.h"
+#include "xroar.h"
+
+// Give up if the prompt isn't reached in this much emulated time
+#define BOOT_TIMEOUT EVENT_S(10)
+
+struct boot_state {
+	struct machine *machine;
+	_Bool at_prompt;
+};
+
+static void boot_at_prompt(void *sptr);
+
+// Same addresses as used to type into BASIC (see keyboard.c)
+
+static struct machine_bp prompt_breakpoint[] = {
+	BP_DRAGON_ROM(.address = 0xbbe5, .handler = DELEGATE_INIT(boot_at_prompt, NULL) ),
+	BP_COCO_BAS10_ROM(.address = 0xa1c1, .handler = DELEGATE_INIT(boot_at_prompt, NULL) ),
+	BP_COCO_BAS11_ROM(.address = 0xa1c1, .handler = DELEGATE_INIT(boot_at_prompt, NULL) ),
+	BP_COCO_BAS12_ROM(.address = 0xa1cb, .handler = DELEGATE_INIT(boot_at_prompt, NULL) ),
+	BP_COCO_BAS13_ROM(.address = 0xa1cb, .handler = DELEGATE_INIT(boot_at_prompt, NULL) ),
+	BP_MX1600_BAS_ROM(.address = 0xa1cb, .handler = DELEGATE_INIT(boot_at_prompt, NULL) ),
+};
+
+static void boot_at_prompt(void *sptr) {
+	struct boot_state *bs = sptr;
+	bs->at_prompt = 1;
+	bs->machine->signal(bs->machine, MACHINE_SIGINT);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static uint32_t crc_uint(uint32_t crc, unsigned v) {
+	uint8_t buf[4] = { v >> 24, v >> 16, v >> 8, v };
+	return crc32_block(crc, buf, sizeof(buf));
+}
+
+static uint32_t crc_string(uint32_t crc, const char *s) {
+	if (!s)
+		return crc_uint(crc, 0);
+	size_t len = strlen(s);
+	crc = crc_uint(crc, len + 1);
+	return crc32_block(crc, (uint8_t *)s, len);
+}
+
+static uint32_t boot_key(struct machine *m, struct cart *c) {
+	struct machine_config *mc = m->config;
+	uint32_t crc = crc_string(CRC32_RESET, PACKAGE_VERSION);
+	crc = crc_uint(crc, mc->architecture);
+	crc = crc_uint(crc, mc->cpu);
+	crc = crc_uint(crc, mc->keymap);
+	crc = crc_uint(crc, mc->tv_standard);
+	crc = crc_uint(crc, mc->vdg_type);
+	crc = crc_uint(crc, mc->ram);
+	crc = crc_uint(crc, m->rom_crc(m));
+	if (c) {
+		crc = crc_string(crc, c->config->name);
+		crc = crc_string(crc, c->config->type);
+		crc = crc_uint(crc, c->config->becker_port);
+		crc = crc_uint(crc, xroar_cfg.becker);
+		crc = crc_uint(crc, c->rom_crc);
+	}
+	return crc;
+}
+
+// Run the machine until the BASIC prompt is reached.  Returns 1 if it was,
+// 0 if it wasn't in time, or -1 if the machine stopped for some other reason.
+
+static int boot_run(struct machine *m) {
+	struct boot_state bs = { .machine = m };
+	struct sound_interface *snd = m->get_interface(m, "sound");
+	_Bool ratelimit = snd->ratelimit;
+	sound_set_ratelimit(snd, 0);
+	machine_bp_add_list(m, prompt_breakpoint, &bs);
+	int result = 0;
+	event_ticks elapsed = 0;
+	while (!bs.at_prompt && elapsed < BOOT_TIMEOUT) {
+		event_ticks start = xroar_context->current_tick;
+		enum machine_run_state state = m->run(m, EVENT_MS(10));
+		event_ticks dt = xroar_context->current_tick - start;
+		// Not progressing, e.g. under control of a debugger
+		if (state == machine_run_state_stopped || dt == 0) {
+			result = -1;
+			break;
+		}
+		elapsed += dt;
+	}
+	machine_bp_remove_list(m, prompt_breakpoint);
+	sound_set_ratelimit(snd, ratelimit);
+	if (!bs.at_prompt)
+		return result;
+
+	// The CPU stopped just before executing the first instruction at the
+	// prompt.  Step its state back so that the instruction hook is called
+	// again when it resumes, allowing other breakpoints there to fire.
+	struct MC6809 *cpu = m->get_component(m, "CPU0");
+	if (cpu->variant == MC6809_VARIANT_HD6309) {
+		struct HD6309 *hcpu = (struct HD6309 *)cpu;
+		hcpu->state = hd6309_state_label_b;
+	} else {
+		cpu->state = mc6809_state_label_b;
+	}
+	return 1;
+}
+
+_Bool bootcache_boot(struct machine *m, const char *dir) {
+	if (!m || !dir || !m->rom_crc)
+		return 0;
+	struct cart *c = m->get_interface(m, "cart");
+	// Autorunning cartridges never reach the prompt
+	if (c && c->config->autorun)
+		return 0;
+
+	uint32_t key = boot_key(m, c);
+	sds filename = sdscatprintf(sdsempty(), "%s/boot-%08x.sna", dir, key);
+	struct stat statbuf;
+	if (stat(filename, &statbuf) == 0) {
+		_Bool ok = statbuf.st_size > 0 && read_snapshot_state(filename) == 0;
+		if (ok) {
+			LOG_DEBUG(1, "Boot cache: restored %s\n", filename);
+		} else {
+			LOG_DEBUG(1, "Boot cache: not using %s\n", filename);
+		}
+		sdsfree(filename);
+		return ok;
+	}
+
+	// Keep the reset state in case the prompt isn't reached
+	size_t reset_size = snapshot_mem_size(m);
+	void *reset_state = xmalloc(reset_size);
+	if (snapshot_mem_save(m, reset_state, reset_size, NULL, NULL) == 0) {
+		free(reset_state);
+		sdsfree(filename);
+		return 0;
+	}
+
+	LOG_DEBUG(1, "Boot cache: booting to create %s\n", filename);
+	int result = boot_run(m);
+	if (result <= 0)
+		(void)snapshot_mem_restore(m, reset_state, reset_size, NULL, NULL);
+	free(reset_state);
+	if (result < 0) {
+		sdsfree(filename);
+		return 0;
+	}
+
+	// Other processes, or other batch jobs in this one, may be creating the
+	// same file, so each writes its own temporary before the rename.
+	static atomic_uint tmp_serial;
+	sds tmpname = sdscatprintf(sdsempty(), "%s.%ld.%u.tmp", filename,
+				   (long)getpid(), atomic_fetch_add(&tmp_serial, 1));
+	_Bool saved;
+	if (result > 0) {
+		saved = (write_snapshot(tmpname) == 0);
+	} else {
+		LOG_WARN("Boot cache: BASIC prompt not reached\n");
+		FILE *fd = fopen(tmpname, "wb");
+		saved = (fd != NULL);
+		if (fd)
+			fclose(fd);
+	}
+	if (saved && rename(tmpname, filename) != 0) {
+		remove(tmpname);
+		saved = 0;
+	}
+	if (!saved)
+		LOG_WARN("Boot cache: failed to write %s\n", filename);
+
+	// Continue from the saved state, exactly as later runs will
+	if (result > 0 && saved)
+		(void)read_snapshot_state(filename);
+	sdsfree(tmpname);
+	sdsfree(filename);
+	return result > 0;
+}
@@ -0,0 +1,33 @@
+/*
+
+Boot state cache
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifndef XROAR_BOOTCACHE_H_
+#define XROAR_BOOTCACHE_H_
+
+struct machine;
+
+/* Bring a freshly reset machine to the BASIC prompt.  State is restored from
+ * a snapshot in dir saved by an earlier run with the same machine config and
+ * ROMs.  Failing that, the machine is run until it reaches the prompt and the
+ * snapshot saved for next time.
+ *
+ * Returns true if the machine is now waiting at the BASIC prompt.  Otherwise
+ * it's left as it was after reset. */
+
+_Bool bootcache_boot(struct machine *m, const char *dir);
+
+#endif
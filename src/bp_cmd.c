@@ -0,0 +1,501 @@
+/*
+
+Debugger breakpoint commands
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "delegate.h"
+#include "sds.h"
+#include "slist.h"
+#include "xalloc.h"
+
+#include "bp_cmd.h"
+#include "bp_expr.h"
+#include "breakpoint.h"
+#include "logging.h"
+#include "machine.h"
+#include "snapshot.h"
+
+#define BP_CMD_MAX_ARGS (8)
+
+enum bp_action_type {
+	BP_ACTION_STOP,
+	BP_ACTION_LOG,
+	BP_ACTION_SNAP,
+};
+
+struct bp_action {
+	enum bp_action_type type;
+	sds text;  // log format or snapshot filename
+	unsigned nargs;
+	struct bp_expr *args[BP_CMD_MAX_ARGS];
+};
+
+struct bp_user {
+	// Added to the breakpoint session, handler is bp_user_hit()
+	struct breakpoint bp;
+	struct bp_cmd *bc;
+	int id;
+	unsigned type;  // 0 for instruction breakpoints, else WP_*
+	unsigned hits;
+	sds description;
+	struct bp_expr *cond;
+	unsigned nactions;
+	struct bp_action *actions;
+};
+
+struct bp_cmd {
+	struct machine *machine;
+	struct MC6809 *cpu;
+	struct bp_session *bps;
+	struct slist *list;
+	int next_id;
+};
+
+static void bp_user_free(struct bp_user *bu);
+static void bp_user_hit(void *sptr);
+
+static const char *help_text =
+"Commands:\n"
+"  break ADDR [if COND] [do ACTIONS]          instruction breakpoint\n"
+"  watch ADDR [len N] [if COND] [do ACTIONS]  write watchpoint\n"
+"  rwatch ...                                 read watchpoint\n"
+"  awatch ...                                 read/write watchpoint\n"
+"  delete [ID]...                             delete (all) breakpoints\n"
+"  info                                       list breakpoints\n"
+"Actions, separated by ';':\n"
+"  stop                     stop emulation (default)\n"
+"  log \"FORMAT\"[, EXPR]...  print line (%d %u %x %X %o %c)\n"
+"  snap FILE                write snapshot to FILE in current directory\n"
+"Expressions: C operators on numbers ($hex, 0xhex, decimal), registers\n"
+"  (a b d x y u s pc cc dp e f w q v md), peek(ADDR), dpeek(ADDR), hits,\n"
+"  ticks (14.31818MHz, 16 per CPU cycle at normal speed).\n";
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+struct bp_cmd *bp_cmd_new(struct machine *m, struct bp_session *bps) {
+	struct bp_cmd *bc = xmalloc(sizeof(*bc));
+	*bc = (struct bp_cmd){0};
+	bc->machine = m;
+	bc->cpu = m->get_component(m, "CPU0");
+	bc->bps = bps;
+	bc->next_id = 1;
+	return bc;
+}
+
+static void bp_user_remove(struct bp_cmd *bc, struct bp_user *bu) {
+	if (bu->type == 0) {
+		bp_remove(bc->bps, &bu->bp);
+	} else {
+		bp_remove_wp(bc->bps, &bu->bp);
+	}
+	bc->list = slist_remove(bc->list, bu);
+	bp_user_free(bu);
+}
+
+void bp_cmd_free(struct bp_cmd *bc) {
+	if (!bc)
+		return;
+	while (bc->list) {
+		bp_user_remove(bc, bc->list->data);
+	}
+	free(bc);
+}
+
+static void bp_user_free(struct bp_user *bu) {
+	for (unsigned i = 0; i < bu->nactions; i++) {
+		struct bp_action *ba = &bu->actions[i];
+		sdsfree(ba->text);
+		for (unsigned j = 0; j < ba->nargs; j++) {
+			bp_expr_free(ba->args[j]);
+		}
+	}
+	free(bu->actions);
+	bp_expr_free(bu->cond);
+	sdsfree(bu->description);
+	free(bu);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Log format conversions are '%', each flag of "-0 +" at most once, a
+// width of up to LOG_WIDTH_DIGITS digits, then one of "diuxXoc".  The
+// format can come from a remote debugger, so anything else is rejected
+// rather than passed to snprintf().
+
+#define LOG_WIDTH_DIGITS (3)
+
+// Returns the length of the conversion at fmt (which points to '%'), or 0 if
+// it's not supported.  A supported conversion is never more than 9 bytes.
+
+static size_t conversion_length(const char *fmt) {
+	static const char *flag_chars = "-0 +";
+	const char *p = fmt + 1;
+	unsigned flags = 0;
+	const char *f;
+	while (*p && (f = strchr(flag_chars, *p))) {
+		unsigned bit = 1 << (f - flag_chars);
+		if (flags & bit)
+			return 0;
+		flags |= bit;
+		p++;
+	}
+	for (int i = 0; isdigit((unsigned char)*p); i++, p++) {
+		if (i >= LOG_WIDTH_DIGITS)
+			return 0;
+	}
+	if (!*p || !strchr("diuxXoc", *p))
+		return 0;
+	return (size_t)(p - fmt) + 1;
+}
+
+// Format a log line.  The format was checked by count_conversions() when the
+// command was parsed.
+
+static sds format_log(sds out, const char *fmt, const int32_t *vals, unsigned nvals) {
+	unsigned v = 0;
+	while (*fmt) {
+		if (*fmt != '%') {
+			const char *next = strchr(fmt, '%');
+			size_t len = next ? (size_t)(next - fmt) : strlen(fmt);
+			out = sdscatlen(out, fmt, len);
+			fmt += len;
+			continue;
+		}
+		if (fmt[1] == '%') {
+			out = sdscatlen(out, "%", 1);
+			fmt += 2;
+			continue;
+		}
+		char spec[16];
+		size_t len = conversion_length(fmt);
+		if (len == 0 || len >= sizeof(spec))
+			break;
+		memcpy(spec, fmt, len);
+		spec[len] = 0;
+		fmt += len;
+		int32_t val = (v < nvals) ? vals[v++] : 0;
+		char conv = spec[len-1];
+		if (conv == 'd' || conv == 'i' || conv == 'c') {
+			out = sdscatprintf(out, spec, (int)val);
+		} else {
+			out = sdscatprintf(out, spec, (unsigned)(uint32_t)val);
+		}
+	}
+	return out;
+}
+
+static int count_conversions(const char *fmt) {
+	int n = 0;
+	while ((fmt = strchr(fmt, '%'))) {
+		if (fmt[1] == '%') {
+			fmt += 2;
+			continue;
+		}
+		size_t len = conversion_length(fmt);
+		if (len == 0)
+			return -1;
+		fmt += len;
+		n++;
+	}
+	return n;
+}
+
+static void bp_user_hit(void *sptr) {
+	struct bp_user *bu = sptr;
+	struct bp_cmd *bc = bu->bc;
+	bu->hits++;
+	struct bp_expr_env env = {
+		.machine = bc->machine, .cpu = bc->cpu, .hits = bu->hits
+	};
+	if (bu->cond && !bp_expr_eval(bu->cond, &env))
+		return;
+	for (unsigned i = 0; i < bu->nactions; i++) {
+		struct bp_action *ba = &bu->actions[i];
+		switch (ba->type) {
+		case BP_ACTION_STOP:
+			LOG_DEBUG(1, "%s %d hit\n", bu->type ? "Watchpoint" : "Breakpoint", bu->id);
+			DELEGATE_SAFE_CALL0(bc->bps->trap_handler);
+			break;
+		case BP_ACTION_LOG: {
+			int32_t vals[BP_CMD_MAX_ARGS];
+			for (unsigned j = 0; j < ba->nargs; j++) {
+				vals[j] = bp_expr_eval(ba->args[j], &env);
+			}
+			sds line = format_log(sdsempty(), ba->text, vals, ba->nargs);
+			LOG_PRINT("%s\n", line);
+			sdsfree(line);
+			} break;
+		case BP_ACTION_SNAP:
+			write_snapshot(ba->text);
+			break;
+		}
+	}
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Command parsing
+
+static void skip_space(const char **sp) {
+	while (isspace((unsigned char)**sp))
+		(*sp)++;
+}
+
+// If the next word matches, skip it and return true.
+
+static _Bool accept_word(const char **sp, const char *word) {
+	skip_space(sp);
+	size_t len = strlen(word);
+	if (strncmp(*sp, word, len) != 0)
+		return 0;
+	char next = (*sp)[len];
+	if (isalnum((unsigned char)next) || next == '_')
+		return 0;
+	*sp += len;
+	return 1;
+}
+
+static struct bp_expr *parse_expr(const char **sp, const char *what, sds *out) {
+	const char *err = NULL;
+	struct bp_expr *e = bp_expr_compile(sp, &err);
+	if (!e) {
+		if (**sp) {
+			*out = sdscatprintf(*out, "%s: %s at '%.20s'\n", what, err, *sp);
+		} else {
+			*out = sdscatprintf(*out, "%s: %s at end of line\n", what, err);
+		}
+	}
+	return e;
+}
+
+static int parse_action(const char **sp, struct bp_action *ba, sds *out) {
+	*ba = (struct bp_action){0};
+	if (accept_word(sp, "stop")) {
+		ba->type = BP_ACTION_STOP;
+		return 0;
+	}
+	if (accept_word(sp, "snap")) {
+		ba->type = BP_ACTION_SNAP;
+		skip_space(sp);
+		size_t len = strcspn(*sp, "; \t");
+		if (len == 0) {
+			*out = sdscat(*out, "snap: filename expected\n");
+			return -1;
+		}
+		// Commands may arrive from a remote debugger, so only allow a
+		// plain filename, written to the current directory.
+		if (strcspn(*sp, "/\\:") < len || (len == 2 && 0 == strncmp(*sp, "..", 2))) {
+			*out = sdscat(*out, "snap: filename must not include a directory\n");
+			return -1;
+		}
+		ba->text = sdsnewlen(*sp, len);
+		*sp += len;
+		return 0;
+	}
+	if (accept_word(sp, "log")) {
+		ba->type = BP_ACTION_LOG;
+		skip_space(sp);
+		const char *end;
+		if (**sp != '"' || !(end = strchr(*sp + 1, '"'))) {
+			*out = sdscat(*out, "log: quoted format expected\n");
+			return -1;
+		}
+		ba->text = sdsnewlen(*sp + 1, end - (*sp + 1));
+		*sp = end + 1;
+		int nconv = count_conversions(ba->text);
+		if (nconv < 0) {
+			*out = sdscat(*out, "log: unsupported conversion in format\n");
+			return -1;
+		}
+		for (;;) {
+			skip_space(sp);
+			if (**sp != ',')
+				break;
+			(*sp)++;
+			if (ba->nargs >= BP_CMD_MAX_ARGS) {
+				*out = sdscat(*out, "log: too many arguments\n");
+				return -1;
+			}
+			if (!(ba->args[ba->nargs] = parse_expr(sp, "log", out)))
+				return -1;
+			ba->nargs++;
+		}
+		if ((unsigned)nconv != ba->nargs) {
+			*out = sdscatprintf(*out, "log: format needs %d arguments, %u given\n",
+					    nconv, ba->nargs);
+			return -1;
+		}
+		return 0;
+	}
+	*out = sdscat(*out, "unknown action\n");
+	return -1;
+}
+
+static int cmd_add(struct bp_cmd *bc, unsigned type, const char *s,
+		   const char *line, sds *out) {
+	struct bp_user *bu = xmalloc(sizeof(*bu));
+	*bu = (struct bp_user){0};
+	bu->bc = bc;
+	bu->type = type;
+
+	// Address is an expression evaluated once, now
+	struct bp_expr *e = parse_expr(&s, "address", out);
+	if (!e)
+		goto error;
+	struct bp_expr_env env = { .machine = bc->machine, .cpu = bc->cpu };
+	unsigned addr = bp_expr_eval(e, &env) & 0xffff;
+	bp_expr_free(e);
+	int32_t len = 1;
+	if (type != 0 && accept_word(&s, "len")) {
+		if (!(e = parse_expr(&s, "len", out)))
+			goto error;
+		len = bp_expr_eval(e, &env);
+		bp_expr_free(e);
+		if (len < 1 || addr + (uint32_t)len > 0x10000) {
+			*out = sdscatprintf(*out, "len: %ld out of range at $%04x\n", (long)len, addr);
+			goto error;
+		}
+	}
+
+	if (accept_word(&s, "if")) {
+		if (!(bu->cond = parse_expr(&s, "condition", out)))
+			goto error;
+	}
+
+	if (accept_word(&s, "do")) {
+		for (;;) {
+			bu->actions = xrealloc(bu->actions, (bu->nactions + 1) * sizeof(*bu->actions));
+			// Count even on failure, so that partial action is freed
+			int err = parse_action(&s, &bu->actions[bu->nactions++], out);
+			if (err < 0)
+				goto error;
+			skip_space(&s);
+			if (*s != ';')
+				break;
+			s++;
+		}
+	} else {
+		bu->actions = xmalloc(sizeof(*bu->actions));
+		bu->actions[0] = (struct bp_action){ .type = BP_ACTION_STOP };
+		bu->nactions = 1;
+	}
+
+	skip_space(&s);
+	if (*s) {
+		*out = sdscatprintf(*out, "unexpected '%.20s'\n", s);
+		goto error;
+	}
+
+	bu->id = bc->next_id++;
+	bu->description = sdstrim(sdsnew(line), " \t\r\n");
+	bu->bp.address = addr;
+	bu->bp.address_end = addr + len - 1;
+	bu->bp.handler = DELEGATE_AS0(void, bp_user_hit, bu);
+	if (type == 0) {
+		bp_add(bc->bps, &bu->bp, bu);
+	} else {
+		bp_add_wp(bc->bps, type, &bu->bp, bu);
+	}
+	bc->list = slist_append(bc->list, bu);
+	*out = sdscatprintf(*out, "%s %d at $%04x\n",
+			    type ? "Watchpoint" : "Breakpoint", bu->id, addr);
+	return 0;
+
+error:
+	bp_user_free(bu);
+	return -1;
+}
+
+static int cmd_delete(struct bp_cmd *bc, const char *s, sds *out) {
+	skip_space(&s);
+	if (!*s) {
+		while (bc->list) {
+			bp_user_remove(bc, bc->list->data);
+		}
+		return 0;
+	}
+	while (*s) {
+		char *end;
+		long id = strtol(s, &end, 10);
+		if (end == s) {
+			*out = sdscatprintf(*out, "delete: bad breakpoint number '%.20s'\n", s);
+			return -1;
+		}
+		s = end;
+		skip_space(&s);
+		struct slist *iter;
+		for (iter = bc->list; iter; iter = iter->next) {
+			struct bp_user *bu = iter->data;
+			if (bu->id == id) {
+				bp_user_remove(bc, bu);
+				break;
+			}
+		}
+		if (!iter) {
+			*out = sdscatprintf(*out, "delete: no breakpoint number %ld\n", id);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void cmd_info(struct bp_cmd *bc, sds *out) {
+	if (!bc->list) {
+		*out = sdscat(*out, "No breakpoints\n");
+		return;
+	}
+	for (struct slist *iter = bc->list; iter; iter = iter->next) {
+		struct bp_user *bu = iter->data;
+		*out = sdscatprintf(*out, "%-3d %s  [hits %u]\n", bu->id,
+				    bu->description, bu->hits);
+	}
+}
+
+int bp_cmd_exec(struct bp_cmd *bc, const char *line, sds *out) {
+	const char *s = line;
+	skip_space(&s);
+	if (!*s)
+		return 0;
+	if (accept_word(&s, "break"))
+		return cmd_add(bc, 0, s, line, out);
+	if (accept_word(&s, "watch"))
+		return cmd_add(bc, WP_WRITE, s, line, out);
+	if (accept_word(&s, "rwatch"))
+		return cmd_add(bc, WP_READ, s, line, out);
+	if (accept_word(&s, "awatch"))
+		return cmd_add(bc, WP_BOTH, s, line, out);
+	if (accept_word(&s, "delete"))
+		return cmd_delete(bc, s, out);
+	if (accept_word(&s, "info")) {
+		cmd_info(bc, out);
+		return 0;
+	}
+	if (accept_word(&s, "help")) {
+		*out = sdscat(*out, help_text);
+		return 0;
+	}
+	*out = sdscatprintf(*out, "Unknown command '%.20s' (try 'help')\n", s);
+	return -1;
+}
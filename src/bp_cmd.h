@@ -0,0 +1,52 @@
+/*
+
+Debugger breakpoint commands
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifndef XROAR_BP_CMD_H_
+#define XROAR_BP_CMD_H_
+
+#include "sds.h"
+
+/* User breakpoints, watchpoints and tracepoints with conditions and actions
+ * evaluated in-process.  Commands are accepted from the command line (-bp)
+ * and the GDB "monitor" command:
+ *
+ *     break ADDR [if COND] [do ACTION[; ACTION]...]
+ *     watch|rwatch|awatch ADDR [len N] [if COND] [do ACTION[; ACTION]...]
+ *     delete [ID]...
+ *     info
+ *
+ * ACTION is one of:
+ *
+ *     stop                     stop, as for any other breakpoint (default)
+ *     log "FORMAT"[, EXPR]...  print line, printf-style (%d %u %x %X %o %c)
+ *     snap FILE                write a snapshot
+ *
+ * See bp_expr.h for the expression syntax of ADDR, COND and log arguments. */
+
+struct machine;
+struct bp_session;
+struct bp_cmd;
+
+struct bp_cmd *bp_cmd_new(struct machine *m, struct bp_session *bps);
+void bp_cmd_free(struct bp_cmd *);
+
+// Execute a command.  Any output, including error messages, is appended to
+// *out.  Returns non-zero on error.
+
+int bp_cmd_exec(struct bp_cmd *, const char *line, sds *out);
+
+#endif
@@ -0,0 +1,421 @@
+/*
+
+Debugger expressions
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xalloc.h"
+
+#include "bp_expr.h"
+#include "events.h"
+#include "hd6309.h"
+#include "machine.h"
+#include "mc6809.h"
+
+// Limits evaluation stack depth, checked at compile time.
+#define BP_EXPR_MAX_STACK (32)
+
+enum bp_expr_op {
+	OP_END = 0,
+	// Push values
+	OP_CONST,  // followed by value
+	OP_REG,  // followed by register
+	OP_HITS,
+	OP_TICKS,
+	// Unary
+	OP_PEEK,
+	OP_DPEEK,
+	OP_NEG,
+	OP_NOT,
+	OP_COM,
+	OP_BOOL,
+	// Binary
+	OP_MUL, OP_DIV, OP_MOD,
+	OP_ADD, OP_SUB,
+	OP_SHL, OP_SHR,
+	OP_LT, OP_LE, OP_GT, OP_GE,
+	OP_EQ, OP_NE,
+	OP_AND, OP_XOR, OP_OR,
+	// Short-circuit logic.  If top of stack is zero (JZ) or non-zero
+	// (JNZ), jump to target leaving it there, else pop it.
+	OP_JZ,  // followed by target
+	OP_JNZ,  // followed by target
+};
+
+enum bp_expr_reg {
+	REG_A, REG_B, REG_D, REG_X, REG_Y, REG_U, REG_S, REG_PC, REG_CC, REG_DP,
+	REG_E, REG_F, REG_W, REG_Q, REG_V, REG_MD,
+};
+
+static const struct {
+	const char *name;
+	enum bp_expr_reg reg;
+} reg_names[] = {
+	{ "a", REG_A }, { "b", REG_B }, { "d", REG_D },
+	{ "x", REG_X }, { "y", REG_Y }, { "u", REG_U }, { "s", REG_S },
+	{ "pc", REG_PC }, { "cc", REG_CC }, { "dp", REG_DP },
+	{ "e", REG_E }, { "f", REG_F }, { "w", REG_W }, { "q", REG_Q },
+	{ "v", REG_V }, { "md", REG_MD },
+};
+
+// Binary operators in order of precedence.  Two-character operators are
+// listed first so they are matched in preference.
+
+static const struct {
+	const char *text;
+	int prec;
+	enum bp_expr_op op;
+} binops[] = {
+	{ "||", 1, OP_JNZ }, { "&&", 2, OP_JZ },
+	{ "==", 6, OP_EQ }, { "!=", 6, OP_NE },
+	{ "<=", 7, OP_LE }, { ">=", 7, OP_GE },
+	{ "<<", 8, OP_SHL }, { ">>", 8, OP_SHR },
+	{ "|", 3, OP_OR }, { "^", 4, OP_XOR }, { "&", 5, OP_AND },
+	{ "<", 7, OP_LT }, { ">", 7, OP_GT },
+	{ "+", 9, OP_ADD }, { "-", 9, OP_SUB },
+	{ "*", 10, OP_MUL }, { "/", 10, OP_DIV }, { "%", 10, OP_MOD },
+};
+
+struct bp_expr {
+	unsigned ncode;
+	int32_t code[];
+};
+
+struct compiler {
+	const char *s;
+	const char *error;
+	int32_t *code;
+	unsigned ncode;
+	unsigned nalloc;
+	int depth;
+	int max_depth;
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Stack effect of each opcode
+
+static int op_stack_delta(enum bp_expr_op op) {
+	switch (op) {
+	case OP_CONST: case OP_REG: case OP_HITS: case OP_TICKS:
+		return 1;
+	case OP_END: case OP_PEEK: case OP_DPEEK: case OP_NEG: case OP_NOT:
+	case OP_COM: case OP_BOOL:
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+static unsigned emit(struct compiler *c, enum bp_expr_op op) {
+	if (c->ncode + 2 > c->nalloc) {
+		c->nalloc = c->nalloc ? c->nalloc * 2 : 32;
+		c->code = xrealloc(c->code, c->nalloc * sizeof(*c->code));
+	}
+	c->depth += op_stack_delta(op);
+	if (c->depth > c->max_depth)
+		c->max_depth = c->depth;
+	c->code[c->ncode++] = op;
+	return c->ncode - 1;
+}
+
+static void emit_arg(struct compiler *c, enum bp_expr_op op, int32_t arg) {
+	emit(c, op);
+	c->code[c->ncode++] = arg;
+}
+
+static void skip_space(struct compiler *c) {
+	while (isspace((unsigned char)*c->s))
+		c->s++;
+}
+
+static int error(struct compiler *c, const char *msg) {
+	if (!c->error)
+		c->error = msg;
+	return -1;
+}
+
+static int parse_expr(struct compiler *c, int min_prec);
+
+static int parse_bracketed(struct compiler *c) {
+	skip_space(c);
+	if (*c->s != '(')
+		return error(c, "expected '('");
+	c->s++;
+	if (parse_expr(c, 1) < 0)
+		return -1;
+	skip_space(c);
+	if (*c->s != ')')
+		return error(c, "expected ')'");
+	c->s++;
+	return 0;
+}
+
+static int parse_unary(struct compiler *c) {
+	skip_space(c);
+	char ch = *c->s;
+
+	if (ch == '-' || ch == '!' || ch == '~') {
+		c->s++;
+		if (parse_unary(c) < 0)
+			return -1;
+		emit(c, (ch == '-') ? OP_NEG : ((ch == '!') ? OP_NOT : OP_COM));
+		return 0;
+	}
+
+	if (ch == '(')
+		return parse_bracketed(c);
+
+	if (ch == '$' || isdigit((unsigned char)ch)) {
+		int base = 10;
+		const char *start = c->s;
+		if (ch == '$') {
+			base = 16;
+			start++;
+		} else if (ch == '0' && (c->s[1] == 'x' || c->s[1] == 'X')) {
+			base = 16;
+			start += 2;
+		}
+		char *end;
+		unsigned long v = strtoul(start, &end, base);
+		if (end == start)
+			return error(c, "bad number");
+		c->s = end;
+		emit_arg(c, OP_CONST, (int32_t)v);
+		return 0;
+	}
+
+	if (isalpha((unsigned char)ch) || ch == '_') {
+		const char *start = c->s;
+		while (isalnum((unsigned char)*c->s) || *c->s == '_')
+			c->s++;
+		size_t len = c->s - start;
+		for (unsigned i = 0; i < sizeof(reg_names) / sizeof(reg_names[0]); i++) {
+			if (strlen(reg_names[i].name) == len && 0 == strncmp(start, reg_names[i].name, len)) {
+				emit_arg(c, OP_REG, reg_names[i].reg);
+				return 0;
+			}
+		}
+		if (len == 4 && 0 == strncmp(start, "hits", 4)) {
+			emit(c, OP_HITS);
+			return 0;
+		}
+		if (len == 5 && 0 == strncmp(start, "ticks", 5)) {
+			emit(c, OP_TICKS);
+			return 0;
+		}
+		if ((len == 4 && 0 == strncmp(start, "peek", 4)) ||
+		    (len == 5 && 0 == strncmp(start, "dpeek", 5))) {
+			if (parse_bracketed(c) < 0)
+				return -1;
+			emit(c, (len == 4) ? OP_PEEK : OP_DPEEK);
+			return 0;
+		}
+		c->s = start;
+		return error(c, "unknown identifier");
+	}
+
+	return error(c, "expected value");
+}
+
+// Precedence climbing: parse operand, then any binary operators binding at
+// least as tightly as min_prec.
+
+static int parse_expr(struct compiler *c, int min_prec) {
+	if (parse_unary(c) < 0)
+		return -1;
+	for (;;) {
+		skip_space(c);
+		int i;
+		int nops = sizeof(binops) / sizeof(binops[0]);
+		for (i = 0; i < nops; i++) {
+			if (0 == strncmp(c->s, binops[i].text, strlen(binops[i].text)))
+				break;
+		}
+		if (i == nops || binops[i].prec < min_prec)
+			return 0;
+		c->s += strlen(binops[i].text);
+		enum bp_expr_op op = binops[i].op;
+		if (op == OP_JZ || op == OP_JNZ) {
+			emit_arg(c, op, 0);
+			unsigned fixup = c->ncode - 1;
+			if (parse_expr(c, binops[i].prec + 1) < 0)
+				return -1;
+			c->code[fixup] = c->ncode;
+			emit(c, OP_BOOL);
+		} else {
+			if (parse_expr(c, binops[i].prec + 1) < 0)
+				return -1;
+			emit(c, op);
+		}
+	}
+}
+
+struct bp_expr *bp_expr_compile(const char **sp, const char **errp) {
+	struct compiler c = { .s = *sp };
+	if (parse_expr(&c, 1) < 0 || c.max_depth > BP_EXPR_MAX_STACK) {
+		if (errp)
+			*errp = c.error ? c.error : "expression too complex";
+		*sp = c.s;
+		free(c.code);
+		return NULL;
+	}
+	emit(&c, OP_END);
+	*sp = c.s;
+	struct bp_expr *e = xmalloc(sizeof(*e) + c.ncode * sizeof(e->code[0]));
+	e->ncode = c.ncode;
+	memcpy(e->code, c.code, c.ncode * sizeof(e->code[0]));
+	free(c.code);
+	return e;
+}
+
+void bp_expr_free(struct bp_expr *e) {
+	free(e);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static int32_t read_reg(struct MC6809 *cpu, enum bp_expr_reg reg) {
+	switch (reg) {
+	case REG_A: return MC6809_REG_A(cpu);
+	case REG_B: return MC6809_REG_B(cpu);
+	case REG_D: return cpu->reg_d;
+	case REG_X: return cpu->reg_x;
+	case REG_Y: return cpu->reg_y;
+	case REG_U: return cpu->reg_u;
+	case REG_S: return cpu->reg_s;
+	case REG_PC: return cpu->reg_pc;
+	case REG_CC: return cpu->reg_cc;
+	case REG_DP: return cpu->reg_dp;
+	default: break;
+	}
+	if (cpu->variant != MC6809_VARIANT_HD6309)
+		return 0;
+	struct HD6309 *hcpu = (struct HD6309 *)cpu;
+	switch (reg) {
+	case REG_E: return HD6309_REG_E(hcpu);
+	case REG_F: return HD6309_REG_F(hcpu);
+	case REG_W: return hcpu->reg_w;
+	case REG_Q: return (int32_t)(((uint32_t)cpu->reg_d << 16) | hcpu->reg_w);
+	case REG_V: return hcpu->reg_v;
+	case REG_MD: return hcpu->reg_md;
+	default: break;
+	}
+	return 0;
+}
+
+// Reading memory through the machine goes via the CPU data bus, so preserve
+// that in case this is called in the middle of a bus cycle.
+
+static uint8_t read_mem(struct bp_expr_env *env, unsigned A) {
+	uint8_t D = env->cpu->D;
+	uint8_t v = env->machine->read_byte(env->machine, A & 0xffff);
+	env->cpu->D = D;
+	return v;
+}
+
+int32_t bp_expr_eval(struct bp_expr const *e, struct bp_expr_env *env) {
+	int32_t stack[BP_EXPR_MAX_STACK + 1];
+	int sp = 0;
+	int32_t const *code = e->code;
+	unsigned pc = 0;
+	for (;;) {
+		int32_t a, b;
+		switch ((enum bp_expr_op)code[pc++]) {
+		case OP_END:
+			return sp ? stack[sp-1] : 0;
+		case OP_CONST:
+			stack[sp++] = code[pc++];
+			break;
+		case OP_REG:
+			stack[sp++] = read_reg(env->cpu, code[pc++]);
+			break;
+		case OP_HITS:
+			stack[sp++] = env->hits;
+			break;
+		case OP_TICKS:
+			stack[sp++] = (int32_t)xroar_context->current_tick;
+			break;
+		case OP_PEEK:
+			stack[sp-1] = read_mem(env, stack[sp-1]);
+			break;
+		case OP_DPEEK:
+			a = stack[sp-1];
+			stack[sp-1] = (read_mem(env, a) << 8) | read_mem(env, a + 1);
+			break;
+		case OP_NEG: stack[sp-1] = -stack[sp-1]; break;
+		case OP_NOT: stack[sp-1] = !stack[sp-1]; break;
+		case OP_COM: stack[sp-1] = ~stack[sp-1]; break;
+		case OP_BOOL: stack[sp-1] = !!stack[sp-1]; break;
+		case OP_JZ:
+			if (stack[sp-1] == 0)
+				pc = code[pc];
+			else {
+				sp--;
+				pc++;
+			}
+			break;
+		case OP_JNZ:
+			if (stack[sp-1] != 0)
+				pc = code[pc];
+			else {
+				sp--;
+				pc++;
+			}
+			break;
+		default:
+			b = stack[--sp];
+			a = stack[sp-1];
+			switch ((enum bp_expr_op)code[pc-1]) {
+			case OP_MUL: a = (int32_t)((uint32_t)a * (uint32_t)b); break;
+			case OP_DIV:
+				// Division by zero yields zero.  Negate -1 case
+				// separately, as INT32_MIN / -1 overflows.
+				if (b == 0)
+					a = 0;
+				else if (b == -1)
+					a = (int32_t)-(uint32_t)a;
+				else
+					a /= b;
+				break;
+			case OP_MOD: a = (b == 0 || b == -1) ? 0 : a % b; break;
+			case OP_ADD: a = (int32_t)((uint32_t)a + (uint32_t)b); break;
+			case OP_SUB: a = (int32_t)((uint32_t)a - (uint32_t)b); break;
+			case OP_SHL: a = (int32_t)((uint32_t)a << (b & 31)); break;
+			case OP_SHR: a = (int32_t)((uint32_t)a >> (b & 31)); break;
+			case OP_LT: a = (a < b); break;
+			case OP_LE: a = (a <= b); break;
+			case OP_GT: a = (a > b); break;
+			case OP_GE: a = (a >= b); break;
+			case OP_EQ: a = (a == b); break;
+			case OP_NE: a = (a != b); break;
+			case OP_AND: a &= b; break;
+			case OP_XOR: a ^= b; break;
+			case OP_OR: a |= b; break;
+			default: break;
+			}
+			stack[sp-1] = a;
+			break;
+		}
+	}
+}
@@ -0,0 +1,56 @@
+/*
+
+Debugger expressions
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifndef XROAR_BP_EXPR_H_
+#define XROAR_BP_EXPR_H_
+
+#include <stdint.h>
+
+/* Expressions are C-like, operating on signed 32-bit integers:
+ *
+ *     Numbers:    123, $7f, 0x7f
+ *     Registers:  a b d x y u s pc cc dp (HD6309 also: e f w q v md)
+ *     Memory:     peek(ADDR) reads a byte, dpeek(ADDR) a big-endian word
+ *     Counters:   hits     times this breakpoint has matched
+ *                 ticks    emulated time (14.31818MHz ticks, 32-bit)
+ *     Operators:  ! ~ - (unary) * / % + - << >> < <= > >= == != & ^ | && ||
+ *
+ * There is no CPU cycle counter.  A cycle is 16 ticks at normal speed but
+ * fewer in the SAM's fast modes, so ticks don't convert reliably to cycles.
+ *
+ * Expressions are compiled to a small stack bytecode, cheap enough to evaluate every
+ * time a breakpoint is hit. */
+
+struct machine;
+struct MC6809;
+struct bp_expr;
+
+struct bp_expr_env {
+	struct machine *machine;
+	struct MC6809 *cpu;
+	unsigned hits;
+};
+
+// Compile the expression at *sp, leaving *sp pointing after it.  Returns NULL
+// on error, and sets *errp to a description if errp is not NULL.
+
+struct bp_expr *bp_expr_compile(const char **sp, const char **errp);
+void bp_expr_free(struct bp_expr *);
+
+int32_t bp_expr_eval(struct bp_expr const *, struct bp_expr_env *env);
+
+#endif
@@ -31,6 +31,12 @@ See COPYING.GPL for redistribution conditions.
 #include "machine.h"
 #include "mc6809.h"
 
+// Each list of breakpoints has a bitmap of all the addresses it covers.
+// Hooks test this before walking the list, so addresses nothing is interested
+// in cost one lookup however many breakpoints are set.
+
+#define BP_MAP_SIZE (0x10000 / 8)
+
 struct bp_session_private {
 	struct bp_session bps;
 	struct slist *instruction_list;
@@ -39,16 +45,18 @@ struct bp_session_private {
 	struct slist *iter_next;
 	struct machine *machine;
 	struct MC6809 *cpu;
+	uint8_t instruction_map[BP_MAP_SIZE];
+	uint8_t wp_read_map[BP_MAP_SIZE];
+	uint8_t wp_write_map[BP_MAP_SIZE];
 };
 
-static struct slist *bp_instruction_list = NULL;
-
-static struct slist *wp_read_list = NULL;
-static struct slist *wp_write_list = NULL;
-
-static struct slist *iter_next = NULL;
-
 static void bp_instruction_hook(void *);
+static void update_instruction_hook(struct bp_session_private *bpsp);
+static void update_map(uint8_t *map, struct slist *bp_list);
+
+static inline _Bool map_test(uint8_t const *map, unsigned address) {
+	return map[(address >> 3) & (BP_MAP_SIZE - 1)] & (1 << (address & 7));
+}
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
@@ -62,40 +70,93 @@ struct bp_session *bp_session_new(struct machine *m) {
 }
 
 void bp_session_free(struct bp_session *bps) {
-	free(bps);
+	struct bp_session_private *bpsp = (struct bp_session_private *)bps;
+	if (!bpsp)
+		return;
+	slist_free_full(bpsp->instruction_list, free);
+	slist_free_full(bpsp->wp_read_list, free);
+	slist_free_full(bpsp->wp_write_list, free);
+	free(bpsp);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-static _Bool is_in_list(struct slist *bp_list, struct breakpoint *bp) {
+// Breakpoints added with bp_add() are copied, as the same (usually static)
+// breakpoint may be added to several sessions at once, each with its own
+// handler context.  The copy records which breakpoint it was made from.
+
+static struct breakpoint *find_ref(struct slist *bp_list, struct breakpoint const *ref) {
 	for (struct slist *iter = bp_list; iter; iter = iter->next) {
-		if (bp == iter->data)
-			return 1;
+		struct breakpoint *bp = iter->data;
+		if (bp->ref == ref)
+			return bp;
 	}
-	return 0;
+	return NULL;
 }
 
-void bp_add(struct bp_session *bps, struct breakpoint *bp) {
+static struct breakpoint *add_copy(struct slist **bp_list, struct breakpoint const *bp, void *sptr) {
+	if (find_ref(*bp_list, bp))
+		return NULL;
+	struct breakpoint *new = xmalloc(sizeof(*new));
+	*new = *bp;
+	new->handler.sptr = sptr;
+	new->ref = bp;
+	*bp_list = slist_prepend(*bp_list, new);
+	return new;
+}
+
+static void remove_copy(struct bp_session_private *bpsp, struct slist **bp_list,
+			struct breakpoint const *bp) {
+	struct breakpoint *old = find_ref(*bp_list, bp);
+	if (!old)
+		return;
+	if (bpsp->iter_next && bpsp->iter_next->data == old)
+		bpsp->iter_next = bpsp->iter_next->next;
+	*bp_list = slist_remove(*bp_list, old);
+	free(old);
+}
+
+void bp_add(struct bp_session *bps, struct breakpoint const *bp, void *sptr) {
 	if (!bps)
 		return;
 	struct bp_session_private *bpsp = (struct bp_session_private *)bps;
-	if (is_in_list(bp_instruction_list, bp))
+	struct breakpoint *new = add_copy(&bpsp->instruction_list, bp, sptr);
+	if (!new)
 		return;
-	bp->address_end = bp->address;
-	bp_instruction_list = slist_prepend(bp_instruction_list, bp);
-	bpsp->cpu->instruction_hook = DELEGATE_AS0(void, bp_instruction_hook, bps);
+	new->address_end = new->address;
+	update_map(bpsp->instruction_map, bpsp->instruction_list);
+	update_instruction_hook(bpsp);
 }
 
-void bp_remove(struct bp_session *bps, struct breakpoint *bp) {
+void bp_remove(struct bp_session *bps, struct breakpoint const *bp) {
 	if (!bps)
 		return;
 	struct bp_session_private *bpsp = (struct bp_session_private *)bps;
-	if (iter_next && iter_next->data == bp)
-		iter_next = iter_next->next;
-	bp_instruction_list = slist_remove(bp_instruction_list, bp);
-	if (!bp_instruction_list) {
-		bpsp->cpu->instruction_hook.func = NULL;
-	}
+	remove_copy(bpsp, &bpsp->instruction_list, bp);
+	update_map(bpsp->instruction_map, bpsp->instruction_list);
+	update_instruction_hook(bpsp);
+}
+
+void bp_add_wp(struct bp_session *bps, unsigned type, struct breakpoint const *bp, void *sptr) {
+	if (!bps)
+		return;
+	struct bp_session_private *bpsp = (struct bp_session_private *)bps;
+	if (type & WP_WRITE)
+		add_copy(&bpsp->wp_write_list, bp, sptr);
+	if (type & WP_READ)
+		add_copy(&bpsp->wp_read_list, bp, sptr);
+	update_map(bpsp->wp_write_map, bpsp->wp_write_list);
+	update_map(bpsp->wp_read_map, bpsp->wp_read_list);
+}
+
+void bp_remove_wp(struct bp_session *bps, struct breakpoint const *bp) {
+	if (!bps)
+		return;
+	struct bp_session_private *bpsp = (struct bp_session_private *)bps;
+	remove_copy(bpsp, &bpsp->wp_write_list, bp);
+	remove_copy(bpsp, &bpsp->wp_read_list, bp);
+	update_map(bpsp->wp_write_map, bpsp->wp_write_list);
+	update_map(bpsp->wp_read_map, bpsp->wp_read_list);
 }
 
 static struct breakpoint *trap_find(struct bp_session_private *bpsp,
@@ -123,6 +184,7 @@ static void trap_add(struct bp_session_private *bpsp,
 	new->address = addr;
 	new->address_end = addr_end;
 	new->handler = bpsp->bps.trap_handler;
+	new->ref = NULL;
 	*bp_list = slist_prepend(*bp_list, new);
 }
 
@@ -131,8 +193,8 @@ static void trap_remove(struct bp_session_private *bpsp,
 			unsigned cond_mask, unsigned cond) {
 	struct breakpoint *bp = trap_find(bpsp, *bp_list, addr, addr_end, cond_mask, cond);
 	if (bp) {
-		if (iter_next && iter_next->data == bp)
-			iter_next = iter_next->next;
+		if (bpsp->iter_next && bpsp->iter_next->data == bp)
+			bpsp->iter_next = bpsp->iter_next->next;
 		*bp_list = slist_remove(*bp_list, bp);
 		free(bp);
 	}
@@ -140,18 +202,16 @@ static void trap_remove(struct bp_session_private *bpsp,
 
 void bp_hbreak_add(struct bp_session *bps, unsigned addr, unsigned cond_mask, unsigned cond) {
 	struct bp_session_private *bpsp = (struct bp_session_private *)bps;
-	trap_add(bpsp, &bp_instruction_list, addr, addr, cond_mask, cond);
-	if (bp_instruction_list) {
-		bpsp->cpu->instruction_hook = DELEGATE_AS0(void, bp_instruction_hook, bps);
-	}
+	trap_add(bpsp, &bpsp->instruction_list, addr, addr, cond_mask, cond);
+	update_map(bpsp->instruction_map, bpsp->instruction_list);
+	update_instruction_hook(bpsp);
 }
 
 void bp_hbreak_remove(struct bp_session *bps, unsigned addr, unsigned cond_mask, unsigned cond) {
 	struct bp_session_private *bpsp = (struct bp_session_private *)bps;
-	trap_remove(bpsp, &bp_instruction_list, addr, addr, cond_mask, cond);
-	if (!bp_instruction_list) {
-		bpsp->cpu->instruction_hook.func = NULL;
-	}
+	trap_remove(bpsp, &bpsp->instruction_list, addr, addr, cond_mask, cond);
+	update_map(bpsp->instruction_map, bpsp->instruction_list);
+	update_instruction_hook(bpsp);
 }
 
 void bp_wp_add(struct bp_session *bps, unsigned type,
@@ -159,18 +219,20 @@ void bp_wp_add(struct bp_session *bps, unsigned type,
 	struct bp_session_private *bpsp = (struct bp_session_private *)bps;
 	switch (type) {
 	case 2:
-		trap_add(bpsp, &wp_write_list, addr, addr + nbytes - 1, cond_mask, cond);
+		trap_add(bpsp, &bpsp->wp_write_list, addr, addr + nbytes - 1, cond_mask, cond);
 		break;
 	case 3:
-		trap_add(bpsp, &wp_read_list, addr, addr + nbytes - 1, cond_mask, cond);
+		trap_add(bpsp, &bpsp->wp_read_list, addr, addr + nbytes - 1, cond_mask, cond);
 		break;
 	case 4:
-		trap_add(bpsp, &wp_write_list, addr, addr + nbytes - 1, cond_mask, cond);
-		trap_add(bpsp, &wp_read_list, addr, addr + nbytes - 1, cond_mask, cond);
+		trap_add(bpsp, &bpsp->wp_write_list, addr, addr + nbytes - 1, cond_mask, cond);
+		trap_add(bpsp, &bpsp->wp_read_list, addr, addr + nbytes - 1, cond_mask, cond);
 		break;
 	default:
 		break;
 	}
+	update_map(bpsp->wp_write_map, bpsp->wp_write_list);
+	update_map(bpsp->wp_read_map, bpsp->wp_read_list);
 }
 
 void bp_wp_remove(struct bp_session *bps, unsigned type,
@@ -178,18 +240,68 @@ void bp_wp_remove(struct bp_session *bps, unsigned type,
 	struct bp_session_private *bpsp = (struct bp_session_private *)bps;
 	switch (type) {
 	case 2:
-		trap_remove(bpsp, &wp_write_list, addr, addr + nbytes - 1, cond_mask, cond);
+		trap_remove(bpsp, &bpsp->wp_write_list, addr, addr + nbytes - 1, cond_mask, cond);
 		break;
 	case 3:
-		trap_remove(bpsp, &wp_read_list, addr, addr + nbytes - 1, cond_mask, cond);
+		trap_remove(bpsp, &bpsp->wp_read_list, addr, addr + nbytes - 1, cond_mask, cond);
 		break;
 	case 4:
-		trap_remove(bpsp, &wp_write_list, addr, addr + nbytes - 1, cond_mask, cond);
-		trap_remove(bpsp, &wp_read_list, addr, addr + nbytes - 1, cond_mask, cond);
+		trap_remove(bpsp, &bpsp->wp_write_list, addr, addr + nbytes - 1, cond_mask, cond);
+		trap_remove(bpsp, &bpsp->wp_read_list, addr, addr + nbytes - 1, cond_mask, cond);
 		break;
 	default:
 		break;
 	}
+	update_map(bpsp->wp_write_map, bpsp->wp_write_list);
+	update_map(bpsp->wp_read_map, bpsp->wp_read_list);
+}
+
+// Rebuild the address bitmap for a list of breakpoints.
+
+static void update_map(uint8_t *map, struct slist *bp_list) {
+	memset(map, 0, BP_MAP_SIZE);
+	for (struct slist *iter = bp_list; iter; iter = iter->next) {
+		struct breakpoint *bp = iter->data;
+		unsigned end = (bp->address_end > 0xffff) ? 0xffff : bp->address_end;
+		for (unsigned a = bp->address; a <= end; a++) {
+			map[a >> 3] |= (1 << (a & 7));
+		}
+	}
+}
+
+_Bool bp_wp_active(struct bp_session *bps) {
+	struct bp_session_private *bpsp = (struct bp_session_private *)bps;
+	return bpsp->wp_read_list || bpsp->wp_write_list;
+}
+
+void bp_set_idle_hook(struct bp_session *bps, DELEGATE_T0(void) hook) {
+	struct bp_session_private *bpsp = (struct bp_session_private *)bps;
+	bps->idle_hook = hook;
+	update_instruction_hook(bpsp);
+}
+
+void bp_set_profile_hook(struct bp_session *bps, DELEGATE_T0(void) hook) {
+	struct bp_session_private *bpsp = (struct bp_session_private *)bps;
+	bps->profile_hook = hook;
+	update_instruction_hook(bpsp);
+}
+
+void bp_set_replay_hook(struct bp_session *bps, DELEGATE_T0(void) hook) {
+	struct bp_session_private *bpsp = (struct bp_session_private *)bps;
+	bps->replay_hook = hook;
+	update_instruction_hook(bpsp);
+}
+
+// The CPU instruction hook is only installed while there are instruction
+// breakpoints or an idle, profile or replay hook to call.
+
+static void update_instruction_hook(struct bp_session_private *bpsp) {
+	if (bpsp->instruction_list || bpsp->bps.idle_hook.func
+	    || bpsp->bps.profile_hook.func || bpsp->bps.replay_hook.func) {
+		bpsp->cpu->instruction_hook = DELEGATE_AS0(void, bp_instruction_hook, bpsp);
+	} else {
+		bpsp->cpu->instruction_hook.func = NULL;
+	}
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -200,8 +312,8 @@ void bp_wp_remove(struct bp_session *bps, unsigned type,
 
 static void bp_hook(struct bp_session_private *bpsp, struct slist *bp_list, unsigned address) {
 	struct bp_session *bps = &bpsp->bps;
-	for (struct slist *iter = bp_list; iter; iter = iter_next) {
-		iter_next = iter->next;
+	for (struct slist *iter = bp_list; iter; iter = bpsp->iter_next) {
+		bpsp->iter_next = iter->next;
 		struct breakpoint *bp = iter->data;
 		if ((bps->cond & bp->cond_mask) != bp->cond)
 			continue;
@@ -211,26 +323,30 @@ static void bp_hook(struct bp_session_private *bpsp, struct slist *bp_list, unsi
 			continue;
 		DELEGATE_CALL0(bp->handler);
 	}
-	iter_next = NULL;
+	bpsp->iter_next = NULL;
 }
 
 static void bp_instruction_hook(void *sptr) {
 	struct bp_session_private *bpsp = sptr;
 	uint16_t old_pc;
+	DELEGATE_SAFE_CALL0(bpsp->bps.replay_hook);
 	do {
 		old_pc = bpsp->cpu->reg_pc;
-		bp_hook(bpsp, bp_instruction_list, old_pc);
+		if (map_test(bpsp->instruction_map, old_pc))
+			bp_hook(bpsp, bpsp->instruction_list, old_pc);
 	} while (old_pc != bpsp->cpu->reg_pc);
+	DELEGATE_SAFE_CALL0(bpsp->bps.profile_hook);
+	DELEGATE_SAFE_CALL0(bpsp->bps.idle_hook);
 }
 
 void bp_wp_read_hook(struct bp_session *bps, unsigned address) {
 	struct bp_session_private *bpsp = (struct bp_session_private *)bps;
-	if (wp_read_list)
-		bp_hook(bpsp, wp_read_list, address);
+	if (map_test(bpsp->wp_read_map, address))
+		bp_hook(bpsp, bpsp->wp_read_list, address);
 }
 
 void bp_wp_write_hook(struct bp_session *bps, unsigned address) {
 	struct bp_session_private *bpsp = (struct bp_session_private *)bps;
-	if (wp_write_list)
-		bp_hook(bpsp, wp_write_list, address);
+	if (map_test(bpsp->wp_write_map, address))
+		bp_hook(bpsp, bpsp->wp_write_list, address);
 }
@@ -39,6 +39,15 @@ struct machine;
 struct bp_session {
 	unsigned cond;  // matched against breakpoint's cond ANDed with cond_mask
 	DELEGATE_T0(void) trap_handler;
+	// Called before each instruction, after any breakpoints have been
+	// checked.  Set with bp_set_idle_hook().
+	DELEGATE_T0(void) idle_hook;
+	// Called before each instruction, before the idle hook.  Set with
+	// bp_set_profile_hook().
+	DELEGATE_T0(void) profile_hook;
+	// Called before each instruction, before any breakpoints are checked.
+	// Set with bp_set_replay_hook().
+	DELEGATE_T0(void) replay_hook;
 };
 
 struct bp_session *bp_session_new(struct machine *m);
@@ -52,6 +61,8 @@ struct breakpoint {
 	unsigned address_end;
 	// Handler
 	DELEGATE_T0(void) handler;
+	// Breakpoint this was copied from by bp_add()
+	struct breakpoint const *ref;
 };
 
 // Chosen to match up to the GDB protcol watchpoint type minus 1.
@@ -59,8 +70,14 @@ struct breakpoint {
 #define WP_READ  (2)
 #define WP_BOTH  (3)
 
-void bp_add(struct bp_session *bps, struct breakpoint *bp);
-void bp_remove(struct bp_session *bps, struct breakpoint *bp);
+// Add a copy of a breakpoint, calling its handler with sptr.
+void bp_add(struct bp_session *bps, struct breakpoint const *bp, void *sptr);
+void bp_remove(struct bp_session *bps, struct breakpoint const *bp);
+
+// Likewise for watchpoints covering address to address_end.  Type is WP_READ,
+// WP_WRITE or WP_BOTH.
+void bp_add_wp(struct bp_session *bps, unsigned type, struct breakpoint const *bp, void *sptr);
+void bp_remove_wp(struct bp_session *bps, struct breakpoint const *bp);
 
 // Manipulate simple traps.
 
@@ -83,4 +100,22 @@ void bp_wp_remove(struct bp_session *bps,
 void bp_wp_read_hook(struct bp_session *bps, unsigned address);
 void bp_wp_write_hook(struct bp_session *bps, unsigned address);
 
+// True if any watchpoints are set.
+
+_Bool bp_wp_active(struct bp_session *bps);
+
+// Idle loop detection needs to see every instruction, so shares the CPU
+// instruction hook with breakpoints.  Pass a NULL delegate to remove.
+
+void bp_set_idle_hook(struct bp_session *bps, DELEGATE_T0(void) hook);
+
+// Likewise the guest profiler.
+
+void bp_set_profile_hook(struct bp_session *bps, DELEGATE_T0(void) hook);
+
+// And reverse execution, which reapplies changes made by breakpoint handlers
+// when reviewing history.
+
+void bp_set_replay_hook(struct bp_session *bps, DELEGATE_T0(void) hook);
+
 #endif
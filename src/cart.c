@@ -41,6 +41,7 @@ See COPYING.GPL for redistribution conditions.
 #include "machine.h"
 #include "part.h"
 #include "romlist.h"
+#include "serialise.h"
 #include "xconfig.h"
 #include "xroar.h"
 
@@ -321,6 +322,7 @@ void cart_rom_init(struct cart *c) {
 	c->signal_nmi = DELEGATE_DEFAULT1(void, bool);
 	c->signal_halt = DELEGATE_DEFAULT1(void, bool);
 	c->EXTMEM = 0;
+	c->snoop = 0;
 	c->has_interface = cart_rom_has_interface;
 }
 
@@ -351,17 +353,15 @@ static uint8_t cart_rom_write(struct cart *c, uint16_t A, _Bool P2, _Bool R2, ui
 
 void cart_rom_reset(struct cart *c) {
 	struct cart_config *cc = c->config;
+	c->rom_crc = CRC32_RESET;
 	if (cc->rom) {
 		char *tmp = romlist_find(cc->rom);
 		if (tmp) {
 			int size = machine_load_rom(tmp, c->rom_data, 0x10000);
-			(void)size;  // avoid warnings if...
-#ifdef LOGGING
 			if (size > 0) {
-				uint32_t crc = crc32_block(CRC32_RESET, c->rom_data, size);
-				LOG_DEBUG(1, "\tCRC = 0x%08x\n", crc);
+				c->rom_crc = crc32_block(CRC32_RESET, c->rom_data, size);
+				LOG_DEBUG(1, "\tCRC = 0x%08x\n", c->rom_crc);
 			}
-#endif
 			free(tmp);
 		}
 	}
@@ -369,13 +369,11 @@ void cart_rom_reset(struct cart *c) {
 		char *tmp = romlist_find(cc->rom2);
 		if (tmp) {
 			int size = machine_load_rom(tmp, c->rom_data + 0x2000, 0x2000);
-			(void)size;  // avoid warnings if...
-#ifdef LOGGING
 			if (size > 0) {
-				uint32_t crc = crc32_block(CRC32_RESET, c->rom_data + 0x2000, size);
-				LOG_DEBUG(1, "\tCRC = 0x%08x\n", crc);
+				LOG_DEBUG(1, "\tCRC = 0x%08x\n", crc32_block(CRC32_RESET, c->rom_data + 0x2000, size));
+				// Combined with the first ROM's
+				c->rom_crc = crc32_block(c->rom_crc, c->rom_data + 0x2000, size);
 			}
-#endif
 			free(tmp);
 		}
 	}
@@ -394,8 +392,8 @@ void cart_rom_attach(struct cart *c) {
 	struct cart_config *cc = c->config;
 	if (cc->autorun) {
 		c->firq_event = event_new(DELEGATE_AS0(void, do_firq, c));
-		c->firq_event->at_tick = event_current_tick + EVENT_MS(100);
-		event_queue(&MACHINE_EVENT_LIST, c->firq_event);
+		c->firq_event->at_tick = xroar_context->current_tick + EVENT_MS(100);
+		event_queue(&xroar_context->machine_events, c->firq_event);
 	} else {
 		c->firq_event = NULL;
 	}
@@ -423,13 +421,55 @@ void cart_rom_select_bank(struct cart *c, uint16_t bank) {
 	c->rom_bank = bank;
 }
 
+void cart_ser_write(struct cart *c, struct ser_handle *sh) {
+	ser_write_uint16(sh, c->rom_bank);
+	ser_write_bool(sh, c->EXTMEM);
+	ser_write_bool(sh, c->firq_event != NULL);
+	if (c->firq_event)
+		ser_write_event(sh, c->firq_event);
+	struct ser_handle *csh = ser_open_write();
+	if (c->ser_write)
+		c->ser_write(c, csh);
+	size_t size;
+	void const *data = ser_data(csh, &size);
+	ser_write_uint32(sh, size);
+	ser_write_bytes(sh, data, size);
+	ser_close(csh);
+}
+
+void cart_ser_read(struct cart *c, struct ser_handle *sh) {
+	c->rom_bank = ser_read_uint16(sh);
+	c->EXTMEM = ser_read_bool(sh);
+	if (ser_read_bool(sh)) {
+		struct event_state es;
+		ser_read_event_state(sh, &es);
+		if (c->firq_event)
+			event_restore_state(c->firq_event, &xroar_context->machine_events, &es);
+	}
+	uint32_t size = ser_read_uint32(sh);
+	if (size > ser_remaining(sh)) {
+		ser_skip(sh, size);
+		return;
+	}
+	void *data = xmalloc(size ? size : 1);
+	ser_read_bytes(sh, data, size);
+	if (c->ser_read && size > 0) {
+		struct ser_handle *csh = ser_open_read(data, size);
+		c->ser_read(c, csh);
+		if (ser_error(csh))
+			LOG_WARN("Snapshot: incomplete state for cartridge '%s'\n", c->config->name);
+		ser_close(csh);
+	}
+	free(data);
+}
+
 // Toggles the cartridge interrupt line.
 static void do_firq(void *data) {
 	static _Bool level = 0;
 	struct cart *c = data;
 	DELEGATE_SAFE_CALL1(c->signal_firq, level);
-	c->firq_event->at_tick = event_current_tick + EVENT_MS(100);
-	event_queue(&MACHINE_EVENT_LIST, c->firq_event);
+	c->firq_event->at_tick = xroar_context->current_tick + EVENT_MS(100);
+	event_queue(&xroar_context->machine_events, c->firq_event);
 	level = !level;
 }
 
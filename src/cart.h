@@ -29,6 +29,7 @@ See COPYING.GPL for redistribution conditions.
 struct slist;
 struct machine_config;
 struct event;
+struct ser_handle;
 
 struct cart_config {
 	char *name;
@@ -60,6 +61,11 @@ struct cart {
 	uint8_t (*read)(struct cart *c, uint16_t A, _Bool P2, _Bool R2, uint8_t D);
 	uint8_t (*write)(struct cart *c, uint16_t A, _Bool P2, _Bool R2, uint8_t D);
 
+	// Cartridge needs to see every cycle (e.g. it may assert EXTMEM, or
+	// decode addresses outside P2).  If not set, the host may skip the
+	// per-cycle call for plain RAM & ROM accesses.
+	_Bool snoop;
+
 	// Reset line.
 	void (*reset)(struct cart *c);
 
@@ -75,11 +81,25 @@ struct cart {
 	// to avoid having to create a "cart_rom" struct that adds little else.
 	uint8_t *rom_data;
 	uint16_t rom_bank;
+	// CRC of ROM images loaded at last reset.  Carts containing others
+	// should combine theirs into this.
+	uint32_t rom_crc;
 
 	// Used to schedule regular FIRQs when an "autorun" cartridge is
 	// configured.
 	struct event *firq_event;
 
+	// In-memory state, for snapshots.  Optional: if state_size is NULL,
+	// the cartridge has no state worth saving beyond its ROM.
+	size_t (*state_size)(struct cart *c);
+	void (*state_save)(struct cart *c, void *buf);
+	void (*state_restore)(struct cart *c, void const *buf);
+
+	// Portable state, for snapshot files.  Optional, and only called
+	// through cart_ser_write() and cart_ser_read().
+	void (*ser_write)(struct cart *c, struct ser_handle *sh);
+	void (*ser_read)(struct cart *c, struct ser_handle *sh);
+
 	// Query if cartridge supports a named interface.
 	_Bool (*has_interface)(struct cart *c, const char *ifname);
 	// Connect a named interface.
@@ -116,4 +136,11 @@ void cart_rom_detach(struct cart *c);
 void cart_rom_free(struct part *p);
 void cart_rom_select_bank(struct cart *c, uint16_t bank);
 
+// Write or read the state common to all cartridges (ROM bank, EXTMEM, autorun
+// FIRQ timing) followed by any specific to the type.  The specific part is
+// length-prefixed, so can be skipped if the reading cartridge has no use for
+// it.
+void cart_ser_write(struct cart *c, struct ser_handle *sh);
+void cart_ser_read(struct cart *c, struct ser_handle *sh);
+
 #endif
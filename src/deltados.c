@@ -36,6 +36,7 @@ See COPYING.GPL for redistribution conditions.
 #include "cart.h"
 #include "logging.h"
 #include "part.h"
+#include "serialise.h"
 #include "vdrive.h"
 #include "wd279x.h"
 #include "xroar.h"
@@ -65,6 +66,11 @@ static uint8_t deltados_write(struct cart *c, uint16_t A, _Bool P2, _Bool R2, ui
 static void deltados_reset(struct cart *c);
 static void deltados_detach(struct cart *c);
 static void deltados_free(struct part *p);
+static size_t deltados_state_size(struct cart *c);
+static void deltados_state_save(struct cart *c, void *buf);
+static void deltados_state_restore(struct cart *c, void const *buf);
+static void deltados_ser_write(struct cart *c, struct ser_handle *sh);
+static void deltados_ser_read(struct cart *c, struct ser_handle *sh);
 static _Bool deltados_has_interface(struct cart *c, const char *ifname);
 static void deltados_attach_interface(struct cart *c, const char *ifname, void *intf);
 
@@ -89,6 +95,11 @@ static struct cart *deltados_new(struct cart_config *cc) {
 	c->read = deltados_read;
 	c->write = deltados_write;
 	c->reset = deltados_reset;
+	c->state_size = deltados_state_size;
+	c->state_save = deltados_state_save;
+	c->state_restore = deltados_state_restore;
+	c->ser_write = deltados_ser_write;
+	c->ser_read = deltados_ser_read;
 
 	c->has_interface = deltados_has_interface;
 	c->attach_interface = deltados_attach_interface;
@@ -107,6 +118,77 @@ static void deltados_reset(struct cart *c) {
 	latch_write(d, 0);
 }
 
+// Latches, FDC and drive state follow each other in the buffer.
+
+struct deltados_state {
+	unsigned latch_old;
+	unsigned latch_drive_select;
+	_Bool latch_side_select;
+	_Bool latch_density;
+};
+
+static size_t deltados_state_size(struct cart *c) {
+	(void)c;
+	return STATE_ALIGN(sizeof(struct deltados_state)) + STATE_ALIGN(wd279x_state_size())
+	       + vdrive_state_size();
+}
+
+static void deltados_state_save(struct cart *c, void *buf) {
+	struct deltados *d = (struct deltados *)c;
+	struct deltados_state *st = buf;
+	st->latch_old = d->latch_old;
+	st->latch_drive_select = d->latch_drive_select;
+	st->latch_side_select = d->latch_side_select;
+	st->latch_density = d->latch_density;
+	uint8_t *p = (uint8_t *)buf + STATE_ALIGN(sizeof(*st));
+	wd279x_state_save(d->fdc, p);
+	p += STATE_ALIGN(wd279x_state_size());
+	if (d->vdrive_interface) {
+		vdrive_state_save(d->vdrive_interface, p);
+	} else {
+		memset(p, 0, vdrive_state_size());
+	}
+}
+
+static void deltados_state_restore(struct cart *c, void const *buf) {
+	struct deltados *d = (struct deltados *)c;
+	struct deltados_state const *st = buf;
+	d->latch_old = st->latch_old;
+	d->latch_drive_select = st->latch_drive_select;
+	d->latch_side_select = st->latch_side_select;
+	d->latch_density = st->latch_density;
+	uint8_t const *p = (uint8_t const *)buf + STATE_ALIGN(sizeof(*st));
+	if (d->vdrive_interface) {
+		vdrive_state_restore(d->vdrive_interface, p + STATE_ALIGN(wd279x_state_size()));
+	}
+	wd279x_state_restore(d->fdc, p);
+}
+
+// Drive state is read before the FDC's, as for the in-memory state.
+
+static void deltados_ser_write(struct cart *c, struct ser_handle *sh) {
+	struct deltados *d = (struct deltados *)c;
+	ser_write_uint32(sh, d->latch_old);
+	ser_write_uint8(sh, d->latch_drive_select);
+	ser_write_bool(sh, d->latch_side_select);
+	ser_write_bool(sh, d->latch_density);
+	ser_write_bool(sh, d->vdrive_interface);
+	if (d->vdrive_interface)
+		vdrive_ser_write(d->vdrive_interface, sh);
+	wd279x_ser_write(d->fdc, sh);
+}
+
+static void deltados_ser_read(struct cart *c, struct ser_handle *sh) {
+	struct deltados *d = (struct deltados *)c;
+	d->latch_old = ser_read_uint32(sh);
+	d->latch_drive_select = ser_read_uint8(sh);
+	d->latch_side_select = ser_read_bool(sh);
+	d->latch_density = ser_read_bool(sh);
+	if (ser_read_bool(sh))
+		vdrive_ser_read(d->vdrive_interface, sh);
+	wd279x_ser_read(d->fdc, sh);
+}
+
 static void deltados_detach(struct cart *c) {
 	struct deltados *d = (struct deltados *)c;
 	vdrive_disconnect(d->vdrive_interface);
@@ -20,6 +20,7 @@ See COPYING.GPL for redistribution conditions.
 #endif
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -27,11 +28,15 @@ See COPYING.GPL for redistribution conditions.
 #include <unistd.h>
 
 #include "delegate.h"
+#include "sds.h"
+#include "slist.h"
 #include "xalloc.h"
 
+#include "bp_cmd.h"
 #include "cart.h"
 #include "crc32.h"
 #include "crclist.h"
+#include "frameskip.h"
 #include "gdb.h"
 #include "hd6309.h"
 #include "joystick.h"
@@ -44,10 +49,16 @@ See COPYING.GPL for redistribution conditions.
 #include "ntsc.h"
 #include "part.h"
 #include "printer.h"
+#include "profile.h"
+#include "replay.h"
+#include "rewind.h"
 #include "romlist.h"
 #include "sam.h"
+#include "serialise.h"
 #include "sound.h"
+#include "stats.h"
 #include "tape.h"
+#include "tracebin.h"
 #include "vdg_palette.h"
 #include "vo.h"
 #include "xroar.h"
@@ -82,9 +93,65 @@ enum machine_ram_organisation {
 	RAM_ORGANISATION_64K
 };
 
+// Registers compared between loop iterations by idle loop detection, and
+// maximum number of instructions in such a loop
+#define IDLE_NREGS (10)
+#define IDLE_MAX_LOOP (16)
+
+// Reverse execution.  Inputs read from outside the machine, and signals
+// arriving asynchronously, are logged so that they can be replayed.  Rewind
+// history logs only the read inputs.
+
+enum {
+	// Read inputs
+	DRAGON_INPUT_KEYBOARD,
+	DRAGON_INPUT_JOYSTICK,
+	DRAGON_INPUT_PRINTER_BUSY,
+	DRAGON_INPUT_CART_IO,
+	// Signals
+	DRAGON_SIGNAL_TAPE,
+	DRAGON_SIGNAL_CART_FIRQ,
+	DRAGON_SIGNAL_CART_NMI,
+	DRAGON_SIGNAL_CART_HALT,
+	DRAGON_SIGNAL_PRINTER_ACK,
+	DRAGON_SIGNAL_SBS_FEEDBACK,
+};
+
+// While looking back through history, the instruction hook is replaced to
+// either find the last instruction start before a target time, seek to a
+// known instruction start, or scan for breakpoint and watchpoint hits.
+
+enum reverse_mode {
+	REVERSE_FIND,
+	REVERSE_SEEK,
+	REVERSE_SCAN,
+};
+
+// Per-page memory lookup.  Each entry points to the memory backing a 256-byte
+// page for CPU reads or writes, or is NULL if accesses to that page need full
+// decode.  A table is cached for each SAM memory map and ROM bank, as
+// software may switch between them often (e.g. toggling map type to copy
+// ROM to RAM).
+
+#define NPAGE_TABLES (32)
+
+struct page_table {
+	_Bool valid;
+	uint8_t *read[256];
+	uint8_t *write[256];
+#ifdef WANT_PREDECODE
+	// Physical address of each read page for the CPU predecode cache: RAM
+	// offset, or ROM offset after RAM.  -1 where read is NULL.
+	int32_t predecode[256];
+#endif
+};
+
 struct machine_dragon {
 	struct machine public;  // first element in turn is part
 
+	// Context the machine was created in, cached for the hot paths
+	struct xroar_context *ctx;
+
 	struct MC6809 *CPU0;
 	struct MC6883 *SAM0;
 	struct MC6821 *PIA0, *PIA1;
@@ -107,16 +174,77 @@ struct machine_dragon {
 	_Bool fast_sound;
 	struct cart *cart;
 	unsigned frameskip;
+	_Bool frameskip_auto;
 
 	int cycles;
+	// Set whenever PIA interrupt state may have changed.  CPU IRQ & FIRQ
+	// lines are only recomputed from the PIAs when this is set.
+	_Bool sync_irq;
+
+	// Current page table, reselected when the SAM memory map or ROM
+	// selection changes.  All are invalidated if the cartridge changes.
+	uint8_t **read_page;
+	uint8_t **write_page;
+	_Bool update_pages;
+	unsigned pages_index;
+	struct cart *pages_cart;
+	struct page_table page_tables[NPAGE_TABLES];
 
 	struct bp_session *bp_session;
 	_Bool single_step;
+
+	// Idle skip.  When the CPU is provably doing nothing but waiting for
+	// an interrupt, time is advanced straight to the next scheduled
+	// event.  See idle_instruction_hook() and idle_cycle().
+	_Bool idle_skip;
+	_Bool idle_dirty;  // store or I/O access since loop start
+	unsigned idle_count;  // consecutive identical loop iterations
+	unsigned idle_ninstructions;  // instructions since loop start
+	unsigned idle_nwait;  // consecutive SYNC/CWAI wait cycles
+	unsigned idle_ncycles;  // bus cycle count
+	uint16_t idle_regs[IDLE_NREGS];
+	event_ticks idle_tick[3];
+	unsigned idle_cycles[3];
+	uint64_t idle_skipped_cycles;
+	uint64_t idle_skipped_ticks;
+
+	// Guest profiler, if enabled
+	struct profile *profile;
+
+	// User breakpoint commands (-bp, GDB "monitor")
+	struct bp_cmd *bp_cmd;
+
 	int stop_signal;
 #ifdef WANT_GDB_TARGET
 	struct gdb_interface *gdb_interface;
 #endif
+	// Reverse execution, if enabled
+	struct replay *replay;
+	// Rewind history, if enabled
+	struct rewind *rewind;
+	_Bool noclock;  // debugger access, not to be logged
+	enum reverse_mode reverse_mode;
+	uint64_t reverse_target;
+	uint64_t reverse_found;
+	_Bool reverse_have_found;
+	_Bool reverse_done;
+	DELEGATE_T0(void) reverse_saved_hook;
+	// Machine breakpoints (ROM call intercepts) are wrapped so that the
+	// changes they make can be logged for reverse execution.  See
+	// rom_hook_handler().
+	struct slist *rom_hooks;
+	_Bool hook_logging;
+	uint8_t *hook_change;
+	size_t hook_change_size;
+	size_t hook_change_len;
+	// Range stepping
+	_Bool range_active;
+	_Bool range_first;  // first instruction is always executed
+	unsigned range_start, range_end;
+	DELEGATE_T0(void) range_saved_hook;
+
 	_Bool trace;
+	struct tracebin *tracebin;
 
 	struct tape_interface *tape_interface;
 	struct keyboard_interface *keyboard_interface;
@@ -136,6 +264,8 @@ struct machine_dragon {
 	_Bool has_ext_charset;
 	uint32_t crc_bas, crc_extbas, crc_altbas, crc_combined;
 	uint32_t crc_ext_charset;
+	// All of the above as computed, before any forced match
+	uint32_t crc_roms;
 	enum machine_ram_organisation ram_organisation;
 	uint16_t ram_mask;
 	_Bool is_dragon;
@@ -258,23 +388,39 @@ static _Bool dragon_set_inverted_text(struct machine *m, int state);
 static void *dragon_get_component(struct machine *m, const char *cname);
 static void *dragon_get_interface(struct machine *m, const char *ifname);
 static void dragon_set_vo_cmp(struct machine *m, int mode);
-static void dragon_set_frameskip(struct machine *m, unsigned fskip);
+static void dragon_set_frameskip(struct machine *m, int fskip);
 static void dragon_set_ratelimit(struct machine *m, _Bool ratelimit);
+static _Bool dragon_rewind(struct machine *m, unsigned nframes);
+static uint32_t dragon_rom_crc(struct machine *m);
 
 static uint8_t dragon_read_byte(struct machine *m, unsigned A);
 static void dragon_write_byte(struct machine *m, unsigned A, unsigned D);
 static void dragon_op_rts(struct machine *m);
+static size_t dragon_state_size(struct machine *m);
+static void dragon_state_save(struct machine *m, void *buf);
+static void dragon_state_restore(struct machine *m, void const *buf);
+static void dragon_ser_write(struct machine *m, struct ser_handle *sh);
+static void dragon_ser_read(struct machine *m, struct ser_handle *sh);
 
+static void add_rom_crc(struct machine_dragon *md, uint32_t crc);
 static void keyboard_update(void *sptr);
 static void joystick_update(void *sptr);
 static void update_sound_mux_source(void *sptr);
 static void update_vdg_mode(struct machine_dragon *md);
+static void invalidate_page_tables(struct machine_dragon *md);
+static void check_page_table(struct machine_dragon *md);
+static _Bool in_past(struct machine_dragon *md);
+static void replay_instruction_hook(void *sptr);
+static void idle_instruction_hook(void *sptr);
+static void idle_get_regs(struct machine_dragon *md, uint16_t *regs);
+static void idle_cycle(struct machine_dragon *md, int ncycles, _Bool RnW, uint16_t A);
 
 static void single_bit_feedback(void *sptr, _Bool level);
 static void update_audio_from_tape(void *sptr, float value);
 static void cart_firq(void *sptr, _Bool level);
 static void cart_nmi(void *sptr, _Bool level);
 static void cart_halt(void *sptr, _Bool level);
+static void apply_signal(void *sptr, unsigned id, unsigned value);
 static void vdg_hs(void *sptr, _Bool level);
 static void vdg_hs_pal_coco(void *sptr, _Bool level);
 static void vdg_fs(void *sptr, _Bool level);
@@ -312,6 +458,10 @@ static struct machine *dragon_new(struct machine_config *mc, struct vo_interface
 
 	struct machine_dragon *md = part_new(sizeof(*md));
 	*md = (struct machine_dragon){0};
+	md->ctx = xroar_context;
+	// Full decode until a page table is selected
+	md->read_page = md->page_tables[0].read;
+	md->write_page = md->page_tables[0].write;
 	struct machine *m = &md->public;
 
 	part_init(&m->part, "dragon");
@@ -338,10 +488,17 @@ static struct machine *dragon_new(struct machine_config *mc, struct vo_interface
 	m->set_vo_cmp = dragon_set_vo_cmp;
 	m->set_frameskip = dragon_set_frameskip;
 	m->set_ratelimit = dragon_set_ratelimit;
+	m->rewind = dragon_rewind;
+	m->rom_crc = dragon_rom_crc;
 
 	m->read_byte = dragon_read_byte;
 	m->write_byte = dragon_write_byte;
 	m->op_rts = dragon_op_rts;
+	m->state_size = dragon_state_size;
+	m->state_save = dragon_state_save;
+	m->state_restore = dragon_state_restore;
+	m->ser_write = dragon_ser_write;
+	m->ser_read = dragon_ser_read;
 
 	md->vo = vo;
 	md->snd = snd;
@@ -396,9 +553,33 @@ static struct machine *dragon_new(struct machine_config *mc, struct vo_interface
 	part_add_component(&m->part, (struct part *)md->CPU0, "CPU");
 	md->CPU0->mem_cycle = DELEGATE_AS2(void, bool, uint16, sam_mem_cycle, md->SAM0);
 
+#ifdef TRACE
+	// Binary trace
+	if (xroar_cfg.trace_file) {
+		int mb = xroar_cfg.trace_buffer > 0 ? xroar_cfg.trace_buffer : 16;
+		int cpu_type = (md->CPU0->variant == MC6809_VARIANT_HD6309) ? TRACEBIN_CPU_HD6309 : TRACEBIN_CPU_MC6809;
+		md->tracebin = tracebin_new(xroar_cfg.trace_file, cpu_type,
+					    (unsigned)mb << 20, xroar_cfg.trace_last,
+					    &md->ctx->current_tick);
+		md->CPU0->tracebin = md->tracebin;
+	}
+#endif
+
 	// Breakpoint session
 	md->bp_session = bp_session_new(m);
 	md->bp_session->trap_handler = DELEGATE_AS0(void, dragon_trap, m);
+	md->bp_cmd = bp_cmd_new(m, md->bp_session);
+
+	// Idle skip
+	md->idle_skip = xroar_cfg.idle_skip;
+	if (md->idle_skip) {
+		bp_set_idle_hook(md->bp_session, DELEGATE_AS0(void, idle_instruction_hook, md));
+	}
+
+	// Guest profiler
+	if (xroar_cfg.profile_file) {
+		md->profile = profile_new(md->CPU0, md->bp_session);
+	}
 
 	// Keyboard interface
 	md->keyboard_interface = keyboard_interface_new(m);
@@ -479,6 +660,7 @@ static struct machine *dragon_new(struct machine_config *mc, struct vo_interface
 	md->crc_combined = md->crc_extbas = md->crc_bas = md->crc_altbas = 0;
 	md->has_ext_charset = 0;
 	md->crc_ext_charset = 0;
+	md->crc_roms = CRC32_RESET;
 
 	/* ... Extended BASIC */
 	if (!mc->noextbas && mc->extbas_rom) {
@@ -546,6 +728,7 @@ static struct machine *dragon_new(struct machine_config *mc, struct vo_interface
 		_Bool forced = 0, valid_crc = 0;
 
 		md->crc_combined = crc32_block(CRC32_RESET, md->rom0, 0x4000);
+		add_rom_crc(md, md->crc_combined);
 
 		if (md->is_dragon64)
 			valid_crc = crclist_match("@d64_1", md->crc_combined);
@@ -573,6 +756,7 @@ static struct machine *dragon_new(struct machine_config *mc, struct vo_interface
 		_Bool forced = 0, valid_crc = 0;
 
 		md->crc_altbas = crc32_block(CRC32_RESET, md->rom1, 0x4000);
+		add_rom_crc(md, md->crc_altbas);
 
 		if (md->is_dragon64)
 			valid_crc = crclist_match("@d64_2", md->crc_altbas);
@@ -594,6 +778,7 @@ static struct machine *dragon_new(struct machine_config *mc, struct vo_interface
 		_Bool forced = 0, valid_crc = 0, coco4k = 0;
 
 		md->crc_bas = crc32_block(CRC32_RESET, md->rom0 + 0x2000, 0x2000);
+		add_rom_crc(md, md->crc_bas);
 
 		if (!md->is_dragon) {
 			if (mc->ram > 4) {
@@ -629,6 +814,7 @@ static struct machine *dragon_new(struct machine_config *mc, struct vo_interface
 		_Bool forced = 0, valid_crc = 0;
 
 		md->crc_extbas = crc32_block(CRC32_RESET, md->rom0, 0x2000);
+		add_rom_crc(md, md->crc_extbas);
 
 		if (!md->is_dragon) {
 			valid_crc = crclist_match("@cocoext", md->crc_extbas);
@@ -648,6 +834,7 @@ static struct machine *dragon_new(struct machine_config *mc, struct vo_interface
 	}
 	if (md->has_ext_charset) {
 		md->crc_ext_charset = crc32_block(CRC32_RESET, md->ext_charset, 0x1000);
+		add_rom_crc(md, md->crc_ext_charset);
 		LOG_DEBUG(1, "\tExternal charset CRC = 0x%08x\n", md->crc_ext_charset);
 	}
 
@@ -723,21 +910,66 @@ static struct machine *dragon_new(struct machine_config *mc, struct vo_interface
 
 	md->fast_sound = xroar_cfg.fast_sound;
 
-	keyboard_set_keymap(md->keyboard_interface, xroar_machine_config->keymap);
+	keyboard_set_keymap(md->keyboard_interface, xroar_context->machine_config->keymap);
 
 #ifdef WANT_GDB_TARGET
 	// GDB
 	if (xroar_cfg.gdb) {
+		// Reverse execution.  History is sized assuming 50 frames per
+		// second.
+		if (xroar_cfg.gdb_history > 0) {
+			unsigned interval = xroar_cfg.gdb_checkpoint > 0 ? xroar_cfg.gdb_checkpoint : 1;
+			unsigned frames = xroar_cfg.gdb_history * 50;
+			md->replay = replay_new(m, interval, (frames + interval - 1) / interval,
+						DELEGATE_AS2(void, unsigned, unsigned, apply_signal, md));
+			if (md->replay)
+				bp_set_replay_hook(md->bp_session, DELEGATE_AS0(void, replay_instruction_hook, md));
+		}
 		md->gdb_interface = gdb_interface_new(xroar_cfg.gdb_ip, xroar_cfg.gdb_port, m, md->bp_session);
 		if (md->gdb_interface) {
 			gdb_set_debug(md->gdb_interface, xroar_cfg.debug_gdb);
+		} else if (md->replay) {
+			bp_set_replay_hook(md->bp_session, (DELEGATE_T0(void)){0});
+			replay_free(md->replay);
+			md->replay = NULL;
 		}
 	}
 #endif
 
+	// Rewind history.  Not available while under debugger control.
+	_Bool debugging = 0;
+#ifdef WANT_GDB_TARGET
+	debugging = (md->gdb_interface != NULL);
+#endif
+	if (xroar_cfg.rewind_memory > 0 && !debugging) {
+		md->rewind = rewind_new(m, xroar_cfg.rewind_interval,
+					(size_t)xroar_cfg.rewind_memory * 1024);
+	}
+
+	// User breakpoints from the command line
+	for (struct slist *l = xroar_cfg.bp_list; l; l = l->next) {
+		sds out = sdsempty();
+		if (bp_cmd_exec(md->bp_cmd, (const char *)l->data, &out) != 0) {
+			LOG_WARN("-bp: %s", out);
+		} else {
+			LOG_PRINT("%s", out);
+		}
+		sdsfree(out);
+	}
+
 	return m;
 }
 
+static void add_rom_crc(struct machine_dragon *md, uint32_t crc) {
+	uint8_t buf[4] = { crc >> 24, crc >> 16, crc >> 8, crc };
+	md->crc_roms = crc32_block(md->crc_roms, buf, sizeof(buf));
+}
+
+static uint32_t dragon_rom_crc(struct machine *m) {
+	struct machine_dragon *md = (struct machine_dragon *)m;
+	return md->crc_roms;
+}
+
 // Called from part_free(), which handles freeing the struct itself
 static void dragon_free(struct part *p) {
 	struct machine_dragon *md = (struct machine_dragon *)p;
@@ -745,21 +977,47 @@ static void dragon_free(struct part *p) {
 	if (m->config && m->config->description) {
 		LOG_DEBUG(1, "Machine shutdown: %s\n", m->config->description);
 	}
+	if (md->idle_skip) {
+		LOG_DEBUG(1, "Idle skip: %llu cycles skipped (%.2fs)\n",
+			  (unsigned long long)md->idle_skipped_cycles,
+			  (double)md->idle_skipped_ticks / EVENT_TICK_RATE);
+	}
 	//m->remove_cart(m);
 #ifdef WANT_GDB_TARGET
 	if (md->gdb_interface) {
 		gdb_interface_free(md->gdb_interface);
 	}
 #endif
+	if (md->replay) {
+		replay_free(md->replay);
+	}
+	if (md->rewind) {
+		rewind_free(md->rewind);
+	}
 	if (md->keyboard_interface) {
 		keyboard_interface_free(md->keyboard_interface);
 	}
 	if (md->printer_interface) {
 		printer_interface_free(md->printer_interface);
 	}
+	if (md->profile) {
+		profile_write_callgrind(md->profile, xroar_cfg.profile_file,
+					xroar_cfg.profile_symbols);
+		profile_free(md->profile);
+	}
+#ifdef TRACE
+	if (md->tracebin) {
+		tracebin_free(md->tracebin);
+	}
+#endif
+	if (md->bp_cmd) {
+		bp_cmd_free(md->bp_cmd);
+	}
 	if (md->bp_session) {
 		bp_session_free(md->bp_session);
 	}
+	slist_free_full(md->rom_hooks, free);
+	free(md->hook_change);
 	ntsc_burst_free(md->ntsc_burst[3]);
 	ntsc_burst_free(md->ntsc_burst[2]);
 	ntsc_burst_free(md->ntsc_burst[1]);
@@ -773,10 +1031,15 @@ static void dragon_free(struct part *p) {
 static void dragon_insert_cart(struct machine *m, struct cart *c) {
 	struct machine_dragon *md = (struct machine_dragon *)m;
 	m->remove_cart(m);
+	if (md->replay)
+		replay_clear(md->replay);
+	if (md->rewind)
+		rewind_clear(md->rewind);
 	if (c) {
 		assert(c->read != NULL);
 		assert(c->write != NULL);
 		md->cart = c;
+		invalidate_page_tables(md);
 		c->signal_firq = DELEGATE_AS1(void, bool, cart_firq, md);
 		c->signal_nmi = DELEGATE_AS1(void, bool, cart_nmi, md);
 		c->signal_halt = DELEGATE_AS1(void, bool, cart_halt, md);
@@ -786,15 +1049,19 @@ static void dragon_insert_cart(struct machine *m, struct cart *c) {
 
 static void dragon_remove_cart(struct machine *m) {
 	struct machine_dragon *md = (struct machine_dragon *)m;
-	(void)md;
+	if (md->replay)
+		replay_clear(md->replay);
+	if (md->rewind)
+		rewind_clear(md->rewind);
 	part_free((struct part *)md->cart);
 	md->cart = NULL;
+	invalidate_page_tables(md);
 }
 
 static void dragon_reset(struct machine *m, _Bool hard) {
 	struct machine_dragon *md = (struct machine_dragon *)m;
-	xroar_set_keymap(1, xroar_machine_config->keymap);
-	switch (xroar_machine_config->tv_standard) {
+	xroar_set_keymap(1, xroar_context->machine_config->keymap);
+	switch (xroar_context->machine_config->tv_standard) {
 	case TV_PAL: default:
 		xroar_set_cross_colour(1, VO_PHASE_OFF);
 		break;
@@ -803,6 +1070,11 @@ static void dragon_reset(struct machine *m, _Bool hard) {
 		xroar_set_cross_colour(1, VO_PHASE_KBRW);
 		break;
 	}
+	// History can't be replayed across a reset
+	if (md->replay)
+		replay_clear(md->replay);
+	if (md->rewind)
+		rewind_clear(md->rewind);
 	if (hard) {
 		/* Intialise RAM contents */
 		int loc = 0, val = 0xff;
@@ -818,6 +1090,14 @@ static void dragon_reset(struct machine *m, _Bool hard) {
 	}
 	mc6821_reset(md->PIA0);
 	mc6821_reset(md->PIA1);
+	md->sync_irq = 1;
+	md->update_pages = 1;
+#ifdef WANT_PREDECODE
+	// ROM or RAM may have been reloaded
+	mc6809_predecode_flush(md->CPU0);
+#endif
+	md->idle_dirty = 1;
+	md->idle_nwait = 0;
 	if (md->cart && md->cart->reset) {
 		md->cart->reset(md->cart);
 	}
@@ -828,37 +1108,121 @@ static void dragon_reset(struct machine *m, _Bool hard) {
 	printer_reset(md->printer_interface);
 }
 
+#ifdef WANT_GDB_TARGET
+static _Bool reverse_step(struct machine_dragon *md);
+static _Bool reverse_continue(struct machine_dragon *md);
+
+// Run under debugger control, stopping for breakpoints.
+
+static void debug_run(struct machine_dragon *md, int ncycles) {
+	md->stop_signal = 0;
+	md->cycles += ncycles;
+	if (md->replay) {
+		replay_sync(md->replay);
+		// Don't run past the end of recorded history
+		if (replay_in_past(md->replay)) {
+			uint64_t left = replay_end(md->replay) - replay_time(md->replay);
+			if ((uint64_t)md->cycles > left)
+				md->cycles = left + 1;
+		}
+		replay_enter(md->replay);
+	}
+	md->sync_irq = 1;
+	md->idle_dirty = 1;
+	check_page_table(md);
+	md->CPU0->running = 1;
+	md->CPU0->run(md->CPU0);
+	if (md->replay) {
+		replay_leave(md->replay);
+	}
+	if (md->stop_signal != 0) {
+		gdb_stop(md->gdb_interface, md->stop_signal);
+	} else if (md->replay) {
+		replay_update(md->replay);
+	}
+}
+
+// Range stepping: stop before the first instruction outside the range,
+// after always executing the one the step started on.
+
+static void range_step_instruction_hook(void *sptr) {
+	struct machine_dragon *md = sptr;
+	if (md->range_first) {
+		md->range_first = 0;
+		return;
+	}
+	unsigned pc = md->CPU0->reg_pc;
+	if (pc < md->range_start || pc >= md->range_end) {
+		dragon_signal(&md->public, MACHINE_SIGTRAP);
+		return;
+	}
+	DELEGATE_SAFE_CALL0(md->range_saved_hook);
+}
+#endif
+
 static enum machine_run_state dragon_run(struct machine *m, int ncycles) {
 	struct machine_dragon *md = (struct machine_dragon *)m;
 
 #ifdef WANT_GDB_TARGET
 	if (md->gdb_interface) {
-		switch (gdb_run_lock(md->gdb_interface)) {
+		int run_state = gdb_run_poll(md->gdb_interface);
+		if (run_state != gdb_run_state_range_step)
+			md->range_active = 0;
+		switch (run_state) {
 		case gdb_run_state_stopped:
 			return machine_run_state_stopped;
 		case gdb_run_state_running:
-			md->stop_signal = 0;
-			md->cycles += ncycles;
-			md->CPU0->running = 1;
-			md->CPU0->run(md->CPU0);
-			if (md->stop_signal != 0) {
-				gdb_stop(md->gdb_interface, md->stop_signal);
+			debug_run(md, ncycles);
+			break;
+		case gdb_run_state_range_step:
+			// A range step may take many runs to complete
+			if (!md->range_active) {
+				gdb_get_step_range(md->gdb_interface, &md->range_start, &md->range_end);
+				md->range_active = 1;
+				md->range_first = 1;
 			}
+			md->range_saved_hook = md->CPU0->instruction_hook;
+			md->CPU0->instruction_hook = DELEGATE_AS0(void, range_step_instruction_hook, md);
+			debug_run(md, ncycles);
+			md->CPU0->instruction_hook = md->range_saved_hook;
 			break;
 		case gdb_run_state_single_step:
+			if (md->replay) {
+				replay_sync(md->replay);
+				replay_enter(md->replay);
+			}
 			m->single_step(m);
+			if (md->replay) {
+				replay_leave(md->replay);
+			}
 			gdb_single_step(md->gdb_interface);
 			break;
+		case gdb_run_state_reverse_step:
+			if (md->replay) {
+				replay_sync(md->replay);
+				gdb_reverse_stop(md->gdb_interface, !reverse_step(md));
+			}
+			break;
+		case gdb_run_state_reverse_continue:
+			if (md->replay) {
+				replay_sync(md->replay);
+				gdb_reverse_stop(md->gdb_interface, !reverse_continue(md));
+			}
+			break;
 		default:
 			break;
 		}
-		gdb_run_unlock(md->gdb_interface);
 		return machine_run_state_ok;
 	} else {
 #endif
 		md->cycles += ncycles;
+		md->sync_irq = 1;
+		md->idle_dirty = 1;
+		check_page_table(md);
 		md->CPU0->running = 1;
 		md->CPU0->run(md->CPU0);
+		if (md->rewind)
+			rewind_update(md->rewind);
 		return machine_run_state_ok;
 #ifdef WANT_GDB_TARGET
 	}
@@ -868,6 +1232,8 @@ static enum machine_run_state dragon_run(struct machine *m, int ncycles) {
 static void dragon_single_step(struct machine *m) {
 	struct machine_dragon *md = (struct machine_dragon *)m;
 	md->single_step = 1;
+	md->sync_irq = 1;
+	check_page_table(md);
 	md->CPU0->running = 0;
 	md->CPU0->instruction_posthook = DELEGATE_AS0(void, dragon_instruction_posthook, md);
 	do {
@@ -877,6 +1243,119 @@ static void dragon_single_step(struct machine *m) {
 	update_vdg_mode(md);
 }
 
+#ifdef WANT_GDB_TARGET
+
+/* Reverse execution.  Earlier points in history are reached by restoring a
+ * checkpoint and running forward with the instruction hook replaced.  Runs
+ * are split into short chunks so that time can be checked between them even
+ * if no instructions start (e.g. while halted). */
+
+static void reverse_instruction_hook(void *sptr) {
+	struct machine_dragon *md = sptr;
+	uint64_t now = replay_time(md->replay);
+	if (now >= md->reverse_target) {
+		// Stopping here, so breakpoints aren't checked, but changes
+		// logged for this instruction must still be made: it won't
+		// be hooked again when execution resumes.
+		replay_instruction_hook(md);
+		md->reverse_done = 1;
+		md->CPU0->running = 0;
+		return;
+	}
+	if (md->reverse_mode == REVERSE_FIND) {
+		md->reverse_found = now;
+		md->reverse_have_found = 1;
+	}
+	// The saved hook is always called, as it also reapplies any changes
+	// logged by ROM hooks.  Breakpoint hits are only noted while
+	// scanning, and never stop the run.
+	DELEGATE_SAFE_CALL0(md->reverse_saved_hook);
+	if (md->stop_signal) {
+		md->stop_signal = 0;
+		if (md->reverse_mode == REVERSE_SCAN) {
+			md->reverse_found = now;
+			md->reverse_have_found = 1;
+		}
+		md->CPU0->running = 1;
+	}
+}
+
+// Run from the current point in the past up to reverse_target.
+
+static void reverse_run(struct machine_dragon *md) {
+	md->reverse_saved_hook = md->CPU0->instruction_hook;
+	md->CPU0->instruction_hook = DELEGATE_AS0(void, reverse_instruction_hook, md);
+	md->reverse_done = 0;
+	replay_enter(md->replay);
+	while (!md->reverse_done) {
+		uint64_t now = replay_time(md->replay);
+		if (now >= md->reverse_target)
+			break;
+		uint64_t left = md->reverse_target - now;
+		// One extra cycle lets the hook see an instruction starting
+		// exactly at the target
+		md->cycles = (left < EVENT_MS(10)) ? (int)left + 1 : EVENT_MS(10);
+		md->stop_signal = 0;
+		md->sync_irq = 1;
+		check_page_table(md);
+		md->CPU0->running = 1;
+		md->CPU0->run(md->CPU0);
+		if (md->stop_signal && md->reverse_mode == REVERSE_SCAN) {
+			// Watchpoint: note the point after the access
+			now = replay_time(md->replay);
+			if (now < md->reverse_target) {
+				md->reverse_found = now;
+				md->reverse_have_found = 1;
+			}
+		}
+		md->stop_signal = 0;
+	}
+	replay_leave(md->replay);
+	md->CPU0->instruction_hook = md->reverse_saved_hook;
+	md->cycles = 0;
+}
+
+// Search back from 'start' one checkpoint interval at a time, until a run
+// in the current reverse mode finds something.  Returns false on reaching
+// the beginning of history, leaving the machine at the oldest checkpoint.
+
+static _Bool reverse_search(struct machine_dragon *md, uint64_t start) {
+	uint64_t to = start;
+	md->reverse_have_found = 0;
+	while (!md->reverse_have_found) {
+		if (to == 0 || !replay_seek(md->replay, to - 1)) {
+			if (to != start)
+				replay_seek(md->replay, to);
+			return 0;
+		}
+		uint64_t from = replay_time(md->replay);
+		// A step must find the instruction immediately before the
+		// start, so always runs up to it
+		md->reverse_target = (md->reverse_mode == REVERSE_FIND) ? start : to;
+		reverse_run(md);
+		to = from;
+	}
+	// Go to what was found
+	replay_seek(md->replay, md->reverse_found);
+	md->reverse_mode = REVERSE_SEEK;
+	md->reverse_target = md->reverse_found;
+	reverse_run(md);
+	update_vdg_mode(md);
+	return 1;
+}
+
+static _Bool reverse_step(struct machine_dragon *md) {
+	md->reverse_mode = REVERSE_FIND;
+	return reverse_search(md, replay_time(md->replay));
+}
+
+static _Bool reverse_continue(struct machine_dragon *md) {
+	md->reverse_mode = REVERSE_SCAN;
+	return reverse_search(md, replay_time(md->replay));
+}
+
+#endif
+
 /*
  * Stop emulation and set stop_signal to reflect the reason.
  */
@@ -893,10 +1372,118 @@ static void dragon_trap(void *sptr) {
 	dragon_signal(m, MACHINE_SIGTRAP);
 }
 
+// Machine breakpoints are ROM call intercepts: fast tape loading, typed
+// commands, printing, etc.  They act on state outside the machine (tape
+// position, the queue of typed text), so can't simply be run again when
+// reviewing history.  Instead, the change each makes to the CPU registers
+// and memory is logged, and reapplied by replay_instruction_hook() in the
+// past.
+
+struct rom_hook {
+	struct breakpoint bp;
+	struct machine_dragon *md;
+	struct breakpoint const *ref;
+	DELEGATE_T0(void) handler;
+};
+
+// A logged change is the CPU registers as from idle_get_regs(), followed by
+// the address and value of each byte written.
+
+#define HOOK_REGS_SIZE (IDLE_NREGS * 2)
+
+static void hook_change_reserve(struct machine_dragon *md, size_t len) {
+	if (len > md->hook_change_size) {
+		md->hook_change_size = len + 256;
+		md->hook_change = xrealloc(md->hook_change, md->hook_change_size);
+	}
+}
+
+static void rom_hook_handler(void *sptr) {
+	struct rom_hook *rh = sptr;
+	struct machine_dragon *md = rh->md;
+	if (!md->replay) {
+		DELEGATE_CALL0(rh->handler);
+		return;
+	}
+	if (in_past(md))
+		return;
+
+	uint16_t regs0[IDLE_NREGS];
+	idle_get_regs(md, regs0);
+	md->hook_change_len = HOOK_REGS_SIZE;
+	hook_change_reserve(md, md->hook_change_len);
+	md->hook_logging = 1;
+	// Handler may remove its own breakpoint, freeing rh
+	DELEGATE_CALL0(rh->handler);
+	md->hook_logging = 0;
+
+	uint16_t regs1[IDLE_NREGS];
+	idle_get_regs(md, regs1);
+	if (md->hook_change_len == HOOK_REGS_SIZE && memcmp(regs0, regs1, sizeof(regs0)) == 0)
+		return;
+	for (int i = 0; i < IDLE_NREGS; i++) {
+		md->hook_change[i*2] = regs1[i] >> 8;
+		md->hook_change[i*2+1] = regs1[i];
+	}
+	replay_log_change(md->replay, md->hook_change, md->hook_change_len);
+}
+
+// Called from dragon_write_byte() while a ROM hook runs.
+
+static void hook_log_write(struct machine_dragon *md, unsigned A, unsigned D) {
+	hook_change_reserve(md, md->hook_change_len + 3);
+	md->hook_change[md->hook_change_len++] = A >> 8;
+	md->hook_change[md->hook_change_len++] = A;
+	md->hook_change[md->hook_change_len++] = D;
+}
+
+// Installed as the breakpoint session replay hook while reverse execution
+// is enabled.  In the past, makes any changes logged by ROM hooks for the
+// current instruction.
+
+static void replay_instruction_hook(void *sptr) {
+	struct machine_dragon *md = sptr;
+	if (!in_past(md))
+		return;
+	const uint8_t *change;
+	size_t size;
+	while ((change = replay_change(md->replay, &size))) {
+		if (size < HOOK_REGS_SIZE)
+			continue;
+		for (size_t i = HOOK_REGS_SIZE; i + 3 <= size; i += 3) {
+			dragon_write_byte(&md->public, (change[i] << 8) | change[i+1], change[i+2]);
+		}
+		struct MC6809 *cpu = md->CPU0;
+		cpu->reg_pc = (change[0] << 8) | change[1];
+		cpu->reg_cc = change[2];
+		cpu->reg_dp = change[3];
+		cpu->reg_d = (change[4] << 8) | change[5];
+		cpu->reg_x = (change[6] << 8) | change[7];
+		cpu->reg_y = (change[8] << 8) | change[9];
+		cpu->reg_u = (change[10] << 8) | change[11];
+		cpu->reg_s = (change[12] << 8) | change[13];
+		if (cpu->variant == MC6809_VARIANT_HD6309) {
+			struct HD6309 *hcpu = (struct HD6309 *)cpu;
+			hcpu->reg_w = (change[14] << 8) | change[15];
+			hcpu->reg_v = (change[16] << 8) | change[17];
+			hcpu->reg_md = change[19];
+		}
+	}
+}
+
+static struct rom_hook *find_rom_hook(struct machine_dragon *md, struct breakpoint const *ref) {
+	for (struct slist *iter = md->rom_hooks; iter; iter = iter->next) {
+		struct rom_hook *rh = iter->data;
+		if (rh->ref == ref)
+			return rh;
+	}
+	return NULL;
+}
+
 static void dragon_bp_add_n(struct machine *m, struct machine_bp *list, int n, void *sptr) {
 	struct machine_dragon *md = (struct machine_dragon *)m;
 	for (int i = 0; i < n; i++) {
-		if ((list[i].add_cond & BP_MACHINE_ARCH) && xroar_machine_config->architecture != list[i].cond_machine_arch)
+		if ((list[i].add_cond & BP_MACHINE_ARCH) && xroar_context->machine_config->architecture != list[i].cond_machine_arch)
 			continue;
 		if ((list[i].add_cond & BP_CRC_COMBINED) && (!md->has_combined || !crclist_match(list[i].cond_crc_combined, md->crc_combined)))
 			continue;
@@ -904,16 +1491,30 @@ static void dragon_bp_add_n(struct machine *m, struct machine_bp *list, int n, v
 			continue;
 		if ((list[i].add_cond & BP_CRC_BAS) && (!md->has_bas || !crclist_match(list[i].cond_crc_bas, md->crc_bas)))
 			continue;
-		list[i].bp.handler.sptr = sptr;
-		bp_add(md->bp_session, &list[i].bp);
+		if (find_rom_hook(md, &list[i].bp))
+			continue;
+		struct rom_hook *rh = xmalloc(sizeof(*rh));
+		*rh = (struct rom_hook){0};
+		rh->bp = list[i].bp;
+		rh->bp.handler = DELEGATE_AS0(void, rom_hook_handler, rh);
+		rh->md = md;
+		rh->ref = &list[i].bp;
+		rh->handler = list[i].bp.handler;
+		rh->handler.sptr = sptr;
+		md->rom_hooks = slist_prepend(md->rom_hooks, rh);
+		bp_add(md->bp_session, &rh->bp, rh);
 	}
 }
 
 static void dragon_bp_remove_n(struct machine *m, struct machine_bp *list, int n) {
 	struct machine_dragon *md = (struct machine_dragon *)m;
-	(void)md;
 	for (int i = 0; i < n; i++) {
-		bp_remove(md->bp_session, &list[i].bp);
+		struct rom_hook *rh = find_rom_hook(md, &list[i].bp);
+		if (!rh)
+			continue;
+		bp_remove(md->bp_session, &rh->bp);
+		md->rom_hooks = slist_remove(md->rom_hooks, rh);
+		free(rh);
 	}
 }
 
@@ -1006,8 +1607,15 @@ static void *dragon_get_component(struct machine *m, const char *cname) {
 	} else if (0 == strcmp(cname, "PIA1")) {
 		return md->PIA1;
 	} else if (0 == strcmp(cname, "RAM0")) {
+#ifdef WANT_PREDECODE
+		// RAM may be written directly
+		mc6809_predecode_flush(md->CPU0);
+#endif
 		return &md->ram0;
 	} else if (0 == strcmp(cname, "RAM1")) {
+#ifdef WANT_PREDECODE
+		mc6809_predecode_flush(md->CPU0);
+#endif
 		return &md->ram1;
 	}
 	return NULL;
@@ -1023,6 +1631,14 @@ static void *dragon_get_interface(struct machine *m, const char *ifname) {
 		return md->keyboard_interface;
 	} else if (0 == strcmp(ifname, "printer")) {
 		return md->printer_interface;
+	} else if (0 == strcmp(ifname, "bp-cmd")) {
+		return md->bp_cmd;
+	} else if (0 == strcmp(ifname, "replay")) {
+		return md->replay;
+	} else if (0 == strcmp(ifname, "sound")) {
+		return md->snd;
+	} else if (0 == strcmp(ifname, "tape")) {
+		return md->tape_interface;
 	} else if (0 == strcmp(ifname, "tape-update-audio")) {
 		return update_audio_from_tape;
 	}
@@ -1045,9 +1661,15 @@ static void dragon_set_vo_cmp(struct machine *m, int mode) {
 	}
 }
 
-static void dragon_set_frameskip(struct machine *m, unsigned fskip) {
+static void dragon_set_frameskip(struct machine *m, int fskip) {
 	struct machine_dragon *md = (struct machine_dragon *)m;
-	md->frameskip = fskip;
+	md->frameskip_auto = (fskip == ANY_AUTO);
+	if (md->frameskip_auto) {
+		frameskip_auto_reset();
+		md->frameskip = 0;
+	} else {
+		md->frameskip = (fskip > 0) ? fskip : 0;
+	}
 }
 
 static void dragon_set_ratelimit(struct machine *m, _Bool ratelimit) {
@@ -1055,6 +1677,30 @@ static void dragon_set_ratelimit(struct machine *m, _Bool ratelimit) {
 	sound_set_ratelimit(md->snd, ratelimit);
 }
 
+// Step back through rewind history.  The machine runs forward from the
+// snapshot restored to reach the exact frame, without rate limiting and
+// without displaying intermediate frames.
+
+static _Bool dragon_rewind(struct machine *m, unsigned nframes) {
+	struct machine_dragon *md = (struct machine_dragon *)m;
+	if (!md->rewind || !rewind_seek(md->rewind, nframes))
+		return 0;
+	_Bool ratelimit = md->snd->ratelimit;
+	sound_set_ratelimit(md->snd, 0);
+	while (rewind_replaying(md->rewind)) {
+		md->cycles = EVENT_MS(10);
+		md->sync_irq = 1;
+		md->idle_dirty = 1;
+		check_page_table(md);
+		md->CPU0->running = 1;
+		md->CPU0->run(md->CPU0);
+	}
+	md->cycles = 0;
+	sound_set_ratelimit(md->snd, ratelimit);
+	update_vdg_mode(md);
+	return 1;
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 // Used when single-stepping.
@@ -1075,7 +1721,157 @@ static uint16_t decode_Z(struct machine_dragon *md, unsigned Z) {
 	}
 }
 
+// SAM register bits affecting the CPU memory map: page #1, memory size and
+// map type.
+#define SAM_MAP_BITS (0xe400)
+
+// Returns pointer to the RAM backing the page containing A, provided the page
+// maps contiguously to RAM entirely below limit.  Otherwise NULL.
+
+static uint8_t *ram_page(struct machine_dragon *md, _Bool RnW, unsigned A, unsigned limit) {
+	_Bool RAS;
+	unsigned Z;
+	sam_decode(md->SAM0, RnW, A, &RAS, &Z);
+	unsigned base = decode_Z(md, Z);
+	if (base + 0xff >= limit)
+		return NULL;
+	for (unsigned i = 1; i < 0x100; i++) {
+		sam_decode(md->SAM0, RnW, A + i, &RAS, &Z);
+		if (decode_Z(md, Z) != base + i)
+			return NULL;
+	}
+	return md->ram + base;
+}
+
+#ifdef WANT_PREDECODE
+static int32_t predecode_base(struct machine_dragon *md, uint8_t const *p) {
+	int32_t base = -1;
+	if (p >= md->ram && p < md->ram + sizeof(md->ram)) {
+		base = p - md->ram;
+	} else if (p >= md->rom0 && p < md->rom0 + sizeof(md->rom0)) {
+		base = 0x10000 + (p - md->rom0);
+	} else if (p >= md->rom1 && p < md->rom1 + sizeof(md->rom1)) {
+		base = 0x14000 + (p - md->rom1);
+	}
+	return (base & 0xff) ? -1 : base;
+}
+#endif
+
+static void build_page_table(struct machine_dragon *md, struct page_table *pt) {
+	pt->valid = 1;
+	for (unsigned page = 0; page < 0x100; page++) {
+		pt->read[page] = NULL;
+		pt->write[page] = NULL;
+#ifdef WANT_PREDECODE
+		pt->predecode[page] = -1;
+#endif
+	}
+	// A cartridge that needs to see every cycle forces full decode
+	if (md->cart && md->cart->snoop)
+		return;
+	// Page 0xff is I/O, so always needs full decode
+	for (unsigned page = 0; page < 0xff; page++) {
+		unsigned A = page << 8;
+		_Bool RAS;
+		unsigned Z;
+		unsigned S = sam_decode(md->SAM0, 1, A, &RAS, &Z);
+		if (S == 0 && RAS) {
+			pt->read[page] = ram_page(md, 1, A, md->ram_size);
+		} else if (S == 1 || S == 2) {
+			pt->read[page] = md->rom + (A & 0x3fff);
+		}
+#ifdef WANT_PREDECODE
+		if (pt->read[page])
+			pt->predecode[page] = predecode_base(md, pt->read[page]);
+#endif
+		// Only writes that would not otherwise be decoded by
+		// write_byte() before going to RAM
+		S = sam_decode(md->SAM0, 0, A, &RAS, &Z);
+		if (RAS && (S == 7 || (!(S & 4) && !md->unexpanded_dragon32))) {
+			pt->write[page] = ram_page(md, 0, A, 0x10000);
+		}
+	}
+}
+
+// Page table index from the SAM map bits (TY, M1, M0, P1) and ROM bank.
+
+static unsigned page_table_index(struct machine_dragon *md) {
+	unsigned reg = sam_get_register(md->SAM0) & SAM_MAP_BITS;
+	unsigned map = (reg >> 12) | ((reg >> 10) & 0x01);
+	return (map << 1) | (md->rom == md->rom1);
+}
+
+static void invalidate_page_tables(struct machine_dragon *md) {
+	for (unsigned i = 0; i < NPAGE_TABLES; i++)
+		md->page_tables[i].valid = 0;
+	md->update_pages = 1;
+}
+
+static void update_page_table(struct machine_dragon *md) {
+	md->update_pages = 0;
+	if (md->cart != md->pages_cart) {
+		invalidate_page_tables(md);
+		md->update_pages = 0;
+		md->pages_cart = md->cart;
+	}
+	unsigned index = page_table_index(md);
+	struct page_table *pt = &md->page_tables[index];
+	if (!pt->valid)
+		build_page_table(md, pt);
+	md->pages_index = index;
+	md->read_page = pt->read;
+	md->write_page = pt->write;
+#ifdef WANT_PREDECODE
+	md->CPU0->predecode_page = pt->predecode;
+#endif
+}
+
+static void check_page_table(struct machine_dragon *md) {
+	if (md->update_pages || page_table_index(md) != md->pages_index
+	    || md->cart != md->pages_cart) {
+		update_page_table(md);
+	}
+}
+
+// True while reviewing history.  Nothing outside the machine should be
+// affected, and inputs come from the replay log.
+
+static _Bool in_past(struct machine_dragon *md) {
+	return md->replay && replay_in_past(md->replay);
+}
+
+static unsigned read_input(struct machine_dragon *md, unsigned id, unsigned value) {
+	if (md->replay)
+		return replay_read(md->replay, id, value);
+	if (md->rewind)
+		return rewind_read(md->rewind, id, value);
+	return value;
+}
+
+static void set_signal(struct machine_dragon *md, unsigned id, unsigned value) {
+	if (md->replay && !replay_signal(md->replay, id, value))
+		return;
+	apply_signal(md, id, value);
+}
+
+// Cartridge I/O reads are logged as inputs.  Debugger accesses are not, and
+// while reviewing history they don't reach the cartridge at all.
+
+static uint8_t cart_read_io(struct machine_dragon *md, unsigned A) {
+	uint8_t D = md->CPU0->D;
+	if (!in_past(md))
+		D = md->cart->read(md->cart, A, 1, 0, D);
+	if (md->noclock)
+		return D;
+	return read_input(md, DRAGON_INPUT_CART_IO, D);
+}
+
 static void read_byte(struct machine_dragon *md, unsigned A) {
+	uint8_t *page = md->read_page[A >> 8];
+	if (page) {
+		md->CPU0->D = page[A & 0xff];
+		return;
+	}
 	// Thanks to CrAlt on #coco_chat for verifying that RAM accesses
 	// produce a different "null" result on his 16K CoCo
 	if (md->SAM0->RAS)
@@ -1105,9 +1901,11 @@ static void read_byte(struct machine_dragon *md, unsigned A) {
 	case 4:
 		if (md->relaxed_pia_decode) {
 			md->CPU0->D = mc6821_read(md->PIA0, A);
+			md->sync_irq = 1;
 		} else {
 			if ((A & 4) == 0) {
 				md->CPU0->D = mc6821_read(md->PIA0, A);
+				md->sync_irq = 1;
 			} else {
 				if (md->have_acia) {
 					/* XXX Dummy ACIA reads */
@@ -1131,11 +1929,12 @@ static void read_byte(struct machine_dragon *md, unsigned A) {
 	case 5:
 		if (md->relaxed_pia_decode || (A & 4) == 0) {
 			md->CPU0->D = mc6821_read(md->PIA1, A);
+			md->sync_irq = 1;
 		}
 		break;
 	case 6:
 		if (md->cart)
-			md->CPU0->D = md->cart->read(md->cart, A, 1, 0, md->CPU0->D);
+			md->CPU0->D = cart_read_io(md, A);
 		break;
 	default:
 		break;
@@ -1143,9 +1942,20 @@ static void read_byte(struct machine_dragon *md, unsigned A) {
 }
 
 static void write_byte(struct machine_dragon *md, unsigned A) {
-	if (md->cart) {
-		md->CPU0->D = md->cart->write(md->cart, A, 0, 0, md->CPU0->D);
-		if (md->cart->EXTMEM && 0 < md->SAM0->S && md->SAM0->S < 7) {
+	uint8_t *page = md->write_page[A >> 8];
+	if (page) {
+		page[A & 0xff] = md->CPU0->D;
+#ifdef WANT_PREDECODE
+		MC6809_PREDECODE_INVALIDATE(md->CPU0, (page - md->ram) + (A & 0xff));
+#endif
+		return;
+	}
+	// Cartridge state is not part of history, so writes are dropped while
+	// reviewing it
+	struct cart *cart = in_past(md) ? NULL : md->cart;
+	if (cart) {
+		md->CPU0->D = cart->write(cart, A, 0, 0, md->CPU0->D);
+		if (cart->EXTMEM && 0 < md->SAM0->S && md->SAM0->S < 7) {
 			return;
 		}
 	}
@@ -1156,26 +1966,29 @@ static void write_byte(struct machine_dragon *md, unsigned A) {
 			md->CPU0->D = md->rom[A & 0x3fff];
 			break;
 		case 3:
-			if (md->cart)
-				md->CPU0->D = md->cart->write(md->cart, A, 0, 1, md->CPU0->D);
+			if (cart)
+				md->CPU0->D = cart->write(cart, A, 0, 1, md->CPU0->D);
 			break;
 		case 4:
 			if (!md->is_dragon || md->unexpanded_dragon32) {
 				mc6821_write(md->PIA0, A, md->CPU0->D);
+				md->sync_irq = 1;
 			} else {
 				if ((A & 4) == 0) {
 					mc6821_write(md->PIA0, A, md->CPU0->D);
+					md->sync_irq = 1;
 				}
 			}
 			break;
 		case 5:
 			if (md->relaxed_pia_decode || (A & 4) == 0) {
 				mc6821_write(md->PIA1, A, md->CPU0->D);
+				md->sync_irq = 1;
 			}
 			break;
 		case 6:
-			if (md->cart)
-				md->CPU0->D = md->cart->write(md->cart, A, 1, 0, md->CPU0->D);
+			if (cart)
+				md->CPU0->D = cart->write(cart, A, 1, 0, md->CPU0->D);
 			break;
 		default:
 			break;
@@ -1184,22 +1997,46 @@ static void write_byte(struct machine_dragon *md, unsigned A) {
 	if (md->SAM0->RAS) {
 		unsigned Z = decode_Z(md, md->SAM0->Z);
 		md->ram[Z] = md->CPU0->D;
+#ifdef WANT_PREDECODE
+		MC6809_PREDECODE_INVALIDATE(md->CPU0, Z);
+#endif
 	}
 }
 
 static void cpu_cycle(void *sptr, int ncycles, _Bool RnW, uint16_t A) {
 	struct machine_dragon *md = sptr;
-	// Changing the SAM VDG mode can affect its idea of the current VRAM
-	// address, so get the VDG output up to date:
-	if (!RnW && A >= 0xffc0 && A < 0xffc6) {
-		update_vdg_mode(md);
+	// Memory map changes take effect after the SAM has processed the
+	// write, so the page table is updated on the following cycle.
+	if (md->update_pages) {
+		update_page_table(md);
+	}
+	if (!RnW && A >= 0xffc0 && A < 0xffe0) {
+		if (A < 0xffc6) {
+			// Changing the SAM VDG mode can affect its idea of the
+			// current VRAM address, so get the VDG output up to
+			// date:
+			update_vdg_mode(md);
+		} else if (A >= 0xffd4) {
+			md->update_pages = 1;
+		}
 	}
 	md->cycles -= ncycles;
 	if (md->cycles <= 0) md->CPU0->running = 0;
-	event_current_tick += ncycles;
-	event_run_queue(&MACHINE_EVENT_LIST);
-	MC6809_IRQ_SET(md->CPU0, md->PIA0->a.irq || md->PIA0->b.irq);
-	MC6809_FIRQ_SET(md->CPU0, md->PIA1->a.irq || md->PIA1->b.irq);
+	md->ctx->current_tick += ncycles;
+	STATS_ADD(STATS_MEM_CYCLE, 1);
+	// The event list caches its earliest deadline, so in the common case
+	// this is a single comparison.  Event handlers may affect PIA state.
+	if (event_pending(&md->ctx->machine_events)) {
+		event_run_queue(&md->ctx->machine_events);
+		md->sync_irq = 1;
+	}
+	// Interrupt lines only need recomputing if something could have
+	// changed PIA interrupt state since they were last set.
+	if (md->sync_irq) {
+		md->sync_irq = 0;
+		MC6809_IRQ_SET(md->CPU0, md->PIA0->a.irq || md->PIA0->b.irq);
+		MC6809_FIRQ_SET(md->CPU0, md->PIA1->a.irq || md->PIA1->b.irq);
+	}
 
 	if (RnW) {
 		read_byte(md, A);
@@ -1208,11 +2045,16 @@ static void cpu_cycle(void *sptr, int ncycles, _Bool RnW, uint16_t A) {
 		write_byte(md, A);
 		bp_wp_write_hook(md->bp_session, A);
 	}
+
+	if (md->idle_skip) {
+		idle_cycle(md, ncycles, RnW, A);
+	}
 }
 
 static void cpu_cycle_noclock(void *sptr, int ncycles, _Bool RnW, uint16_t A) {
 	struct machine_dragon *md = sptr;
 	(void)ncycles;
+	md->sync_irq = 1;
 	if (RnW) {
 		read_byte(md, A);
 	} else {
@@ -1220,6 +2062,161 @@ static void cpu_cycle_noclock(void *sptr, int ncycles, _Bool RnW, uint16_t A) {
 	}
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Idle skip.
+//
+// While the CPU is spinning waiting for an interrupt, nothing it does can
+// affect the rest of the machine, and nothing can affect it until the next
+// scheduled event.  Time is advanced directly to just before that event,
+// accounting for the cycles the CPU would have run.  Emulated state ends up
+// exactly as if those cycles had been run.
+//
+// Two cases are handled:
+//
+// - SYNC and CWAI: the CPU repeatedly runs "dead" cycles on the bus.
+//
+// - Loops like "BRA *", or polling a flag in RAM that an interrupt handler
+//   will change: the CPU returns to the same instruction with the same
+//   register contents, without any store or I/O access in between.  No
+//   list of known addresses is needed, so this works for any such loop in
+//   ROM or RAM.
+//
+// The SAM may alternate between two timing states for a repeated sequence
+// of accesses, so time is always skipped in multiples of two iterations,
+// timed from the two most recent.
+
+static _Bool idle_cpu_waiting(struct machine_dragon *md) {
+	if (md->CPU0->variant == MC6809_VARIANT_HD6309) {
+		struct HD6309 *hcpu = (struct HD6309 *)md->CPU0;
+		return hcpu->state == hd6309_state_sync
+		       || hcpu->state == hd6309_state_cwai_check_halt;
+	}
+	return md->CPU0->state == mc6809_state_sync
+	       || md->CPU0->state == mc6809_state_cwai_check_halt;
+}
+
+static void idle_get_regs(struct machine_dragon *md, uint16_t *regs) {
+	struct MC6809 *cpu = md->CPU0;
+	regs[0] = cpu->reg_pc;
+	regs[1] = (cpu->reg_cc << 8) | cpu->reg_dp;
+	regs[2] = cpu->reg_d;
+	regs[3] = cpu->reg_x;
+	regs[4] = cpu->reg_y;
+	regs[5] = cpu->reg_u;
+	regs[6] = cpu->reg_s;
+	if (cpu->variant == MC6809_VARIANT_HD6309) {
+		struct HD6309 *hcpu = (struct HD6309 *)cpu;
+		regs[7] = hcpu->reg_w;
+		regs[8] = hcpu->reg_v;
+		regs[9] = hcpu->reg_md;
+	} else {
+		regs[7] = regs[8] = regs[9] = 0;
+	}
+}
+
+// Skip as many whole periods as possible without reaching the next event or
+// the end of the current run.
+
+static void idle_skip(struct machine_dragon *md, event_ticks period, unsigned ncycles) {
+	struct MC6809 *cpu = md->CPU0;
+	if (!cpu->running || md->single_step || md->trace)
+		return;
+	// Reverse execution needs to see every instruction in the past
+	if (in_past(md))
+		return;
+	// Any interrupt activity means the CPU may be about to stop idling
+	if (cpu->halt || cpu->nmi || cpu->firq || cpu->irq)
+		return;
+	if (cpu->nmi_latch || cpu->firq_latch || cpu->irq_latch)
+		return;
+	if (cpu->nmi_active || cpu->firq_active || cpu->irq_active)
+		return;
+	// Skipped cycles would not be seen by the cartridge or watchpoints
+	if ((md->cart && md->cart->snoop) || bp_wp_active(md->bp_session))
+		return;
+
+	int limit = md->cycles;
+	if (md->ctx->machine_events.nevents) {
+		int dt = event_tick_delta(md->ctx->machine_events.next_tick, md->ctx->current_tick);
+		if (dt < limit)
+			limit = dt;
+	}
+	if (limit <= 0 || period == 0)
+		return;
+	unsigned n = (unsigned)(limit - 1) / period;
+	if (n == 0)
+		return;
+
+	event_ticks skip = n * period;
+	md->ctx->current_tick += skip;
+	md->cycles -= skip;
+	for (int i = 0; i < 3; i++) {
+		md->idle_tick[i] += skip;
+	}
+	md->idle_skipped_ticks += skip;
+	md->idle_skipped_cycles += (uint64_t)n * ncycles;
+}
+
+// Start watching for a loop from the current instruction
+
+static void idle_loop_start(struct machine_dragon *md, uint16_t *regs) {
+	memcpy(md->idle_regs, regs, sizeof(md->idle_regs));
+	md->idle_dirty = 0;
+	md->idle_count = 0;
+	md->idle_ninstructions = 0;
+	md->idle_tick[0] = md->ctx->current_tick;
+	md->idle_cycles[0] = md->idle_ncycles;
+}
+
+static void idle_instruction_hook(void *sptr) {
+	struct machine_dragon *md = sptr;
+	uint16_t regs[IDLE_NREGS];
+	if (md->CPU0->reg_pc != md->idle_regs[0]) {
+		// Only short loops are considered
+		if (++md->idle_ninstructions > IDLE_MAX_LOOP) {
+			idle_get_regs(md, regs);
+			idle_loop_start(md, regs);
+		}
+		return;
+	}
+	idle_get_regs(md, regs);
+	if (md->idle_dirty || memcmp(regs, md->idle_regs, sizeof(regs)) != 0) {
+		idle_loop_start(md, regs);
+		return;
+	}
+	md->idle_ninstructions = 0;
+	md->idle_tick[2] = md->idle_tick[1];
+	md->idle_tick[1] = md->idle_tick[0];
+	md->idle_tick[0] = md->ctx->current_tick;
+	md->idle_cycles[2] = md->idle_cycles[1];
+	md->idle_cycles[1] = md->idle_cycles[0];
+	md->idle_cycles[0] = md->idle_ncycles;
+	// The first iteration may differ in timing, so wait until the last two
+	// are known to have started with the SAM in a repeating state.
+	if (++md->idle_count < 3)
+		return;
+	idle_skip(md, md->idle_tick[0] - md->idle_tick[2],
+		  md->idle_cycles[0] - md->idle_cycles[2]);
+}
+
+static void idle_cycle(struct machine_dragon *md, int ncycles, _Bool RnW, uint16_t A) {
+	md->idle_ncycles++;
+	if (!RnW || (md->SAM0->S >= 3 && md->SAM0->S <= 6)) {
+		md->idle_dirty = 1;
+	}
+	// Consecutive dead cycles all have the same timing after the first
+	if (RnW && A == 0xffff && idle_cpu_waiting(md)) {
+		if (md->idle_nwait++ > 0) {
+			idle_skip(md, 2 * ncycles, 2);
+		}
+	} else {
+		md->idle_nwait = 0;
+	}
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 static void vdg_fetch_handler(void *sptr, int nbytes, uint16_t *dest) {
 	struct machine_dragon *md = sptr;
 	uint16_t attr = (PIA_VALUE_B(md->PIA1) & 0x10) << 6;  // GM0 -> ¬INT/EXT
@@ -1274,8 +2271,11 @@ static void vdg_fetch_handler_chargen(void *sptr, int nbytes, uint16_t *dest) {
 
 static uint8_t dragon_read_byte(struct machine *m, unsigned A) {
 	struct machine_dragon *md = (struct machine_dragon *)m;
+	check_page_table(md);
 	md->SAM0->cpu_cycle = DELEGATE_AS3(void, int, bool, uint16, cpu_cycle_noclock, md);
+	md->noclock = 1;
 	sam_mem_cycle(md->SAM0, 1, A);
+	md->noclock = 0;
 	md->SAM0->cpu_cycle = DELEGATE_AS3(void, int, bool, uint16, cpu_cycle, md);
 	return md->CPU0->D;
 }
@@ -1284,9 +2284,14 @@ static uint8_t dragon_read_byte(struct machine *m, unsigned A) {
 
 static void dragon_write_byte(struct machine *m, unsigned A, unsigned D) {
 	struct machine_dragon *md = (struct machine_dragon *)m;
+	if (md->hook_logging)
+		hook_log_write(md, A, D);
+	check_page_table(md);
 	md->CPU0->D = D;
 	md->SAM0->cpu_cycle = DELEGATE_AS3(void, int, bool, uint16, cpu_cycle_noclock, md);
+	md->noclock = 1;
 	sam_mem_cycle(md->SAM0, 0, A);
+	md->noclock = 0;
 	md->SAM0->cpu_cycle = DELEGATE_AS3(void, int, bool, uint16, cpu_cycle, md);
 }
 
@@ -1301,6 +2306,238 @@ static void dragon_op_rts(struct machine *m) {
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+/* Machine state for reverse execution.  SAM, PIA and VDG state follow this
+ * struct in the buffer.  Cartridge state is not included. */
+
+struct dragon_state {
+	uint8_t ram[0x10000];
+	_Bool rom1;
+	_Bool sync_irq;
+	unsigned ntsc_burst_mod;
+	union {
+		struct MC6809 mc6809;
+		struct HD6309 hd6309;
+	} cpu;
+};
+
+static size_t dragon_state_size(struct machine *m) {
+	(void)m;
+	return STATE_ALIGN(sizeof(struct dragon_state)) + STATE_ALIGN(sam_state_size())
+	       + 2 * STATE_ALIGN(mc6821_state_size()) + mc6847_state_size();
+}
+
+static void dragon_state_save(struct machine *m, void *buf) {
+	struct machine_dragon *md = (struct machine_dragon *)m;
+	struct dragon_state *ds = buf;
+	memcpy(ds->ram, md->ram, sizeof(ds->ram));
+	ds->rom1 = (md->rom == md->rom1);
+	ds->sync_irq = md->sync_irq;
+	ds->ntsc_burst_mod = md->ntsc_burst_mod;
+	if (md->CPU0->variant == MC6809_VARIANT_HD6309) {
+		ds->cpu.hd6309 = *(struct HD6309 *)md->CPU0;
+	} else {
+		ds->cpu.mc6809 = *md->CPU0;
+	}
+	uint8_t *p = (uint8_t *)buf + STATE_ALIGN(sizeof(*ds));
+	sam_state_save(md->SAM0, p);
+	p += STATE_ALIGN(sam_state_size());
+	mc6821_state_save(md->PIA0, p);
+	p += STATE_ALIGN(mc6821_state_size());
+	mc6821_state_save(md->PIA1, p);
+	p += STATE_ALIGN(mc6821_state_size());
+	mc6847_state_save(md->VDG0, p);
+}
+
+// Only CPU state is restored, not methods, delegates or trace settings.
+
+static void restore_cpu_state(struct MC6809 *cpu, struct MC6809 const *s) {
+	cpu->halt = s->halt;
+	cpu->nmi = s->nmi;
+	cpu->firq = s->firq;
+	cpu->irq = s->irq;
+	cpu->D = s->D;
+	cpu->state = s->state;
+	cpu->page = s->page;
+	cpu->reg_cc = s->reg_cc;
+	cpu->reg_dp = s->reg_dp;
+	cpu->reg_d = s->reg_d;
+	cpu->reg_x = s->reg_x;
+	cpu->reg_y = s->reg_y;
+	cpu->reg_u = s->reg_u;
+	cpu->reg_s = s->reg_s;
+	cpu->reg_pc = s->reg_pc;
+	cpu->nmi_armed = s->nmi_armed;
+	cpu->nmi_latch = s->nmi_latch;
+	cpu->firq_latch = s->firq_latch;
+	cpu->irq_latch = s->irq_latch;
+	cpu->nmi_active = s->nmi_active;
+	cpu->firq_active = s->firq_active;
+	cpu->irq_active = s->irq_active;
+	if (cpu->variant == MC6809_VARIANT_HD6309) {
+		struct HD6309 *hcpu = (struct HD6309 *)cpu;
+		struct HD6309 const *hs = (struct HD6309 const *)s;
+		hcpu->state = hs->state;
+		hcpu->reg_w = hs->reg_w;
+		hcpu->reg_md = hs->reg_md;
+		hcpu->reg_v = hs->reg_v;
+		hcpu->tfm_src = hs->tfm_src;
+		hcpu->tfm_dest = hs->tfm_dest;
+		hcpu->tfm_data = hs->tfm_data;
+		hcpu->tfm_src_mod = hs->tfm_src_mod;
+		hcpu->tfm_dest_mod = hs->tfm_dest_mod;
+	}
+}
+
+static void dragon_state_restore(struct machine *m, void const *buf) {
+	struct machine_dragon *md = (struct machine_dragon *)m;
+	struct dragon_state const *ds = buf;
+	memcpy(md->ram, ds->ram, sizeof(md->ram));
+#ifdef WANT_PREDECODE
+	mc6809_predecode_flush(md->CPU0);
+#endif
+	md->rom = ds->rom1 ? md->rom1 : md->rom0;
+	md->sync_irq = ds->sync_irq;
+	md->ntsc_burst_mod = ds->ntsc_burst_mod;
+	restore_cpu_state(md->CPU0, &ds->cpu.mc6809);
+	uint8_t const *p = (uint8_t const *)buf + STATE_ALIGN(sizeof(*ds));
+	sam_state_restore(md->SAM0, p);
+	p += STATE_ALIGN(sam_state_size());
+	mc6821_state_restore(md->PIA0, p);
+	p += STATE_ALIGN(mc6821_state_size());
+	mc6821_state_restore(md->PIA1, p);
+	p += STATE_ALIGN(mc6821_state_size());
+	mc6847_state_restore(md->VDG0, p);
+	md->update_pages = 1;
+	md->idle_dirty = 1;
+	md->idle_nwait = 0;
+}
+
+// Portable machine state.  CPU state is written in full, so it doesn't depend
+// on the older snapshot chunks.  The HD6309 TFM register pointers are written
+// as indices.
+
+static unsigned tfm_reg_index(struct HD6309 *hcpu, uint16_t *ptr) {
+	struct MC6809 *cpu = &hcpu->mc6809;
+	uint16_t *regs[5] = { &cpu->reg_d, &cpu->reg_x, &cpu->reg_y, &cpu->reg_u, &cpu->reg_s };
+	for (unsigned i = 0; i < 5; i++) {
+		if (ptr == regs[i])
+			return i;
+	}
+	return 15;
+}
+
+static uint16_t *tfm_reg_ptr(struct HD6309 *hcpu, unsigned i) {
+	struct MC6809 *cpu = &hcpu->mc6809;
+	uint16_t *regs[5] = { &cpu->reg_d, &cpu->reg_x, &cpu->reg_y, &cpu->reg_u, &cpu->reg_s };
+	return (i < 5) ? regs[i] : NULL;
+}
+
+static void dragon_ser_write(struct machine *m, struct ser_handle *sh) {
+	struct machine_dragon *md = (struct machine_dragon *)m;
+	struct MC6809 *cpu = md->CPU0;
+	ser_write_bool(sh, md->rom == md->rom1);
+	ser_write_bool(sh, md->sync_irq);
+	ser_write_uint8(sh, md->ntsc_burst_mod);
+
+	ser_write_bool(sh, cpu->variant == MC6809_VARIANT_HD6309);
+	ser_write_bool(sh, cpu->halt);
+	ser_write_bool(sh, cpu->nmi);
+	ser_write_bool(sh, cpu->firq);
+	ser_write_bool(sh, cpu->irq);
+	ser_write_uint8(sh, cpu->D);
+	ser_write_uint8(sh, cpu->state);
+	ser_write_uint16(sh, cpu->page);
+	ser_write_uint8(sh, cpu->reg_cc);
+	ser_write_uint8(sh, cpu->reg_dp);
+	ser_write_uint16(sh, cpu->reg_d);
+	ser_write_uint16(sh, cpu->reg_x);
+	ser_write_uint16(sh, cpu->reg_y);
+	ser_write_uint16(sh, cpu->reg_u);
+	ser_write_uint16(sh, cpu->reg_s);
+	ser_write_uint16(sh, cpu->reg_pc);
+	ser_write_bool(sh, cpu->nmi_armed);
+	ser_write_bool(sh, cpu->nmi_latch);
+	ser_write_bool(sh, cpu->firq_latch);
+	ser_write_bool(sh, cpu->irq_latch);
+	ser_write_bool(sh, cpu->nmi_active);
+	ser_write_bool(sh, cpu->firq_active);
+	ser_write_bool(sh, cpu->irq_active);
+	if (cpu->variant == MC6809_VARIANT_HD6309) {
+		struct HD6309 *hcpu = (struct HD6309 *)cpu;
+		ser_write_uint8(sh, hcpu->state);
+		ser_write_uint16(sh, hcpu->reg_w);
+		ser_write_uint8(sh, hcpu->reg_md);
+		ser_write_uint16(sh, hcpu->reg_v);
+		ser_write_uint8(sh, tfm_reg_index(hcpu, hcpu->tfm_src));
+		ser_write_uint8(sh, tfm_reg_index(hcpu, hcpu->tfm_dest));
+		ser_write_uint8(sh, hcpu->tfm_data);
+		ser_write_uint16(sh, hcpu->tfm_src_mod);
+		ser_write_uint16(sh, hcpu->tfm_dest_mod);
+	}
+
+	sam_ser_write(md->SAM0, sh);
+	mc6821_ser_write(md->PIA0, sh);
+	mc6821_ser_write(md->PIA1, sh);
+	mc6847_ser_write(md->VDG0, sh);
+}
+
+static void dragon_ser_read(struct machine *m, struct ser_handle *sh) {
+	struct machine_dragon *md = (struct machine_dragon *)m;
+	struct MC6809 *cpu = md->CPU0;
+	md->rom = ser_read_bool(sh) ? md->rom1 : md->rom0;
+	md->sync_irq = ser_read_bool(sh);
+	md->ntsc_burst_mod = ser_read_uint8(sh);
+
+	if (ser_read_bool(sh) != (cpu->variant == MC6809_VARIANT_HD6309)) {
+		LOG_WARN("Snapshot: CPU mismatch - skipping machine state\n");
+		return;
+	}
+	cpu->halt = ser_read_bool(sh);
+	cpu->nmi = ser_read_bool(sh);
+	cpu->firq = ser_read_bool(sh);
+	cpu->irq = ser_read_bool(sh);
+	cpu->D = ser_read_uint8(sh);
+	cpu->state = ser_read_uint8(sh);
+	cpu->page = ser_read_uint16(sh);
+	cpu->reg_cc = ser_read_uint8(sh);
+	cpu->reg_dp = ser_read_uint8(sh);
+	cpu->reg_d = ser_read_uint16(sh);
+	cpu->reg_x = ser_read_uint16(sh);
+	cpu->reg_y = ser_read_uint16(sh);
+	cpu->reg_u = ser_read_uint16(sh);
+	cpu->reg_s = ser_read_uint16(sh);
+	cpu->reg_pc = ser_read_uint16(sh);
+	cpu->nmi_armed = ser_read_bool(sh);
+	cpu->nmi_latch = ser_read_bool(sh);
+	cpu->firq_latch = ser_read_bool(sh);
+	cpu->irq_latch = ser_read_bool(sh);
+	cpu->nmi_active = ser_read_bool(sh);
+	cpu->firq_active = ser_read_bool(sh);
+	cpu->irq_active = ser_read_bool(sh);
+	if (cpu->variant == MC6809_VARIANT_HD6309) {
+		struct HD6309 *hcpu = (struct HD6309 *)cpu;
+		hcpu->state = ser_read_uint8(sh);
+		hcpu->reg_w = ser_read_uint16(sh);
+		hcpu->reg_md = ser_read_uint8(sh);
+		hcpu->reg_v = ser_read_uint16(sh);
+		hcpu->tfm_src = tfm_reg_ptr(hcpu, ser_read_uint8(sh));
+		hcpu->tfm_dest = tfm_reg_ptr(hcpu, ser_read_uint8(sh));
+		hcpu->tfm_data = ser_read_uint8(sh);
+		hcpu->tfm_src_mod = ser_read_uint16(sh);
+		hcpu->tfm_dest_mod = ser_read_uint16(sh);
+	}
+
+	sam_ser_read(md->SAM0, sh);
+	mc6821_ser_read(md->PIA0, sh);
+	mc6821_ser_read(md->PIA1, sh);
+	mc6847_ser_read(md->VDG0, sh);
+	md->update_pages = 1;
+	md->idle_dirty = 1;
+	md->idle_nwait = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 static void keyboard_update(void *sptr) {
 	struct machine_dragon *md = sptr;
 	unsigned buttons = ~(joystick_read_buttons() & 3);
@@ -1311,9 +2548,12 @@ static void keyboard_update(void *sptr) {
 		.col_sink = md->PIA0->b.out_sink,
 	};
 	keyboard_read_matrix(md->keyboard_interface, &state);
-	md->PIA0->a.in_sink = state.row_sink;
-	md->PIA0->b.in_source = state.col_source;
-	md->PIA0->b.in_sink = state.col_sink;
+	unsigned value = read_input(md, DRAGON_INPUT_KEYBOARD,
+				    (state.row_sink & 0xff) | ((state.col_source & 0xff) << 8)
+				    | ((state.col_sink & 0xff) << 16));
+	md->PIA0->a.in_sink = value & 0xff;
+	md->PIA0->b.in_source = (value >> 8) & 0xff;
+	md->PIA0->b.in_sink = (value >> 16) & 0xff;
 }
 
 static void joystick_update(void *sptr) {
@@ -1322,7 +2562,7 @@ static void joystick_update(void *sptr) {
 	int axis = (md->PIA0->a.control_register & 0x08) >> 3;
 	int dac_value = (md->PIA1->a.out_sink & 0xfc) << 8;
 	int js_value = joystick_read_axis(port, axis);
-	if (js_value >= dac_value)
+	if (read_input(md, DRAGON_INPUT_JOYSTICK, js_value >= dac_value))
 		md->PIA0->a.in_sink |= 0x80;
 	else
 		md->PIA0->a.in_sink &= 0x7f;
@@ -1332,6 +2572,8 @@ static void update_sound_mux_source(void *sptr) {
 	struct machine_dragon *md = sptr;
 	unsigned source = ((md->PIA0->b.control_register & (1<<3)) >> 2)
 	                  | ((md->PIA0->a.control_register & (1<<3)) >> 3);
+	if (in_past(md))
+		return;
 	sound_set_mux_source(md->snd, source);
 }
 
@@ -1365,23 +2607,29 @@ static void pia0b_data_preread_coco64k(void *sptr) {
 
 static void pia1a_data_postwrite(void *sptr) {
 	struct machine_dragon *md = sptr;
-	sound_set_dac_level(md->snd, (float)(PIA_VALUE_A(md->PIA1) & 0xfc) / 252.);
-	tape_update_output(md->tape_interface, md->PIA1->a.out_sink & 0xfc);
+	_Bool past = in_past(md);
+	if (!past) {
+		sound_set_dac_level(md->snd, (float)(PIA_VALUE_A(md->PIA1) & 0xfc) / 252.);
+		tape_update_output(md->tape_interface, md->PIA1->a.out_sink & 0xfc);
+	}
 	if (md->is_dragon) {
 		keyboard_update(md);
-		printer_strobe(md->printer_interface, PIA_VALUE_A(md->PIA1) & 0x02, PIA_VALUE_B(md->PIA0));
+		if (!past)
+			printer_strobe(md->printer_interface, PIA_VALUE_A(md->PIA1) & 0x02, PIA_VALUE_B(md->PIA0));
 	}
 }
 
 static void pia1a_control_postwrite(void *sptr) {
 	struct machine_dragon *md = sptr;
+	if (in_past(md))
+		return;
 	tape_update_motor(md->tape_interface, md->PIA1->a.control_register & 0x08);
 	tape_update_output(md->tape_interface, md->PIA1->a.out_sink & 0xfc);
 }
 
 static void pia1b_data_preread_dragon(void *sptr) {
 	struct machine_dragon *md = sptr;
-	if (printer_busy(md->printer_interface))
+	if (read_input(md, DRAGON_INPUT_PRINTER_BUSY, printer_busy(md->printer_interface)))
 		md->PIA1->b.in_sink |= 0x01;
 	else
 		md->PIA1->b.in_sink &= ~0x01;
@@ -1403,24 +2651,27 @@ static void pia1b_data_postwrite(void *sptr) {
 	struct machine_dragon *md = sptr;
 	if (md->is_dragon64) {
 		_Bool is_32k = PIA_VALUE_B(md->PIA1) & 0x04;
-		if (is_32k) {
-			md->rom = md->rom0;
-			keyboard_set_chord_mode(md->keyboard_interface, keyboard_chord_mode_dragon_32k_basic);
-		} else {
-			md->rom = md->rom1;
-			keyboard_set_chord_mode(md->keyboard_interface, keyboard_chord_mode_dragon_64k_basic);
+		md->update_pages = 1;
+		md->rom = is_32k ? md->rom0 : md->rom1;
+		if (!in_past(md)) {
+			keyboard_set_chord_mode(md->keyboard_interface, is_32k ?
+						keyboard_chord_mode_dragon_32k_basic :
+						keyboard_chord_mode_dragon_64k_basic);
 		}
 	}
 	// Single-bit sound
 	_Bool sbs_enabled = !((md->PIA1->b.out_source ^ md->PIA1->b.out_sink) & (1<<1));
 	_Bool sbs_level = md->PIA1->b.out_source & md->PIA1->b.out_sink & (1<<1);
-	sound_set_sbs(md->snd, sbs_enabled, sbs_level);
+	if (!in_past(md))
+		sound_set_sbs(md->snd, sbs_enabled, sbs_level);
 	// VDG mode
 	update_vdg_mode(md);
 }
 
 static void pia1b_control_postwrite(void *sptr) {
 	struct machine_dragon *md = sptr;
+	if (in_past(md))
+		return;
 	sound_set_mux_enabled(md->snd, md->PIA1->b.control_register & 0x08);
 }
 
@@ -1431,6 +2682,7 @@ static void pia1b_control_postwrite(void *sptr) {
 static void vdg_hs(void *sptr, _Bool level) {
 	struct machine_dragon *md = sptr;
 	mc6821_set_cx1(&md->PIA0->a, level);
+	md->sync_irq = 1;
 	sam_vdg_hsync(md->SAM0, level);
 	if (!level) {
 		unsigned p1bval = md->PIA1->b.out_source & md->PIA1->b.out_sink;
@@ -1444,6 +2696,7 @@ static void vdg_hs(void *sptr, _Bool level) {
 static void vdg_hs_pal_coco(void *sptr, _Bool level) {
 	struct machine_dragon *md = sptr;
 	mc6821_set_cx1(&md->PIA0->a, !level);
+	md->sync_irq = 1;
 	sam_vdg_hsync(md->SAM0, level);
 	// PAL uses palletised output so this wouldn't technically matter, but
 	// user is able to cycle to a faux-NTSC colourscheme, so update phase
@@ -1459,14 +2712,40 @@ static void vdg_hs_pal_coco(void *sptr, _Bool level) {
 static void vdg_fs(void *sptr, _Bool level) {
 	struct machine_dragon *md = sptr;
 	mc6821_set_cx1(&md->PIA0->b, level);
+	md->sync_irq = 1;
 	sam_vdg_fsync(md->SAM0, level);
 	if (level) {
-		sound_update(md->snd);
-		md->frame--;
-		if (md->frame < 0)
-			md->frame = md->frameskip;
-		if (md->frame == 0) {
-			DELEGATE_CALL0(md->vo->vsync);
+		if (md->replay) {
+			replay_frame(md->replay);
+		}
+		// Running forward through rewind history, only the final
+		// frame is shown
+		_Bool rewinding = 0;
+		if (md->rewind) {
+			if (rewind_frame(md->rewind))
+				md->CPU0->running = 0;
+			rewinding = rewind_replaying(md->rewind);
+		}
+		if (!in_past(md) && !rewinding)
+			sound_update(md->snd);
+		STATS_FRAME();
+		_Bool present;
+		if (md->frameskip_auto) {
+			present = frameskip_auto_frame(md->ctx->current_tick, md->snd->ratelimit, md->vo->refresh_rate);
+		} else {
+			md->frame--;
+			if (md->frame < 0)
+				md->frame = md->frameskip;
+			present = (md->frame == 0);
+		}
+		if (!rewinding) {
+			if (present) {
+				STATS_ENTER(STATS_VO_VSYNC);
+				DELEGATE_CALL0(md->vo->vsync);
+				STATS_LEAVE();
+			} else {
+				STATS_ADD(STATS_FRAME_SKIPPED, 1);
+			}
 		}
 	}
 }
@@ -1476,7 +2755,9 @@ static void vdg_render_line(void *sptr, uint8_t *data, unsigned burst) {
 	burst = (burst | md->ntsc_burst_mod) & 3;
 	struct ntsc_burst *nb = md->ntsc_burst[burst];
 	unsigned phase = 2*md->public.config->cross_colour_phase;
+	STATS_ENTER(STATS_VO_RENDER);
 	DELEGATE_CALL3(md->vo->render_scanline, data, nb, phase);
+	STATS_LEAVE();
 }
 
 /* Dragon parallel printer line delegate. */
@@ -1484,7 +2765,7 @@ static void vdg_render_line(void *sptr, uint8_t *data, unsigned burst) {
 //ACK is active low
 static void printer_ack(void *sptr, _Bool ack) {
 	struct machine_dragon *md = sptr;
-	mc6821_set_cx1(&md->PIA1->a, !ack);
+	set_signal(md, DRAGON_SIGNAL_PRINTER_ACK, ack);
 }
 
 /* Sound output can feed back into the single bit sound pin when it's
@@ -1492,40 +2773,71 @@ static void printer_ack(void *sptr, _Bool ack) {
 
 static void single_bit_feedback(void *sptr, _Bool level) {
 	struct machine_dragon *md = sptr;
-	if (level) {
-		md->PIA1->b.in_source &= ~(1<<1);
-		md->PIA1->b.in_sink &= ~(1<<1);
-	} else {
-		md->PIA1->b.in_source |= (1<<1);
-		md->PIA1->b.in_sink |= (1<<1);
-	}
+	set_signal(md, DRAGON_SIGNAL_SBS_FEEDBACK, level);
 }
 
 /* Tape audio delegate */
 
 static void update_audio_from_tape(void *sptr, float value) {
 	struct machine_dragon *md = sptr;
+	if (in_past(md))
+		return;
 	sound_set_tape_level(md->snd, value);
-	if (value >= 0.5)
-		md->PIA1->a.in_sink &= ~(1<<0);
-	else
-		md->PIA1->a.in_sink |= (1<<0);
+	set_signal(md, DRAGON_SIGNAL_TAPE, value >= 0.5);
 }
 
 /* Catridge signalling */
 
 static void cart_firq(void *sptr, _Bool level) {
 	struct machine_dragon *md = sptr;
-	(void)md;
-	mc6821_set_cx1(&md->PIA1->b, level);
+	set_signal(md, DRAGON_SIGNAL_CART_FIRQ, level);
 }
 
 static void cart_nmi(void *sptr, _Bool level) {
 	struct machine_dragon *md = sptr;
-	MC6809_NMI_SET(md->CPU0, level);
+	set_signal(md, DRAGON_SIGNAL_CART_NMI, level);
 }
 
 static void cart_halt(void *sptr, _Bool level) {
 	struct machine_dragon *md = sptr;
-	MC6809_HALT_SET(md->CPU0, level);
+	set_signal(md, DRAGON_SIGNAL_CART_HALT, level);
+}
+
+/* Act on a signal, either as it arrives or when replayed from history. */
+
+static void apply_signal(void *sptr, unsigned id, unsigned value) {
+	struct machine_dragon *md = sptr;
+	switch (id) {
+	case DRAGON_SIGNAL_TAPE:
+		if (value)
+			md->PIA1->a.in_sink &= ~(1<<0);
+		else
+			md->PIA1->a.in_sink |= (1<<0);
+		break;
+	case DRAGON_SIGNAL_CART_FIRQ:
+		mc6821_set_cx1(&md->PIA1->b, value);
+		md->sync_irq = 1;
+		break;
+	case DRAGON_SIGNAL_CART_NMI:
+		MC6809_NMI_SET(md->CPU0, value);
+		break;
+	case DRAGON_SIGNAL_CART_HALT:
+		MC6809_HALT_SET(md->CPU0, value);
+		break;
+	case DRAGON_SIGNAL_PRINTER_ACK:
+		mc6821_set_cx1(&md->PIA1->a, !value);
+		md->sync_irq = 1;
+		break;
+	case DRAGON_SIGNAL_SBS_FEEDBACK:
+		if (value) {
+			md->PIA1->b.in_source &= ~(1<<1);
+			md->PIA1->b.in_sink &= ~(1<<1);
+		} else {
+			md->PIA1->b.in_source |= (1<<1);
+			md->PIA1->b.in_sink |= (1<<1);
+		}
+		break;
+	default:
+		break;
+	}
 }
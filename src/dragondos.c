@@ -38,6 +38,7 @@ See COPYING.GPL for redistribution conditions.
 #include "cart.h"
 #include "logging.h"
 #include "part.h"
+#include "serialise.h"
 #include "vdrive.h"
 #include "wd279x.h"
 #include "xroar.h"
@@ -69,6 +70,11 @@ static uint8_t dragondos_write(struct cart *c, uint16_t A, _Bool P2, _Bool R2, u
 static void dragondos_reset(struct cart *c);
 static void dragondos_detach(struct cart *c);
 static void dragondos_free(struct part *p);
+static size_t dragondos_state_size(struct cart *c);
+static void dragondos_state_save(struct cart *c, void *buf);
+static void dragondos_state_restore(struct cart *c, void const *buf);
+static void dragondos_ser_write(struct cart *c, struct ser_handle *sh);
+static void dragondos_ser_read(struct cart *c, struct ser_handle *sh);
 static _Bool dragondos_has_interface(struct cart *c, const char *ifname);
 static void dragondos_attach_interface(struct cart *c, const char *ifname, void *intf);
 
@@ -96,6 +102,11 @@ static struct cart *dragondos_new(struct cart_config *cc) {
 	c->read = dragondos_read;
 	c->write = dragondos_write;
 	c->reset = dragondos_reset;
+	c->state_size = dragondos_state_size;
+	c->state_save = dragondos_state_save;
+	c->state_restore = dragondos_state_restore;
+	c->ser_write = dragondos_ser_write;
+	c->ser_read = dragondos_ser_read;
 
 	c->has_interface = dragondos_has_interface;
 	c->attach_interface = dragondos_attach_interface;
@@ -120,6 +131,87 @@ static void dragondos_reset(struct cart *c) {
 		becker_reset(d->becker);
 }
 
+// Latches, FDC and drive state follow each other in the buffer.
+
+struct dragondos_state {
+	unsigned latch_old;
+	unsigned latch_drive_select;
+	_Bool latch_motor_enable;
+	_Bool latch_precomp_enable;
+	_Bool latch_density;
+	_Bool latch_nmi_enable;
+};
+
+static size_t dragondos_state_size(struct cart *c) {
+	(void)c;
+	return STATE_ALIGN(sizeof(struct dragondos_state)) + STATE_ALIGN(wd279x_state_size())
+	       + vdrive_state_size();
+}
+
+static void dragondos_state_save(struct cart *c, void *buf) {
+	struct dragondos *d = (struct dragondos *)c;
+	struct dragondos_state *st = buf;
+	st->latch_old = d->latch_old;
+	st->latch_drive_select = d->latch_drive_select;
+	st->latch_motor_enable = d->latch_motor_enable;
+	st->latch_precomp_enable = d->latch_precomp_enable;
+	st->latch_density = d->latch_density;
+	st->latch_nmi_enable = d->latch_nmi_enable;
+	uint8_t *p = (uint8_t *)buf + STATE_ALIGN(sizeof(*st));
+	wd279x_state_save(d->fdc, p);
+	p += STATE_ALIGN(wd279x_state_size());
+	if (d->vdrive_interface) {
+		vdrive_state_save(d->vdrive_interface, p);
+	} else {
+		memset(p, 0, vdrive_state_size());
+	}
+}
+
+static void dragondos_state_restore(struct cart *c, void const *buf) {
+	struct dragondos *d = (struct dragondos *)c;
+	struct dragondos_state const *st = buf;
+	d->latch_old = st->latch_old;
+	d->latch_drive_select = st->latch_drive_select;
+	d->latch_motor_enable = st->latch_motor_enable;
+	d->latch_precomp_enable = st->latch_precomp_enable;
+	d->latch_density = st->latch_density;
+	d->latch_nmi_enable = st->latch_nmi_enable;
+	uint8_t const *p = (uint8_t const *)buf + STATE_ALIGN(sizeof(*st));
+	if (d->vdrive_interface) {
+		vdrive_state_restore(d->vdrive_interface, p + STATE_ALIGN(wd279x_state_size()));
+	}
+	wd279x_state_restore(d->fdc, p);
+}
+
+// Drive state is read before the FDC's, as for the in-memory state.
+
+static void dragondos_ser_write(struct cart *c, struct ser_handle *sh) {
+	struct dragondos *d = (struct dragondos *)c;
+	ser_write_uint32(sh, d->latch_old);
+	ser_write_uint8(sh, d->latch_drive_select);
+	ser_write_bool(sh, d->latch_motor_enable);
+	ser_write_bool(sh, d->latch_precomp_enable);
+	ser_write_bool(sh, d->latch_density);
+	ser_write_bool(sh, d->latch_nmi_enable);
+	ser_write_bool(sh, d->vdrive_interface);
+	if (d->vdrive_interface)
+		vdrive_ser_write(d->vdrive_interface, sh);
+	wd279x_ser_write(d->fdc, sh);
+}
+
+static void dragondos_ser_read(struct cart *c, struct ser_handle *sh) {
+	struct dragondos *d = (struct dragondos *)c;
+	d->latch_old = ser_read_uint32(sh);
+	d->latch_drive_select = ser_read_uint8(sh);
+	d->latch_motor_enable = ser_read_bool(sh);
+	d->latch_precomp_enable = ser_read_bool(sh);
+	d->latch_density = ser_read_bool(sh);
+	d->latch_nmi_enable = ser_read_bool(sh);
+	if (ser_read_bool(sh))
+		vdrive_ser_read(d->vdrive_interface, sh);
+	wd279x_ser_read(d->fdc, sh);
+}
+
 static void dragondos_detach(struct cart *c) {
 	struct dragondos *d = (struct dragondos *)c;
 	vdrive_disconnect(d->vdrive_interface);
@@ -27,12 +27,39 @@ See COPYING.GPL for redistribution conditions.
 #include "logging.h"
 
 extern inline int event_tick_delta(event_ticks t0, event_ticks t1);
-extern inline _Bool event_pending(struct event **list);
-extern inline void event_dispatch_next(struct event **list);
-extern inline void event_run_queue(struct event **list);
+extern inline _Bool event_pending(struct event_list *list);
+extern inline void event_dispatch_next(struct event_list *list);
+extern inline void event_run_queue(struct event_list *list);
+
+static struct xroar_context default_context = {
+	.machine_events.ctx = &default_context,
+	.ui_events.ctx = &default_context,
+};
+THREAD_LOCAL struct xroar_context *xroar_context = &default_context;
+
+struct xroar_context *xroar_context_new(void) {
+	struct xroar_context *ctx = xmalloc(sizeof(*ctx));
+	*ctx = (struct xroar_context){0};
+	ctx->machine_events.ctx = ctx;
+	ctx->ui_events.ctx = ctx;
+	return ctx;
+}
 
+void xroar_context_free(struct xroar_context *ctx) {
+	if (!ctx || ctx == &default_context)
+		return;
+	if (xroar_context == ctx)
+		xroar_context = &default_context;
+	event_list_free(&ctx->machine_events);
+	event_list_free(&ctx->ui_events);
+	free(ctx);
+}
 
-event_ticks event_current_tick = 0;
+struct xroar_context *xroar_context_set(struct xroar_context *ctx) {
+	struct xroar_context *old = xroar_context;
+	xroar_context = ctx ? ctx : &default_context;
+	return old;
+}
 
 struct event *event_new(DELEGATE_T0(void) delegate) {
 	struct event *new = xmalloc(sizeof(*new));
@@ -43,8 +70,9 @@ struct event *event_new(DELEGATE_T0(void) delegate) {
 void event_init(struct event *event, DELEGATE_T0(void) delegate) {
 	if (event == NULL) return;
 	*event = (struct event){0};
-	event->at_tick = event_current_tick;
+	event->at_tick = xroar_context->current_tick;
 	event->delegate = delegate;
+	STATS_EVENT_TYPE(event, STATS_EVENT_OTHER);
 }
 
 void event_free(struct event *event) {
@@ -52,24 +80,86 @@ void event_free(struct event *event) {
 	free(event);
 }
 
-void event_queue(struct event **list, struct event *event) {
-	struct event **entry;
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Heap helpers.  Entry a sorts before entry b if it is scheduled earlier, or
+// if scheduled for the same tick but queued first.
+
+static inline _Bool entry_before(struct event_heap_entry const *a, struct event_heap_entry const *b) {
+	int dt = event_tick_delta(a->at_tick, b->at_tick);
+	if (dt != 0)
+		return dt < 0;
+	return (int32_t)(a->seq - b->seq) < 0;
+}
+
+static inline void heap_set(struct event_list *list, unsigned i, struct event_heap_entry entry) {
+	list->heap[i] = entry;
+	entry.event->heap_index = i;
+}
+
+static void sift_up(struct event_list *list, unsigned i) {
+	struct event_heap_entry entry = list->heap[i];
+	while (i > 0) {
+		unsigned parent = (i - 1) >> 1;
+		if (!entry_before(&entry, &list->heap[parent]))
+			break;
+		heap_set(list, i, list->heap[parent]);
+		i = parent;
+	}
+	heap_set(list, i, entry);
+}
+
+static void sift_down(struct event_list *list, unsigned i) {
+	struct event_heap_entry entry = list->heap[i];
+	unsigned n = list->nevents;
+	for (;;) {
+		unsigned child = (i << 1) + 1;
+		if (child >= n)
+			break;
+		if (child + 1 < n && entry_before(&list->heap[child + 1], &list->heap[child]))
+			child++;
+		if (!entry_before(&list->heap[child], &entry))
+			break;
+		heap_set(list, i, list->heap[child]);
+		i = child;
+	}
+	heap_set(list, i, entry);
+}
+
+// Remove entry at index i, restoring heap order and the cached next tick.
+
+static void heap_remove(struct event_list *list, unsigned i) {
+	unsigned last = --list->nevents;
+	if (i != last) {
+		heap_set(list, i, list->heap[last]);
+		if (i > 0 && entry_before(&list->heap[i], &list->heap[(i - 1) >> 1])) {
+			sift_up(list, i);
+		} else {
+			sift_down(list, i);
+		}
+	}
+	if (list->nevents)
+		list->next_tick = list->heap[0].at_tick;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void event_queue(struct event_list *list, struct event *event) {
 	if (event->queued)
 		event_dequeue(event);
+	if (list->nevents >= list->heap_size) {
+		list->heap_size = list->heap_size ? list->heap_size * 2 : 16;
+		list->heap = xrealloc(list->heap, list->heap_size * sizeof(*list->heap));
+	}
 	event->list = list;
 	event->queued = 1;
-	for (entry = list; *entry; entry = &((*entry)->next)) {
-		if (event_tick_delta(event->at_tick, (*entry)->at_tick) < 0) {
-			event->next = *entry;
-			*entry = event;
-			return;
-		}
-	}
-	*entry = event;
-	event->next = NULL;
+	unsigned i = list->nevents++;
+	list->heap[i] = (struct event_heap_entry){ .at_tick = event->at_tick, .seq = list->seq++, .event = event };
+	sift_up(list, i);
+	list->next_tick = list->heap[0].at_tick;
 }
 
-void event_queue_auto(struct event **list, DELEGATE_T0(void) delegate, int dt) {
+void event_queue_auto(struct event_list *list, DELEGATE_T0(void) delegate, int dt) {
 	struct event *e = event_new(delegate);
 	e->at_tick += dt;
 	e->autofree = 1;
@@ -77,19 +167,41 @@ void event_queue_auto(struct event **list, DELEGATE_T0(void) delegate, int dt) {
 }
 
 void event_dequeue(struct event *event) {
-	struct event **list = event->list;
-	struct event **entry;
-	event->queued = 0;
-	if (list == NULL)
-		return;
-	if (*list == event) {
-		*list = event->next;
+	struct event_list *list = event->list;
+	if (!event->queued || list == NULL) {
+		event->queued = 0;
 		return;
 	}
-	for (entry = list; *entry; entry = &((*entry)->next)) {
-		if ((*entry)->next == event) {
-			(*entry)->next = event->next;
-			return;
-		}
+	event->queued = 0;
+	heap_remove(list, event->heap_index);
+}
+
+void event_save_state(struct event const *event, struct event_state *es) {
+	es->dt = event->at_tick - xroar_context->current_tick;
+	es->queued = event->queued;
+}
+
+void event_restore_state(struct event *event, struct event_list *list,
+			 struct event_state const *es) {
+	event_dequeue(event);
+	event->at_tick = list->ctx->current_tick + es->dt;
+	if (es->queued)
+		event_queue(list, event);
+}
+
+struct event *event_list_pop(struct event_list *list) {
+	struct event *e = list->heap[0].event;
+	e->queued = 0;
+	heap_remove(list, 0);
+	return e;
+}
+
+void event_list_free(struct event_list *list) {
+	while (list->nevents > 0) {
+		struct event *e = event_list_pop(list);
+		if (e->autofree)
+			free(e);
 	}
+	free(list->heap);
+	*list = (struct event_list){0};
 }
@@ -22,6 +22,9 @@ See COPYING.GPL for redistribution conditions.
 #include <stdlib.h>
 
 #include "delegate.h"
+#include "pl-thread.h"
+
+#include "stats.h"
 
 /* Maintains queues of events.  Each event has a tick number at which its
  * delegate is scheduled to run.  */
@@ -35,18 +38,88 @@ typedef uint32_t event_ticks;
 #define EVENT_MS(ms) ((EVENT_TICK_RATE * (ms)) / 1000)
 #define EVENT_US(us) ((EVENT_TICK_RATE * (us)) / 1000000)
 
-/* Current "time". */
-extern event_ticks event_current_tick;
+struct event_list;
+struct xroar_context;
 
 struct event {
 	event_ticks at_tick;
 	DELEGATE_T0(void) delegate;
 	_Bool queued;
 	_Bool autofree;
-	struct event **list;
-	struct event *next;
+	struct event_list *list;
+	unsigned heap_index;
+#ifdef WANT_STATS
+	enum stats_id stats_id;
+#endif
+};
+
+/* Queued events are held in a binary min-heap.  The scheduled tick is copied
+ * into each heap entry along with a sequence number that breaks ties, so
+ * events queued for the same tick still dispatch in the order they were
+ * queued. */
+
+struct event_heap_entry {
+	event_ticks at_tick;
+	uint32_t seq;
+	struct event *event;
 };
 
+struct event_list {
+	struct event_heap_entry *heap;
+	unsigned nevents;
+	unsigned heap_size;
+	uint32_t seq;
+	// Tick of the earliest queued event.  Only meaningful while nevents is
+	// non-zero.
+	event_ticks next_tick;
+	// Context whose current_tick this list is measured against.
+	struct xroar_context *ctx;
+};
+
+// An emulation context holds the state that would otherwise be global to a
+// running machine: the current time, its event queues and the machine and
+// interfaces attached to it.  Each thread has a current context, reached
+// through xroar_context.  This allows several machines to run in one process,
+// each on its own thread.  A default context is current for every thread
+// until another is set.
+//
+// Finding the current context costs a thread-local load, so code on hot paths
+// should use a pointer cached when it was created (struct event_list and the
+// machine both keep one) rather than going through xroar_context.
+
+struct ao_interface;
+struct keyboard_interface;
+struct machine_config;
+struct machine;
+struct printer_interface;
+struct tape_interface;
+struct vdrive_interface;
+struct vo_interface;
+
+struct xroar_context {
+	event_ticks current_tick;
+	struct event_list machine_events;
+	struct event_list ui_events;
+	struct machine_config *machine_config;
+	struct machine *machine;
+	struct tape_interface *tape_interface;
+	struct vdrive_interface *vdrive_interface;
+	struct keyboard_interface *keyboard_interface;
+	struct printer_interface *printer_interface;
+	struct vo_interface *vo_interface;
+	struct ao_interface *ao_interface;
+};
+
+extern THREAD_LOCAL struct xroar_context *xroar_context;
+
+struct xroar_context *xroar_context_new(void);
+// Frees the event lists, but nothing else referenced by the context.  If the
+// context was current, this thread reverts to the default context.
+void xroar_context_free(struct xroar_context *ctx);
+// Make ctx current for the calling thread.  NULL selects the default context.
+// Returns the previously current context.
+struct xroar_context *xroar_context_set(struct xroar_context *ctx);
+
 struct event *event_new(DELEGATE_T0(void));
 void event_init(struct event *event, DELEGATE_T0(void));
 
@@ -54,12 +127,38 @@ void event_init(struct event *event, DELEGATE_T0(void));
  * order of their being added to queue */
 
 void event_free(struct event *event);
-void event_queue(struct event **list, struct event *event);
+void event_queue(struct event_list *list, struct event *event);
 void event_dequeue(struct event *event);
 
 // Allocate an event and queue it, flagged to autofree.  Event will be
 // scheduled for current time + dt.
-void event_queue_auto(struct event **list, DELEGATE_T0(void), int dt);
+void event_queue_auto(struct event_list *list, DELEGATE_T0(void), int dt);
+
+// Machine state snapshots record when an event is scheduled relative to the
+// current time, so that the schedule can be restored at a different time.
+
+struct event_state {
+	event_ticks dt;
+	_Bool queued;
+};
+
+void event_save_state(struct event const *event, struct event_state *es);
+
+// Dequeues the event, then if it was queued when saved, requeues it on list.
+void event_restore_state(struct event *event, struct event_list *list,
+			 struct event_state const *es);
+
+// Where the state of several components is saved to one buffer, each part
+// starts at an offset aligned with this.
+#define STATE_ALIGN(s) (((s) + 7) & ~(size_t)7)
+
+// Remove the earliest event from the list, returning it.  Used by
+// event_dispatch_next(); list must not be empty.
+struct event *event_list_pop(struct event_list *list);
+
+// Free any storage associated with a list.  Queued events are dequeued (and
+// freed if flagged to autofree).
+void event_list_free(struct event_list *list);
 
 /* In theory, C99 6.5:7 combined with the fact that fixed width integers are
  * guaranteed 2s complement should make this safe.  Kinda hard to tell, though.
@@ -70,20 +169,20 @@ inline int event_tick_delta(event_ticks t0, event_ticks t1) {
 	return *(int32_t *)&dt;
 }
 
-inline _Bool event_pending(struct event **list) {
-	return *list && event_tick_delta(event_current_tick, (*list)->at_tick) >= 0;
+inline _Bool event_pending(struct event_list *list) {
+	return list->nevents && event_tick_delta(list->ctx->current_tick, list->next_tick) >= 0;
 }
 
-inline void event_dispatch_next(struct event **list) {
-	struct event *e = *list;
-	*list = e->next;
-	e->queued = 0;
+inline void event_dispatch_next(struct event_list *list) {
+	struct event *e = event_list_pop(list);
+	STATS_ENTER(e->stats_id);
 	DELEGATE_CALL0(e->delegate);
+	STATS_LEAVE();
 	if (e->autofree)
 		free(e);
 }
 
-inline void event_run_queue(struct event **list) {
+inline void event_run_queue(struct event_list *list) {
 	while (event_pending(list))
 		event_dispatch_next(list);
 }
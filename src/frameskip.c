@@ -0,0 +1,136 @@
+/*
+
+Automatic frameskip
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+When rate limited, the audio module is what keeps emulation in step with real
+time: writing a buffer blocks until there's room for it.  Time spent blocked is
+therefore time the host had to spare.  If there's too little of it, audio is
+close to underrunning, so more frames are skipped to free up host time.
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+
+#include "pl-thread.h"
+
+#include "events.h"
+#include "frameskip.h"
+#include "hosttime.h"
+#include "logging.h"
+#include "stats.h"
+
+// Frames measured before each adjustment
+#define WINDOW_FRAMES (25)
+
+// Fraction of wall time spent waiting for audio below which skip is raised,
+// and above which it is lowered.
+#define IDLE_LOW (0.05)
+#define IDLE_HIGH (0.20)
+
+// Emulation speed below which the host isn't keeping up
+#define SPEED_LOW (0.97)
+
+struct frameskip_state {
+	unsigned skip;
+	// Frames still to skip before the next is presented
+	unsigned countdown;
+	_Bool ratelimit;
+	uint64_t last_present_ns;
+
+	// Current measurement window
+	unsigned nframes;
+	uint64_t window_ns;
+	uint32_t window_tick;
+	uint64_t audio_ns;
+	uint64_t audio_enter_ns;
+};
+
+static THREAD_LOCAL struct frameskip_state fs;
+
+static void start_window(uint64_t now, uint32_t tick) {
+	fs.nframes = 0;
+	fs.window_ns = now;
+	fs.window_tick = tick;
+	fs.audio_ns = 0;
+}
+
+void frameskip_auto_reset(void) {
+	fs = (struct frameskip_state){0};
+}
+
+void frameskip_audio_enter(void) {
+	fs.audio_enter_ns = hosttime_ns();
+}
+
+void frameskip_audio_leave(void) {
+	if (fs.audio_enter_ns)
+		fs.audio_ns += hosttime_ns() - fs.audio_enter_ns;
+	fs.audio_enter_ns = 0;
+}
+
+static void adjust(uint64_t now, uint32_t tick) {
+	uint64_t wall_ns = now - fs.window_ns;
+	if (wall_ns == 0)
+		return;
+	double emulated_s = (double)(uint32_t)(tick - fs.window_tick) / EVENT_TICK_RATE;
+	double speed = emulated_s * 1e9 / wall_ns;
+	double idle = (double)fs.audio_ns / wall_ns;
+
+	unsigned skip = fs.skip;
+	if ((speed < SPEED_LOW || idle < IDLE_LOW) && skip < FRAMESKIP_AUTO_MAX) {
+		skip++;
+	} else if (speed >= SPEED_LOW && idle > IDLE_HIGH && skip > 0) {
+		skip--;
+	}
+	if (skip != fs.skip) {
+		LOG_DEBUG(2, "Frameskip: %u (%.1f%% speed, %.1f%% idle)\n",
+			  skip, 100. * speed, 100. * idle);
+		fs.skip = skip;
+	}
+	start_window(now, tick);
+}
+
+_Bool frameskip_auto_frame(uint32_t tick, _Bool ratelimit, unsigned refresh_rate) {
+	uint64_t now = hosttime_ns();
+
+	if (!ratelimit) {
+		fs.ratelimit = 0;
+		unsigned hz = refresh_rate ? refresh_rate : FRAMESKIP_DEFAULT_REFRESH;
+		if (fs.last_present_ns && (now - fs.last_present_ns) < 1000000000 / hz)
+			return 0;
+		fs.last_present_ns = now;
+		return 1;
+	}
+
+	// Measurements taken while running flat out are meaningless
+	if (!fs.ratelimit) {
+		fs.ratelimit = 1;
+		start_window(now, tick);
+	}
+	if (++fs.nframes >= WINDOW_FRAMES)
+		adjust(now, tick);
+	STATS_FRAMESKIP_AUTO(fs.skip);
+
+	if (fs.countdown > 0) {
+		fs.countdown--;
+		return 0;
+	}
+	fs.countdown = fs.skip;
+	fs.last_present_ns = now;
+	return 1;
+}
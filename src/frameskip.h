@@ -0,0 +1,49 @@
+/*
+
+Automatic frameskip
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifndef XROAR_FRAMESKIP_H_
+#define XROAR_FRAMESKIP_H_
+
+#include <stdint.h>
+
+// Upper limit for the automatically chosen frameskip
+#define FRAMESKIP_AUTO_MAX (10)
+
+// Assumed display refresh rate when the video module doesn't know
+#define FRAMESKIP_DEFAULT_REFRESH (60)
+
+/* Controller state is per-thread, as it's driven from the emulation loop. */
+
+// Forget measurements and start again with no frames skipped.
+void frameskip_auto_reset(void);
+
+// Bracket writes to the audio module.  While rate limited, time spent in here
+// is time the host had to spare.
+void frameskip_audio_enter(void);
+void frameskip_audio_leave(void);
+
+/* Call once per emulated frame with the current emulated time.  Returns true
+ * if the frame should be presented.
+ *
+ * When rate limited, the number of frames skipped is raised while the host
+ * can't keep up or has little time to spare waiting for audio, and lowered
+ * again when there's plenty.  Otherwise, frames are presented no more often
+ * than refresh_rate (Hz, 0 if unknown). */
+
+_Bool frameskip_auto_frame(uint32_t tick, _Bool ratelimit, unsigned refresh_rate);
+
+#endif
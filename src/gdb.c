@@ -42,20 +42,48 @@ See COPYING.GPL for redistribution conditions.
  * packets must supply 19 values, either hex pairs or 'xx'.
  *
  * 'm' and 'M' packets will read or write translated memory addresses (as seen
- * by the CPU).
+ * by the CPU).  'X' packets write binary data to memory.  Packets of up to
+ * 16K are accepted, so large transfers take few round trips.
  *
  * Breakpoints and watchpoints are supported ('Z' and 'z').
  *
+ * Execution is controlled with 'c' and 's', or 'vCont' with continue ('c'),
+ * step ('s') or range step ('r') actions.  As there is only one thread, only
+ * the first action of a 'vCont' packet is used.  'QStartNoAckMode' is
+ * supported, and worth using when single stepping a lot.
+ *
+ * The socket thread never runs the machine itself: execution commands are
+ * passed to the machine through a lock-free queue, and stop replies are sent
+ * from the machine's thread as soon as it stops.
+ *
+ * If the machine keeps a history of its execution, reverse step and continue
+ * ('bs' and 'bc') are supported.  Reaching the beginning of history is
+ * reported with a "replaylog:begin" stop reason.  Modifying memory or
+ * registers while looking back through history discards everything after
+ * that point.
+ *
  * Some standard, and some vendor-specific general queries are supported:
 
  *      qxroar.sam      XXXX    get SAM register, reply is 4 hex digits
- *      qSupported      XX...   report PacketSize
+ *      qSupported      XX...   report PacketSize and supported features
  *      qAttached       1       always report attached
+ *      qRcmd,XX...     O...    "monitor" command, see below and bp_cmd.h
+ *      qXfer:memory-map:read::OFFSET,LENGTH
+ *                              memory map for the current SAM map type
+
+ * In addition to the breakpoint commands in bp_cmd.h, "monitor" accepts:
+
+ *      ram save FILE [PAGE]    write RAM page 0 or 1 (default both) to FILE
+ *      ram load FILE [PAGE]    read RAM page 0 or 1 (default both) from FILE
 
  * Only these vendor-specific general sets are supported:
 
  *      Qxroar.sam:XXXX         set SAM register (4 hex digits)
 
+ * and the standard:
+
+ *      QStartNoAckMode         stop sending and expecting '+' and '-'
+
  */
 
 #ifdef HAVE_CONFIG_H
@@ -72,6 +100,7 @@ See COPYING.GPL for redistribution conditions.
 #include <ctype.h>
 #include <errno.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -79,6 +108,7 @@ See COPYING.GPL for redistribution conditions.
 #include <sys/time.h>
 
 #include "pl-string.h"
+#include "sds.h"
 #include "xalloc.h"
 
 #ifndef WINDOWS32
@@ -100,23 +130,54 @@ See COPYING.GPL for redistribution conditions.
 
 #endif
 
+#include "pl-thread.h"
+
+#include "bp_cmd.h"
 #include "breakpoint.h"
+#include "events.h"
 #include "gdb.h"
 #include "hd6309.h"
 #include "logging.h"
 #include "machine.h"
 #include "mc6809.h"
+#include "replay.h"
 #include "sam.h"
 #include "xroar.h"
 
+// Commands from the socket thread to the machine's thread
+
+enum gdb_cmd_type {
+	GDB_CMD_STOP,
+	GDB_CMD_CONTINUE,
+	GDB_CMD_STEP,
+	GDB_CMD_RANGE_STEP,
+	GDB_CMD_REVERSE_STEP,
+	GDB_CMD_REVERSE_CONTINUE,
+};
+
+struct gdb_cmd {
+	enum gdb_cmd_type type;
+	int sig;  // GDB_CMD_STOP
+	unsigned start, end;  // GDB_CMD_RANGE_STEP
+};
+
+// Power of 2
+#define GDB_CMD_QUEUE_SIZE (16)
+
 struct gdb_interface_private {
 	struct machine *machine;
+	// Emulation context of the machine, made current in the socket thread
+	struct xroar_context *context;
 
 	struct MC6809 *cpu;
 	struct MC6883 *sam;
 
 	// Breakpoint session
 	struct bp_session *bp_session;
+	// User breakpoint commands, for "monitor"
+	struct bp_cmd *bp_cmd;
+	// Execution history, if kept
+	struct replay *replay;
 
 	// Thread info
 	int listenfd;
@@ -124,11 +185,29 @@ struct gdb_interface_private {
 	pthread_t sock_thread;
 	int sockfd;
 
-	// Run state
-	enum gdb_run_state run_state;
+	// Run state.  Only changed by the machine's thread, which takes
+	// commands from the socket thread through the command queue.  The
+	// condition variable wakes the machine's thread when a command is
+	// queued while it is stopped, and the socket thread when the machine
+	// stops.
+	atomic_int run_state;
 	pthread_cond_t run_state_cv;
 	pthread_mutex_t run_state_mt;
 	int last_signal;
+	_Bool replay_begin;  // reverse execution reached start of history
+	unsigned range_start, range_end;  // range stepping
+
+	// Command queue: single producer (socket thread), single consumer
+	// (machine's thread).  Indices only ever increase.
+	struct gdb_cmd cmd_queue[GDB_CMD_QUEUE_SIZE];
+	atomic_uint cmd_head;
+	atomic_uint cmd_tail;
+
+	// Connection state, socket thread only
+	_Bool no_ack;
+	unsigned rbuf_pos;
+	unsigned rbuf_len;
+	char rbuf[4096];
 
 	// Debugging
 	unsigned debug;
@@ -146,8 +225,15 @@ enum gdb_error {
 	GDBE_WRITE_ERROR,
 };
 
-static char in_packet[1025];
-static char packet[1025];
+// Maximum packet size, reported to the client.  Big enough to transfer
+// whole pages of RAM in a few packets.
+#define GDB_PACKET_SIZE (0x4000)
+
+// One socket thread per interface, so buffers are per-thread.
+static THREAD_LOCAL char in_packet[GDB_PACKET_SIZE + 1];
+static THREAD_LOCAL char packet[GDB_PACKET_SIZE + 1];
+// Outgoing packet after escaping, with framing and checksum
+static THREAD_LOCAL char out_packet[2 * sizeof(packet) + 4];
 
 static int read_packet(struct gdb_interface_private *gip, char *buffer, unsigned count);
 static int send_packet(struct gdb_interface_private *gip, const char *buffer, unsigned count);
@@ -159,14 +245,17 @@ static void send_general_registers(struct gdb_interface_private *gip);  // g
 static void set_general_registers(struct gdb_interface_private *gip, char *args);  // G
 static void send_memory(struct gdb_interface_private *gip, char *args);  // m
 static void set_memory(struct gdb_interface_private *gip, char *args);  // M
+static void set_memory_binary(struct gdb_interface_private *gip, char *args, unsigned args_len);  // X
 static void send_register(struct gdb_interface_private *gip, char *args);  // p
 static void set_register(struct gdb_interface_private *gip, char *args);  // P
 static void general_query(struct gdb_interface_private *gip, char *args);  // q
 static void general_set(struct gdb_interface_private *gip, char *args);  // Q
+static void v_packet(struct gdb_interface_private *gip, char *args);  // v
 static void add_breakpoint(struct gdb_interface_private *gip, char *args);  // Z
 static void remove_breakpoint(struct gdb_interface_private *gip, char *args);  // z
 
 static void send_supported(struct gdb_interface_private *gip, char *args);  // qSupported
+static void send_memory_map(struct gdb_interface_private *gip, char *args);  // qXfer:memory-map
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
@@ -181,9 +270,12 @@ struct gdb_interface *gdb_interface_new(const char *hostname, const char *portna
 	*gip = (struct gdb_interface_private){0};
 
 	gip->machine = m;
+	gip->context = xroar_context;
 	gip->cpu = m->get_component(m, "CPU0");
 	gip->sam = m->get_component(m, "SAM0");
 	gip->bp_session = bp_session;
+	gip->bp_cmd = m->get_interface(m, "bp-cmd");
+	gip->replay = m->get_interface(m, "replay");
 	gip->run_state = gdb_run_state_running;
 
 	struct addrinfo hints;
@@ -254,13 +346,122 @@ void gdb_interface_free(struct gdb_interface *gi) {
 	free(gip);
 }
 
-// Lock the run_state mutex and return true if ready to run
-int gdb_run_lock(struct gdb_interface *gi) {
+// Socket thread: queue a command for the machine's thread, and wake it in
+// case it's waiting while stopped.
+
+static void send_command(struct gdb_interface_private *gip, struct gdb_cmd const *cmd) {
+	unsigned head = atomic_load_explicit(&gip->cmd_head, memory_order_relaxed);
+	unsigned tail = atomic_load_explicit(&gip->cmd_tail, memory_order_acquire);
+	if ((head - tail) >= GDB_CMD_QUEUE_SIZE) {
+		LOG_WARN("gdb: command queue full\n");
+		return;
+	}
+	gip->cmd_queue[head % GDB_CMD_QUEUE_SIZE] = *cmd;
+	atomic_store_explicit(&gip->cmd_head, head + 1, memory_order_release);
+	pthread_mutex_lock(&gip->run_state_mt);
+	pthread_cond_broadcast(&gip->run_state_cv);
+	pthread_mutex_unlock(&gip->run_state_mt);
+}
+
+static void send_command_type(struct gdb_interface_private *gip, enum gdb_cmd_type type, int sig) {
+	struct gdb_cmd cmd = { .type = type, .sig = sig };
+	send_command(gip, &cmd);
+}
+
+static _Bool command_queue_empty(struct gdb_interface_private *gip) {
+	unsigned head = atomic_load_explicit(&gip->cmd_head, memory_order_acquire);
+	unsigned tail = atomic_load_explicit(&gip->cmd_tail, memory_order_acquire);
+	return head == tail;
+}
+
+// Socket thread: true if the machine is stopped and will stay that way until
+// sent another command.
+
+static _Bool machine_stopped(struct gdb_interface_private *gip) {
+	return command_queue_empty(gip) && atomic_load(&gip->run_state) == gdb_run_state_stopped;
+}
+
+// Socket thread: wait for the machine to stop.  Used on connection, where
+// nothing can be done until it has.
+
+static void wait_stopped(struct gdb_interface_private *gip) {
+	pthread_mutex_lock(&gip->run_state_mt);
+	while (!machine_stopped(gip)) {
+		pthread_cond_wait(&gip->run_state_cv, &gip->run_state_mt);
+	}
+	pthread_mutex_unlock(&gip->run_state_mt);
+}
+
+// Machine's thread: the machine stopped.  Run state is updated before the
+// stop reply is sent, so that the next packet from the client is accepted.
+
+static void machine_stop(struct gdb_interface_private *gip, int sig) {
+	atomic_store(&gip->run_state, gdb_run_state_stopped);
+	gip->last_signal = sig;
+	send_last_signal(gip);
+	pthread_mutex_lock(&gip->run_state_mt);
+	pthread_cond_broadcast(&gip->run_state_cv);
+	pthread_mutex_unlock(&gip->run_state_mt);
+}
+
+// Machine's thread: act on any queued commands.  The socket thread considers
+// the machine stopped only if the queue is empty, so a new run state is set
+// before its command is removed from the queue, and a stop (which wakes the
+// socket thread) happens after.
+
+static void process_commands(struct gdb_interface_private *gip) {
+	unsigned tail = atomic_load_explicit(&gip->cmd_tail, memory_order_relaxed);
+	unsigned head = atomic_load_explicit(&gip->cmd_head, memory_order_acquire);
+	while (tail != head) {
+		struct gdb_cmd cmd = gip->cmd_queue[tail % GDB_CMD_QUEUE_SIZE];
+		int run_state = atomic_load(&gip->run_state);
+		if (cmd.type != GDB_CMD_STOP && run_state == gdb_run_state_stopped) {
+			gip->replay_begin = 0;
+			switch (cmd.type) {
+			case GDB_CMD_CONTINUE:
+				run_state = gdb_run_state_running;
+				break;
+			case GDB_CMD_STEP:
+				run_state = gdb_run_state_single_step;
+				break;
+			case GDB_CMD_RANGE_STEP:
+				gip->range_start = cmd.start;
+				gip->range_end = cmd.end;
+				run_state = gdb_run_state_range_step;
+				break;
+			case GDB_CMD_REVERSE_STEP:
+				run_state = gdb_run_state_reverse_step;
+				break;
+			case GDB_CMD_REVERSE_CONTINUE:
+				run_state = gdb_run_state_reverse_continue;
+				break;
+			default:
+				break;
+			}
+			atomic_store(&gip->run_state, run_state);
+		}
+		tail++;
+		atomic_store_explicit(&gip->cmd_tail, tail, memory_order_release);
+		if (cmd.type == GDB_CMD_STOP && run_state != gdb_run_state_stopped) {
+			gip->machine->signal(gip->machine, cmd.sig);
+			machine_stop(gip, cmd.sig);
+		}
+		head = atomic_load_explicit(&gip->cmd_head, memory_order_acquire);
+	}
+}
+
+// Process any commands and return the resulting run state.  If stopped, wait
+// up to 20ms for a command, returning early as soon as one arrives.
+
+int gdb_run_poll(struct gdb_interface *gi) {
 	struct gdb_interface_private *gip = (struct gdb_interface_private *)gi;
 
+	process_commands(gip);
+	if (atomic_load(&gip->run_state) != gdb_run_state_stopped)
+		return atomic_load(&gip->run_state);
+
 	pthread_mutex_lock(&gip->run_state_mt);
-	if (gip->run_state == gdb_run_state_stopped) {
-		// If machine stopped, wait up to 20ms for state to change
+	if (command_queue_empty(gip)) {
 		struct timeval tv;
 		gettimeofday(&tv, NULL);
 		tv.tv_usec += 20000;
@@ -269,70 +470,40 @@ int gdb_run_lock(struct gdb_interface *gi) {
 		struct timespec ts;
 		ts.tv_sec = tv.tv_sec;
 		ts.tv_nsec = tv.tv_usec * 1000;
-		if (pthread_cond_timedwait(&gip->run_state_cv, &gip->run_state_mt, &ts) == ETIMEDOUT) {
-			pthread_mutex_unlock(&gip->run_state_mt);
-			return gdb_run_state_stopped;
-		}
+		pthread_cond_timedwait(&gip->run_state_cv, &gip->run_state_mt, &ts);
 	}
-	return gip->run_state;
-}
-
-void gdb_run_unlock(struct gdb_interface *gi) {
-	struct gdb_interface_private *gip = (struct gdb_interface_private *)gi;
 	pthread_mutex_unlock(&gip->run_state_mt);
+	process_commands(gip);
+	return atomic_load(&gip->run_state);
 }
 
-static void gdb_handle_signal(struct gdb_interface_private *gip, int sig) {
-	gip->last_signal = sig;
-	send_last_signal(gip);
+void gdb_get_step_range(struct gdb_interface *gi, unsigned *start, unsigned *end) {
+	struct gdb_interface_private *gip = (struct gdb_interface_private *)gi;
+	*start = gip->range_start;
+	*end = gip->range_end;
 }
 
 void gdb_stop(struct gdb_interface *gi, int sig) {
 	struct gdb_interface_private *gip = (struct gdb_interface_private *)gi;
-	gip->run_state = gdb_run_state_stopped;
-	gdb_handle_signal(gip, sig);
+	machine_stop(gip, sig);
 }
 
 void gdb_single_step(struct gdb_interface *gi) {
 	struct gdb_interface_private *gip = (struct gdb_interface_private *)gi;
-	gip->run_state = gdb_run_state_stopped;
-	gdb_handle_signal(gip, MACHINE_SIGTRAP);
-	pthread_cond_signal(&gip->run_state_cv);
-}
-
-static void gdb_machine_single_step(struct gdb_interface_private *gip) {
-	pthread_mutex_lock(&gip->run_state_mt);
-	if (gip->run_state == gdb_run_state_stopped) {
-		gip->run_state = gdb_run_state_single_step;
-		pthread_cond_wait(&gip->run_state_cv, &gip->run_state_mt);
-	}
-	pthread_mutex_unlock(&gip->run_state_mt);
-}
-
-static void gdb_machine_signal(struct gdb_interface_private *gip, int sig) {
-	pthread_mutex_lock(&gip->run_state_mt);
-	if (gip->run_state == gdb_run_state_running) {
-		gip->machine->signal(gip->machine, sig);
-		gip->run_state = gdb_run_state_stopped;
-		gdb_handle_signal(gip, sig);
-	}
-	pthread_mutex_unlock(&gip->run_state_mt);
+	machine_stop(gip, MACHINE_SIGTRAP);
 }
 
-static void gdb_continue(struct gdb_interface_private *gip) {
-	//struct gdb_interface_private *gip = (struct gdb_interface_private *)gi;
-	pthread_mutex_lock(&gip->run_state_mt);
-	if (gip->run_state == gdb_run_state_stopped) {
-		gip->run_state = gdb_run_state_running;
-		pthread_cond_signal(&gip->run_state_cv);
-	}
-	pthread_mutex_unlock(&gip->run_state_mt);
+void gdb_reverse_stop(struct gdb_interface *gi, _Bool begin) {
+	struct gdb_interface_private *gip = (struct gdb_interface_private *)gi;
+	gip->replay_begin = begin;
+	machine_stop(gip, MACHINE_SIGTRAP);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 static void *handle_tcp_sock(void *sptr) {
 	struct gdb_interface_private *gip = sptr;
+	xroar_context_set(gip->context);
 
 	for (;;) {
 
@@ -371,7 +542,10 @@ static void *handle_tcp_sock(void *sptr) {
 			LOG_PRINT("gdb: connection accepted\n");
 		}
 
-		gdb_machine_signal(gip, MACHINE_SIGINT);
+		gip->no_ack = 0;
+		gip->rbuf_pos = gip->rbuf_len = 0;
+		send_command_type(gip, GDB_CMD_STOP, MACHINE_SIGINT);
+		wait_stopped(gip);
 		_Bool attached = 1;
 		while (attached) {
 			int l = read_packet(gip, in_packet, sizeof(in_packet));
@@ -379,17 +553,20 @@ static void *handle_tcp_sock(void *sptr) {
 				if (gip->debug & GDB_DEBUG_PACKET) {
 					LOG_PRINT("gdb: BREAK\n");
 				}
-				gdb_machine_signal(gip, MACHINE_SIGINT);
+				// Nothing to do if already stopped
+				if (!machine_stopped(gip))
+					send_command_type(gip, GDB_CMD_STOP, MACHINE_SIGINT);
 				continue;
 			} else if (l == -GDBE_BAD_CHECKSUM) {
-				if (send_char(gip, '-') < 0)
+				if (!gip->no_ack && send_char(gip, '-') < 0)
 					break;
 				continue;
 			} else if (l < 0) {
 				break;
 			}
+			_Bool stopped = machine_stopped(gip);
 			if (gip->debug & GDB_DEBUG_PACKET) {
-				if (gip->run_state == gdb_run_state_stopped) {
+				if (stopped) {
 					LOG_PRINT("gdb: packet received: ");
 				} else {
 					LOG_PRINT("gdb: packet ignored (send ^C first): ");
@@ -403,12 +580,12 @@ static void *handle_tcp_sock(void *sptr) {
 				}
 				LOG_PRINT("\n");
 			}
-			if (gip->run_state != gdb_run_state_stopped) {
-				if (send_char(gip, '-') < 0)
+			if (!stopped) {
+				if (!gip->no_ack && send_char(gip, '-') < 0)
 					break;
 				continue;
 			}
-			if (send_char(gip, '+') < 0)
+			if (!gip->no_ack && send_char(gip, '+') < 0)
 				break;
 
 			char *args = &in_packet[1];
@@ -419,8 +596,18 @@ static void *handle_tcp_sock(void *sptr) {
 				send_last_signal(gip);
 				break;
 
+			case 'b':
+				if (gip->replay && args[0] == 's') {
+					send_command_type(gip, GDB_CMD_REVERSE_STEP, 0);
+				} else if (gip->replay && args[0] == 'c') {
+					send_command_type(gip, GDB_CMD_REVERSE_CONTINUE, 0);
+				} else {
+					send_packet(gip, NULL, 0);
+				}
+				break;
+
 			case 'c':
-				gdb_continue(gip);
+				send_command_type(gip, GDB_CMD_CONTINUE, 0);
 				break;
 
 			case 'D':
@@ -461,7 +648,15 @@ static void *handle_tcp_sock(void *sptr) {
 				break;
 
 			case 's':
-				gdb_machine_single_step(gip);
+				send_command_type(gip, GDB_CMD_STEP, 0);
+				break;
+
+			case 'v':
+				v_packet(gip, args);
+				break;
+
+			case 'X':
+				set_memory_binary(gip, args, l - 1);
 				break;
 
 			case 'z':
@@ -478,7 +673,7 @@ static void *handle_tcp_sock(void *sptr) {
 			}
 		}
 		close(gip->sockfd);
-		gdb_continue(gip);
+		send_command_type(gip, GDB_CMD_CONTINUE, 0);
 		if (gip->debug & GDB_DEBUG_CONNECT) {
 			LOG_PRINT("gdb: connection closed\n");
 		}
@@ -500,36 +695,43 @@ static int read_packet(struct gdb_interface_private *gip, char *buffer, unsigned
 	unsigned length = 0;
 	uint8_t packet_sum = 0;
 	uint8_t csum = 0;
+	_Bool escape = 0;
 	char in_byte;
 	int tmp;
 
 	while (1) {
 
-		// Another Windows workaround - recv() not a cancellation point?
-		while (1) {
-			fd_set fds;
-			struct timeval tv;
-			FD_ZERO(&fds);
-			FD_SET(gip->sockfd, &fds);
-			tv.tv_sec = 0;
-			tv.tv_usec = 200000;
-			pthread_testcancel();
-			int r = select(gip->sockfd+1, &fds, NULL, NULL, &tv);
-			if (r > 0) {
-				break;
+		if (gip->rbuf_pos >= gip->rbuf_len) {
+			// Another Windows workaround - recv() not a cancellation point?
+			while (1) {
+				fd_set fds;
+				struct timeval tv;
+				FD_ZERO(&fds);
+				FD_SET(gip->sockfd, &fds);
+				tv.tv_sec = 0;
+				tv.tv_usec = 200000;
+				pthread_testcancel();
+				int r = select(gip->sockfd+1, &fds, NULL, NULL, &tv);
+				if (r > 0) {
+					break;
+				}
 			}
-		}
 
-		int r = recv(gip->sockfd, &in_byte, 1, 0);
-		if (r < 0)
-			return -GDBE_READ_ERROR;
-		if (r == 0)
-			continue;
+			// Read as much as is available.  Zero means the
+			// connection was closed.
+			int r = recv(gip->sockfd, gip->rbuf, sizeof(gip->rbuf), 0);
+			if (r <= 0)
+				return -GDBE_READ_ERROR;
+			gip->rbuf_pos = 0;
+			gip->rbuf_len = r;
+		}
+		in_byte = gip->rbuf[gip->rbuf_pos++];
 
 		switch (state) {
 		case packet_wait:
 			if (in_byte == '$') {
 				packet_sum = 0;
+				escape = 0;
 				state = packet_read;
 			} else if (in_byte == 3) {
 				return -GDBE_BREAK;
@@ -539,9 +741,18 @@ static int read_packet(struct gdb_interface_private *gip, char *buffer, unsigned
 			if (in_byte == '#') {
 				state = packet_csum0;
 			} else {
+				// Checksum covers escaped data
+				packet_sum += (uint8_t)in_byte;
+				if (in_byte == 0x7d && !escape) {
+					escape = 1;
+					break;
+				}
+				if (escape) {
+					in_byte ^= 0x20;
+					escape = 0;
+				}
 				if (length < (count - 1)) {
 					buffer[length++] = in_byte;
-					packet_sum += (uint8_t)in_byte;
 				}
 			}
 			break;
@@ -582,12 +793,14 @@ static int read_packet(struct gdb_interface_private *gip, char *buffer, unsigned
 	return -GDBE_READ_ERROR;
 }
 
+// Escape and frame the whole packet so that it can be sent at once.
+
 static int send_packet(struct gdb_interface_private *gip, const char *buffer, unsigned count) {
-	char tmpbuf[4];
+	if (count > sizeof(packet))
+		count = sizeof(packet);
+	unsigned length = 0;
 	uint8_t csum = 0;
-	tmpbuf[0] = '$';
-	if (send(gip->sockfd, tmpbuf, 1, 0) < 0)
-		return -GDBE_WRITE_ERROR;
+	out_packet[length++] = '$';
 	for (unsigned i = 0; i < count; i++) {
 		csum += buffer[i];
 		switch (buffer[i]) {
@@ -595,20 +808,22 @@ static int send_packet(struct gdb_interface_private *gip, const char *buffer, un
 		case '$':
 		case 0x7d:
 		case '*':
-			tmpbuf[0] = 0x7d;
-			tmpbuf[1] = buffer[i] ^ 0x20;
-			if (send(gip->sockfd, tmpbuf, 2, 0) < 0)
-				return -GDBE_WRITE_ERROR;
+			out_packet[length++] = 0x7d;
+			out_packet[length++] = buffer[i] ^ 0x20;
 			break;
 		default:
-			if (send(gip->sockfd, &buffer[i], 1, 0) < 0)
-				return -GDBE_WRITE_ERROR;
+			out_packet[length++] = buffer[i];
 			break;
 		}
 	}
-	snprintf(tmpbuf, sizeof(tmpbuf), "#%02x", (unsigned)csum);
-	if (send(gip->sockfd, tmpbuf, 3, 0) < 0)
-		return -GDBE_WRITE_ERROR;
+	snprintf(out_packet + length, 4, "#%02x", (unsigned)csum);
+	length += 3;
+	for (unsigned i = 0; i < length; ) {
+		int r = send(gip->sockfd, out_packet + i, length - i, 0);
+		if (r < 0)
+			return -GDBE_WRITE_ERROR;
+		i += r;
+	}
 	// the reply ("+" or "-") will be discarded by the next read_packet
 
 	if (gip->debug & GDB_DEBUG_PACKET) {
@@ -640,7 +855,12 @@ static int send_char(struct gdb_interface_private *gip, char c) {
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 static void send_last_signal(struct gdb_interface_private *gip) {
-	char tmpbuf[4];
+	char tmpbuf[24];
+	if (gip->replay_begin) {
+		int len = snprintf(tmpbuf, sizeof(tmpbuf), "T%02xreplaylog:begin;", gip->last_signal);
+		send_packet(gip, tmpbuf, len);
+		return;
+	}
 	snprintf(tmpbuf, sizeof(tmpbuf), "S%02x", gip->last_signal);
 	send_packet(gip, tmpbuf, 3);
 }
@@ -702,6 +922,7 @@ static void set_general_registers(struct gdb_interface_private *gip, char *args)
 		if ((tmp = hex16(args+34)) >= 0)
 			((struct HD6309 *)gip->cpu)->reg_v = tmp;
 	}
+	replay_diverge(gip->replay);
 	send_packet_string(gip, "OK");
 }
 
@@ -711,25 +932,14 @@ static void send_memory(struct gdb_interface_private *gip, char *args) {
 		goto error;
 	uint16_t A = strtoul(addr, NULL, 16);
 	unsigned length = strtoul(args, NULL, 16);
-	uint8_t csum = 0;
-	packet[0] = '$';
-	if (send(gip->sockfd, packet, 1, 0) < 0)
-		return;
+	// Client should respect PacketSize, but a short reply is allowed
+	if (length > (sizeof(packet) - 1) / 2)
+		length = (sizeof(packet) - 1) / 2;
 	for (unsigned i = 0; i < length; i++) {
 		uint8_t b = gip->machine->read_byte(gip->machine, A++);
-		snprintf(packet, sizeof(packet), "%02x", b);
-		csum += packet[0];
-		csum += packet[1];
-		if (send(gip->sockfd, packet, 2, 0) < 0)
-			return;
-	}
-	snprintf(packet, sizeof(packet), "#%02x", csum);
-	if (send(gip->sockfd, packet, 3, 0) < 0)
-		return;
-	// the ACK ("+") or NAK ("-") will be discarded by the next read_packet
-	if (gip->debug & GDB_DEBUG_PACKET) {
-		LOG_PRINT("gdb: packet sent (binary): %u bytes\n", length);
+		snprintf(packet + i*2, 3, "%02x", b);
 	}
+	send_packet(gip, packet, length * 2);
 	return;
 error:
 	send_packet(gip, NULL, 0);
@@ -755,6 +965,34 @@ static void set_memory(struct gdb_interface_private *gip, char *args) {
 		A++;
 		data += 2;
 	}
+	replay_diverge(gip->replay);
+	send_packet_string(gip, "OK");
+	return;
+error:
+	send_packet_string(gip, "E00");
+}
+
+// X addr,length:BINARY-DATA
+
+static void set_memory_binary(struct gdb_interface_private *gip, char *args, unsigned args_len) {
+	char *end = args + args_len;
+	char *arglist = strsep(&args, ":");
+	char *data = args;
+	if (!arglist || !data)
+		goto error;
+	char *addr = strsep(&arglist, ",");
+	if (!addr || !arglist)
+		goto error;
+	uint16_t A = strtoul(addr, NULL, 16);
+	unsigned length = strtoul(arglist, NULL, 16);
+	if (length > (unsigned)(end - data))
+		goto error;
+	// A zero length write is used to probe for 'X' support
+	for (unsigned i = 0; i < length; i++) {
+		gip->machine->write_byte(gip->machine, A++, (uint8_t)data[i]);
+	}
+	if (length > 0)
+		replay_diverge(gip->replay);
 	send_packet_string(gip, "OK");
 	return;
 error:
@@ -828,12 +1066,123 @@ static void set_register(struct gdb_interface_private *gip, char *args) {
 	case 12: hcpu->reg_v = value; break;
 	default: break;
 	}
+	replay_diverge(gip->replay);
 	send_packet_string(gip, "OK");
 	return;
 error:
 	send_packet_string(gip, "E00");
 }
 
+// Decode and run a "monitor" command.  Output is sent back as a series of
+// 'O' packets before the final "OK" (or "E01" on error).
+
+// Save or load whole pages of RAM on the host.  Much faster than transferring
+// the data over the connection.  With no page specified, both pages are
+// saved or loaded in turn.
+
+static int ram_command(struct gdb_interface_private *gip, char *line, sds *out) {
+	char *saveptr = NULL;
+	char *op = strtok_r(line, " \t", &saveptr);
+	char *filename = op ? strtok_r(NULL, " \t", &saveptr) : NULL;
+	char *page_str = filename ? strtok_r(NULL, " \t", &saveptr) : NULL;
+	_Bool save;
+	if (op && 0 == strcmp(op, "save")) {
+		save = 1;
+	} else if (op && 0 == strcmp(op, "load")) {
+		save = 0;
+	} else {
+		*out = sdscat(*out, "usage: ram save|load FILE [PAGE]\n");
+		return -1;
+	}
+	if (!filename) {
+		*out = sdscat(*out, "ram: filename expected\n");
+		return -1;
+	}
+	int first = 0, last = 1;
+	if (page_str) {
+		first = last = strtol(page_str, NULL, 0);
+		if (first < 0 || first > 1) {
+			*out = sdscat(*out, "ram: page must be 0 or 1\n");
+			return -1;
+		}
+	}
+
+	FILE *fd = fopen(filename, save ? "wb" : "rb");
+	if (!fd) {
+		*out = sdscatprintf(*out, "ram: %s: %s\n", filename, strerror(errno));
+		return -1;
+	}
+	size_t total = 0;
+	for (int page = first; page <= last; page++) {
+		struct machine_memory *mem = gip->machine->get_component(gip->machine, page ? "RAM1" : "RAM0");
+		if (!mem || !mem->size)
+			continue;
+		size_t n;
+		if (save) {
+			n = fwrite(mem->data, 1, mem->size, fd);
+		} else {
+			n = fread(mem->data, 1, mem->size, fd);
+		}
+		total += n;
+		if (n < mem->size)
+			break;
+	}
+	fclose(fd);
+	if (!save && total > 0)
+		replay_diverge(gip->replay);
+	*out = sdscatprintf(*out, "%s %zu bytes\n", save ? "Saved" : "Loaded", total);
+	return 0;
+}
+
+static void monitor_command(struct gdb_interface_private *gip, char *hex) {
+	unsigned len = strlen(hex) / 2;
+	char *line = xmalloc(len + 1);
+	for (unsigned i = 0; i < len; i++) {
+		int b = hex8(hex + i*2);
+		if (b < 0) {
+			free(line);
+			send_packet_string(gip, "E00");
+			return;
+		}
+		line[i] = b;
+	}
+	line[len] = 0;
+
+	sds out = sdsempty();
+	int err = 0;
+	char *s = line + strspn(line, " \t");
+	if (0 == strncmp(s, "ram", 3) && (s[3] == 0 || isspace(s[3]))) {
+		err = ram_command(gip, s + 3, &out);
+	} else if (gip->bp_cmd) {
+		err = bp_cmd_exec(gip->bp_cmd, line, &out);
+		if (0 == strcmp(s, "help")) {
+			out = sdscat(out, "GDB only:\n"
+				     "  ram save|load FILE [PAGE]  save or load RAM page 0, 1 or both\n");
+		}
+	} else {
+		free(line);
+		sdsfree(out);
+		send_packet(gip, NULL, 0);
+		return;
+	}
+	free(line);
+
+	// Each output packet carries up to 256 bytes, hex encoded
+	size_t outlen = sdslen(out);
+	for (size_t i = 0; i < outlen; i += 256) {
+		size_t n = outlen - i;
+		if (n > 256)
+			n = 256;
+		packet[0] = 'O';
+		for (size_t j = 0; j < n; j++) {
+			sprintf(packet + 1 + j*2, "%02x", (uint8_t)out[i+j]);
+		}
+		send_packet(gip, packet, 1 + n*2);
+	}
+	sdsfree(out);
+	send_packet_string(gip, err ? "E01" : "OK");
+}
+
 static void general_query(struct gdb_interface_private *gip, char *args) {
 	char *query = strsep(&args, ":");
 	if (0 == strncmp(query, "xroar.", 6)) {
@@ -854,11 +1203,21 @@ static void general_query(struct gdb_interface_private *gip, char *args) {
 			LOG_PRINT("gdb: query: Supported\n");
 		}
 		send_supported(gip, args);
+	} else if (0 == strcmp(query, "Xfer") && args && 0 == strncmp(args, "memory-map:read::", 17)) {
+		if (gip->debug & GDB_DEBUG_QUERY) {
+			LOG_PRINT("gdb: query: Xfer:memory-map\n");
+		}
+		send_memory_map(gip, args + 17);
 	} else if (0 == strcmp(query, "Attached")) {
 		if (gip->debug & GDB_DEBUG_QUERY) {
 			LOG_PRINT("gdb: query: Attached\n");
 		}
 		send_packet_string(gip, "1");
+	} else if (0 == strncmp(query, "Rcmd,", 5)) {
+		if (gip->debug & GDB_DEBUG_QUERY) {
+			LOG_PRINT("gdb: query: Rcmd\n");
+		}
+		monitor_command(gip, query + 5);
 	} else {
 		if (gip->debug & GDB_DEBUG_QUERY) {
 			LOG_PRINT("gdb: query: unknown query\n");
@@ -869,10 +1228,18 @@ static void general_query(struct gdb_interface_private *gip, char *args) {
 
 static void general_set(struct gdb_interface_private *gip, char *args) {
 	char *set = strsep(&args, ":");
+	if (0 == strcmp(set, "StartNoAckMode")) {
+		// The client acknowledges this reply, then neither side sends
+		// any more acknowledgements
+		send_packet_string(gip, "OK");
+		gip->no_ack = 1;
+		return;
+	}
 	if (0 == strncmp(set, "xroar.", 6)) {
 		set += 6;
 		if (0 == strcmp(set, "sam")) {
 			sam_set_register(gip->sam, hex16(args));
+			replay_diverge(gip->replay);
 			send_packet_string(gip, "OK");
 			return;
 		}
@@ -881,6 +1248,45 @@ static void general_set(struct gdb_interface_private *gip, char *args) {
 	return;
 }
 
+// vCont? and vCont;ACTION[:THREAD-ID][;ACTION...]
+
+static void v_packet(struct gdb_interface_private *gip, char *args) {
+	if (0 == strcmp(args, "Cont?")) {
+		send_packet_string(gip, "vCont;c;C;s;S;r");
+		return;
+	}
+	if (0 != strncmp(args, "Cont;", 5)) {
+		send_packet(gip, NULL, 0);
+		return;
+	}
+	// Only one thread, so the first action applies.  Signals to deliver
+	// ('C' and 'S') are ignored.
+	char *action = args + 5;
+	struct gdb_cmd cmd = {0};
+	switch (*action) {
+	case 'c': case 'C':
+		cmd.type = GDB_CMD_CONTINUE;
+		break;
+	case 's': case 'S':
+		cmd.type = GDB_CMD_STEP;
+		break;
+	case 'r': {
+		char *end;
+		cmd.start = strtoul(action + 1, &end, 16);
+		if (*end != ',')
+			goto error;
+		cmd.end = strtoul(end + 1, NULL, 16);
+		cmd.type = GDB_CMD_RANGE_STEP;
+		} break;
+	default:
+		goto error;
+	}
+	send_command(gip, &cmd);
+	return;
+error:
+	send_packet_string(gip, "E00");
+}
+
 static void add_breakpoint(struct gdb_interface_private *gip, char *args) {
 	char *type_str = strsep(&args, ",");
 	if (!type_str || !args)
@@ -939,10 +1345,53 @@ error:
 
 static void send_supported(struct gdb_interface_private *gip, char *args) {
 	(void)args;  // args ignored at the moment
-	snprintf(packet, sizeof(packet), "PacketSize=%zx", sizeof(packet)-1);
+	snprintf(packet, sizeof(packet), "PacketSize=%zx;QStartNoAckMode+;qXfer:memory-map:read+%s", sizeof(packet)-1,
+		 gip->replay ? ";ReverseStep+;ReverseContinue+" : "");
 	send_packet_string(gip, packet);
 }
 
+// qXfer:memory-map:read::OFFSET,LENGTH
+
+// Regions depend on the SAM map type.  GDB has no type for I/O, so the page
+// at $FF00 is described as RAM, keeping it writable.
+
+static void send_memory_map(struct gdb_interface_private *gip, char *args) {
+	char *offset_str = strsep(&args, ",");
+	if (!offset_str || !args) {
+		send_packet_string(gip, "E00");
+		return;
+	}
+	unsigned offset = strtoul(offset_str, NULL, 16);
+	unsigned length = strtoul(args, NULL, 16);
+
+	_Bool map_type_1 = sam_get_register(gip->sam) & 0x8000;
+	sds xml = sdsnew("<?xml version=\"1.0\"?>\n"
+			 "<!DOCTYPE memory-map PUBLIC \"+//IDN gnu.org//DTD GDB Memory Map V1.0//EN\" "
+			 "\"http://sourceware.org/gdb/gdb-memory-map.dtd\">\n"
+			 "<memory-map>\n");
+	if (map_type_1) {
+		xml = sdscat(xml, "<memory type=\"ram\" start=\"0x0000\" length=\"0xff00\"/>\n");
+	} else {
+		xml = sdscat(xml, "<memory type=\"ram\" start=\"0x0000\" length=\"0x8000\"/>\n"
+			      "<memory type=\"rom\" start=\"0x8000\" length=\"0x7f00\"/>\n");
+	}
+	xml = sdscat(xml, "<memory type=\"ram\" start=\"0xff00\" length=\"0x0100\"/>\n"
+		      "</memory-map>\n");
+
+	// Reply is 'm' if more data follows, 'l' for the last part
+	size_t xml_len = sdslen(xml);
+	if (offset > xml_len)
+		offset = xml_len;
+	if (length > sizeof(packet) - 2)
+		length = sizeof(packet) - 2;
+	if (length > xml_len - offset)
+		length = xml_len - offset;
+	packet[0] = (offset + length < xml_len) ? 'm' : 'l';
+	memcpy(packet + 1, xml + offset, length);
+	send_packet(gip, packet, length + 1);
+	sdsfree(xml);
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 static int hexdigit(char c) {
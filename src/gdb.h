@@ -28,6 +28,9 @@ enum gdb_run_state {
 	gdb_run_state_running = 0,
 	gdb_run_state_stopped,
 	gdb_run_state_single_step,
+	gdb_run_state_range_step,
+	gdb_run_state_reverse_step,
+	gdb_run_state_reverse_continue,
 };
 
 struct gdb_interface;
@@ -35,10 +38,16 @@ struct gdb_interface;
 struct gdb_interface *gdb_interface_new(const char *hostname, const char *portname, struct machine *m, struct bp_session *bp_session);
 void gdb_interface_free(struct gdb_interface *gi);
 
-int gdb_run_lock(struct gdb_interface *gi);
-void gdb_run_unlock(struct gdb_interface *gi);
+// Called by the machine before running.  Acts on any commands from the
+// client and returns the run state.  If stopped, waits briefly for a command.
+int gdb_run_poll(struct gdb_interface *gi);
+// Range stepping: keep stepping while PC is in the range [start,end).
+void gdb_get_step_range(struct gdb_interface *gi, unsigned *start, unsigned *end);
 void gdb_stop(struct gdb_interface *gi, int sig);
 void gdb_single_step(struct gdb_interface *gi);
+// Reverse step or continue complete.  If begin is true, the beginning of
+// recorded history was reached.
+void gdb_reverse_stop(struct gdb_interface *gi, _Bool begin);
 _Bool gdb_signal_lock(struct gdb_interface *gi, int sig);
 
 /* Debugging */
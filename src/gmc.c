@@ -112,7 +112,7 @@ static void gmc_attach_interface(struct cart *c, const char *ifname, void *intf)
 		return;
 	struct gmc *gmc = (struct gmc *)c;
 	gmc->snd = intf;
-	gmc->csg = sn76489_new(4000000, gmc->snd->framerate, EVENT_TICK_RATE, event_current_tick);
+	gmc->csg = sn76489_new(4000000, gmc->snd->framerate, EVENT_TICK_RATE, xroar_context->current_tick);
 	part_add_component(&c->part, (struct part *)gmc->csg, "CSG");
 	if (gmc->csg) {
 		gmc->snd->get_cart_audio = DELEGATE_AS3(float, uint32, int, floatp, sn76489_get_audio, gmc->csg);
@@ -140,7 +140,7 @@ static uint8_t gmc_write(struct cart *c, uint16_t A, _Bool P2, _Bool R2, uint8_t
 	// 76489 sound register
 	sound_update(gmc->snd);
 	if (gmc->csg) {
-		sn76489_write(gmc->csg, event_current_tick, D);
+		sn76489_write(gmc->csg, xroar_context->current_tick, D);
 	}
 	return D;
 }
@@ -150,7 +150,7 @@ void gtk2_create_dc_window(struct ui_gtk2_interface *uigtk2) {
 	gtk_builder_connect_signals(builder, uigtk2);
 	g_object_unref(builder);
 
-	xroar_vdrive_interface->update_drive_cyl_head = DELEGATE_AS3(void, unsigned, unsigned, unsigned, update_drive_cyl_head, uigtk2);
+	xroar_context->vdrive_interface->update_drive_cyl_head = DELEGATE_AS3(void, unsigned, unsigned, unsigned, update_drive_cyl_head, uigtk2);
 }
 
 /* Drive Control - Signal Handlers */
@@ -83,7 +83,7 @@ void gtk2_joystick_init(struct ui_gtk2_interface *uigtk2) {
 	uigtk2->mouse_yoffset = 25.5;
 	uigtk2->mouse_xdiv = 252.;
 	uigtk2->mouse_ydiv = 189.;
-	uigtk2->last_mouse_update_time = event_current_tick;
+	uigtk2->last_mouse_update_time = xroar_context->current_tick;
 }
 
 static void update_mouse_state(struct ui_gtk2_interface *uigtk2) {
@@ -106,17 +106,17 @@ static void update_mouse_state(struct ui_gtk2_interface *uigtk2) {
 	uigtk2->mouse_button[0] = buttons & GDK_BUTTON1_MASK;
 	uigtk2->mouse_button[1] = buttons & GDK_BUTTON2_MASK;
 	uigtk2->mouse_button[2] = buttons & GDK_BUTTON3_MASK;
-	uigtk2->last_mouse_update_time = event_current_tick;
+	uigtk2->last_mouse_update_time = xroar_context->current_tick;
 }
 
 static unsigned read_axis(unsigned *a) {
-	if ((event_current_tick - global_uigtk2->last_mouse_update_time) >= EVENT_MS(10))
+	if ((xroar_context->current_tick - global_uigtk2->last_mouse_update_time) >= EVENT_MS(10))
 		update_mouse_state(global_uigtk2);
 	return *a;
 }
 
 static _Bool read_button(_Bool *b) {
-	if ((event_current_tick - global_uigtk2->last_mouse_update_time) >= EVENT_MS(10))
+	if ((xroar_context->current_tick - global_uigtk2->last_mouse_update_time) >= EVENT_MS(10))
 		update_mouse_state(global_uigtk2);
 	return *b;
 }
@@ -148,7 +148,7 @@ static struct joystick_axis *configure_axis(char *spec, unsigned jaxis) {
 	struct joystick_axis *axis = g_malloc(sizeof(*axis));
 	axis->read = (js_read_axis_func)read_axis;
 	axis->data = &global_uigtk2->mouse_axis[jaxis];
-	global_uigtk2->last_mouse_update_time = event_current_tick - EVENT_MS(10);
+	global_uigtk2->last_mouse_update_time = xroar_context->current_tick - EVENT_MS(10);
 	return axis;
 }
 
@@ -161,6 +161,6 @@ static struct joystick_button *configure_button(char *spec, unsigned jbutton) {
 	struct joystick_button *button = g_malloc(sizeof(*button));
 	button->read = (js_read_button_func)read_button;
 	button->data = &global_uigtk2->mouse_button[jbutton];
-	global_uigtk2->last_mouse_update_time = event_current_tick - EVENT_MS(10);
+	global_uigtk2->last_mouse_update_time = xroar_context->current_tick - EVENT_MS(10);
 	return button;
 }
@@ -88,7 +88,7 @@ static void input_file_selected(GtkTreeView *tree_view, GtkTreePath *path, GtkTr
 	(void)user_data;
 	gtk_tree_model_get_iter(GTK_TREE_MODEL(tc_input_list_store), &iter, path);
 	gtk_tree_model_get(GTK_TREE_MODEL(tc_input_list_store), &iter, TC_FILE_POINTER, &file, -1);
-	tape_seek_to_file(xroar_tape_interface->tape_input, file);
+	tape_seek_to_file(xroar_context->tape_interface->tape_input, file);
 }
 
 static void tc_toggled_fast(GtkToggleButton *togglebutton, gpointer user_data);
@@ -157,22 +157,22 @@ void gtk2_create_tc_window(struct ui_gtk2_interface *uigtk2) {
 	g_object_unref(builder);
 
 	event_init(&update_tape_counters_event, DELEGATE_AS0(void, update_tape_counters, uigtk2));
-	update_tape_counters_event.at_tick = event_current_tick + EVENT_MS(500);
-	event_queue(&UI_EVENT_LIST, &update_tape_counters_event);
+	update_tape_counters_event.at_tick = xroar_context->current_tick + EVENT_MS(500);
+	event_queue(&xroar_context->ui_events, &update_tape_counters_event);
 }
 
 /* Tape Control - helper functions */
 
 static void update_input_list_store(void) {
 	if (have_input_list_store) return;
-	if (!xroar_tape_interface || !xroar_tape_interface->tape_input) return;
+	if (!xroar_context->tape_interface || !xroar_context->tape_interface->tape_input) return;
 	have_input_list_store = 1;
 	struct tape_file *file;
-	long old_offset = tape_tell(xroar_tape_interface->tape_input);
-	tape_rewind(xroar_tape_interface->tape_input);
-	while ((file = tape_file_next(xroar_tape_interface->tape_input, 1))) {
+	long old_offset = tape_tell(xroar_context->tape_interface->tape_input);
+	tape_rewind(xroar_context->tape_interface->tape_input);
+	while ((file = tape_file_next(xroar_context->tape_interface->tape_input, 1))) {
 		GtkTreeIter iter;
-		int ms = tape_to_ms(xroar_tape_interface->tape_input, file->offset);
+		int ms = tape_to_ms(xroar_context->tape_interface->tape_input, file->offset);
 		gchar *timestr = ms_to_string(ms);
 		gtk_list_store_append(tc_input_list_store, &iter);
 		gtk_list_store_set(tc_input_list_store, &iter,
@@ -181,7 +181,7 @@ static void update_input_list_store(void) {
 				   TC_FILE_POINTER, file,
 				   -1);
 	}
-	tape_seek(xroar_tape_interface->tape_input, old_offset, SEEK_SET);
+	tape_seek(xroar_context->tape_interface->tape_input, old_offset, SEEK_SET);
 }
 
 static gchar *ms_to_string(int ms) {
@@ -232,13 +232,13 @@ static void update_tape_counters(void *data) {
 	static long imax = -1, ipos = -1;
 	long new_omax = 0, new_opos = 0;
 	long new_imax = 0, new_ipos = 0;
-	if (xroar_tape_interface->tape_input) {
-		new_imax = tape_to_ms(xroar_tape_interface->tape_input, xroar_tape_interface->tape_input->size);
-		new_ipos = tape_to_ms(xroar_tape_interface->tape_input, xroar_tape_interface->tape_input->offset);
+	if (xroar_context->tape_interface->tape_input) {
+		new_imax = tape_to_ms(xroar_context->tape_interface->tape_input, xroar_context->tape_interface->tape_input->size);
+		new_ipos = tape_to_ms(xroar_context->tape_interface->tape_input, xroar_context->tape_interface->tape_input->offset);
 	}
-	if (xroar_tape_interface->tape_output) {
-		new_omax = tape_to_ms(xroar_tape_interface->tape_output, xroar_tape_interface->tape_output->size);
-		new_opos = tape_to_ms(xroar_tape_interface->tape_output, xroar_tape_interface->tape_output->offset);
+	if (xroar_context->tape_interface->tape_output) {
+		new_omax = tape_to_ms(xroar_context->tape_interface->tape_output, xroar_context->tape_interface->tape_output->size);
+		new_opos = tape_to_ms(xroar_context->tape_interface->tape_output, xroar_context->tape_interface->tape_output->offset);
 	}
 	if (imax != new_imax) {
 		imax = new_imax;
@@ -259,7 +259,7 @@ static void update_tape_counters(void *data) {
 		gtk_label_set_text(GTK_LABEL(tc_output_time), ms_to_string(new_opos));
 	}
 	update_tape_counters_event.at_tick += EVENT_MS(500);
-	event_queue(&UI_EVENT_LIST, &update_tape_counters_event);
+	event_queue(&xroar_context->ui_events, &update_tape_counters_event);
 }
 
 /* Tape Control - UI callbacks */
@@ -290,22 +290,22 @@ void gtk2_output_tape_filename_cb(struct ui_gtk2_interface *uigtk2, const char *
 static void tc_toggled_fast(GtkToggleButton *togglebutton, gpointer user_data) {
 	(void)user_data;
 	int set = gtk_toggle_button_get_active(togglebutton) ? TAPE_FAST : 0;
-	int flags = (tape_get_state(xroar_tape_interface) & ~TAPE_FAST) | set;
-	tape_set_state(xroar_tape_interface, flags);
+	int flags = (tape_get_state(xroar_context->tape_interface) & ~TAPE_FAST) | set;
+	tape_set_state(xroar_context->tape_interface, flags);
 }
 
 static void tc_toggled_pad_auto(GtkToggleButton *togglebutton, gpointer user_data) {
 	(void)user_data;
 	int set = gtk_toggle_button_get_active(togglebutton) ? TAPE_PAD_AUTO : 0;
-	int flags = (tape_get_state(xroar_tape_interface) & ~TAPE_PAD_AUTO) | set;
-	tape_set_state(xroar_tape_interface, flags);
+	int flags = (tape_get_state(xroar_context->tape_interface) & ~TAPE_PAD_AUTO) | set;
+	tape_set_state(xroar_context->tape_interface, flags);
 }
 
 static void tc_toggled_rewrite(GtkToggleButton *togglebutton, gpointer user_data) {
 	(void)user_data;
 	int set = gtk_toggle_button_get_active(togglebutton) ? TAPE_REWRITE : 0;
-	int flags = (tape_get_state(xroar_tape_interface) & ~TAPE_REWRITE) | set;
-	tape_set_state(xroar_tape_interface, flags);
+	int flags = (tape_get_state(xroar_context->tape_interface) & ~TAPE_REWRITE) | set;
+	tape_set_state(xroar_context->tape_interface, flags);
 }
 
 void gtk2_update_tape_state(struct ui_gtk2_interface *uigtk2, int flags) {
@@ -339,15 +339,15 @@ static void hide_tc_window(GtkEntry *entry, gpointer user_data) {
 static gboolean tc_input_progress_change(GtkRange *range, GtkScrollType scroll, gdouble value, gpointer user_data) {
 	(void)range;
 	(void)user_data;
-	tc_seek(xroar_tape_interface->tape_input, scroll, value);
+	tc_seek(xroar_context->tape_interface->tape_input, scroll, value);
 	return TRUE;
 }
 
 static void tc_input_rewind(GtkButton *button, gpointer user_data) {
 	(void)button;
 	(void)user_data;
-	if (xroar_tape_interface->tape_input) {
-		tape_seek(xroar_tape_interface->tape_input, 0, SEEK_SET);
+	if (xroar_context->tape_interface->tape_input) {
+		tape_seek(xroar_context->tape_interface->tape_input, 0, SEEK_SET);
 	}
 }
 
@@ -366,15 +366,15 @@ static void tc_input_eject(GtkButton *button, gpointer user_data) {
 static gboolean tc_output_progress_change(GtkRange *range, GtkScrollType scroll, gdouble value, gpointer user_data) {
 	(void)range;
 	(void)user_data;
-	tc_seek(xroar_tape_interface->tape_output, scroll, value);
+	tc_seek(xroar_context->tape_interface->tape_output, scroll, value);
 	return TRUE;
 }
 
 static void tc_output_rewind(GtkButton *button, gpointer user_data) {
 	(void)button;
 	(void)user_data;
-	if (xroar_tape_interface && xroar_tape_interface->tape_output) {
-		tape_seek(xroar_tape_interface->tape_output, 0, SEEK_SET);
+	if (xroar_context->tape_interface && xroar_context->tape_interface->tape_output) {
+		tape_seek(xroar_context->tape_interface->tape_output, 0, SEEK_SET);
 	}
 }
 
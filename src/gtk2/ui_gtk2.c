@@ -159,24 +159,24 @@ static void zoom_1_1(GtkEntry *entry, gpointer user_data) {
 	(void)entry;
 	struct ui_gtk2_interface *uigtk2 = user_data;
 	(void)uigtk2;
-	if (!xroar_vo_interface)
+	if (!xroar_context->vo_interface)
 		return;
-	DELEGATE_SAFE_CALL2(xroar_vo_interface->resize, 320, 240);
+	DELEGATE_SAFE_CALL2(xroar_context->vo_interface->resize, 320, 240);
 }
 
 static void zoom_2_1(GtkEntry *entry, gpointer user_data) {
 	(void)entry;
 	struct ui_gtk2_interface *uigtk2 = user_data;
 	(void)uigtk2;
-	if (!xroar_vo_interface)
+	if (!xroar_context->vo_interface)
 		return;
-	DELEGATE_SAFE_CALL2(xroar_vo_interface->resize, 640, 480);
+	DELEGATE_SAFE_CALL2(xroar_context->vo_interface->resize, 640, 480);
 }
 
 static void zoom_in(GtkEntry *entry, gpointer user_data) {
 	(void)entry;
 	struct ui_gtk2_interface *uigtk2 = user_data;
-	if (!xroar_vo_interface)
+	if (!xroar_context->vo_interface)
 		return;
 	int xscale = uigtk2->display_rect.w / 160;
 	int yscale = uigtk2->display_rect.h / 120;
@@ -189,13 +189,13 @@ static void zoom_in(GtkEntry *entry, gpointer user_data) {
 		scale = xscale + 1;
 	if (scale < 1)
 		scale = 1;
-	DELEGATE_SAFE_CALL2(xroar_vo_interface->resize, 160 * scale, 120 * scale);
+	DELEGATE_SAFE_CALL2(xroar_context->vo_interface->resize, 160 * scale, 120 * scale);
 }
 
 static void zoom_out(GtkEntry *entry, gpointer user_data) {
 	(void)entry;
 	struct ui_gtk2_interface *uigtk2 = user_data;
-	if (!xroar_vo_interface)
+	if (!xroar_context->vo_interface)
 		return;
 	int xscale = uigtk2->display_rect.w / 160;
 	int yscale = uigtk2->display_rect.h / 120;
@@ -208,7 +208,7 @@ static void zoom_out(GtkEntry *entry, gpointer user_data) {
 		scale = xscale - 1;
 	if (scale < 1)
 		scale = 1;
-	DELEGATE_SAFE_CALL2(xroar_vo_interface->resize, 160 * scale, 120 * scale);
+	DELEGATE_SAFE_CALL2(xroar_context->vo_interface->resize, 160 * scale, 120 * scale);
 }
 
 static void toggle_inverse_text(GtkToggleAction *current, gpointer user_data) {
@@ -785,7 +785,7 @@ static void update_machine_menu(struct ui_gtk2_interface *uigtk2) {
 	int i = 0;
 	for (struct slist *iter = mcl; iter; iter = iter->next, i++) {
 		struct machine_config *mc = iter->data;
-		if (mc == xroar_machine_config)
+		if (mc == xroar_context->machine_config)
 			selected = mc->id;
 		names[i] = g_strdup_printf("machine%d", i+1);
 		radio_entries[i].name = names[i];
@@ -821,7 +821,7 @@ static void update_cartridge_menu(struct ui_gtk2_interface *uigtk2) {
 	gchar **labels = g_malloc0(num_carts * sizeof(gchar *));
 	/* add these to the ui in reverse order, as each will be
 	   inserted before the previous */
-	struct cart *cart = xroar_machine ? xroar_machine->get_interface(xroar_machine, "cart") : NULL;
+	struct cart *cart = xroar_context->machine ? xroar_context->machine->get_interface(xroar_context->machine, "cart") : NULL;
 	int i = 0;
 	for (struct slist *iter = ccl; iter; iter = iter->next, i++) {
 		struct cart_config *cc = iter->data;
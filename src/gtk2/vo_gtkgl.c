@@ -197,6 +197,9 @@ static gboolean configure(GtkWidget *da, GdkEventConfigure *event, gpointer data
 	struct vo_interface *vogl = vogtkgl->vogl;
 	(void)event;
 
+	// Called by GTK, not through our own resize delegate
+	DELEGATE_SAFE_CALL0(vogtkgl->public.sync);
+
 	GdkGLContext *glcontext = gtk_widget_get_gl_context(da);
 	GdkGLDrawable *gldrawable = gtk_widget_get_gl_drawable(da);
 
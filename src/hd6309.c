@@ -35,6 +35,7 @@ See COPYING.GPL for redistribution conditions.
 #include <string.h>
 
 #include "delegate.h"
+#include "pl-thread.h"
 #include "xalloc.h"
 
 #include "hd6309.h"
@@ -206,6 +207,10 @@ struct MC6809 *hd6309_new(void) {
 #endif
 	// External handlers
 	cpu->mem_cycle = DELEGATE_DEFAULT2(void, bool, uint16);
+#ifdef WANT_PREDECODE
+	cpu->predecode = xmalloc(MC6809_PREDECODE_SIZE * sizeof(*cpu->predecode));
+	mc6809_predecode_flush(cpu);
+#endif
 	hd6309_reset(cpu);
 	return cpu;
 }
@@ -217,6 +222,9 @@ static void hd6309_free(struct part *p) {
 		hd6309_trace_free(hcpu->tracer);
 	}
 #endif
+#ifdef WANT_PREDECODE
+	free(((struct MC6809 *)p)->predecode);
+#endif
 }
 
 static void hd6309_reset(struct MC6809 *cpu) {
@@ -233,6 +241,11 @@ static void hd6309_reset(struct MC6809 *cpu) {
 
 static void hd6309_run(struct MC6809 *cpu) {
 	struct HD6309 *hcpu = (struct HD6309 *)cpu;
+#ifdef WANT_THREADED_DISPATCH
+	// Per-thread, as concurrent batch jobs each run a CPU
+	static THREAD_LOCAL void *op_dispatch[0x400];
+	static THREAD_LOCAL _Bool op_dispatch_ready = 0;
+#endif
 
 	do {
 
@@ -267,6 +280,9 @@ static void hd6309_run(struct MC6809 *cpu) {
 		// done_instruction case for backwards-compatibility
 		case hd6309_state_done_instruction:
 		case hd6309_state_label_a:
+#ifdef WANT_THREADED_DISPATCH
+state_label_a:
+#endif
 			if (cpu->halt) {
 				NVMA_CYCLE;
 				continue;
@@ -301,6 +317,12 @@ static void hd6309_run(struct MC6809 *cpu) {
 			// Instruction fetch hook called here so that machine
 			// can be stopped beforehand.
 			DELEGATE_SAFE_CALL0(cpu->instruction_hook);
+#ifdef WANT_THREADED_DISPATCH
+			// Unless the hook stopped the CPU or changed its state
+			// (e.g. reset), go straight on to the next instruction.
+			if (cpu->running && hcpu->state == hd6309_state_next_instruction)
+				goto state_next_instruction;
+#endif
 			continue;
 
 		case hd6309_state_dispatch_irq:
@@ -392,12 +414,34 @@ static void hd6309_run(struct MC6809 *cpu) {
 			continue;
 
 		case hd6309_state_next_instruction:
+#ifdef WANT_THREADED_DISPATCH
+state_next_instruction:
+#endif
 			{
 			unsigned op;
+#ifdef WANT_THREADED_DISPATCH
+			if (!op_dispatch_ready) {
+				op = 0;
+				goto build_op_dispatch;
+			}
+op_dispatch_built:
+#endif
 			// Fetch op-code and process
 			hcpu->state = hd6309_state_label_a;
+#ifdef WANT_PREDECODE
+			op = fetch_op_predecode(cpu);
+			if (op == PREDECODE_STOPPED) {
+				hcpu->state = hd6309_state_next_instruction;
+				continue;
+			}
+#else
 			op = byte_immediate(cpu);
 			op |= cpu->page;
+#endif
+#ifdef WANT_THREADED_DISPATCH
+			goto *op_dispatch[op];
+build_op_dispatch:
+#endif
 			switch (op) {
 
 			// 0x00 - 0x0f direct mode ops
@@ -424,7 +468,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			case 0x70: case 0x73:
 			case 0x74: case 0x76: case 0x77:
 			case 0x78: case 0x79: case 0x7a:
-			case 0x7c: case 0x7d: case 0x7f: {
+			case 0x7c: case 0x7d: case 0x7f: OP_HANDLER {
 				uint16_t ea;
 				unsigned tmp1;
 				switch ((op >> 4) & 0xf) {
@@ -489,7 +533,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			case 0x01: case 0x61: case 0x71:
 			case 0x02: case 0x62: case 0x72:
 			case 0x05: case 0x65: case 0x75:
-			case 0x0b: case 0x6b: case 0x7b: {
+			case 0x0b: case 0x6b: case 0x7b: OP_HANDLER {
 				unsigned a, tmp1, tmp2;
 				tmp2 = byte_immediate(cpu);
 				switch ((op >> 4) & 0xf) {
@@ -518,7 +562,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			// 0x0e JMP direct
 			// 0x6e JMP indexed
 			// 0x7e JMP extended
-			case 0x0e: case 0x6e: case 0x7e: {
+			case 0x0e: case 0x6e: case 0x7e: OP_HANDLER {
 				unsigned ea;
 				switch ((op >> 4) & 0xf) {
 				case 0x0: ea = ea_direct(cpu); break;
@@ -533,7 +577,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			case 0x10:
 			// 0x1010, 0x1011 Page 2
 			case 0x0210:
-			case 0x0211:
+			case 0x0211: OP_HANDLER
 				hcpu->state = hd6309_state_next_instruction;
 				cpu->page = 0x200;
 				continue;
@@ -541,15 +585,15 @@ static void hd6309_run(struct MC6809 *cpu) {
 			case 0x11:
 			// 0x1110, 0x1111 Page 3
 			case 0x0310:
-			case 0x0311:
+			case 0x0311: OP_HANDLER
 				hcpu->state = hd6309_state_next_instruction;
 				cpu->page = 0x300;
 				continue;
 
 			// 0x12 NOP inherent
-			case 0x12: peek_byte(cpu, REG_PC); break;
+			case 0x12: OP_HANDLER peek_byte(cpu, REG_PC); break;
 			// 0x13 SYNC inherent
-			case 0x13:
+			case 0x13: OP_HANDLER
 				if (!NATIVE_MODE)
 					peek_byte(cpu, REG_PC);
 				cpu->nmi_active = cpu->nmi_latch;
@@ -559,7 +603,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 				hcpu->state = hd6309_state_sync;
 				continue;
 			// 0x14 SEXW inherent
-			case 0x14:
+			case 0x14: OP_HANDLER
 				REG_D = (REG_W & 0x8000) ? 0xffff : 0;
 				CLR_NZ;
 				SET_N16(REG_D);
@@ -570,7 +614,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 				NVMA_CYCLE;
 				break;
 			// 0x16 LBRA relative
-			case 0x16: {
+			case 0x16: OP_HANDLER {
 				uint16_t ea;
 				ea = long_relative(cpu);
 				REG_PC += ea;
@@ -579,7 +623,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 					NVMA_CYCLE;
 			} break;
 			// 0x17 LBSR relative
-			case 0x17: {
+			case 0x17: OP_HANDLER {
 				uint16_t ea;
 				ea = long_relative(cpu);
 				ea += REG_PC;
@@ -593,26 +637,26 @@ static void hd6309_run(struct MC6809 *cpu) {
 				REG_PC = ea;
 			} break;
 			// 0x19 DAA inherent
-			case 0x19:
+			case 0x19: OP_HANDLER
 				REG_A = op_daa(cpu, REG_A);
 				peek_byte(cpu, REG_PC);
 				break;
 			// 0x1a ORCC immediate
-			case 0x1a: {
+			case 0x1a: OP_HANDLER {
 				unsigned data;
 				data = byte_immediate(cpu);
 				REG_CC |= data;
 				peek_byte(cpu, REG_PC);
 			} break;
 			// 0x1c ANDCC immediate
-			case 0x1c: {
+			case 0x1c: OP_HANDLER {
 				unsigned data;
 				data = byte_immediate(cpu);
 				REG_CC &= data;
 				peek_byte(cpu, REG_PC);
 			} break;
 			// 0x1d SEX inherent
-			case 0x1d:
+			case 0x1d: OP_HANDLER
 				REG_A = (REG_B & 0x80) ? 0xff : 0;
 				CLR_NZ;
 				SET_NZ16(REG_D);
@@ -620,7 +664,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 					peek_byte(cpu, REG_PC);
 				break;
 			// 0x1e EXG immediate
-			case 0x1e: {
+			case 0x1e: OP_HANDLER {
 				unsigned postbyte;
 				uint16_t tmp1, tmp2;
 				postbyte = byte_immediate(cpu);
@@ -685,7 +729,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 				}
 			} break;
 			// 0x1f TFR immediate
-			case 0x1f: {
+			case 0x1f: OP_HANDLER {
 				unsigned postbyte;
 				uint16_t tmp1;
 				postbyte = byte_immediate(cpu);
@@ -735,7 +779,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			case 0x20: case 0x21: case 0x22: case 0x23:
 			case 0x24: case 0x25: case 0x26: case 0x27:
 			case 0x28: case 0x29: case 0x2a: case 0x2b:
-			case 0x2c: case 0x2d: case 0x2e: case 0x2f: {
+			case 0x2c: case 0x2d: case 0x2e: case 0x2f: OP_HANDLER {
 				unsigned tmp = sex8(byte_immediate(cpu));
 				NVMA_CYCLE;
 				if (branch_condition(cpu, op))
@@ -743,7 +787,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			} break;
 
 			// 0x30 LEAX indexed
-			case 0x30:
+			case 0x30: OP_HANDLER
 				REG_X = ea_indexed(cpu);
 				CLR_Z;
 				SET_Z16(REG_X);
@@ -751,7 +795,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 				break;
 
 			// 0x31 LEAY indexed
-			case 0x31:
+			case 0x31: OP_HANDLER
 				REG_Y = ea_indexed(cpu);
 				CLR_Z;
 				SET_Z16(REG_Y);
@@ -759,20 +803,20 @@ static void hd6309_run(struct MC6809 *cpu) {
 				break;
 
 			// 0x32 LEAS indexed
-			case 0x32:
+			case 0x32: OP_HANDLER
 				REG_S = ea_indexed(cpu);
 				NVMA_CYCLE;
 				cpu->nmi_armed = 1;  // XXX: Really?
 				break;
 
 			// 0x33 LEAU indexed
-			case 0x33:
+			case 0x33: OP_HANDLER
 				REG_U = ea_indexed(cpu);
 				NVMA_CYCLE;
 				break;
 
 			// 0x34 PSHS immediate
-			case 0x34:
+			case 0x34: OP_HANDLER
 				{
 					unsigned postbyte = byte_immediate(cpu);
 					NVMA_CYCLE;
@@ -791,7 +835,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 				break;
 
 			// 0x35 PULS immediate
-			case 0x35:
+			case 0x35: OP_HANDLER
 				{
 					unsigned postbyte = byte_immediate(cpu);
 					NVMA_CYCLE;
@@ -810,7 +854,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 				break;
 
 			// 0x36 PSHU immediate
-			case 0x36:
+			case 0x36: OP_HANDLER
 				{
 					unsigned postbyte = byte_immediate(cpu);
 					NVMA_CYCLE;
@@ -829,7 +873,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 				break;
 
 			// 0x37 PULU immediate
-			case 0x37:
+			case 0x37: OP_HANDLER
 				{
 					unsigned postbyte = byte_immediate(cpu);
 					NVMA_CYCLE;
@@ -848,14 +892,14 @@ static void hd6309_run(struct MC6809 *cpu) {
 				break;
 
 			// 0x39 RTS inherent
-			case 0x39:
+			case 0x39: OP_HANDLER
 				peek_byte(cpu, REG_PC);
 				REG_PC = pull_s_word(cpu);
 				NVMA_CYCLE;
 				break;
 
 			// 0x3a ABX inherent
-			case 0x3a:
+			case 0x3a: OP_HANDLER
 				REG_X += REG_B;
 				peek_byte(cpu, REG_PC);
 				if (!NATIVE_MODE)
@@ -863,7 +907,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 				break;
 
 			// 0x3b RTI inherent
-			case 0x3b:
+			case 0x3b: OP_HANDLER
 				peek_byte(cpu, REG_PC);
 				REG_CC = pull_s_byte(cpu);
 				if (REG_CC & CC_E) {
@@ -886,7 +930,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 				break;
 
 			// 0x3c CWAI immediate
-			case 0x3c: {
+			case 0x3c: OP_HANDLER {
 				unsigned data;
 				data = byte_immediate(cpu);
 				REG_CC &= data;
@@ -898,7 +942,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			} break;
 
 			// 0x3d MUL inherent
-			case 0x3d: {
+			case 0x3d: OP_HANDLER {
 				unsigned tmp = REG_A * REG_B;
 				REG_D = tmp;
 				CLR_ZC;
@@ -919,7 +963,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			} break;
 
 			// 0x3f SWI inherent
-			case 0x3f:
+			case 0x3f: OP_HANDLER
 				peek_byte(cpu, REG_PC);
 				stack_irq_registers(cpu, 1);
 				instruction_posthook(cpu);
@@ -952,7 +996,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			case 0xe8: case 0xe9: case 0xea: case 0xeb:
 			case 0xf0: case 0xf1: case 0xf2:
 			case 0xf4: case 0xf5: case 0xf6:
-			case 0xf8: case 0xf9: case 0xfa: case 0xfb: {
+			case 0xf8: case 0xf9: case 0xfa: case 0xfb: OP_HANDLER {
 				unsigned tmp1, tmp2;
 				tmp1 = !(op & 0x40) ? REG_A : REG_B;
 				switch ((op >> 4) & 3) {
@@ -985,7 +1029,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			// 0x83, 0x93, 0xa3, 0xb3 SUBD
 			// 0xc3, 0xd3, 0xe3, 0xf3 ADDD
 			case 0x83: case 0x93: case 0xa3: case 0xb3:
-			case 0xc3: case 0xd3: case 0xe3: case 0xf3: {
+			case 0xc3: case 0xd3: case 0xe3: case 0xf3: OP_HANDLER {
 				unsigned tmp1, tmp2;
 				tmp1 = REG_D;
 				switch ((op >> 4) & 3) {
@@ -1014,7 +1058,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			// 0x1183, 0x1193, 0x11a3, 0x11b3 CMPU
 			// 0x118c, 0x119c, 0x11ac, 0x11bc CMPS
 			case 0x0383: case 0x0393: case 0x03a3: case 0x03b3:
-			case 0x038c: case 0x039c: case 0x03ac: case 0x03bc: {
+			case 0x038c: case 0x039c: case 0x03ac: case 0x03bc: OP_HANDLER {
 				unsigned tmp1, tmp2;
 				switch (op & 0x0308) {
 				default:
@@ -1038,7 +1082,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 
 			// 0x8d BSR
 			// 0x9d, 0xad, 0xbd JSR
-			case 0x8d: case 0x9d: case 0xad: case 0xbd: {
+			case 0x8d: case 0x9d: case 0xad: case 0xbd: OP_HANDLER {
 				uint16_t ea;
 				switch ((op >> 4) & 3) {
 				case 0: ea = short_relative(cpu); ea += REG_PC; NVMA_CYCLE; NVMA_CYCLE; if (!NATIVE_MODE) NVMA_CYCLE; break;
@@ -1062,7 +1106,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			// 0x10ce, 0x10de, 0x10ee, 0x10fe LDS
 			case 0x0286: case 0x0296: case 0x02a6: case 0x02b6:
 			case 0x028e: case 0x029e: case 0x02ae: case 0x02be:
-			case 0x02ce: case 0x02de: case 0x02ee: case 0x02fe: {
+			case 0x02ce: case 0x02de: case 0x02ee: case 0x02fe: OP_HANDLER {
 				unsigned tmp1, tmp2;
 				switch ((op >> 4) & 3) {
 				case 0: tmp2 = word_immediate(cpu); break;
@@ -1090,7 +1134,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			// 0x1197, 0x11a7, 0x11b7 STE
 			// 0x11d7, 0x11e7, 0x11f7 STF
 			case 0x0397: case 0x03a7: case 0x03b7:
-			case 0x03d7: case 0x03e7: case 0x03f7: {
+			case 0x03d7: case 0x03e7: case 0x03f7: OP_HANDLER {
 				uint16_t ea;
 				uint8_t tmp1;
 				switch (op & 0x0340) {
@@ -1122,7 +1166,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			// 0x10df, 0x10ef, 0x10ff STS
 			case 0x0297: case 0x02a7: case 0x02b7:
 			case 0x029f: case 0x02af: case 0x02bf:
-			case 0x02df: case 0x02ef: case 0x02ff: {
+			case 0x02df: case 0x02ef: case 0x02ff: OP_HANDLER {
 				uint16_t ea, tmp1;
 				switch (op & 0x034e) {
 				default:
@@ -1146,7 +1190,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			} break;
 
 			// 0xcd LDQ immediate
-			case 0xcd: {
+			case 0xcd: OP_HANDLER {
 				REG_D = word_immediate(cpu);
 				REG_W = word_immediate(cpu);
 				CLR_NZV;
@@ -1159,7 +1203,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			case 0x0221: case 0x0222: case 0x0223:
 			case 0x0224: case 0x0225: case 0x0226: case 0x0227:
 			case 0x0228: case 0x0229: case 0x022a: case 0x022b:
-			case 0x022c: case 0x022d: case 0x022e: case 0x022f: {
+			case 0x022c: case 0x022d: case 0x022e: case 0x022f: OP_HANDLER {
 				unsigned tmp = word_immediate(cpu);
 				if (branch_condition(cpu, op)) {
 					REG_PC += tmp;
@@ -1184,7 +1228,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			// 0x1036 EORR
 			// 0x1037 CMPR
 			case 0x0230: case 0x0231: case 0x0232: case 0x0233:
-			case 0x0234: case 0x0235: case 0x0236: case 0x0237: {
+			case 0x0234: case 0x0235: case 0x0236: case 0x0237: OP_HANDLER {
 				unsigned postbyte;
 				postbyte = byte_immediate(cpu);
 				unsigned tmp1, tmp2;
@@ -1291,7 +1335,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			} break;
 
 			// 0x1038 PSHSW inherent
-			case 0x0238:
+			case 0x0238: OP_HANDLER
 				NVMA_CYCLE;
 				NVMA_CYCLE;
 				push_s_byte(cpu, REG_F);
@@ -1299,7 +1343,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 				break;
 
 			// 0x1039 PULSW inherent
-			case 0x0239:
+			case 0x0239: OP_HANDLER
 				NVMA_CYCLE;
 				NVMA_CYCLE;
 				REG_E = pull_s_byte(cpu);
@@ -1307,7 +1351,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 				break;
 
 			// 0x103a PSHUW inherent
-			case 0x023a:
+			case 0x023a: OP_HANDLER
 				NVMA_CYCLE;
 				NVMA_CYCLE;
 				push_u_byte(cpu, REG_F);
@@ -1315,7 +1359,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 				break;
 
 			// 0x103b PULUW inherent
-			case 0x023b:
+			case 0x023b: OP_HANDLER
 				NVMA_CYCLE;
 				NVMA_CYCLE;
 				REG_E = pull_u_byte(cpu);
@@ -1323,7 +1367,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 				break;
 
 			// 0x103f SWI2 inherent
-			case 0x023f:
+			case 0x023f: OP_HANDLER
 				peek_byte(cpu, REG_PC);
 				stack_irq_registers(cpu, 1);
 				instruction_posthook(cpu);
@@ -1342,7 +1386,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			case 0x0253:
 			case 0x0254: case 0x0256:
 			case 0x0259: case 0x025a:
-			case 0x025c: case 0x025d: case 0x025f: {
+			case 0x025c: case 0x025d: case 0x025f: OP_HANDLER {
 				unsigned tmp1;
 				tmp1 = !(op & 0x10) ? REG_D : REG_W;
 				switch (op & 0xf) {
@@ -1381,7 +1425,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			// 0x108b, 0x109b, 0x10ab, 0x10bb ADDW
 			case 0x0280: case 0x0290: case 0x02a0: case 0x02b0:
 			case 0x0281: case 0x0291: case 0x02a1: case 0x02b1:
-			case 0x028b: case 0x029b: case 0x02ab: case 0x02bb: {
+			case 0x028b: case 0x029b: case 0x02ab: case 0x02bb: OP_HANDLER {
 				unsigned tmp1, tmp2;
 				tmp1 = REG_W;
 				switch ((op >> 4) & 3) {
@@ -1413,7 +1457,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			case 0x0285: case 0x0295: case 0x02a5: case 0x02b5:
 			case 0x0288: case 0x0298: case 0x02a8: case 0x02b8:
 			case 0x0289: case 0x0299: case 0x02a9: case 0x02b9:
-			case 0x028a: case 0x029a: case 0x02aa: case 0x02ba: {
+			case 0x028a: case 0x029a: case 0x02aa: case 0x02ba: OP_HANDLER {
 				unsigned tmp1, tmp2;
 				tmp1 = REG_D;
 				switch ((op >> 4) & 3) {
@@ -1438,7 +1482,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			} break;
 
 			// 0x10dc, 0x10ec, 0x10fc LDQ direct, indexed, extended
-			case 0x02dc: case 0x02ec: case 0x02fc: {
+			case 0x02dc: case 0x02ec: case 0x02fc: OP_HANDLER {
 				unsigned ea;
 				switch ((op >> 4) & 3) {
 				case 1: ea = ea_direct(cpu); break;
@@ -1455,7 +1499,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			} break;
 
 			// 0x10dd, 0x10ed, 0x10fd STQ
-			case 0x02dd: case 0x02ed: case 0x02fd: {
+			case 0x02dd: case 0x02ed: case 0x02fd: OP_HANDLER {
 				unsigned ea;
 				switch ((op >> 4) & 3) {
 				case 1: ea = ea_direct(cpu); break;
@@ -1475,7 +1519,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 
 			// 0x1130 - 0x1137 direct logical bit ops
 			case 0x0330: case 0x0331: case 0x0332: case 0x0333:
-			case 0x0334: case 0x0335: case 0x0336: case 0x0337: {
+			case 0x0334: case 0x0335: case 0x0336: case 0x0337: OP_HANDLER {
 				unsigned postbyte;
 				unsigned mem_byte;
 				unsigned ea;
@@ -1549,7 +1593,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			// 0x1139 TFM r0-,r1-
 			// 0x113a TFM r0+,r1
 			// 0x113b TFM r0,r1+
-			case 0x0338: case 0x0339: case 0x033a: case 0x033b: {
+			case 0x0338: case 0x0339: case 0x033a: case 0x033b: OP_HANDLER {
 				unsigned postbyte;
 				switch (op & 3) {
 				case 0: hcpu->tfm_src_mod = hcpu->tfm_dest_mod = 1; break;
@@ -1595,7 +1639,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			}
 
 			// 0x113c BITMD immediate
-			case 0x033c: {
+			case 0x033c: OP_HANDLER {
 				unsigned data;
 				data = byte_immediate(cpu);
 				data &= (MD_D0 | MD_IL);
@@ -1608,7 +1652,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			} break;
 
 			// 0x113d LDMD immediate
-			case 0x033d: {
+			case 0x033d: OP_HANDLER {
 				unsigned data;
 				data = byte_immediate(cpu);
 				data &= (MD_FM | MD_NM);
@@ -1618,7 +1662,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			} break;
 
 			// 0x113f SWI3 inherent
-			case 0x033f:
+			case 0x033f: OP_HANDLER
 				peek_byte(cpu, REG_PC);
 				stack_irq_registers(cpu, 1);
 				instruction_posthook(cpu);
@@ -1633,7 +1677,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			case 0x034c: case 0x034d: case 0x034f:
 			case 0x0353:
 			case 0x035a:
-			case 0x035c: case 0x035d: case 0x035f: {
+			case 0x035c: case 0x035d: case 0x035f: OP_HANDLER {
 				unsigned tmp1;
 				tmp1 = !(op & 0x10) ? REG_E : REG_F;
 				switch (op & 0xf) {
@@ -1671,7 +1715,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			case 0x03c0: case 0x03c1: case 0x03c6: case 0x03cb:
 			case 0x03d0: case 0x03d1: case 0x03d6: case 0x03db:
 			case 0x03e0: case 0x03e1: case 0x03e6: case 0x03eb:
-			case 0x03f0: case 0x03f1: case 0x03f6: case 0x03fb: {
+			case 0x03f0: case 0x03f1: case 0x03f6: case 0x03fb: OP_HANDLER {
 				unsigned tmp1, tmp2;
 				tmp1 = !(op & 0x40) ? REG_E : REG_F;
 				switch ((op >> 4) & 3) {
@@ -1696,7 +1740,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			} break;
 
 			// 0x118d, 0x119d, 0x11ad, 0x11bd DIVD
-			case 0x038d: case 0x039d: case 0x03ad: case 0x03bd: {
+			case 0x038d: case 0x039d: case 0x03ad: case 0x03bd: OP_HANDLER {
 				uint16_t tmp1;
 				uint8_t tmp2;
 				tmp1 = REG_D;
@@ -1745,7 +1789,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			} break;
 
 			// 0x118e, 0x119e, 0x11ae, 0x11be DIVQ
-			case 0x038e: case 0x039e: case 0x03ae: case 0x03be: {
+			case 0x038e: case 0x039e: case 0x03ae: case 0x03be: OP_HANDLER {
 				uint32_t tmp1;
 				uint16_t tmp2;
 				tmp1 = RREG_Q;
@@ -1793,7 +1837,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			} break;
 
 			// 0x118f, 0x119f, 0x11af, 0x11bf MULD
-			case 0x038f: case 0x039f: case 0x03af: case 0x03bf: {
+			case 0x038f: case 0x039f: case 0x03af: case 0x03bf: OP_HANDLER {
 				uint16_t tmp1, tmp2;
 				tmp1 = REG_D;
 				switch ((op >> 4) & 3) {
@@ -1818,7 +1862,7 @@ static void hd6309_run(struct MC6809 *cpu) {
 			} break;
 
 			// Illegal instruction
-			default:
+			default: OP_HANDLER
 				// XXX Two dead cycles?  Verify further!
 				peek_byte(cpu, cpu->reg_pc);
 				peek_byte(cpu, cpu->reg_pc);
@@ -1843,6 +1887,10 @@ static void hd6309_run(struct MC6809 *cpu) {
 		cpu->firq_active = cpu->firq_latch;
 		cpu->irq_active = cpu->irq_latch;
 		instruction_posthook(cpu);
+#ifdef WANT_THREADED_DISPATCH
+		if (cpu->running && hcpu->state == hd6309_state_label_a)
+			goto state_label_a;
+#endif
 		continue;
 
 	} while (cpu->running);
@@ -2039,6 +2087,7 @@ static void take_interrupt(struct MC6809 *cpu, uint8_t mask, uint16_t vec) {
 		hd6309_trace_irq(hcpu->tracer, vec);
 	}
 #endif
+	DELEGATE_SAFE_CALL1(cpu->interrupt_hook, vec);
 	REG_PC = fetch_word(cpu, vec);
 	NVMA_CYCLE;
 }
@@ -28,6 +28,7 @@ See COPYING.GPL for redistribution conditions.
 
 #include "hd6309.h"
 #include "hd6309_trace.h"
+#include "tracebin.h"
 
 /* Instruction types.  PAGE0, PAGE2 and PAGE3 switch which page is selected. */
 
@@ -1017,6 +1018,7 @@ struct hd6309_trace {
 
 static void reset_state(struct hd6309_trace *tracer);
 static void trace_print_short(struct hd6309_trace *tracer);
+static void trace_record(struct hd6309_trace *tracer, unsigned flags);
 
 #define STACK_PRINT(t,r) do { \
 		if (not_first) { strcat((t)->operand_text, "," r); } \
@@ -1202,6 +1204,14 @@ void hd6309_trace_byte(struct hd6309_trace *tracer, uint8_t byte, uint16_t pc) {
 
 	tracer->state_list = NULL;
 
+	// Binary trace needs no text, and records IRQ vectors immediately.
+	if (tracer->hcpu->mc6809.tracebin) {
+		if (tracer->ins_type == IRQVECTOR) {
+			trace_record(tracer, TRACEBIN_F_IRQ);
+		}
+		return;
+	}
+
 	tracer->operand_text[0] = '\0';
 	switch (tracer->ins_type) {
 		case ILLEGAL: case INHERENT:
@@ -1360,6 +1370,10 @@ void hd6309_trace_print(struct hd6309_trace *tracer) {
 	struct HD6309 *hcpu = tracer->hcpu;
 	struct MC6809 *cpu = &hcpu->mc6809;
 	if (tracer->state != WANT_PRINT) return;
+	if (cpu->tracebin) {
+		trace_record(tracer, 0);
+		return;
+	}
 	trace_print_short(tracer);
 	printf("cc=%02x a=%02x b=%02x e=%02x "
 	       "f=%02x dp=%02x x=%04x y=%04x "
@@ -1380,3 +1394,24 @@ static void trace_print_short(struct hd6309_trace *tracer) {
 	printf("%04x| %-12s%-8s%-20s", tracer->instr_pc, bytes_string, tracer->mnemonic, tracer->operand_text);
 	reset_state(tracer);
 }
+
+static void trace_record(struct hd6309_trace *tracer, unsigned flags) {
+	struct HD6309 *hcpu = tracer->hcpu;
+	struct MC6809 *cpu = &hcpu->mc6809;
+	uint16_t regs[12];
+	regs[TRACEBIN_REG_CC] = cpu->reg_cc;
+	regs[TRACEBIN_REG_A] = MC6809_REG_A(cpu);
+	regs[TRACEBIN_REG_B] = MC6809_REG_B(cpu);
+	regs[TRACEBIN_REG_DP] = cpu->reg_dp;
+	regs[TRACEBIN_REG_X] = cpu->reg_x;
+	regs[TRACEBIN_REG_Y] = cpu->reg_y;
+	regs[TRACEBIN_REG_U] = cpu->reg_u;
+	regs[TRACEBIN_REG_S] = cpu->reg_s;
+	regs[TRACEBIN_REG_E] = HD6309_REG_E(hcpu);
+	regs[TRACEBIN_REG_F] = HD6309_REG_F(hcpu);
+	regs[TRACEBIN_REG_V] = hcpu->reg_v;
+	regs[TRACEBIN_REG_MD] = hcpu->reg_md;
+	tracebin_record(cpu->tracebin, flags, tracer->instr_pc,
+			tracer->bytes_buf, tracer->bytes_count, regs);
+	reset_state(tracer);
+}
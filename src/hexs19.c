@@ -101,7 +101,7 @@ int intel_hex_read(const char *filename, int autorun) {
 			if (type == 0) {
 				if (xroar_cfg.debug_file & XROAR_DEBUG_FILE_BIN_DATA)
 					log_hexdump_byte(log_hex, data);
-				xroar_machine->write_byte(xroar_machine, addr & 0xffff, data);
+				xroar_context->machine->write_byte(xroar_context->machine, addr & 0xffff, data);
 				addr++;
 			}
 		}
@@ -123,7 +123,7 @@ int intel_hex_read(const char *filename, int autorun) {
 		log_close(&log_hex);
 	if (exec != 0) {
 		if (autorun) {
-			struct MC6809 *cpu = xroar_machine->get_component(xroar_machine, "CPU0");
+			struct MC6809 *cpu = xroar_context->machine->get_component(xroar_context->machine, "CPU0");
 			if (xroar_cfg.debug_file & XROAR_DEBUG_FILE_BIN)
 				LOG_PRINT("Intel HEX: EXEC $%04x - autorunning\n", exec);
 			cpu->jump(cpu, exec);
@@ -183,12 +183,12 @@ static int dragon_bin_load(FILE *fd, int autorun) {
 			LOG_WARN("Dragon BIN: short read\n");
 			break;
 		}
-		xroar_machine->write_byte(xroar_machine, (load + i) & 0xffff, data);
+		xroar_context->machine->write_byte(xroar_context->machine, (load + i) & 0xffff, data);
 		log_hexdump_byte(log_bin, data);
 	}
 	log_close(&log_bin);
 	if (autorun) {
-		struct MC6809 *cpu = xroar_machine->get_component(xroar_machine, "CPU0");
+		struct MC6809 *cpu = xroar_context->machine->get_component(xroar_context->machine, "CPU0");
 		if (xroar_cfg.debug_file & XROAR_DEBUG_FILE_BIN)
 			LOG_PRINT("Dragon BIN: EXEC $%04x - autorunning\n", exec);
 		cpu->jump(cpu, exec);
@@ -225,7 +225,7 @@ static int coco_bin_load(FILE *fd, int autorun) {
 					LOG_WARN("CoCo BIN: short read in data chunk\n");
 					break;
 				}
-				xroar_machine->write_byte(xroar_machine, (load + i) & 0xffff, data);
+				xroar_context->machine->write_byte(xroar_context->machine, (load + i) & 0xffff, data);
 				log_hexdump_byte(log_bin, data);
 			}
 			log_close(&log_bin);
@@ -238,7 +238,7 @@ static int coco_bin_load(FILE *fd, int autorun) {
 				break;
 			}
 			if (autorun) {
-				struct MC6809 *cpu = xroar_machine->get_component(xroar_machine, "CPU0");
+				struct MC6809 *cpu = xroar_context->machine->get_component(xroar_context->machine, "CPU0");
 				if (xroar_cfg.debug_file & XROAR_DEBUG_FILE_BIN)
 					LOG_PRINT("CoCo BIN: EXEC $%04x - autorunning\n", exec);
 				cpu->jump(cpu, exec);
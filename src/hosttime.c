@@ -0,0 +1,47 @@
+/*
+
+Host monotonic clock
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+// For clock_gettime()
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef WINDOWS32
+#include <windows.h>
+#endif
+
+#include "hosttime.h"
+
+uint64_t hosttime_ns(void) {
+#ifdef WINDOWS32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER t;
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&t);
+	return (uint64_t)((double)t.QuadPart * 1e9 / freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
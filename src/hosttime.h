@@ -0,0 +1,28 @@
+/*
+
+Host monotonic clock
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifndef XROAR_HOSTTIME_H_
+#define XROAR_HOSTTIME_H_
+
+#include <stdint.h>
+
+/* Host time in nanoseconds from an arbitrary starting point.  Never goes
+ * backwards, so only useful for measuring intervals. */
+
+uint64_t hosttime_ns(void);
+
+#endif
@@ -42,15 +42,15 @@ extern inline void keyboard_release_matrix(struct keyboard_interface *ki, int co
 extern inline void keyboard_press(struct keyboard_interface *ki, int s);
 extern inline void keyboard_release(struct keyboard_interface *ki, int s);
 
-/* Current chording mode - only affects how backslash is typed: */
-static enum keyboard_chord_mode chord_mode = keyboard_chord_mode_dragon_32k_basic;
-
 struct keyboard_interface_private {
 	struct keyboard_interface public;
 
 	struct machine *machine;
 	struct MC6809 *cpu;
 
+	/* Current chording mode - only affects how backslash is typed: */
+	enum keyboard_chord_mode chord_mode;
+
 	struct slist *basic_command_list;
 	sds basic_command;
 	unsigned command_index;
@@ -73,6 +73,7 @@ struct keyboard_interface *keyboard_interface_new(struct machine *m) {
 	struct keyboard_interface *ki = &kip->public;
 	kip->machine = m;
 	kip->cpu = m->get_component(m, "CPU0");
+	kip->chord_mode = keyboard_chord_mode_dragon_32k_basic;
 	for (int i = 0; i < 8; i++) {
 		ki->keyboard_column[i] = ~0;
 		ki->keyboard_row[i] = ~0;
@@ -89,12 +90,13 @@ void keyboard_interface_free(struct keyboard_interface *ki) {
 
 void keyboard_set_keymap(struct keyboard_interface *ki, int map) {
 	map %= NUM_KEYMAPS;
-	xroar_machine_config->keymap = map;
+	xroar_context->machine_config->keymap = map;
 	dkbd_map_init(&ki->keymap, map);
 }
 
 void keyboard_set_chord_mode(struct keyboard_interface *ki, enum keyboard_chord_mode mode) {
-	chord_mode = mode;
+	struct keyboard_interface_private *kip = (struct keyboard_interface_private *)ki;
+	kip->chord_mode = mode;
 	if (ki->keymap.layout == dkbd_layout_dragon) {
 		if (mode == keyboard_chord_mode_dragon_32k_basic) {
 			ki->keymap.unicode_to_dkey['\\'].dk_key = DSCAN_COMMA;
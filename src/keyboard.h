@@ -28,8 +28,8 @@ struct machine;
 #define KEYMAP_COCO   (1)
 #define KEYMAP_DRAGON200E (2)
 
-#define IS_DRAGON_KEYMAP (xroar_machine_config->keymap == KEYMAP_DRAGON)
-#define IS_COCO_KEYMAP (xroar_machine_config->keymap == KEYMAP_COCO)
+#define IS_DRAGON_KEYMAP (xroar_context->machine_config->keymap == KEYMAP_DRAGON)
+#define IS_COCO_KEYMAP (xroar_context->machine_config->keymap == KEYMAP_COCO)
 
 struct keyboard_state {
 	unsigned row_source;
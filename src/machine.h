@@ -18,6 +18,7 @@ See COPYING.GPL for redistribution conditions.
 #ifndef XROAR_MACHINE_H_
 #define XROAR_MACHINE_H_
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <sys/types.h>
@@ -27,6 +28,7 @@ See COPYING.GPL for redistribution conditions.
 #include "xconfig.h"
 
 struct cart;
+struct ser_handle;
 struct slist;
 struct sound_interface;
 struct tape_interface;
@@ -212,14 +214,31 @@ struct machine {
 	void *(*get_component)(struct machine *m, const char *cname);
 	void *(*get_interface)(struct machine *m, const char *ifname);
 	void (*set_vo_cmp)(struct machine *m, int mode);
-	void (*set_frameskip)(struct machine *m, unsigned fskip);
+	/* ANY_AUTO for automatic frameskip */
+	void (*set_frameskip)(struct machine *m, int fskip);
 	void (*set_ratelimit)(struct machine *m, _Bool ratelimit);
+	/* step back through rewind history, returns false if unavailable */
+	_Bool (*rewind)(struct machine *m, unsigned nframes);
+	/* combined CRC of all ROM images loaded, as checked against crclist */
+	uint32_t (*rom_crc)(struct machine *m);
 
 	/* simplified read & write byte for convenience functions */
 	uint8_t (*read_byte)(struct machine *m, unsigned A);
 	void (*write_byte)(struct machine *m, unsigned A, unsigned D);
 	/* simulate an RTS without otherwise affecting machine state */
 	void (*op_rts)(struct machine *m);
+
+	/* In-memory machine state, used for reverse execution.  Event times
+	 * are saved relative to the current time, so state may be restored
+	 * later, or into a different emulation context. */
+	size_t (*state_size)(struct machine *m);
+	void (*state_save)(struct machine *m, void *buf);
+	void (*state_restore)(struct machine *m, void const *buf);
+
+	/* Portable machine state for snapshot files: complete CPU state and
+	 * that of the other chips, but not RAM. */
+	void (*ser_write)(struct machine *m, struct ser_handle *sh);
+	void (*ser_read)(struct machine *m, struct ser_handle *sh);
 };
 
 void machine_init(void);
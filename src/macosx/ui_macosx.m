@@ -248,8 +248,8 @@ int cocoa_super_all_keys = 0;
 			xroar_insert_output_tape();
 			break;
 		case TAG_TAPE_INPUT_REWIND:
-			if (xroar_tape_interface->tape_input) {
-				tape_seek(xroar_tape_interface->tape_input, 0, SEEK_SET);
+			if (xroar_context->tape_interface->tape_input) {
+				tape_seek(xroar_context->tape_interface->tape_input, 0, SEEK_SET);
 			}
 			break;
 		case TAG_ZOOM_IN:
@@ -284,7 +284,7 @@ int cocoa_super_all_keys = 0;
 
 	/* Cassettes: */
 	case TAG_TAPE_FLAGS:
-		tape_set_state(xroar_tape_interface, tape_get_state(xroar_tape_interface) ^ tag_value);
+		tape_set_state(xroar_context->tape_interface, tape_get_state(xroar_context->tape_interface) ^ tag_value);
 		break;
 
 	/* Disks: */
@@ -376,7 +376,7 @@ int cocoa_super_all_keys = 0;
 		break;
 
 	case TAG_TAPE_FLAGS:
-		[item setState:((tape_get_state(xroar_tape_interface) & tag_value) ? NSOnState : NSOffState)];
+		[item setState:((tape_get_state(xroar_context->tape_interface) & tag_value) ? NSOnState : NSOffState)];
 		break;
 
 	case TAG_WRITE_ENABLE:
@@ -1036,7 +1036,7 @@ void cocoa_update_machine_menu(void *sptr) {
 		[machine_menu removeItem:[machine_menu itemAtIndex:0]];
 	for (iter = mcl; iter; iter = iter->next) {
 		struct machine_config *mc = iter->data;
-		if (mc == xroar_machine_config)
+		if (mc == xroar_context->machine_config)
 			current_machine = TAG(ui_tag_machine, mc->id);
 		NSString *description = [[NSString alloc] initWithUTF8String:mc->description];
 		item = [[NSMenuItem alloc] initWithTitle:description action:@selector(do_set_state:) keyEquivalent:@""];
@@ -1055,7 +1055,7 @@ void cocoa_update_cartridge_menu(void *sptr) {
 	NSMenuItem *item;
 	struct slist *ccl = slist_reverse(slist_copy(cart_config_list()));
 	struct slist *iter;
-	struct cart *cart = xroar_machine ? xroar_machine->get_interface(xroar_machine, "cart") : NULL;
+	struct cart *cart = xroar_context->machine ? xroar_context->machine->get_interface(xroar_context->machine, "cart") : NULL;
 	while ([cartridge_menu numberOfItems] > 0)
 		[cartridge_menu removeItem:[cartridge_menu itemAtIndex:0]];
 	for (iter = ccl; iter; iter = iter->next) {
@@ -35,6 +35,7 @@ See COPYING.GPL for redistribution conditions.
 #include <string.h>
 
 #include "delegate.h"
+#include "pl-thread.h"
 #include "xalloc.h"
 
 #include "mc6809.h"
@@ -48,6 +49,9 @@ extern inline void MC6809_HALT_SET(struct MC6809 *cpu, _Bool val);
 extern inline void MC6809_NMI_SET(struct MC6809 *cpu, _Bool val);
 extern inline void MC6809_FIRQ_SET(struct MC6809 *cpu, _Bool val);
 extern inline void MC6809_IRQ_SET(struct MC6809 *cpu, _Bool val);
+#ifdef WANT_PREDECODE
+extern inline void MC6809_PREDECODE_INVALIDATE(struct MC6809 *cpu, uint32_t P);
+#endif
 
 /*
  * External interface
@@ -178,6 +182,10 @@ struct MC6809 *mc6809_new(void) {
 #endif
 	// External handlers
 	cpu->mem_cycle = DELEGATE_DEFAULT2(void, bool, uint16);
+#ifdef WANT_PREDECODE
+	cpu->predecode = xmalloc(MC6809_PREDECODE_SIZE * sizeof(*cpu->predecode));
+	mc6809_predecode_flush(cpu);
+#endif
 	mc6809_reset(cpu);
 	return cpu;
 }
@@ -189,7 +197,16 @@ static void mc6809_free(struct part *p) {
 		mc6809_trace_free(cpu->tracer);
 	}
 #endif
+#ifdef WANT_PREDECODE
+	free(((struct MC6809 *)p)->predecode);
+#endif
+}
+
+#ifdef WANT_PREDECODE
+void mc6809_predecode_flush(struct MC6809 *cpu) {
+	memset(cpu->predecode, 0, MC6809_PREDECODE_SIZE * sizeof(*cpu->predecode));
 }
+#endif
 
 static void mc6809_reset(struct MC6809 *cpu) {
 	cpu->halt = cpu->nmi = 0;
@@ -203,6 +220,11 @@ static void mc6809_reset(struct MC6809 *cpu) {
 /* Run CPU while cpu->running is true. */
 
 static void mc6809_run(struct MC6809 *cpu) {
+#ifdef WANT_THREADED_DISPATCH
+	// Per-thread, as concurrent batch jobs each run a CPU
+	static THREAD_LOCAL void *op_dispatch[0x400];
+	static THREAD_LOCAL _Bool op_dispatch_ready = 0;
+#endif
 
 	do {
 
@@ -237,6 +259,9 @@ static void mc6809_run(struct MC6809 *cpu) {
 		// done_instruction case for backwards-compatibility
 		case mc6809_state_done_instruction:
 		case mc6809_state_label_a:
+#ifdef WANT_THREADED_DISPATCH
+state_label_a:
+#endif
 			if (cpu->halt) {
 				NVMA_CYCLE;
 				continue;
@@ -271,6 +296,12 @@ static void mc6809_run(struct MC6809 *cpu) {
 			// Instruction fetch hook called here so that machine
 			// can be stopped beforehand.
 			DELEGATE_SAFE_CALL0(cpu->instruction_hook);
+#ifdef WANT_THREADED_DISPATCH
+			// Unless the hook stopped the CPU or changed its state
+			// (e.g. reset), go straight on to the next instruction.
+			if (cpu->running && cpu->state == mc6809_state_next_instruction)
+				goto state_next_instruction;
+#endif
 			continue;
 
 		case mc6809_state_dispatch_irq:
@@ -327,12 +358,34 @@ static void mc6809_run(struct MC6809 *cpu) {
 			continue;
 
 		case mc6809_state_next_instruction:
+#ifdef WANT_THREADED_DISPATCH
+state_next_instruction:
+#endif
 			{
 			unsigned op;
+#ifdef WANT_THREADED_DISPATCH
+			if (!op_dispatch_ready) {
+				op = 0;
+				goto build_op_dispatch;
+			}
+op_dispatch_built:
+#endif
 			cpu->state = mc6809_state_label_a;
 			// Fetch op-code and process
+#ifdef WANT_PREDECODE
+			op = fetch_op_predecode(cpu);
+			if (op == PREDECODE_STOPPED) {
+				cpu->state = mc6809_state_next_instruction;
+				continue;
+			}
+#else
 			op = byte_immediate(cpu);
 			op |= cpu->page;
+#endif
+#ifdef WANT_THREADED_DISPATCH
+			goto *op_dispatch[op];
+build_op_dispatch:
+#endif
 			switch (op) {
 
 			// 0x00 - 0x0f direct mode ops
@@ -386,7 +439,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 			case 0x0270: case 0x0271: case 0x0272: case 0x0273:
 			case 0x0274: case 0x0275: case 0x0276: case 0x0277:
 			case 0x0278: case 0x0279: case 0x027a: case 0x027b:
-			case 0x027c: case 0x027d: case 0x027f: {
+			case 0x027c: case 0x027d: case 0x027f: OP_HANDLER {
 				uint16_t ea;
 				unsigned tmp1;
 				switch ((op >> 4) & 0xf) {
@@ -442,7 +495,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 			// 0x0e JMP direct
 			// 0x6e JMP indexed
 			// 0x7e JMP extended
-			case 0x0e: case 0x6e: case 0x7e: {
+			case 0x0e: case 0x6e: case 0x7e: OP_HANDLER {
 				unsigned ea;
 				switch ((op >> 4) & 0xf) {
 				case 0x0: ea = ea_direct(cpu); break;
@@ -457,7 +510,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 			case 0x10:
 			// 0x1010, 0x1011 Page 2
 			case 0x0210:
-			case 0x0211:
+			case 0x0211: OP_HANDLER
 				cpu->state = mc6809_state_next_instruction;
 				cpu->page = 0x200;
 				continue;
@@ -465,15 +518,15 @@ static void mc6809_run(struct MC6809 *cpu) {
 			// 0x1110, 0x1111 Page 3
 			case 0x0310:
 			case 0x0311:
-			case 0x11:
+			case 0x11: OP_HANDLER
 				cpu->state = mc6809_state_next_instruction;
 				cpu->page = 0x300;
 				continue;
 
 			// 0x12 NOP inherent
-			case 0x12: peek_byte(cpu, REG_PC); break;
+			case 0x12: OP_HANDLER peek_byte(cpu, REG_PC); break;
 			// 0x13 SYNC inherent
-			case 0x13:
+			case 0x13: OP_HANDLER
 				peek_byte(cpu, REG_PC);
 				cpu->nmi_active = cpu->nmi_latch;
 				cpu->firq_active = cpu->firq_latch;
@@ -483,11 +536,11 @@ static void mc6809_run(struct MC6809 *cpu) {
 				continue;
 			// 0x14, 0x15 HCF? (illegal)
 			case 0x14:
-			case 0x15:
+			case 0x15: OP_HANDLER
 				cpu->state = mc6809_state_hcf;
 				break;
 			// 0x16 LBRA relative
-			case 0x16: {
+			case 0x16: OP_HANDLER {
 				uint16_t ea;
 				ea = long_relative(cpu);
 				REG_PC += ea;
@@ -495,7 +548,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 				NVMA_CYCLE;
 			} break;
 			// 0x17 LBSR relative
-			case 0x17: {
+			case 0x17: OP_HANDLER {
 				uint16_t ea;
 				ea = long_relative(cpu);
 				ea += REG_PC;
@@ -507,41 +560,41 @@ static void mc6809_run(struct MC6809 *cpu) {
 				REG_PC = ea;
 			} break;
 			// 0x18 Shift CC with mask inherent (illegal)
-			case 0x18:
+			case 0x18: OP_HANDLER
 				REG_CC = (REG_CC << 1) & (CC_H | CC_Z);
 				NVMA_CYCLE;
 				peek_byte(cpu, REG_PC);
 				break;
 			// 0x19 DAA inherent
-			case 0x19:
+			case 0x19: OP_HANDLER
 				REG_A = op_daa(cpu, REG_A);
 				peek_byte(cpu, REG_PC);
 				break;
 			// 0x1a ORCC immediate
-			case 0x1a: {
+			case 0x1a: OP_HANDLER {
 				unsigned data;
 				data = byte_immediate(cpu);
 				REG_CC |= data;
 				peek_byte(cpu, REG_PC);
 			} break;
 			// 0x1b NOP inherent (illegal)
-			case 0x1b: peek_byte(cpu, REG_PC); break;
+			case 0x1b: OP_HANDLER peek_byte(cpu, REG_PC); break;
 			// 0x1c ANDCC immediate
-			case 0x1c: {
+			case 0x1c: OP_HANDLER {
 				unsigned data;
 				data = byte_immediate(cpu);
 				REG_CC &= data;
 				peek_byte(cpu, REG_PC);
 			} break;
 			// 0x1d SEX inherent
-			case 0x1d:
+			case 0x1d: OP_HANDLER
 				REG_A = (REG_B & 0x80) ? 0xff : 0;
 				CLR_NZ;
 				SET_NZ16(REG_D);
 				peek_byte(cpu, REG_PC);
 				break;
 			// 0x1e EXG immediate
-			case 0x1e: {
+			case 0x1e: OP_HANDLER {
 				unsigned postbyte;
 				uint16_t tmp1, tmp2;
 				postbyte = byte_immediate(cpu);
@@ -594,7 +647,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 				NVMA_CYCLE;
 			} break;
 			// 0x1f TFR immediate
-			case 0x1f: {
+			case 0x1f: OP_HANDLER {
 				unsigned postbyte;
 				uint16_t tmp1;
 				postbyte = byte_immediate(cpu);
@@ -635,7 +688,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 			case 0x20: case 0x21: case 0x22: case 0x23:
 			case 0x24: case 0x25: case 0x26: case 0x27:
 			case 0x28: case 0x29: case 0x2a: case 0x2b:
-			case 0x2c: case 0x2d: case 0x2e: case 0x2f: {
+			case 0x2c: case 0x2d: case 0x2e: case 0x2f: OP_HANDLER {
 				unsigned tmp = sex8(byte_immediate(cpu));
 				NVMA_CYCLE;
 				if (branch_condition(cpu, op))
@@ -645,7 +698,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 			// 0x30 LEAX indexed
 			case 0x30:
 			// 0x1030 LEAX indexed illegal
-			case 0x0230:
+			case 0x0230: OP_HANDLER
 				REG_X = ea_indexed(cpu);
 				CLR_Z;
 				SET_Z16(REG_X);
@@ -655,7 +708,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 			// 0x31 LEAY indexed
 			case 0x31:
 			// 0x1031 LEAY indexed illegal
-			case 0x0231:
+			case 0x0231: OP_HANDLER
 				REG_Y = ea_indexed(cpu);
 				CLR_Z;
 				SET_Z16(REG_Y);
@@ -665,7 +718,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 			// 0x32 LEAS indexed
 			case 0x32:
 			// 0x1032 LEAS indexed illegal
-			case 0x0232:
+			case 0x0232: OP_HANDLER
 				REG_S = ea_indexed(cpu);
 				NVMA_CYCLE;
 				cpu->nmi_armed = 1;  // XXX: Really?
@@ -674,13 +727,13 @@ static void mc6809_run(struct MC6809 *cpu) {
 			// 0x33 LEAU indexed
 			case 0x33:
 			// 0x1033 LEAU indexed illegal
-			case 0x0233:
+			case 0x0233: OP_HANDLER
 				REG_U = ea_indexed(cpu);
 				NVMA_CYCLE;
 				break;
 
 			// 0x34 PSHS immediate
-			case 0x34:
+			case 0x34: OP_HANDLER
 				{
 					unsigned postbyte = byte_immediate(cpu);
 					NVMA_CYCLE;
@@ -698,7 +751,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 				break;
 
 			// 0x35 PULS immediate
-			case 0x35:
+			case 0x35: OP_HANDLER
 				{
 					unsigned postbyte = byte_immediate(cpu);
 					NVMA_CYCLE;
@@ -716,7 +769,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 				break;
 
 			// 0x36 PSHU immediate
-			case 0x36:
+			case 0x36: OP_HANDLER
 				{
 					unsigned postbyte = byte_immediate(cpu);
 					NVMA_CYCLE;
@@ -734,7 +787,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 				break;
 
 			// 0x37 PULU immediate
-			case 0x37:
+			case 0x37: OP_HANDLER
 				{
 					unsigned postbyte = byte_immediate(cpu);
 					NVMA_CYCLE;
@@ -752,7 +805,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 				break;
 
 			// 0x38 ANDCC immediate (illegal)
-			case 0x38: {
+			case 0x38: OP_HANDLER {
 				unsigned data;
 				data = byte_immediate(cpu);
 				REG_CC &= data;
@@ -763,21 +816,21 @@ static void mc6809_run(struct MC6809 *cpu) {
 			} break;
 
 			// 0x39 RTS inherent
-			case 0x39:
+			case 0x39: OP_HANDLER
 				peek_byte(cpu, REG_PC);
 				REG_PC = pull_s_word(cpu);
 				NVMA_CYCLE;
 				break;
 
 			// 0x3a ABX inherent
-			case 0x3a:
+			case 0x3a: OP_HANDLER
 				REG_X += REG_B;
 				peek_byte(cpu, REG_PC);
 				NVMA_CYCLE;
 				break;
 
 			// 0x3b RTI inherent
-			case 0x3b:
+			case 0x3b: OP_HANDLER
 				peek_byte(cpu, REG_PC);
 				REG_CC = pull_s_byte(cpu);
 				if (REG_CC & CC_E) {
@@ -796,7 +849,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 				break;
 
 			// 0x3c CWAI immediate
-			case 0x3c: {
+			case 0x3c: OP_HANDLER {
 				unsigned data;
 				data = byte_immediate(cpu);
 				REG_CC &= data;
@@ -808,7 +861,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 			} break;
 
 			// 0x3d MUL inherent
-			case 0x3d: {
+			case 0x3d: OP_HANDLER {
 				unsigned tmp = REG_A * REG_B;
 				REG_D = tmp;
 				CLR_ZC;
@@ -828,7 +881,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 			} break;
 
 			// 0x3e RESET (illegal)
-			case 0x3e:
+			case 0x3e: OP_HANDLER
 				peek_byte(cpu, REG_PC);
 				push_irq_registers(cpu);
 				instruction_posthook(cpu);
@@ -837,7 +890,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 				continue;
 
 			// 0x3f SWI inherent
-			case 0x3f:
+			case 0x3f: OP_HANDLER
 				peek_byte(cpu, REG_PC);
 				stack_irq_registers(cpu, 1);
 				instruction_posthook(cpu);
@@ -870,7 +923,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 			case 0xe8: case 0xe9: case 0xea: case 0xeb:
 			case 0xf0: case 0xf1: case 0xf2:
 			case 0xf4: case 0xf5: case 0xf6:
-			case 0xf8: case 0xf9: case 0xfa: case 0xfb: {
+			case 0xf8: case 0xf9: case 0xfa: case 0xfb: OP_HANDLER {
 				unsigned tmp1, tmp2;
 				tmp1 = !(op & 0x40) ? REG_A : REG_B;
 				switch ((op >> 4) & 3) {
@@ -904,7 +957,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 			// 0x83, 0x93, 0xa3, 0xb3 SUBD
 			// 0xc3, 0xd3, 0xe3, 0xf3 ADDD
 			case 0x83: case 0x93: case 0xa3: case 0xb3:
-			case 0xc3: case 0xd3: case 0xe3: case 0xf3: {
+			case 0xc3: case 0xd3: case 0xe3: case 0xf3: OP_HANDLER {
 				unsigned tmp1, tmp2;
 				tmp1 = REG_D;
 				switch ((op >> 4) & 3) {
@@ -932,7 +985,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 			// 0x1183, 0x1193, 0x11a3, 0x11b3 CMPU
 			// 0x118c, 0x119c, 0x11ac, 0x11bc CMPS
 			case 0x0383: case 0x0393: case 0x03a3: case 0x03b3:
-			case 0x038c: case 0x039c: case 0x03ac: case 0x03bc: {
+			case 0x038c: case 0x039c: case 0x03ac: case 0x03bc: OP_HANDLER {
 				unsigned tmp1, tmp2;
 				switch (op & 0x0308) {
 				default:
@@ -955,7 +1008,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 
 			// 0x8d BSR
 			// 0x9d, 0xad, 0xbd JSR
-			case 0x8d: case 0x9d: case 0xad: case 0xbd: {
+			case 0x8d: case 0x9d: case 0xad: case 0xbd: OP_HANDLER {
 				unsigned ea;
 				switch ((op >> 4) & 3) {
 				case 0: ea = short_relative(cpu); ea += REG_PC; NVMA_CYCLE; NVMA_CYCLE; NVMA_CYCLE; break;
@@ -977,7 +1030,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 			// 0x108e, 0x109e, 0x10ae, 0x10be LDY
 			// 0x10ce, 0x10de, 0x10ee, 0x10fe LDS
 			case 0x028e: case 0x029e: case 0x02ae: case 0x02be:
-			case 0x02ce: case 0x02de: case 0x02ee: case 0x02fe: {
+			case 0x02ce: case 0x02de: case 0x02ee: case 0x02fe: OP_HANDLER {
 				unsigned tmp1, tmp2;
 				switch ((op >> 4) & 3) {
 				case 0: tmp2 = word_immediate(cpu); break;
@@ -1000,7 +1053,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 			// 0x8f STX immediate (illegal)
 			// 0xcf STU immediate (illegal)
 			// Illegal instruction only part working
-			case 0x8f: case 0xcf: {
+			case 0x8f: case 0xcf: OP_HANDLER {
 				unsigned tmp1;
 				tmp1 = !(op & 0x40) ? REG_X : REG_U;
 				(void)fetch_byte_notrace(cpu, REG_PC);
@@ -1014,7 +1067,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 			// 0x97, 0xa7, 0xb7 STA
 			// 0xd7, 0xe7, 0xf7 STB
 			case 0x97: case 0xa7: case 0xb7:
-			case 0xd7: case 0xe7: case 0xf7: {
+			case 0xd7: case 0xe7: case 0xf7: OP_HANDLER {
 				uint16_t ea;
 				uint8_t tmp1;
 				tmp1 = !(op & 0x40) ? REG_A : REG_B;
@@ -1038,7 +1091,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 			// 0x109f, 0x10af, 0x10bf STY
 			// 0x10df, 0x10ef, 0x10ff STS
 			case 0x029f: case 0x02af: case 0x02bf:
-			case 0x02df: case 0x02ef: case 0x02ff: {
+			case 0x02df: case 0x02ef: case 0x02ff: OP_HANDLER {
 				uint16_t ea, tmp1;
 				switch (op & 0x034e) {
 				default:
@@ -1061,7 +1114,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 			} break;
 
 			// 0xcd HCF? (illegal)
-			case 0xcd:
+			case 0xcd: OP_HANDLER
 				cpu->state = mc6809_state_hcf;
 				break;
 
@@ -1069,7 +1122,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 			case 0x0220: case 0x0221: case 0x0222: case 0x0223:
 			case 0x0224: case 0x0225: case 0x0226: case 0x0227:
 			case 0x0228: case 0x0229: case 0x022a: case 0x022b:
-			case 0x022c: case 0x022d: case 0x022e: case 0x022f: {
+			case 0x022c: case 0x022d: case 0x022e: case 0x022f: OP_HANDLER {
 				unsigned tmp = word_immediate(cpu);
 				if (branch_condition(cpu, op)) {
 					REG_PC += tmp;
@@ -1079,7 +1132,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 			} break;
 
 			// 0x103f SWI2 inherent
-			case 0x023f:
+			case 0x023f: OP_HANDLER
 				peek_byte(cpu, REG_PC);
 				stack_irq_registers(cpu, 1);
 				instruction_posthook(cpu);
@@ -1088,7 +1141,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 				continue;
 
 			// 0x113f SWI3 inherent
-			case 0x033f:
+			case 0x033f: OP_HANDLER
 				peek_byte(cpu, REG_PC);
 				stack_irq_registers(cpu, 1);
 				instruction_posthook(cpu);
@@ -1097,7 +1150,7 @@ static void mc6809_run(struct MC6809 *cpu) {
 				continue;
 
 			// Illegal instruction
-			default:
+			default: OP_HANDLER
 				NVMA_CYCLE;
 				break;
 			}
@@ -1121,6 +1174,10 @@ static void mc6809_run(struct MC6809 *cpu) {
 		cpu->firq_active = cpu->firq_latch;
 		cpu->irq_active = cpu->irq_latch;
 		instruction_posthook(cpu);
+#ifdef WANT_THREADED_DISPATCH
+		if (cpu->running && cpu->state == mc6809_state_label_a)
+			goto state_label_a;
+#endif
 		continue;
 
 	} while (cpu->running);
@@ -1286,6 +1343,7 @@ static void take_interrupt(struct MC6809 *cpu, uint8_t mask, uint16_t vec) {
 		mc6809_trace_irq(cpu->tracer, vec);
 	}
 #endif
+	DELEGATE_SAFE_CALL1(cpu->interrupt_hook, vec);
 	REG_PC = fetch_word(cpu, vec);
 	NVMA_CYCLE;
 }
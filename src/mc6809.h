@@ -92,6 +92,9 @@ struct MC6809 {
 	DELEGATE_T0(void) instruction_hook;
 	/* Called after instruction is executed */
 	DELEGATE_T0(void) instruction_posthook;
+	/* Called when an interrupt is taken, after registers are stacked and
+	 * before the vector is fetched.  Argument is the vector address. */
+	DELEGATE_T1(void, unsigned) interrupt_hook;
 
 	/* Internal state */
 
@@ -101,6 +104,8 @@ struct MC6809 {
 #ifdef TRACE
 	_Bool trace;
 	struct mc6809_trace *tracer;
+	// If set, trace is recorded here in binary instead of printed
+	struct tracebin *tracebin;
 #endif
 
 	/* Registers */
@@ -111,6 +116,14 @@ struct MC6809 {
 	_Bool nmi_armed;
 	_Bool nmi_latch, firq_latch, irq_latch;
 	_Bool nmi_active, firq_active, irq_active;
+#ifdef WANT_PREDECODE
+	/* Predecoded instruction cache.  Indexed by physical address, which
+	 * the machine supplies for each 256-byte page of the current memory
+	 * map in predecode_page[] (negative for pages that are not plain RAM
+	 * or ROM, which are never cached).  NULL disables the cache. */
+	const int32_t *predecode_page;
+	uint16_t *predecode;
+#endif
 };
 
 #if __BYTE_ORDER == __BIG_ENDIAN
@@ -140,6 +153,23 @@ inline void MC6809_IRQ_SET(struct MC6809 *cpu, _Bool val) {
 	cpu->irq = val;
 }
 
+#ifdef WANT_PREDECODE
+
+/* Physical address space covered by the predecode cache. */
+#define MC6809_PREDECODE_SIZE (0x20000)
+
+/* Must be called for every write to cached memory, however made. */
+inline void MC6809_PREDECODE_INVALIDATE(struct MC6809 *cpu, uint32_t P) {
+	// An entry covers its op-code and any page prefix before it
+	cpu->predecode[P] = 0;
+	cpu->predecode[(P - 1) & (MC6809_PREDECODE_SIZE - 1)] = 0;
+}
+
+/* Discard all cached instructions, e.g. when ROM or RAM is reloaded. */
+void mc6809_predecode_flush(struct MC6809 *cpu);
+
+#endif
+
 struct MC6809 *mc6809_new(void);
 
 #endif
@@ -43,6 +43,50 @@ static void store_byte(struct MC6809 *cpu, uint16_t a, uint8_t d) {
 	DELEGATE_CALL2(cpu->mem_cycle, 0, a);
 }
 
+/* Predecode cache.  Each entry holds the op-code with page, plus a valid
+ * flag, for the instruction starting at that address.  Bytes are still
+ * fetched exactly as without the cache, but a cached page prefix is followed
+ * straight into its instruction.  Entries never span a 256-byte page, and
+ * are cleared by the machine as memory is written. */
+
+#ifdef WANT_PREDECODE
+
+#define PREDECODE_VALID (0x8000)
+
+static unsigned fetch_op_predecode(struct MC6809 *cpu) {
+	uint16_t pc = REG_PC;
+	uint16_t *entry = NULL;
+	if (cpu->predecode_page) {
+		int32_t base = cpu->predecode_page[pc >> 8];
+		if (base >= 0)
+			entry = &cpu->predecode[base | (pc & 0xff)];
+	}
+	if (entry && (*entry & PREDECODE_VALID)) {
+		unsigned op = *entry & 0x3ff;
+		if (op & 0x300) {
+			(void)byte_immediate(cpu);
+			cpu->page = op & 0x300;
+			if (!cpu->running)
+				return PREDECODE_STOPPED;
+		}
+		(void)byte_immediate(cpu);
+		return op;
+	}
+	unsigned op = byte_immediate(cpu) | cpu->page;
+	// Prefixes are cached as part of the instruction that follows
+	if (!entry || (op & 0xfe) == 0x10)
+		return op;
+	if (!cpu->page) {
+		*entry = PREDECODE_VALID | op;
+	} else if ((pc & 0xff) != 0) {
+		// Prefix was the byte before
+		*(entry - 1) = PREDECODE_VALID | op;
+	}
+	return op;
+}
+
+#endif
+
 /* Read & write various addressing modes */
 
 static uint8_t byte_immediate(struct MC6809 *cpu) {
@@ -15,6 +15,30 @@ See COPYING.GPL for redistribution conditions.
 
 */
 
+/* Opcode dispatch.
+ *
+ * Each group of opcodes handled in the main opcode switch is tagged with
+ * OP_HANDLER.  Ordinarily this expands to nothing.  With threaded dispatch,
+ * the first pass through the switch runs every opcode in turn, recording the
+ * address of its handler in op_dispatch[] (requires labels as values).
+ * Subsequent opcodes jump straight to their handler without going through
+ * the switch. */
+
+#ifdef WANT_THREADED_DISPATCH
+#define OP_HANDLER OP_HANDLER_(__LINE__)
+#define OP_HANDLER_(l) OP_HANDLER__(l)
+#define OP_HANDLER__(l) \
+	if (!op_dispatch_ready) { \
+		op_dispatch[op] = &&op_handler_ ## l; \
+		if (++op < 0x400) goto build_op_dispatch; \
+		op_dispatch_ready = 1; \
+		goto op_dispatch_built; \
+	} \
+	op_handler_ ## l:
+#else
+#define OP_HANDLER
+#endif
+
 /* Memory interface */
 
 static uint8_t fetch_byte_notrace(struct MC6809 *cpu, uint16_t a);
@@ -23,6 +47,16 @@ static void store_byte(struct MC6809 *cpu, uint16_t a, uint8_t d);
 #define peek_byte(c,a) ((void)fetch_byte_notrace(c,a))
 #define NVMA_CYCLE (peek_byte(cpu, 0xffff))
 
+/* Op-code fetch through the predecode cache.  Returns the op-code including
+ * any page, or PREDECODE_STOPPED if the CPU was stopped after fetching a
+ * cached instruction's page prefix (cpu->page is then set, and the op-code
+ * should be fetched next). */
+
+#ifdef WANT_PREDECODE
+#define PREDECODE_STOPPED (0x400)
+static unsigned fetch_op_predecode(struct MC6809 *cpu);
+#endif
+
 /* Read & write various addressing modes */
 
 static uint8_t byte_immediate(struct MC6809 *cpu);
@@ -28,6 +28,7 @@ See COPYING.GPL for redistribution conditions.
 
 #include "mc6809.h"
 #include "mc6809_trace.h"
+#include "tracebin.h"
 
 /* Instruction types.  PAGE0, PAGE2 and PAGE3 switch which page is selected. */
 
@@ -991,6 +992,7 @@ struct mc6809_trace {
 
 static void reset_state(struct mc6809_trace *tracer);
 static void trace_print_short(struct mc6809_trace *tracer);
+static void trace_record(struct mc6809_trace *tracer, unsigned flags);
 
 #define STACK_PRINT(t,r) do { \
 		if (not_first) { strcat((t)->operand_text, "," r); } \
@@ -1141,6 +1143,14 @@ void mc6809_trace_byte(struct mc6809_trace *tracer, uint8_t byte, uint16_t pc) {
 
 	tracer->state_list = NULL;
 
+	// Binary trace needs no text, and records IRQ vectors immediately.
+	if (tracer->cpu->tracebin) {
+		if (tracer->ins_type == IRQVECTOR) {
+			trace_record(tracer, TRACEBIN_F_IRQ);
+		}
+		return;
+	}
+
 	tracer->operand_text[0] = '\0';
 	switch (tracer->ins_type) {
 		case ILLEGAL: case INHERENT:
@@ -1267,8 +1277,12 @@ void mc6809_trace_irq(struct mc6809_trace *tracer, int vector) {
 
 void mc6809_trace_print(struct mc6809_trace *tracer) {
 	if (tracer->state != WANT_PRINT) return;
-	trace_print_short(tracer);
 	struct MC6809 *cpu = tracer->cpu;
+	if (cpu->tracebin) {
+		trace_record(tracer, 0);
+		return;
+	}
+	trace_print_short(tracer);
 	printf("cc=%02x a=%02x b=%02x dp=%02x "
 	       "x=%04x y=%04x u=%04x s=%04x\n",
 	       cpu->reg_cc, MC6809_REG_A(cpu), MC6809_REG_B(cpu), cpu->reg_dp,
@@ -1286,3 +1300,19 @@ static void trace_print_short(struct mc6809_trace *tracer) {
 	printf("%04x| %-12s%-8s%-20s", tracer->instr_pc, bytes_string, tracer->mnemonic, tracer->operand_text);
 	reset_state(tracer);
 }
+
+static void trace_record(struct mc6809_trace *tracer, unsigned flags) {
+	struct MC6809 *cpu = tracer->cpu;
+	uint16_t regs[8];
+	regs[TRACEBIN_REG_CC] = cpu->reg_cc;
+	regs[TRACEBIN_REG_A] = MC6809_REG_A(cpu);
+	regs[TRACEBIN_REG_B] = MC6809_REG_B(cpu);
+	regs[TRACEBIN_REG_DP] = cpu->reg_dp;
+	regs[TRACEBIN_REG_X] = cpu->reg_x;
+	regs[TRACEBIN_REG_Y] = cpu->reg_y;
+	regs[TRACEBIN_REG_U] = cpu->reg_u;
+	regs[TRACEBIN_REG_S] = cpu->reg_s;
+	tracebin_record(cpu->tracebin, flags, tracer->instr_pc,
+			tracer->bytes_buf, tracer->bytes_count, regs);
+	reset_state(tracer);
+}
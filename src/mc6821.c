@@ -28,6 +28,8 @@ See COPYING.GPL for redistribution conditions.
 #include "events.h"
 #include "mc6821.h"
 #include "part.h"
+#include "serialise.h"
+#include "stats.h"
 #include "xroar.h"
 
 static void mc6821_free(struct part *p);
@@ -43,6 +45,8 @@ struct MC6821 *mc6821_new(void) {
 	pia->b.in_sink = 0xff;
 	event_init(&pia->a.irq_event, DELEGATE_AS0(void, do_irq, &pia->a));
 	event_init(&pia->b.irq_event, DELEGATE_AS0(void, do_irq, &pia->b));
+	STATS_EVENT_TYPE(&pia->a.irq_event, STATS_EVENT_PIA);
+	STATS_EVENT_TYPE(&pia->b.irq_event, STATS_EVENT_PIA);
 
 	return pia;
 }
@@ -80,6 +84,86 @@ void mc6821_reset(struct MC6821 *pia) {
 	mc6821_update_state(pia);
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+struct mc6821_state {
+	struct MC6821_side side[2];
+	struct event_state irq_event[2];
+};
+
+size_t mc6821_state_size(void) {
+	return sizeof(struct mc6821_state);
+}
+
+void mc6821_state_save(struct MC6821 *pia, void *buf) {
+	struct mc6821_state *st = buf;
+	st->side[0] = pia->a;
+	st->side[1] = pia->b;
+	event_save_state(&pia->a.irq_event, &st->irq_event[0]);
+	event_save_state(&pia->b.irq_event, &st->irq_event[1]);
+}
+
+static void restore_side(struct MC6821_side *side, struct MC6821_side const *saved,
+			 struct event_state const *es) {
+	side->control_register = saved->control_register;
+	side->direction_register = saved->direction_register;
+	side->output_register = saved->output_register;
+	side->cx1 = saved->cx1;
+	side->interrupt_received = saved->interrupt_received;
+	side->irq = saved->irq;
+	side->out_source = saved->out_source;
+	side->out_sink = saved->out_sink;
+	side->in_source = saved->in_source;
+	side->in_sink = saved->in_sink;
+	event_restore_state(&side->irq_event, &xroar_context->machine_events, es);
+}
+
+void mc6821_state_restore(struct MC6821 *pia, void const *buf) {
+	struct mc6821_state const *st = buf;
+	restore_side(&pia->a, &st->side[0], &st->irq_event[0]);
+	restore_side(&pia->b, &st->side[1], &st->irq_event[1]);
+}
+
+static void ser_write_side(struct MC6821_side *side, struct ser_handle *sh) {
+	ser_write_uint8(sh, side->control_register);
+	ser_write_uint8(sh, side->direction_register);
+	ser_write_uint8(sh, side->output_register);
+	ser_write_bool(sh, side->cx1);
+	ser_write_bool(sh, side->interrupt_received);
+	ser_write_bool(sh, side->irq);
+	ser_write_event(sh, &side->irq_event);
+	ser_write_uint8(sh, side->out_source);
+	ser_write_uint8(sh, side->out_sink);
+	ser_write_uint8(sh, side->in_source);
+	ser_write_uint8(sh, side->in_sink);
+}
+
+static void ser_read_side(struct MC6821_side *side, struct ser_handle *sh) {
+	side->control_register = ser_read_uint8(sh);
+	side->direction_register = ser_read_uint8(sh);
+	side->output_register = ser_read_uint8(sh);
+	side->cx1 = ser_read_bool(sh);
+	side->interrupt_received = ser_read_bool(sh);
+	side->irq = ser_read_bool(sh);
+	ser_read_event(sh, &side->irq_event, &xroar_context->machine_events);
+	side->out_source = ser_read_uint8(sh);
+	side->out_sink = ser_read_uint8(sh);
+	side->in_source = ser_read_uint8(sh);
+	side->in_sink = ser_read_uint8(sh);
+}
+
+void mc6821_ser_write(struct MC6821 *pia, struct ser_handle *sh) {
+	ser_write_side(&pia->a, sh);
+	ser_write_side(&pia->b, sh);
+}
+
+void mc6821_ser_read(struct MC6821 *pia, struct ser_handle *sh) {
+	ser_read_side(&pia->a, sh);
+	ser_read_side(&pia->b, sh);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 #define PIA_INTERRUPT_ENABLED(s) ((s)->control_register & 0x01)
 #define PIA_DDR_SELECTED(s)      (!((s)->control_register & 0x04))
 #define PIA_PDR_SELECTED(s)      ((s)->control_register & 0x04)
@@ -93,8 +177,8 @@ void mc6821_set_cx1(struct MC6821_side *side, _Bool level) {
 		_Bool irq_enabled = side->control_register & 1;
 		side->interrupt_received = 1;
 		if (irq_enabled) {
-			side->irq_event.at_tick = event_current_tick + EVENT_US(1);
-			event_queue(&MACHINE_EVENT_LIST, &side->irq_event);
+			side->irq_event.at_tick = xroar_context->current_tick + EVENT_US(1);
+			event_queue(&xroar_context->machine_events, &side->irq_event);
 		} else {
 			side->irq = 0;
 		}
@@ -77,4 +77,19 @@ void mc6821_update_state(struct MC6821 *pia);
 uint8_t mc6821_read(struct MC6821 *pia, uint16_t A);
 void mc6821_write(struct MC6821 *pia, uint16_t A, uint8_t D);
 
+/* Save and restore internal state, for reverse execution.  Hooks are not
+ * called, and pending interrupt events are rescheduled relative to the
+ * current time. */
+
+size_t mc6821_state_size(void);
+void mc6821_state_save(struct MC6821 *pia, void *buf);
+void mc6821_state_restore(struct MC6821 *pia, void const *buf);
+
+/* Portable state, for snapshot files. */
+
+struct ser_handle;
+
+void mc6821_ser_write(struct MC6821 *pia, struct ser_handle *sh);
+void mc6821_ser_read(struct MC6821 *pia, struct ser_handle *sh);
+
 #endif
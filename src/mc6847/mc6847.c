@@ -35,6 +35,8 @@ See COPYING.GPL for redistribution conditions.
 #include "ntsc.h"
 #include "part.h"
 #include "sam.h"
+#include "serialise.h"
+#include "stats.h"
 #include "xroar.h"
 
 struct ser_handle;
@@ -51,6 +53,9 @@ enum vdg_render_mode {
 struct MC6847_private {
 	struct MC6847 public;
 
+	// Emulation context, cached as scanline events use it
+	struct xroar_context *ctx;
+
 	/* Control lines */
 	unsigned GM;
 	_Bool nA_S;
@@ -90,7 +95,9 @@ struct MC6847_private {
 	/* Unsafe warning: pixel_data[] needs to be 8 elements longer than a
 	 * full scanline, for the mid-scanline 32 -> 16 byte mode switch case
 	 * where many extra pixels are emitted.  8 is the maximum number of
-	 * elements rendered in render_scanline() between index checks. */
+	 * elements rendered in render_scanline() between index checks, other
+	 * than whole bytes, which are only rendered if they end before the
+	 * beam position. */
 	uint8_t pixel_data[VDG_LINE_DURATION+8];
 
 	const struct ntsc_palette *palette;
@@ -141,6 +148,105 @@ static inline int encode_pixel(struct MC6847_private *vdg, int colour) {
 
 #endif
 
+// Output elements per VRAM byte in 32 and 16 byte per line modes.
+
+#define BYTE_ELEMENTS_32 (16 / SCALE_PIXELS)
+#define BYTE_ELEMENTS_16 (32 / SCALE_PIXELS)
+
+/* Byte expansion tables, used where a whole VRAM byte can be rendered at
+ * once.  For each byte value, and each output element:
+ *
+ * expand_bits: 0xff where the corresponding bit is set, else 0x00.  Selects
+ * between foreground and background colours in RG and SG modes.
+ *
+ * expand_cg: the 2-bit colour offset for that element in CG modes.
+ *
+ * Colours are combined with these eight elements at a time, using a colour
+ * value repeated in each byte of a uint64_t. */
+
+// The tables are constant data, generated here by the preprocessor, so they
+// are safe to share between machines running on different threads.
+
+#define EXPAND_BIT(b,i,n) ((((b) >> (7 - ((i) * 8) / (n))) & 1) ? 0xff : 0x00)
+#define EXPAND_CG(b,i,n) (((b) >> ((7 - ((i) * 8) / (n)) & 6)) & 3)
+
+#define EXPAND_E4(F,b,i,n) F(b,i,n), F(b,(i)+1,n), F(b,(i)+2,n), F(b,(i)+3,n)
+#define EXPAND_E8(F,b,i,n) EXPAND_E4(F,b,i,n), EXPAND_E4(F,b,(i)+4,n)
+#define EXPAND_E16(F,b,i,n) EXPAND_E8(F,b,i,n), EXPAND_E8(F,b,(i)+8,n)
+#define EXPAND_E32(F,b,i,n) EXPAND_E16(F,b,i,n), EXPAND_E16(F,b,(i)+16,n)
+
+#if SCALE_PIXELS == 1
+#define EXPAND_ROW_32(F,b) { EXPAND_E16(F,b,0,16) }
+#define EXPAND_ROW_16(F,b) { EXPAND_E32(F,b,0,32) }
+#else
+#define EXPAND_ROW_32(F,b) { EXPAND_E8(F,b,0,8) }
+#define EXPAND_ROW_16(F,b) { EXPAND_E16(F,b,0,16) }
+#endif
+
+#define EXPAND_B4(R,F,b) R(F,b), R(F,(b)+1), R(F,(b)+2), R(F,(b)+3)
+#define EXPAND_B16(R,F,b) EXPAND_B4(R,F,b), EXPAND_B4(R,F,(b)+4), EXPAND_B4(R,F,(b)+8), EXPAND_B4(R,F,(b)+12)
+#define EXPAND_B64(R,F,b) EXPAND_B16(R,F,b), EXPAND_B16(R,F,(b)+16), EXPAND_B16(R,F,(b)+32), EXPAND_B16(R,F,(b)+48)
+#define EXPAND_TABLE(R,F) { EXPAND_B64(R,F,0), EXPAND_B64(R,F,64), EXPAND_B64(R,F,128), EXPAND_B64(R,F,192) }
+
+static const uint8_t expand_bits_32[256][BYTE_ELEMENTS_32] = EXPAND_TABLE(EXPAND_ROW_32, EXPAND_BIT);
+static const uint8_t expand_bits_16[256][BYTE_ELEMENTS_16] = EXPAND_TABLE(EXPAND_ROW_16, EXPAND_BIT);
+static const uint8_t expand_cg_32[256][BYTE_ELEMENTS_32] = EXPAND_TABLE(EXPAND_ROW_32, EXPAND_CG);
+static const uint8_t expand_cg_16[256][BYTE_ELEMENTS_16] = EXPAND_TABLE(EXPAND_ROW_16, EXPAND_CG);
+
+#define REPEAT_BYTE(c) ((uint64_t)(c) * UINT64_C(0x0101010101010101))
+
+// Write n elements (a multiple of 8), either selecting between fg and bg
+// colours by mask, or adding a per-element offset to fg.
+
+static inline uint8_t *write_elements(struct MC6847_private *vdg, uint8_t *pixel, uint8_t const *table, unsigned n, uint64_t fg, uint64_t bg, _Bool select) {
+	(void)vdg;
+	for (unsigned i = 0; i < n; i += 8) {
+		uint64_t t, v;
+		memcpy(&t, table + i, sizeof(t));
+		if (select) {
+			v = (fg & t) | (bg & ~t);
+		} else {
+			v = fg + t;
+		}
+#ifdef WANT_SIMULATED_NTSC
+		uint8_t c[8];
+		memcpy(c, &v, sizeof(c));
+		for (unsigned j = 0; j < 8; j++) {
+			*(pixel++) = encode_pixel(vdg, c[j]);
+		}
+#else
+		memcpy(pixel, &v, sizeof(v));
+		pixel += 8;
+#endif
+	}
+	return pixel;
+}
+
+// Render the whole of the current VRAM byte.
+
+static uint8_t *render_byte(struct MC6847_private *vdg, uint8_t *pixel) {
+	unsigned n = vdg->is_32byte ? BYTE_ELEMENTS_32 : BYTE_ELEMENTS_16;
+	switch (vdg->render_mode) {
+	case VDG_RENDER_SG: default:
+		pixel = write_elements(vdg, pixel,
+				       vdg->is_32byte ? expand_bits_32[vdg->vram_sg_data] : expand_bits_16[vdg->vram_sg_data], n,
+				       REPEAT_BYTE(vdg->s_fg_colour), REPEAT_BYTE(vdg->s_bg_colour), 1);
+		break;
+	case VDG_RENDER_CG:
+		// No carry between elements: offsets are at most 3
+		pixel = write_elements(vdg, pixel,
+				       vdg->is_32byte ? expand_cg_32[vdg->vram_g_data] : expand_cg_16[vdg->vram_g_data], n,
+				       REPEAT_BYTE(vdg->cg_colours), 0, 0);
+		break;
+	case VDG_RENDER_RG:
+		pixel = write_elements(vdg, pixel,
+				       vdg->is_32byte ? expand_bits_32[vdg->vram_g_data] : expand_bits_16[vdg->vram_g_data], n,
+				       REPEAT_BYTE(vdg->fg_colour), REPEAT_BYTE(vdg->bg_colour), 1);
+		break;
+	}
+	return pixel;
+}
+
 // - - - - - - -
 
 static void do_hs_fall(void *data) {
@@ -156,7 +262,9 @@ static void do_hs_fall(void *data) {
 			}
 			DELEGATE_CALL2(vdg->public.render_line, vdg->pixel_data, vdg->burst);
 		} else if (vdg->scanline >= VDG_ACTIVE_AREA_START && vdg->scanline < VDG_ACTIVE_AREA_END) {
+			STATS_ENTER(STATS_VDG_RENDER);
 			render_scanline(vdg);
+			STATS_LEAVE();
 			vdg->public.row++;
 			if (vdg->public.row > 11)
 				vdg->public.row = 0;
@@ -213,8 +321,8 @@ static void do_hs_fall(void *data) {
 		}
 	}
 
-	event_queue(&MACHINE_EVENT_LIST, &vdg->hs_rise_event);
-	event_queue(&MACHINE_EVENT_LIST, &vdg->hs_fall_event);
+	event_queue(&vdg->ctx->machine_events, &vdg->hs_rise_event);
+	event_queue(&vdg->ctx->machine_events, &vdg->hs_fall_event);
 
 	// Next scanline
 	vdg->scanline = SCANLINE(vdg->scanline + 1);
@@ -262,12 +370,12 @@ static void do_hs_fall_pal(void *data) {
 	if (vdg->pal_padding == 0)
 		vdg->hs_fall_event.delegate.func = do_hs_fall;
 
-	event_queue(&MACHINE_EVENT_LIST, &vdg->hs_rise_event);
-	event_queue(&MACHINE_EVENT_LIST, &vdg->hs_fall_event);
+	event_queue(&vdg->ctx->machine_events, &vdg->hs_rise_event);
+	event_queue(&vdg->ctx->machine_events, &vdg->hs_fall_event);
 }
 
 static void render_scanline(struct MC6847_private *vdg) {
-	unsigned beam_to = (event_current_tick - vdg->scanline_start) / EVENT_VDG_PIXELS(1);
+	unsigned beam_to = (vdg->ctx->current_tick - vdg->scanline_start) / EVENT_VDG_PIXELS(1);
 	if (vdg->is_32byte && beam_to >= (VDG_tHBNK + 16)) {
 		unsigned nbytes = (beam_to - VDG_tHBNK) >> 4;
 		if (nbytes > 42)
@@ -365,6 +473,22 @@ static void render_scanline(struct MC6847_private *vdg) {
 			}
 		}
 
+		// Whole byte at once if it'll all be rendered before beam_to.
+		// Otherwise two bits at a time, so that a mode change partway
+		// through a byte takes effect at the right point.
+		unsigned byte_pixels = vdg->is_32byte ? 16 : 32;
+		if (vdg->vram_bit == 8 && vdg->beam_pos + byte_pixels <= beam_to) {
+			pixel = render_byte(vdg, pixel);
+			vdg->beam_pos += byte_pixels;
+			vdg->vram_bit = 0;
+			vdg->vram_remaining--;
+			vdg->vram_g_data = 0;
+			vdg->vram_sg_data = 0;
+			if (vdg->beam_pos >= beam_to)
+				return;
+			continue;
+		}
+
 		uint8_t c0, c1;
 		switch (vdg->render_mode) {
 		case VDG_RENDER_SG: default:
@@ -473,6 +597,7 @@ static void update_vdg(struct MC6847_private *vdg) {
 struct MC6847 *mc6847_new(_Bool t1) {
 	struct MC6847_private *vdg = part_new(sizeof(*vdg));
 	*vdg = (struct MC6847_private){0};
+	vdg->ctx = xroar_context;
 	part_init((struct part *)vdg, t1 ? "MC6847T1" : "MC6847");
 	vdg->public.part.free = mc6847_free;
 	vdg->is_t1 = t1;
@@ -482,6 +607,8 @@ struct MC6847 *mc6847_new(_Bool t1) {
 	vdg->public.fetch_data = DELEGATE_DEFAULT2(void, int, uint16p);
 	event_init(&vdg->hs_fall_event, DELEGATE_AS0(void, do_hs_fall, vdg));
 	event_init(&vdg->hs_rise_event, DELEGATE_AS0(void, do_hs_rise, vdg));
+	STATS_EVENT_TYPE(&vdg->hs_fall_event, STATS_EVENT_VDG);
+	STATS_EVENT_TYPE(&vdg->hs_rise_event, STATS_EVENT_VDG);
 	update_vdg(vdg);
 	return (struct MC6847 *)vdg;
 }
@@ -498,9 +625,9 @@ void mc6847_reset(struct MC6847 *vdgp) {
 	vdg->beam_pos = VDG_LEFT_BORDER_START;
 	vdg->scanline = 0;
 	vdg->public.row = 0;
-	vdg->scanline_start = event_current_tick;
-	vdg->hs_fall_event.at_tick = event_current_tick + EVENT_VDG_PIXELS(VDG_LINE_DURATION);
-	event_queue(&MACHINE_EVENT_LIST, &vdg->hs_fall_event);
+	vdg->scanline_start = vdg->ctx->current_tick;
+	vdg->hs_fall_event.at_tick = vdg->ctx->current_tick + EVENT_VDG_PIXELS(VDG_LINE_DURATION);
+	event_queue(&vdg->ctx->machine_events, &vdg->hs_fall_event);
 	// 6847T1 doesn't appear to do bright orange:
 	vdg->bright_orange = vdg->is_t1 ? VDG_ORANGE : VDG_BRIGHT_ORANGE;
 	mc6847_set_mode(vdgp, 0);
@@ -511,6 +638,149 @@ void mc6847_reset(struct MC6847 *vdgp) {
 	vdg->rborder_remaining = VDG_tRB;
 }
 
+struct mc6847_state {
+	struct MC6847_private vdg;
+	struct event_state hs_fall_event;
+	struct event_state hs_rise_event;
+};
+
+size_t mc6847_state_size(void) {
+	return sizeof(struct mc6847_state);
+}
+
+void mc6847_state_save(struct MC6847 *vdgp, void *buf) {
+	struct MC6847_private *vdg = (struct MC6847_private *)vdgp;
+	struct mc6847_state *st = buf;
+	memcpy(&st->vdg, vdg, sizeof(*vdg));
+	st->vdg.scanline_start -= vdg->ctx->current_tick;
+	event_save_state(&vdg->hs_fall_event, &st->hs_fall_event);
+	event_save_state(&vdg->hs_rise_event, &st->hs_rise_event);
+}
+
+void mc6847_state_restore(struct MC6847 *vdgp, void const *buf) {
+	struct MC6847_private *vdg = (struct MC6847_private *)vdgp;
+	struct mc6847_state const *st = buf;
+	event_dequeue(&vdg->hs_fall_event);
+	event_dequeue(&vdg->hs_rise_event);
+	struct MC6847 public = vdg->public;
+	struct event hs_fall_event = vdg->hs_fall_event;
+	struct event hs_rise_event = vdg->hs_rise_event;
+	const struct ntsc_palette *palette = vdg->palette;
+	_Bool inverted_text = vdg->inverted_text;
+	memcpy(vdg, &st->vdg, sizeof(*vdg));
+	vdg->public = public;
+	vdg->public.row = st->vdg.public.row;
+	vdg->hs_fall_event = hs_fall_event;
+	vdg->hs_rise_event = hs_rise_event;
+	// HS fall handler differs while padding PAL frames
+	vdg->hs_fall_event.delegate.func = st->vdg.hs_fall_event.delegate.func;
+	vdg->palette = palette;
+	vdg->inverted_text = inverted_text;
+	vdg->scanline_start += vdg->ctx->current_tick;
+	event_restore_state(&vdg->hs_fall_event, &vdg->ctx->machine_events, &st->hs_fall_event);
+	event_restore_state(&vdg->hs_rise_event, &vdg->ctx->machine_events, &st->hs_rise_event);
+}
+
+// Portable state for snapshot files.  Configuration (chip type, palette,
+// inverted text) is left as set up for the machine.
+
+void mc6847_ser_write(struct MC6847 *vdgp, struct ser_handle *sh) {
+	struct MC6847_private *vdg = (struct MC6847_private *)vdgp;
+	ser_write_uint8(sh, vdg->public.row);
+	ser_write_uint8(sh, vdg->GM);
+	ser_write_bool(sh, vdg->nA_S);
+	ser_write_bool(sh, vdg->nA_G);
+	ser_write_bool(sh, vdg->EXT);
+	ser_write_bool(sh, vdg->CSS);
+	ser_write_bool(sh, vdg->CSSa);
+	ser_write_bool(sh, vdg->CSSb);
+	ser_write_event(sh, &vdg->hs_fall_event);
+	ser_write_event(sh, &vdg->hs_rise_event);
+	ser_write_bool(sh, vdg->hs_fall_event.delegate.func == do_hs_fall_pal);
+	ser_write_int32(sh, (int32_t)(vdg->scanline_start - vdg->ctx->current_tick));
+	ser_write_uint16(sh, vdg->beam_pos);
+	ser_write_uint16(sh, vdg->scanline);
+	ser_write_uint8(sh, vdg->vram_g_data);
+	ser_write_uint8(sh, vdg->vram_sg_data);
+	ser_write_bool(sh, vdg->is_32byte);
+	ser_write_bool(sh, vdg->GM0);
+	ser_write_uint8(sh, vdg->s_fg_colour);
+	ser_write_uint8(sh, vdg->s_bg_colour);
+	ser_write_uint8(sh, vdg->fg_colour);
+	ser_write_uint8(sh, vdg->bg_colour);
+	ser_write_uint8(sh, vdg->cg_colours);
+	ser_write_uint8(sh, vdg->border_colour);
+	ser_write_int32(sh, vdg->vram_bit);
+	ser_write_uint8(sh, vdg->render_mode);
+	ser_write_uint8(sh, vdg->pal_padding);
+	ser_write_uint16(sh, sizeof(vdg->pixel_data));
+	ser_write_bytes(sh, vdg->pixel_data, sizeof(vdg->pixel_data));
+	ser_write_uint8(sh, vdg->burst);
+	for (unsigned i = 0; i < 42; i++) {
+		ser_write_uint16(sh, vdg->vram[i]);
+	}
+	ser_write_uint8(sh, vdg->vram_index);
+	ser_write_uint8(sh, vdg->vram_nbytes);
+	ser_write_uint16(sh, vdg->lborder_remaining);
+	ser_write_uint16(sh, vdg->vram_remaining);
+	ser_write_uint16(sh, vdg->rborder_remaining);
+	ser_write_bool(sh, vdg->inverse_text);
+	ser_write_bool(sh, vdg->text_border);
+	ser_write_uint8(sh, vdg->text_border_colour);
+}
+
+void mc6847_ser_read(struct MC6847 *vdgp, struct ser_handle *sh) {
+	struct MC6847_private *vdg = (struct MC6847_private *)vdgp;
+	vdg->public.row = ser_read_uint8(sh);
+	vdg->GM = ser_read_uint8(sh) & 7;
+	vdg->nA_S = ser_read_bool(sh);
+	vdg->nA_G = ser_read_bool(sh);
+	vdg->EXT = ser_read_bool(sh);
+	vdg->CSS = ser_read_bool(sh);
+	vdg->CSSa = ser_read_bool(sh);
+	vdg->CSSb = ser_read_bool(sh);
+	ser_read_event(sh, &vdg->hs_fall_event, &vdg->ctx->machine_events);
+	ser_read_event(sh, &vdg->hs_rise_event, &vdg->ctx->machine_events);
+	vdg->hs_fall_event.delegate.func = ser_read_bool(sh) ? do_hs_fall_pal : do_hs_fall;
+	vdg->scanline_start = vdg->ctx->current_tick + ser_read_int32(sh);
+	vdg->beam_pos = ser_read_uint16(sh);
+	vdg->scanline = SCANLINE(ser_read_uint16(sh));
+	vdg->vram_g_data = ser_read_uint8(sh);
+	vdg->vram_sg_data = ser_read_uint8(sh);
+	vdg->is_32byte = ser_read_bool(sh);
+	vdg->GM0 = ser_read_bool(sh);
+	vdg->s_fg_colour = ser_read_uint8(sh);
+	vdg->s_bg_colour = ser_read_uint8(sh);
+	vdg->fg_colour = ser_read_uint8(sh);
+	vdg->bg_colour = ser_read_uint8(sh);
+	vdg->cg_colours = ser_read_uint8(sh);
+	vdg->border_colour = ser_read_uint8(sh);
+	vdg->vram_bit = ser_read_int32(sh);
+	vdg->render_mode = ser_read_uint8(sh);
+	vdg->pal_padding = ser_read_uint8(sh);
+	// Pixel data is only kept if the line length matches this build
+	unsigned npixels = ser_read_uint16(sh);
+	if (npixels == sizeof(vdg->pixel_data)) {
+		ser_read_bytes(sh, vdg->pixel_data, npixels);
+	} else {
+		for (unsigned i = 0; i < npixels; i++)
+			(void)ser_read_uint8(sh);
+		memset(vdg->pixel_data, VDG_BLACK, sizeof(vdg->pixel_data));
+	}
+	vdg->burst = ser_read_uint8(sh);
+	for (unsigned i = 0; i < 42; i++) {
+		vdg->vram[i] = ser_read_uint16(sh);
+	}
+	vdg->vram_index = ser_read_uint8(sh) % 42;
+	vdg->vram_nbytes = ser_read_uint8(sh) % 43;
+	vdg->lborder_remaining = ser_read_uint16(sh);
+	vdg->vram_remaining = ser_read_uint16(sh);
+	vdg->rborder_remaining = ser_read_uint16(sh);
+	vdg->inverse_text = ser_read_bool(sh);
+	vdg->text_border = ser_read_bool(sh);
+	vdg->text_border_colour = ser_read_uint8(sh);
+}
+
 void mc6847_set_palette(struct MC6847 *vdgp, const struct ntsc_palette *np) {
 	struct MC6847_private *vdg = (struct MC6847_private *)vdgp;
 	vdg->palette = np;
@@ -528,7 +798,9 @@ void mc6847_set_mode(struct MC6847 *vdgp, unsigned mode) {
 	struct MC6847_private *vdg = (struct MC6847_private *)vdgp;
 	/* Render scanline so far before changing modes */
 	if (vdg->scanline >= VDG_ACTIVE_AREA_START && vdg->scanline < VDG_ACTIVE_AREA_END) {
+		STATS_ENTER(STATS_VDG_RENDER);
 		render_scanline(vdg);
+		STATS_LEAVE();
 	}
 
 	vdg->GM = (mode >> 4) & 7;
@@ -18,6 +18,7 @@ See COPYING.GPL for redistribution conditions.
 #ifndef XROAR_VDG_H_
 #define XROAR_VDG_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "delegate.h"
@@ -134,4 +135,19 @@ void mc6847_set_inverted_text(struct MC6847 *, _Bool);
 
 void mc6847_set_mode(struct MC6847 *, unsigned mode);
 
+/* Save and restore internal state, for reverse execution.  Delegates, palette
+ * and the inverted text setting are not affected, and the HS events are
+ * rescheduled relative to the current time. */
+
+size_t mc6847_state_size(void);
+void mc6847_state_save(struct MC6847 *, void *buf);
+void mc6847_state_restore(struct MC6847 *, void const *buf);
+
+/* Portable state, for snapshot files. */
+
+struct ser_handle;
+
+void mc6847_ser_write(struct MC6847 *, struct ser_handle *);
+void mc6847_ser_read(struct MC6847 *, struct ser_handle *);
+
 #endif
@@ -74,6 +74,7 @@ struct cart *mooh_new(struct cart_config *cc) {
 	cart_rom_init(c);
 	c->read = mooh_read;
 	c->write = mooh_write;
+	c->snoop = 1;
 	c->reset = mooh_reset;
 	c->detach = mooh_detach;
 
@@ -27,10 +27,12 @@ See COPYING.GPL for redistribution conditions.
 
 #include "becker.h"
 #include "cart.h"
+#include "crc32.h"
 #include "delegate.h"
 #include "logging.h"
 #include "mpi.h"
 #include "part.h"
+#include "serialise.h"
 #include "xroar.h"
 
 static struct cart *mpi_new(struct cart_config *);
@@ -80,6 +82,8 @@ static void mpi_free(struct part *p);
 static uint8_t mpi_read(struct cart *c, uint16_t A, _Bool P2, _Bool R2, uint8_t D);
 static uint8_t mpi_write(struct cart *c, uint16_t A, _Bool P2, _Bool R2, uint8_t D);
 static void mpi_reset(struct cart *c);
+static void mpi_ser_write(struct cart *c, struct ser_handle *sh);
+static void mpi_ser_read(struct cart *c, struct ser_handle *sh);
 static _Bool mpi_has_interface(struct cart *c, const char *ifname);
 static void mpi_attach_interface(struct cart *c, const char *ifname, void *intf);
 
@@ -106,6 +110,8 @@ static struct cart *mpi_new(struct cart_config *cc) {
 	c->read = mpi_read;
 	c->write = mpi_write;
 	c->reset = mpi_reset;
+	c->ser_write = mpi_ser_write;
+	c->ser_read = mpi_ser_read;
 
 	c->signal_firq = DELEGATE_DEFAULT1(void, bool);
 	c->signal_nmi = DELEGATE_DEFAULT1(void, bool);
@@ -135,6 +141,9 @@ static struct cart *mpi_new(struct cart_config *cc) {
 				c2->signal_halt = DELEGATE_AS1(void, bool, set_halt, &m->slot[i]);
 				m->slot[i].cart = c2;
 				part_add_component(&c->part, (struct part *)c2, id);
+				// Only needs to see every cycle if a slot does
+				if (c2->snoop)
+					c->snoop = 1;
 			}
 		}
 	}
@@ -148,15 +157,78 @@ static void mpi_reset(struct cart *c) {
 	m->firq_state = 0;
 	m->nmi_state = 0;
 	m->halt_state = 0;
+	c->rom_crc = CRC32_RESET;
 	for (int i = 0; i < 4; i++) {
 		struct cart *c2 = m->slot[i].cart;
 		if (c2 && c2->reset) {
 			c2->reset(c2);
 		}
+		uint32_t slot_crc = c2 ? c2->rom_crc : 0;
+		c->rom_crc = crc32_block(c->rom_crc, (uint8_t *)&slot_crc, sizeof(slot_crc));
 	}
 	m->cart.EXTMEM = 0;
 }
 
+// Each slot's state is prefixed with the name of the cartridge it was
+// written from, and is skipped if a different cartridge is in that slot now.
+
+static void mpi_ser_write(struct cart *c, struct ser_handle *sh) {
+	struct mpi *m = (struct mpi *)c;
+	ser_write_bool(sh, m->switch_enable);
+	ser_write_uint8(sh, m->cts_route);
+	ser_write_uint8(sh, m->p2_route);
+	ser_write_uint8(sh, m->firq_state);
+	ser_write_uint8(sh, m->nmi_state);
+	ser_write_uint8(sh, m->halt_state);
+	for (int i = 0; i < 4; i++) {
+		struct cart *c2 = m->slot[i].cart;
+		ser_write_string(sh, c2 ? c2->config->name : NULL);
+		if (!c2)
+			continue;
+		struct ser_handle *csh = ser_open_write();
+		cart_ser_write(c2, csh);
+		size_t size;
+		void const *data = ser_data(csh, &size);
+		ser_write_uint32(sh, size);
+		ser_write_bytes(sh, data, size);
+		ser_close(csh);
+	}
+}
+
+static void mpi_ser_read(struct cart *c, struct ser_handle *sh) {
+	struct mpi *m = (struct mpi *)c;
+	m->switch_enable = ser_read_bool(sh);
+	m->cts_route = ser_read_uint8(sh) & 3;
+	m->p2_route = ser_read_uint8(sh) & 3;
+	m->firq_state = ser_read_uint8(sh);
+	m->nmi_state = ser_read_uint8(sh);
+	m->halt_state = ser_read_uint8(sh);
+	for (int i = 0; i < 4; i++) {
+		char *name = ser_read_string(sh);
+		if (!name)
+			continue;
+		uint32_t size = ser_read_uint32(sh);
+		if (size > ser_remaining(sh)) {
+			free(name);
+			ser_skip(sh, size);
+			return;
+		}
+		struct cart *c2 = m->slot[i].cart;
+		if (c2 && strcmp(name, c2->config->name) == 0) {
+			void *data = xmalloc(size ? size : 1);
+			ser_read_bytes(sh, data, size);
+			struct ser_handle *csh = ser_open_read(data, size);
+			cart_ser_read(c2, csh);
+			ser_close(csh);
+			free(data);
+		} else {
+			LOG_WARN("Snapshot: MPI slot %d: no cartridge '%s'\n", i, name);
+			ser_skip(sh, size);
+		}
+		free(name);
+	}
+}
+
 static void mpi_attach(struct cart *c) {
 	struct mpi *m = (struct mpi *)c;
 	for (int i = 0; i < 4; i++) {
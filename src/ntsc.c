@@ -22,6 +22,7 @@ See COPYING.GPL for redistribution conditions.
 #include <assert.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifndef M_PI
 # define M_PI 3.14159265358979323846
@@ -32,7 +33,22 @@ See COPYING.GPL for redistribution conditions.
 #include "ntsc.h"
 #include "vo.h"
 
-unsigned ntsc_phase = 0;
+// Vector line decoders.  x86 variants are compiled with target attributes and
+// picked at runtime, NEON is used whenever the compiler targets it.
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+	((defined(__GNUC__) && __GNUC__ >= 5) || defined(__clang__))
+#define NTSC_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) && defined(__BYTE_ORDER__) && \
+	__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define NTSC_NEON
+#include <arm_neon.h>
+#endif
+
+THREAD_LOCAL unsigned ntsc_phase = 0;
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
@@ -91,12 +107,15 @@ void ntsc_palette_add_direct(struct ntsc_palette *np, unsigned c) {
 
 extern inline int ntsc_encode_from_palette(const struct ntsc_palette *np, unsigned c);
 
+static ntsc_decode_line_func select_decode_line(void);
+
 struct ntsc_burst *ntsc_burst_new(int offset) {
 	struct ntsc_burst *nb = xmalloc(sizeof(*nb));
 	*nb = (struct ntsc_burst){0};
 	while (offset < 0)
 		offset += 360;
 	offset %= 360;
+	nb->offset = offset;
 	float hue = (2.0 * M_PI * (float)offset) / 360.0;
 	for (int p = 0; p < 4; p++) {
 		double p0 = sin(hue+((2.*M_PI)*(double)(p+0))/4.);
@@ -111,6 +130,26 @@ struct ntsc_burst *ntsc_burst_new(int offset) {
 		nb->byphase[p][5] = NTSC_C2*p2;
 		nb->byphase[p][6] = NTSC_C3*p3;
 	}
+	// Fold the luma filter and matrix from ntsc_decode() into the burst
+	// coefficients.  Unsigned, as the sums are only exact modulo 2^32.
+	static const unsigned ycoeff[7] = {
+		NTSC_C3, NTSC_C2, NTSC_C1, NTSC_C0, NTSC_C1, NTSC_C2, NTSC_C3
+	};
+	static const int matrix[3][2] = { { 122, 79 }, { -35, -83 }, { -141, 218 } };
+	for (int p = 0; p < 4; p++) {
+		for (int c = 0; c < 3; c++) {
+			for (int t = 0; t < 7; t++) {
+				for (int l = 0; l < 4; l++) {
+					unsigned lp = (p + l) & 3;
+					uint32_t k = 128 * ycoeff[t];
+					k += (uint32_t)(matrix[c][0] * nb->byphase[(lp+1)&3][t]);
+					k += (uint32_t)(matrix[c][1] * nb->byphase[lp][t]);
+					nb->lanes[p][c][t][l] = (int32_t)k;
+				}
+			}
+		}
+	}
+	nb->decode_line = select_decode_line();
 	return nb;
 }
 
@@ -123,3 +162,187 @@ void ntsc_burst_free(struct ntsc_burst *nb) {
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 extern inline struct ntsc_xyz ntsc_decode(const struct ntsc_burst *nb, const uint8_t *ntsc);
+extern inline void ntsc_decode_line(const struct ntsc_burst *nb, const uint8_t *ntsc,
+				    unsigned n, int offset, uint8_t *x, uint8_t *y, uint8_t *z);
+
+static void decode_line_scalar(const struct ntsc_burst *nb, const uint8_t *ntsc,
+			       unsigned n, int offset, uint8_t *x, uint8_t *y, uint8_t *z) {
+	for (unsigned i = 0; i < n; i++) {
+		struct ntsc_xyz rgb = ntsc_decode(nb, ntsc + i);
+		x[i] = clamp_uint8(rgb.x + offset);
+		y[i] = clamp_uint8(rgb.y + offset);
+		z[i] = clamp_uint8(rgb.z + offset);
+	}
+}
+
+#ifdef NTSC_X86_SIMD
+
+// SSE2 lacks a 32-bit multiply-low; samples are unsigned, so the low halves
+// of two unsigned 32x32->64 multiplies give the same result.
+
+__attribute__((target("sse2")))
+static inline __m128i mullo_epi32_sse2(__m128i a, __m128i b) {
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)),
+				  _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)));
+}
+
+// Divide by 2^22 rounding towards zero, as C division does, add offset and
+// saturate to 0-255.
+
+__attribute__((target("sse2")))
+static inline __m128i scale_epi32_sse2(__m128i v, __m128i offset) {
+	__m128i bias = _mm_and_si128(_mm_srai_epi32(v, 31), _mm_set1_epi32((1 << 22) - 1));
+	v = _mm_srai_epi32(_mm_add_epi32(v, bias), 22);
+	return _mm_add_epi32(v, offset);
+}
+
+__attribute__((target("sse2")))
+static void decode_line_sse2(const struct ntsc_burst *nb, const uint8_t *ntsc,
+			     unsigned n, int offset, uint8_t *x, uint8_t *y, uint8_t *z) {
+	const int32_t (*k)[7][4] = nb->lanes[ntsc_phase & 3];
+	__m128i zero = _mm_setzero_si128();
+	__m128i voffset = _mm_set1_epi32(offset);
+	unsigned i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i ax = zero, ay = zero, az = zero;
+		for (int t = 0; t < 7; t++) {
+			uint32_t w;
+			memcpy(&w, ntsc + i + t, sizeof(w));
+			__m128i s = _mm_cvtsi32_si128(w);
+			s = _mm_unpacklo_epi16(_mm_unpacklo_epi8(s, zero), zero);
+			ax = _mm_add_epi32(ax, mullo_epi32_sse2(s, _mm_loadu_si128((const __m128i *)k[0][t])));
+			ay = _mm_add_epi32(ay, mullo_epi32_sse2(s, _mm_loadu_si128((const __m128i *)k[1][t])));
+			az = _mm_add_epi32(az, mullo_epi32_sse2(s, _mm_loadu_si128((const __m128i *)k[2][t])));
+		}
+		__m128i r;
+		r = scale_epi32_sse2(ax, voffset);
+		r = _mm_packus_epi16(_mm_packs_epi32(r, r), zero);
+		uint32_t w = _mm_cvtsi128_si32(r);
+		memcpy(x + i, &w, sizeof(w));
+		r = scale_epi32_sse2(ay, voffset);
+		r = _mm_packus_epi16(_mm_packs_epi32(r, r), zero);
+		w = _mm_cvtsi128_si32(r);
+		memcpy(y + i, &w, sizeof(w));
+		r = scale_epi32_sse2(az, voffset);
+		r = _mm_packus_epi16(_mm_packs_epi32(r, r), zero);
+		w = _mm_cvtsi128_si32(r);
+		memcpy(z + i, &w, sizeof(w));
+	}
+	ntsc_phase = (ntsc_phase + i) & 3;
+	decode_line_scalar(nb, ntsc + i, n - i, offset, x + i, y + i, z + i);
+}
+
+// Eight pixels at a time.  Lane phases repeat every four pixels, so each
+// half of a coefficient vector is the same as for SSE2.
+
+__attribute__((target("avx2")))
+static inline void store_epi32_avx2(uint8_t *dst, __m256i v, __m256i offset) {
+	__m256i bias = _mm256_and_si256(_mm256_srai_epi32(v, 31), _mm256_set1_epi32((1 << 22) - 1));
+	v = _mm256_srai_epi32(_mm256_add_epi32(v, bias), 22);
+	v = _mm256_add_epi32(v, offset);
+	__m128i r = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	r = _mm_packus_epi16(r, r);
+	_mm_storel_epi64((__m128i *)dst, r);
+}
+
+__attribute__((target("avx2")))
+static void decode_line_avx2(const struct ntsc_burst *nb, const uint8_t *ntsc,
+			     unsigned n, int offset, uint8_t *x, uint8_t *y, uint8_t *z) {
+	const int32_t (*k)[7][4] = nb->lanes[ntsc_phase & 3];
+	__m256i kv[3][7];
+	for (int c = 0; c < 3; c++) {
+		for (int t = 0; t < 7; t++) {
+			kv[c][t] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)k[c][t]));
+		}
+	}
+	__m256i voffset = _mm256_set1_epi32(offset);
+	unsigned i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i ax = _mm256_setzero_si256(), ay = ax, az = ax;
+		for (int t = 0; t < 7; t++) {
+			__m256i s = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(ntsc + i + t)));
+			ax = _mm256_add_epi32(ax, _mm256_mullo_epi32(s, kv[0][t]));
+			ay = _mm256_add_epi32(ay, _mm256_mullo_epi32(s, kv[1][t]));
+			az = _mm256_add_epi32(az, _mm256_mullo_epi32(s, kv[2][t]));
+		}
+		store_epi32_avx2(x + i, ax, voffset);
+		store_epi32_avx2(y + i, ay, voffset);
+		store_epi32_avx2(z + i, az, voffset);
+	}
+	ntsc_phase = (ntsc_phase + i) & 3;
+	decode_line_sse2(nb, ntsc + i, n - i, offset, x + i, y + i, z + i);
+}
+
+#endif
+
+#ifdef NTSC_NEON
+
+static inline void store_s32_neon(uint8_t *dst, int32x4_t v, int32x4_t offset) {
+	int32x4_t bias = vandq_s32(vshrq_n_s32(v, 31), vdupq_n_s32((1 << 22) - 1));
+	v = vaddq_s32(vshrq_n_s32(vaddq_s32(v, bias), 22), offset);
+	int16x4_t h = vqmovn_s32(v);
+	uint8x8_t b = vqmovun_s16(vcombine_s16(h, h));
+	uint32_t w = vget_lane_u32(vreinterpret_u32_u8(b), 0);
+	memcpy(dst, &w, sizeof(w));
+}
+
+static void decode_line_neon(const struct ntsc_burst *nb, const uint8_t *ntsc,
+			     unsigned n, int offset, uint8_t *x, uint8_t *y, uint8_t *z) {
+	const int32_t (*k)[7][4] = nb->lanes[ntsc_phase & 3];
+	int32x4_t voffset = vdupq_n_s32(offset);
+	unsigned i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		int32x4_t ax = vdupq_n_s32(0), ay = ax, az = ax;
+		for (int t = 0; t < 7; t++) {
+			uint32_t w;
+			memcpy(&w, ntsc + i + t, sizeof(w));
+			uint8x8_t b = vreinterpret_u8_u32(vdup_n_u32(w));
+			int32x4_t s = vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(vmovl_u8(b))));
+			ax = vmlaq_s32(ax, s, vld1q_s32(k[0][t]));
+			ay = vmlaq_s32(ay, s, vld1q_s32(k[1][t]));
+			az = vmlaq_s32(az, s, vld1q_s32(k[2][t]));
+		}
+		store_s32_neon(x + i, ax, voffset);
+		store_s32_neon(y + i, ay, voffset);
+		store_s32_neon(z + i, az, voffset);
+	}
+	ntsc_phase = (ntsc_phase + i) & 3;
+	decode_line_scalar(nb, ntsc + i, n - i, offset, x + i, y + i, z + i);
+}
+
+#endif
+
+ntsc_decode_line_func ntsc_decode_line_variant(unsigned i, const char **name) {
+	struct {
+		const char *name;
+		ntsc_decode_line_func func;
+	} v[3];
+	unsigned n = 0;
+#if defined(NTSC_X86_SIMD)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		v[n].name = "avx2";
+		v[n++].func = decode_line_avx2;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		v[n].name = "sse2";
+		v[n++].func = decode_line_sse2;
+	}
+#elif defined(NTSC_NEON)
+	v[n].name = "neon";
+	v[n++].func = decode_line_neon;
+#endif
+	v[n].name = "scalar";
+	v[n++].func = decode_line_scalar;
+	if (i >= n)
+		return NULL;
+	if (name)
+		*name = v[i].name;
+	return v[i].func;
+}
+
+static ntsc_decode_line_func select_decode_line(void) {
+	return ntsc_decode_line_variant(0, NULL);
+}
@@ -29,6 +29,10 @@ Coefficients scaled for integer maths.  Result should be divided by 32768.
 #ifndef XROAR_NTSC_H_
 #define XROAR_NTSC_H_
 
+#include <stdint.h>
+
+#include "pl-thread.h"
+
 #include "machine.h"
 #include "xroar.h"
 
@@ -44,18 +48,33 @@ struct ntsc_palette {
 	int *byphase[NTSC_NPHASES];
 };
 
+struct ntsc_burst;
+
+typedef void (*ntsc_decode_line_func)(const struct ntsc_burst *, const uint8_t *,
+				      unsigned, int, uint8_t *, uint8_t *, uint8_t *);
+
 struct ntsc_burst {
+	// Phase offset in degrees, 0-359.  The coefficients below depend only
+	// on this, so it identifies the burst's contents.
+	int offset;
 	int byphase[NTSC_NPHASES][7];
+	// The filter and YIQ->RGB matrix combined into one set of taps per
+	// output channel.  Indexed by the phase of the first of four
+	// consecutive pixels, so each [4] is a vector of per-pixel taps.
+	int32_t lanes[NTSC_NPHASES][3][7][4];
+	// Line decoder selected for this host CPU
+	ntsc_decode_line_func decode_line;
 };
 
 struct ntsc_xyz {
 	int x, y, z;
 };
 
-extern unsigned ntsc_phase;
+// Renderer state, so per-thread.
+extern THREAD_LOCAL unsigned ntsc_phase;
 
 inline void ntsc_reset_phase(void) {
-	if (xroar_machine_config->cross_colour_phase == VO_PHASE_KRBW) {
+	if (xroar_context->machine_config->cross_colour_phase == VO_PHASE_KRBW) {
 		ntsc_phase = 1;
 	} else {
 		ntsc_phase = 3;
@@ -99,4 +118,19 @@ inline struct ntsc_xyz ntsc_decode(const struct ntsc_burst *nb, const uint8_t *n
 	return buf;
 }
 
+/* Decode n pixels at once, with results identical to calling ntsc_decode()
+ * n times.  The offset (brightness) is added to each channel and the result
+ * clamped to 0-255 before being written to x[], y[] and z[].  ntsc_phase is
+ * advanced by n. */
+
+inline void ntsc_decode_line(const struct ntsc_burst *nb, const uint8_t *ntsc,
+			     unsigned n, int offset, uint8_t *x, uint8_t *y, uint8_t *z) {
+	nb->decode_line(nb, ntsc, n, offset, x, y, z);
+}
+
+/* Line decoders usable on this host, fastest first, for testing.  Returns
+ * NULL if i is past the last, which is always the plain C version. */
+
+ntsc_decode_line_func ntsc_decode_line_variant(unsigned i, const char **name);
+
 #endif
@@ -78,7 +78,7 @@ static void *new(void *cfg) {
 		return NULL;
 	}
 	ao->sound_interface->write_buffer = DELEGATE_AS1(voidp, voidp, ao_null_write_buffer, ao);
-	aonull->last_pause_cycle = event_current_tick;
+	aonull->last_pause_cycle = xroar_context->current_tick;
 	aonull->last_pause_ms = current_time();
 	return aonull;
 }
@@ -116,7 +116,7 @@ static void ao_null_free(void *sptr) {
 static void *ao_null_write_buffer(void *sptr, void *buffer) {
 	struct ao_null_interface *aonull = sptr;
 
-	event_ticks elapsed_cycles = event_current_tick - aonull->last_pause_cycle;
+	event_ticks elapsed_cycles = xroar_context->current_tick - aonull->last_pause_cycle;
 	unsigned int expected_elapsed_ms = elapsed_cycles / EVENT_MS(1);
 	unsigned int actual_elapsed_ms, difference_ms;
 	actual_elapsed_ms = current_time() - aonull->last_pause_ms;
@@ -124,7 +124,7 @@ static void *ao_null_write_buffer(void *sptr, void *buffer) {
 	if (difference_ms >= 10) {
 		if (!aonull->public.sound_interface->ratelimit || difference_ms > 1000) {
 			aonull->last_pause_ms = current_time();
-			aonull->last_pause_cycle = event_current_tick;
+			aonull->last_pause_cycle = xroar_context->current_tick;
 		} else {
 			sleep_ms(difference_ms);
 			difference_ms = current_time() - aonull->last_pause_ms;
@@ -68,6 +68,7 @@ struct cart *nx32_new(struct cart_config *cc) {
 	cart_rom_init(c);
 	c->read = nx32_read;
 	c->write = nx32_write;
+	c->snoop = 1;
 	c->reset = nx32_reset;
 	c->detach = nx32_detach;
 
@@ -35,6 +35,7 @@ See COPYING.GPL for redistribution conditions.
 #include "mc6809.h"
 #include "machine.h"
 #include "printer.h"
+#include "stats.h"
 #include "xroar.h"
 
 struct printer_interface_private {
@@ -69,6 +70,7 @@ struct printer_interface *printer_interface_new(struct machine *m) {
 	pip->stream_dest = NULL;
 	pip->is_pipe = 0;
 	event_init(&pip->ack_clear_event, DELEGATE_AS0(void, do_ack_clear, pip));
+	STATS_EVENT_TYPE(&pip->ack_clear_event, STATS_EVENT_PRINTER);
 	pip->strobe_state = 1;
 	pip->busy = 0;
 	return &pip->public;
@@ -152,8 +154,8 @@ void printer_strobe(struct printer_interface *pi, _Bool strobe, int data) {
 	}
 	/* ACK, and schedule !ACK */
 	DELEGATE_SAFE_CALL1(pi->signal_ack, 1);
-	pip->ack_clear_event.at_tick = event_current_tick + EVENT_US(7);
-	event_queue(&MACHINE_EVENT_LIST, &pip->ack_clear_event);
+	pip->ack_clear_event.at_tick = xroar_context->current_tick + EVENT_US(7);
+	event_queue(&xroar_context->machine_events, &pip->ack_clear_event);
 }
 
 static void coco_print_byte(void *sptr) {
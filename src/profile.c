@@ -0,0 +1,543 @@
+/*
+
+Guest code profiler
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "c-strcase.h"
+#include "delegate.h"
+#include "xalloc.h"
+
+#include "breakpoint.h"
+#include "events.h"
+#include "hd6309.h"
+#include "logging.h"
+#include "mc6809.h"
+#include "profile.h"
+
+// Deeper calls are still counted, but not added to the call graph.
+#define PROFILE_MAX_DEPTH (256)
+
+struct profile_frame {
+	uint16_t site;  // address of call instruction, or interrupted address
+	uint16_t callee;
+	uint16_t sp;  // S on entry to callee
+	event_ticks entry_tick;
+	uint64_t entry_ninstructions;
+};
+
+struct profile_edge {
+	_Bool used;
+	uint16_t site;
+	uint16_t callee;
+	uint64_t ncalls;
+	uint64_t ninstructions;  // inclusive
+	uint64_t nticks;  // inclusive
+};
+
+struct profile {
+	struct MC6809 *cpu;
+	struct bp_session *bps;
+
+	// Exclusive costs by address
+	uint64_t ninstructions[0x10000];
+	uint64_t nticks[0x10000];
+	// Bitmap of addresses seen as function entry points
+	uint8_t entry[0x10000 / 8];
+
+	uint64_t total_ninstructions;
+
+	// Instruction currently executing
+	_Bool have_prev;
+	uint16_t prev_pc;
+	uint16_t prev_s;
+	event_ticks prev_tick;
+
+	// Set when an interrupt is taken: next instruction is the handler
+	_Bool interrupt_pending;
+	uint16_t interrupt_site;
+
+	// Shadow call stack
+	struct profile_frame stack[PROFILE_MAX_DEPTH];
+	unsigned depth;
+	unsigned long ndropped;
+
+	// Call graph edges, open-addressed hash table
+	struct profile_edge *edges;
+	unsigned edges_size;  // power of two
+	unsigned nedges;
+};
+
+static void profile_instruction_hook(void *sptr);
+static void profile_interrupt_hook(void *sptr, unsigned vec);
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+struct profile *profile_new(struct MC6809 *cpu, struct bp_session *bps) {
+	struct profile *p = xzalloc(sizeof(*p));
+	p->cpu = cpu;
+	p->bps = bps;
+	p->edges_size = 1024;
+	p->edges = xzalloc(p->edges_size * sizeof(*p->edges));
+	bp_set_profile_hook(bps, DELEGATE_AS0(void, profile_instruction_hook, p));
+	cpu->interrupt_hook = DELEGATE_AS1(void, unsigned, profile_interrupt_hook, p);
+	return p;
+}
+
+void profile_free(struct profile *p) {
+	if (!p)
+		return;
+	bp_set_profile_hook(p->bps, (DELEGATE_T0(void)){0});
+	p->cpu->interrupt_hook.func = NULL;
+	free(p->edges);
+	free(p);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void set_entry(struct profile *p, uint16_t addr) {
+	p->entry[addr >> 3] |= (1 << (addr & 7));
+}
+
+static _Bool is_entry(struct profile *p, uint16_t addr) {
+	return p->entry[addr >> 3] & (1 << (addr & 7));
+}
+
+static unsigned edge_hash(uint16_t site, uint16_t callee, unsigned size) {
+	uint32_t key = ((uint32_t)site << 16) | callee;
+	return (key * 2654435761u) & (size - 1);
+}
+
+static struct profile_edge *find_edge(struct profile *p, uint16_t site, uint16_t callee) {
+	unsigned i = edge_hash(site, callee, p->edges_size);
+	while (p->edges[i].used) {
+		if (p->edges[i].site == site && p->edges[i].callee == callee)
+			return &p->edges[i];
+		i = (i + 1) & (p->edges_size - 1);
+	}
+	// Not found: grow the table if it would become more than half full,
+	// then add a new entry.
+	if ((p->nedges + 1) * 2 > p->edges_size) {
+		unsigned old_size = p->edges_size;
+		struct profile_edge *old_edges = p->edges;
+		p->edges_size *= 2;
+		p->edges = xzalloc(p->edges_size * sizeof(*p->edges));
+		for (unsigned j = 0; j < old_size; j++) {
+			if (!old_edges[j].used)
+				continue;
+			unsigned k = edge_hash(old_edges[j].site, old_edges[j].callee, p->edges_size);
+			while (p->edges[k].used)
+				k = (k + 1) & (p->edges_size - 1);
+			p->edges[k] = old_edges[j];
+		}
+		free(old_edges);
+		i = edge_hash(site, callee, p->edges_size);
+		while (p->edges[i].used)
+			i = (i + 1) & (p->edges_size - 1);
+	}
+	p->nedges++;
+	p->edges[i] = (struct profile_edge){ .used = 1, .site = site, .callee = callee };
+	return &p->edges[i];
+}
+
+static void push_frame(struct profile *p, uint16_t site, uint16_t callee,
+		       uint16_t sp, event_ticks now) {
+	set_entry(p, callee);
+	if (p->depth >= PROFILE_MAX_DEPTH) {
+		p->ndropped++;
+		return;
+	}
+	p->stack[p->depth++] = (struct profile_frame){
+		.site = site, .callee = callee, .sp = sp,
+		.entry_tick = now,
+		.entry_ninstructions = p->total_ninstructions,
+	};
+}
+
+static void pop_frame(struct profile *p, event_ticks now) {
+	struct profile_frame *f = &p->stack[--p->depth];
+	struct profile_edge *e = find_edge(p, f->site, f->callee);
+	e->ncalls++;
+	e->ninstructions += p->total_ninstructions - f->entry_ninstructions;
+	e->nticks += (event_ticks)(now - f->entry_tick);
+}
+
+// Account for the previous instruction having completed, leaving the CPU at
+// the supplied PC and S.
+
+static void retire(struct profile *p, event_ticks now, uint16_t pc, uint16_t s) {
+	if (!p->have_prev)
+		return;
+	uint16_t prev_pc = p->prev_pc;
+	p->ninstructions[prev_pc]++;
+	p->nticks[prev_pc] += (event_ticks)(now - p->prev_tick);
+	p->total_ninstructions++;
+
+	// Frames return (by RTS, PULS PC, RTI, or just discarding the return
+	// address) when S rises above its value on entry.
+	while (p->depth > 0 && s > p->stack[p->depth-1].sp) {
+		pop_frame(p, now);
+	}
+
+	// JSR, BSR & LBSR push two bytes and branch elsewhere.  Longest is
+	// JSR extended indirect at four bytes.
+	if (s == (uint16_t)(p->prev_s - 2) && (uint16_t)(pc - prev_pc) > 4) {
+		push_frame(p, prev_pc, pc, s, now);
+	}
+}
+
+static void profile_instruction_hook(void *sptr) {
+	struct profile *p = sptr;
+	event_ticks now = xroar_context->current_tick;
+	uint16_t pc = p->cpu->reg_pc;
+	uint16_t s = p->cpu->reg_s;
+
+	if (p->interrupt_pending) {
+		// First instruction of an interrupt handler.  The previous
+		// instruction was retired when the interrupt was taken, and
+		// prev_tick was left there so that vector fetch is charged to
+		// the handler.
+		p->interrupt_pending = 0;
+		push_frame(p, p->interrupt_site, pc, s, p->prev_tick);
+	} else {
+		if (!p->have_prev)
+			set_entry(p, pc);
+		retire(p, now, pc, s);
+		p->prev_tick = now;
+	}
+
+	p->have_prev = 1;
+	p->prev_pc = pc;
+	p->prev_s = s;
+}
+
+// Called after registers are stacked.  Retiring the interrupted instruction
+// needs S as it was before that.
+
+static void profile_interrupt_hook(void *sptr, unsigned vec) {
+	(void)vec;
+	struct profile *p = sptr;
+	struct MC6809 *cpu = p->cpu;
+	event_ticks now = xroar_context->current_tick;
+	unsigned nstacked = 3;
+	if (cpu->reg_cc & 0x80) {
+		nstacked = 12;
+		if (cpu->variant == MC6809_VARIANT_HD6309) {
+			struct HD6309 *hcpu = (struct HD6309 *)cpu;
+			if (hcpu->reg_md & 0x01)
+				nstacked = 14;
+		}
+	}
+	retire(p, now, cpu->reg_pc, cpu->reg_s + nstacked);
+	p->have_prev = 0;
+	p->prev_tick = now;
+	p->interrupt_pending = 1;
+	p->interrupt_site = cpu->reg_pc;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Symbol file parsing
+
+struct profile_symbol {
+	unsigned addr;
+	char *name;
+};
+
+struct profile_symbols {
+	struct profile_symbol *symbols;
+	unsigned nsymbols;
+};
+
+static _Bool parse_addr(const char *s, _Bool need_prefix, unsigned *addr) {
+	_Bool prefix = 0;
+	if (*s == '$') {
+		s++;
+		prefix = 1;
+	} else if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+		s += 2;
+		prefix = 1;
+	}
+	if (need_prefix && !prefix)
+		return 0;
+	char *end;
+	errno = 0;
+	unsigned long v = strtoul(s, &end, 16);
+	if (end == s || *end || errno || v > 0xffff)
+		return 0;
+	*addr = v;
+	return 1;
+}
+
+static int compare_symbols(const void *a, const void *b) {
+	const struct profile_symbol *sa = a;
+	const struct profile_symbol *sb = b;
+	if (sa->addr != sb->addr)
+		return (sa->addr < sb->addr) ? -1 : 1;
+	return 0;
+}
+
+static void read_symbols(struct profile_symbols *syms, const char *filename) {
+	FILE *fd = fopen(filename, "r");
+	if (!fd) {
+		LOG_WARN("Profile: cannot open '%s': %s\n", filename, strerror(errno));
+		return;
+	}
+	unsigned nalloc = 0;
+	char line[256];
+	while (fgets(line, sizeof(line), fd)) {
+		if (line[0] == ';' || line[0] == '*' || line[0] == '#')
+			continue;
+		char *tok[6];
+		int ntok = 0;
+		for (char *t = strtok(line, " \t\r\n"); t && ntok < 6; t = strtok(NULL, " \t\r\n")) {
+			tok[ntok++] = t;
+		}
+		char **t = tok;
+		if (ntok > 0 && c_strcasecmp(t[0], "Symbol:") == 0) {
+			t++;
+			ntok--;
+		}
+		const char *name = NULL;
+		unsigned addr;
+		if (ntok >= 3 && (c_strcasecmp(t[ntok-2], "equ") == 0 || strcmp(t[ntok-2], "=") == 0)) {
+			if (parse_addr(t[ntok-1], 0, &addr))
+				name = t[0];
+		} else if (ntok == 2) {
+			if (parse_addr(t[1], 1, &addr))
+				name = t[0];
+			else if (parse_addr(t[0], 0, &addr))
+				name = t[1];
+		}
+		if (!name)
+			continue;
+		if (syms->nsymbols >= nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 256;
+			syms->symbols = xrealloc(syms->symbols, nalloc * sizeof(*syms->symbols));
+		}
+		syms->symbols[syms->nsymbols++] = (struct profile_symbol){
+			.addr = addr, .name = xstrdup(name)
+		};
+	}
+	fclose(fd);
+	if (syms->nsymbols > 0)
+		qsort(syms->symbols, syms->nsymbols, sizeof(*syms->symbols), compare_symbols);
+	LOG_DEBUG(1, "Profile: %u symbols read from '%s'\n", syms->nsymbols, filename);
+}
+
+static void free_symbols(struct profile_symbols *syms) {
+	for (unsigned i = 0; i < syms->nsymbols; i++) {
+		free(syms->symbols[i].name);
+	}
+	free(syms->symbols);
+}
+
+// Name a function entry point: its own symbol if it has one, else offset from
+// the nearest preceding symbol, else just the address.
+
+static void function_name(struct profile_symbols *syms, unsigned addr,
+			  char *buf, size_t bufsize) {
+	const struct profile_symbol *best = NULL;
+	for (unsigned i = 0; i < syms->nsymbols && syms->symbols[i].addr <= addr; i++) {
+		best = &syms->symbols[i];
+	}
+	if (best && best->addr == addr) {
+		snprintf(buf, bufsize, "%s", best->name);
+	} else if (best) {
+		snprintf(buf, bufsize, "%s+0x%x", best->name, addr - best->addr);
+	} else {
+		snprintf(buf, bufsize, "0x%04x", addr);
+	}
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Callgrind output
+
+static int compare_edges(const void *a, const void *b) {
+	const struct profile_edge *ea = a;
+	const struct profile_edge *eb = b;
+	if (ea->site != eb->site)
+		return (ea->site < eb->site) ? -1 : 1;
+	if (ea->callee != eb->callee)
+		return (ea->callee < eb->callee) ? -1 : 1;
+	return 0;
+}
+
+// Index into sorted list of entry points of the function containing addr.
+
+static unsigned function_of(const uint16_t *entries, unsigned nentries, unsigned addr) {
+	unsigned lo = 0, hi = nentries;
+	while (hi - lo > 1) {
+		unsigned mid = (lo + hi) / 2;
+		if (entries[mid] <= addr)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// Callgrind name compression: the first reference to a function gives its
+// name, later references just the number.
+
+static void write_fn(FILE *fd, const char *key, unsigned id, _Bool *named,
+		     struct profile_symbols *syms, unsigned addr) {
+	if (named[id]) {
+		fprintf(fd, "%s=(%u)\n", key, id + 1);
+		return;
+	}
+	char name[80];
+	function_name(syms, addr, name, sizeof(name));
+	fprintf(fd, "%s=(%u) %s\n", key, id + 1, name);
+	named[id] = 1;
+}
+
+int profile_write_callgrind(struct profile *p, const char *filename,
+			    const char *symbol_file) {
+	if (!p || !filename)
+		return -1;
+
+	// Frames still open are accounted for as if they returned now.
+	event_ticks now = xroar_context->current_tick;
+	while (p->depth > 0) {
+		pop_frame(p, now);
+	}
+	p->have_prev = 0;
+	if (p->ndropped) {
+		LOG_WARN("Profile: call stack overflowed: %lu calls not graphed\n", p->ndropped);
+	}
+
+	// Sorted list of call edges
+	struct profile_edge *edges = xmalloc((p->nedges + 1) * sizeof(*edges));
+	unsigned nedges = 0;
+	for (unsigned i = 0; i < p->edges_size; i++) {
+		if (p->edges[i].used)
+			edges[nedges++] = p->edges[i];
+	}
+	qsort(edges, nedges, sizeof(*edges), compare_edges);
+
+	// Anything before the first known entry point is attributed to a
+	// function starting at the lowest address seen.
+	for (unsigned addr = 0; addr < 0x10000; addr++) {
+		if (is_entry(p, addr))
+			break;
+		if (p->ninstructions[addr] || (nedges > 0 && edges[0].site == addr)) {
+			set_entry(p, addr);
+			break;
+		}
+	}
+
+	// Sorted list of entry points
+	unsigned nentries = 0;
+	for (unsigned addr = 0; addr < 0x10000; addr++) {
+		if (is_entry(p, addr))
+			nentries++;
+	}
+	if (nentries == 0) {
+		free(edges);
+		LOG_WARN("Profile: no instructions recorded\n");
+		return -1;
+	}
+	uint16_t *entries = xmalloc(nentries * sizeof(*entries));
+	nentries = 0;
+	for (unsigned addr = 0; addr < 0x10000; addr++) {
+		if (is_entry(p, addr))
+			entries[nentries++] = addr;
+	}
+
+	FILE *fd = fopen(filename, "w");
+	if (!fd) {
+		LOG_WARN("Profile: cannot open '%s': %s\n", filename, strerror(errno));
+		free(entries);
+		free(edges);
+		return -1;
+	}
+
+	struct profile_symbols syms = {0};
+	if (symbol_file)
+		read_symbols(&syms, symbol_file);
+	_Bool *named = xzalloc(nentries * sizeof(*named));
+
+	uint64_t total_nticks = 0;
+	for (unsigned addr = 0; addr < 0x10000; addr++) {
+		total_nticks += p->nticks[addr];
+	}
+
+	// Positions are addresses, presented as line numbers.
+	fprintf(fd, "# callgrind format\n");
+	fprintf(fd, "version: 1\n");
+	fprintf(fd, "creator: " PACKAGE_STRING "\n");
+	fprintf(fd, "positions: line\n");
+	fprintf(fd, "event: Ir : Instructions executed\n");
+	fprintf(fd, "event: Ticks : Emulated time (%llu ticks per second)\n",
+		(unsigned long long)EVENT_TICK_RATE);
+	fprintf(fd, "events: Ir Ticks\n");
+	fprintf(fd, "summary: %llu %llu\n\n",
+		(unsigned long long)p->total_ninstructions,
+		(unsigned long long)total_nticks);
+	fprintf(fd, "fl=(1) %s\n", symbol_file ? symbol_file : "guest");
+
+	unsigned e = 0;
+	for (unsigned f = 0; f < nentries; f++) {
+		unsigned start = entries[f];
+		unsigned end = (f + 1 < nentries) ? entries[f+1] : 0x10000;
+		_Bool have_cost = 0;
+		for (unsigned addr = start; addr < end; addr++) {
+			if (p->ninstructions[addr]) {
+				have_cost = 1;
+				break;
+			}
+		}
+		if (!have_cost && (e >= nedges || edges[e].site >= end))
+			continue;
+		fprintf(fd, "\n");
+		write_fn(fd, "fn", f, named, &syms, start);
+		for (unsigned addr = start; addr < end; addr++) {
+			if (p->ninstructions[addr]) {
+				fprintf(fd, "%u %llu %llu\n", addr,
+					(unsigned long long)p->ninstructions[addr],
+					(unsigned long long)p->nticks[addr]);
+			}
+			for ( ; e < nedges && edges[e].site == addr; e++) {
+				unsigned callee = function_of(entries, nentries, edges[e].callee);
+				write_fn(fd, "cfn", callee, named, &syms, entries[callee]);
+				fprintf(fd, "calls=%llu %u\n",
+					(unsigned long long)edges[e].ncalls,
+					edges[e].callee);
+				fprintf(fd, "%u %llu %llu\n", addr,
+					(unsigned long long)edges[e].ninstructions,
+					(unsigned long long)edges[e].nticks);
+			}
+		}
+	}
+
+	fclose(fd);
+	free(named);
+	free_symbols(&syms);
+	free(entries);
+	free(edges);
+	LOG_DEBUG(1, "Profile: written to '%s'\n", filename);
+	return 0;
+}
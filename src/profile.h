@@ -0,0 +1,54 @@
+/*
+
+Guest code profiler
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifndef XROAR_PROFILE_H_
+#define XROAR_PROFILE_H_
+
+/* Counts instructions executed and emulated time spent at each address, and
+ * reconstructs the call graph from the CPU's stack pointer: a subroutine call
+ * is an instruction that pushes two bytes and transfers control, and a frame
+ * returns once S rises above its level on entry.  Interrupts are recorded as
+ * calls from the interrupted address to the handler.
+ *
+ * Counters are flat 64K arrays indexed by PC, so the profiler is cheap enough
+ * to leave running at full speed. */
+
+struct MC6809;
+struct bp_session;
+struct profile;
+
+// Attaches to the CPU's instruction and interrupt hooks (the instruction hook
+// via the breakpoint session, which shares it).
+
+struct profile *profile_new(struct MC6809 *cpu, struct bp_session *bps);
+void profile_free(struct profile *);
+
+/* Write profile in callgrind format.  If symbol_file is not NULL, function
+ * entry points are named from it.  Recognised formats, one per line:
+ *
+ *     NAME EQU $ADDR
+ *     NAME = $ADDR
+ *     NAME $ADDR
+ *     ADDR NAME
+ *     Symbol: NAME (FILE) = ADDR
+ *
+ * Returns non-zero on error. */
+
+int profile_write_callgrind(struct profile *, const char *filename,
+			    const char *symbol_file);
+
+#endif
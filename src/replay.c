@@ -0,0 +1,448 @@
+/*
+
+Reverse execution support
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "delegate.h"
+#include "xalloc.h"
+
+#include "events.h"
+#include "logging.h"
+#include "machine.h"
+#include "replay.h"
+#include "xroar.h"
+
+// Log entries for signals are flagged in their id.  Changes are logged with
+// their own id, value being the size of the data.
+
+#define ID_SIGNAL (0x80)
+#define ID_CHANGE (0x40)
+
+struct replay_entry {
+	uint64_t time;
+	unsigned id;
+	unsigned value;
+	void *data;
+};
+
+struct replay_checkpoint {
+	uint64_t time;
+	// Log position, counted from the first entry ever logged
+	uint64_t log_pos;
+	unsigned input[REPLAY_MAX_INPUTS];
+	uint8_t *state;
+};
+
+struct replay {
+	struct machine *machine;
+	DELEGATE_T2(void, unsigned, unsigned) signal;
+	size_t state_size;
+
+	// Time is base_time plus ticks elapsed in the current time base
+	// context since base_tick.  Rebased often enough not to wrap.
+	struct xroar_context *base_ctx;
+	event_ticks base_tick;
+	uint64_t base_time;
+
+	// Checkpoint ring
+	unsigned interval;
+	unsigned frames;
+	unsigned ncheckpoints;
+	unsigned first;  // oldest
+	unsigned count;
+	struct replay_checkpoint *checkpoints;
+
+	// Input log, entries [log_first, log_len) valid.  log_base counts
+	// entries discarded from the front.
+	struct replay_entry *log;
+	unsigned log_size;
+	unsigned log_first;
+	unsigned log_len;
+	uint64_t log_base;
+	// Last value of each input: logged if live, replayed if in the past
+	unsigned input[REPLAY_MAX_INPUTS];
+
+	// Reviewing history
+	_Bool past;
+	struct xroar_context *live_ctx;
+	struct xroar_context *ctx;
+	struct xroar_context *prev_ctx;
+	unsigned read_next;
+	unsigned signal_next;
+	unsigned change_next;
+	struct event signal_event;
+	_Bool diverged;
+
+	// Live state at the end of history
+	uint64_t end_time;
+	unsigned end_input[REPLAY_MAX_INPUTS];
+	uint8_t *end_state;
+};
+
+static void rebase(struct replay *rp, struct xroar_context *ctx, uint64_t time);
+static void free_entries(struct replay *rp, unsigned from, unsigned to);
+static void go_live(struct replay *rp);
+static void do_signal_event(void *sptr);
+static void queue_signal_event(struct replay *rp);
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+struct replay *replay_new(struct machine *m, unsigned interval, unsigned ncheckpoints,
+			  DELEGATE_T2(void, unsigned, unsigned) signal) {
+	if (!m->state_size || ncheckpoints == 0)
+		return NULL;
+	struct replay *rp = xmalloc(sizeof(*rp));
+	*rp = (struct replay){0};
+	rp->machine = m;
+	rp->signal = signal;
+	rp->state_size = m->state_size(m);
+	rp->interval = interval ? interval : 1;
+	rp->ncheckpoints = ncheckpoints;
+	rp->checkpoints = xmalloc(ncheckpoints * sizeof(*rp->checkpoints));
+	for (unsigned i = 0; i < ncheckpoints; i++) {
+		rp->checkpoints[i] = (struct replay_checkpoint){0};
+		rp->checkpoints[i].state = xmalloc(rp->state_size);
+	}
+	rp->end_state = xmalloc(rp->state_size);
+	rp->live_ctx = xroar_context;
+	rp->ctx = xroar_context_new();
+	event_init(&rp->signal_event, DELEGATE_AS0(void, do_signal_event, rp));
+	rebase(rp, rp->live_ctx, 0);
+	LOG_DEBUG(1, "Reverse execution: %u checkpoints of %zuK, every %u frames\n",
+		  ncheckpoints, (rp->state_size + 1023) / 1024, rp->interval);
+	return rp;
+}
+
+void replay_free(struct replay *rp) {
+	if (!rp)
+		return;
+	event_dequeue(&rp->signal_event);
+	xroar_context_free(rp->ctx);
+	for (unsigned i = 0; i < rp->ncheckpoints; i++) {
+		free(rp->checkpoints[i].state);
+	}
+	free(rp->checkpoints);
+	free(rp->end_state);
+	free_entries(rp, rp->log_first, rp->log_len);
+	free(rp->log);
+	free(rp);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void rebase(struct replay *rp, struct xroar_context *ctx, uint64_t time) {
+	rp->base_ctx = ctx;
+	rp->base_tick = ctx->current_tick;
+	rp->base_time = time;
+}
+
+uint64_t replay_time(struct replay *rp) {
+	return rp->base_time + (event_ticks)(rp->base_ctx->current_tick - rp->base_tick);
+}
+
+_Bool replay_in_past(struct replay *rp) {
+	return rp->past;
+}
+
+uint64_t replay_end(struct replay *rp) {
+	return rp->past ? rp->end_time : replay_time(rp);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Checkpoints
+
+static struct replay_checkpoint *checkpoint(struct replay *rp, unsigned i) {
+	return &rp->checkpoints[(rp->first + i) % rp->ncheckpoints];
+}
+
+static void drop_oldest(struct replay *rp) {
+	rp->first = (rp->first + 1) % rp->ncheckpoints;
+	rp->count--;
+	if (rp->count == 0)
+		return;
+	// Log entries before the new oldest checkpoint are no longer needed
+	unsigned keep = checkpoint(rp, 0)->log_pos - rp->log_base;
+	free_entries(rp, rp->log_first, keep);
+	rp->log_first = keep;
+	if (rp->log_first > rp->log_size / 2) {
+		memmove(rp->log, rp->log + keep, (rp->log_len - keep) * sizeof(*rp->log));
+		rp->log_len -= keep;
+		rp->log_first = 0;
+		rp->log_base += keep;
+	}
+}
+
+void replay_frame(struct replay *rp) {
+	if (!rp->past)
+		rp->frames++;
+}
+
+void replay_sync(struct replay *rp) {
+	if (rp->diverged) {
+		rp->diverged = 0;
+		if (rp->past) {
+			uint64_t now = replay_time(rp);
+			// Bring read inputs up to date and drop the future
+			for (unsigned i = rp->read_next; i < rp->log_len && rp->log[i].time <= now; i++) {
+				if (!(rp->log[i].id & (ID_SIGNAL|ID_CHANGE)))
+					rp->input[rp->log[i].id] = rp->log[i].value;
+			}
+			unsigned cut = rp->signal_next < rp->read_next ? rp->signal_next : rp->read_next;
+			if (rp->change_next < cut)
+				cut = rp->change_next;
+			while (cut < rp->log_len && rp->log[cut].time <= now)
+				cut++;
+			free_entries(rp, cut, rp->log_len);
+			rp->log_len = cut;
+			while (rp->count > 0 && checkpoint(rp, rp->count - 1)->time > now)
+				rp->count--;
+			// Move the machine into the live context from here
+			struct xroar_context *prev = xroar_context_set(rp->ctx);
+			rp->machine->state_save(rp->machine, rp->end_state);
+			xroar_context_set(prev);
+			memcpy(rp->end_input, rp->input, sizeof(rp->end_input));
+			rp->end_time = now;
+			go_live(rp);
+			LOG_DEBUG(1, "Reverse execution: history after %" PRIu64 " discarded\n", now);
+		}
+	}
+	if (!rp->past) {
+		rebase(rp, rp->live_ctx, replay_time(rp));
+	}
+}
+
+void replay_update(struct replay *rp) {
+	if (rp->past || rp->frames < rp->interval)
+		return;
+	rp->frames = 0;
+	uint64_t now = replay_time(rp);
+	if (rp->count > 0 && checkpoint(rp, rp->count - 1)->time == now)
+		return;
+	if (rp->count == rp->ncheckpoints)
+		drop_oldest(rp);
+	struct replay_checkpoint *cp = checkpoint(rp, rp->count++);
+	cp->time = now;
+	cp->log_pos = rp->log_base + rp->log_len;
+	memcpy(cp->input, rp->input, sizeof(cp->input));
+	rp->machine->state_save(rp->machine, cp->state);
+}
+
+void replay_clear(struct replay *rp) {
+	if (rp->past) {
+		rp->diverged = 1;
+		replay_sync(rp);
+	}
+	rp->count = 0;
+	free_entries(rp, rp->log_first, rp->log_len);
+	rp->log_base += rp->log_len;
+	rp->log_first = rp->log_len = 0;
+	rp->frames = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Input log
+
+static struct replay_entry *log_entry(struct replay *rp, unsigned id, unsigned value) {
+	if (rp->count == 0)
+		return NULL;
+	if (rp->log_len >= rp->log_size) {
+		rp->log_size = rp->log_size ? rp->log_size * 2 : 1024;
+		rp->log = xrealloc(rp->log, rp->log_size * sizeof(*rp->log));
+	}
+	struct replay_entry *e = &rp->log[rp->log_len++];
+	*e = (struct replay_entry){
+		.time = replay_time(rp), .id = id, .value = value
+	};
+	return e;
+}
+
+static void log_input(struct replay *rp, unsigned id, unsigned value) {
+	(void)log_entry(rp, id, value);
+}
+
+static void free_entries(struct replay *rp, unsigned from, unsigned to) {
+	for (unsigned i = from; i < to; i++) {
+		free(rp->log[i].data);
+		rp->log[i].data = NULL;
+	}
+}
+
+unsigned replay_read(struct replay *rp, unsigned id, unsigned value) {
+	if (rp->past) {
+		uint64_t now = replay_time(rp);
+		while (rp->read_next < rp->log_len && rp->log[rp->read_next].time <= now) {
+			struct replay_entry *e = &rp->log[rp->read_next++];
+			if (!(e->id & (ID_SIGNAL|ID_CHANGE)))
+				rp->input[e->id] = e->value;
+		}
+		return rp->input[id];
+	}
+	if (rp->input[id] != value) {
+		rp->input[id] = value;
+		log_input(rp, id, value);
+	}
+	return value;
+}
+
+_Bool replay_signal(struct replay *rp, unsigned id, unsigned value) {
+	if (rp->past)
+		return 0;
+	if (rp->input[id] != value) {
+		rp->input[id] = value;
+		log_input(rp, id | ID_SIGNAL, value);
+	}
+	return 1;
+}
+
+void replay_log_change(struct replay *rp, const void *data, size_t size) {
+	if (rp->past)
+		return;
+	struct replay_entry *e = log_entry(rp, ID_CHANGE, size);
+	if (e)
+		e->data = xmemdup(data, size);
+}
+
+const void *replay_change(struct replay *rp, size_t *size) {
+	if (!rp->past)
+		return NULL;
+	uint64_t now = replay_time(rp);
+	while (rp->change_next < rp->log_len && rp->log[rp->change_next].time <= now) {
+		struct replay_entry *e = &rp->log[rp->change_next++];
+		if (e->id == ID_CHANGE && e->time == now) {
+			*size = e->value;
+			return e->data;
+		}
+	}
+	return NULL;
+}
+
+// Redeliver logged signals that are due, then wait for the next one.
+
+static void do_signal_event(void *sptr) {
+	struct replay *rp = sptr;
+	uint64_t now = replay_time(rp);
+	while (rp->signal_next < rp->log_len && rp->log[rp->signal_next].time <= now) {
+		struct replay_entry *e = &rp->log[rp->signal_next++];
+		if (e->id & ID_SIGNAL) {
+			unsigned id = e->id & ~ID_SIGNAL;
+			rp->input[id] = e->value;
+			DELEGATE_CALL2(rp->signal, id, e->value);
+		}
+	}
+	queue_signal_event(rp);
+}
+
+// Called with the private context current.
+
+static void queue_signal_event(struct replay *rp) {
+	while (rp->signal_next < rp->log_len && !(rp->log[rp->signal_next].id & ID_SIGNAL))
+		rp->signal_next++;
+	if (rp->signal_next >= rp->log_len)
+		return;
+	uint64_t dt = rp->log[rp->signal_next].time - replay_time(rp);
+	rp->signal_event.at_tick = xroar_context->current_tick + (event_ticks)dt;
+	event_queue(&xroar_context->machine_events, &rp->signal_event);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Reviewing history
+
+_Bool replay_seek(struct replay *rp, uint64_t t) {
+	struct replay_checkpoint *cp = NULL;
+	for (unsigned i = rp->count; i > 0; i--) {
+		struct replay_checkpoint *c = checkpoint(rp, i - 1);
+		if (c->time <= t) {
+			cp = c;
+			break;
+		}
+	}
+	if (!cp)
+		return 0;
+
+	if (!rp->past) {
+		// Keep the live state to return to
+		rp->end_time = replay_time(rp);
+		memcpy(rp->end_input, rp->input, sizeof(rp->end_input));
+		rp->machine->state_save(rp->machine, rp->end_state);
+		rp->past = 1;
+	}
+
+	struct xroar_context *prev = xroar_context_set(rp->ctx);
+	event_dequeue(&rp->signal_event);
+	rp->machine->state_restore(rp->machine, cp->state);
+	memcpy(rp->input, cp->input, sizeof(rp->input));
+	rp->read_next = rp->signal_next = rp->change_next = cp->log_pos - rp->log_base;
+	rebase(rp, rp->ctx, cp->time);
+	queue_signal_event(rp);
+	xroar_context_set(prev);
+	return 1;
+}
+
+void replay_enter(struct replay *rp) {
+	if (!rp->past)
+		return;
+	// Everything but time and the machine's events is shared with the
+	// live context
+	struct xroar_context *live = rp->live_ctx;
+	struct xroar_context *ctx = rp->ctx;
+	ctx->machine_config = live->machine_config;
+	ctx->machine = live->machine;
+	ctx->tape_interface = live->tape_interface;
+	ctx->vdrive_interface = live->vdrive_interface;
+	ctx->keyboard_interface = live->keyboard_interface;
+	ctx->printer_interface = live->printer_interface;
+	ctx->vo_interface = live->vo_interface;
+	ctx->ao_interface = live->ao_interface;
+	rp->prev_ctx = xroar_context_set(ctx);
+}
+
+void replay_leave(struct replay *rp) {
+	if (!rp->past)
+		return;
+	xroar_context_set(rp->prev_ctx);
+	if (replay_time(rp) >= rp->end_time) {
+		go_live(rp);
+	}
+}
+
+// Restore the live state saved in end_state.  Called with the live context
+// current.
+
+static void go_live(struct replay *rp) {
+	event_dequeue(&rp->signal_event);
+	rp->machine->state_restore(rp->machine, rp->end_state);
+	memcpy(rp->input, rp->end_input, sizeof(rp->input));
+	// Anything else left queued in the private context is stale
+	event_list_free(&rp->ctx->machine_events);
+	rp->past = 0;
+	rebase(rp, rp->live_ctx, rp->end_time);
+}
+
+void replay_diverge(struct replay *rp) {
+	if (rp && rp->past)
+		rp->diverged = 1;
+}
@@ -0,0 +1,123 @@
+/*
+
+Reverse execution support
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifndef XROAR_REPLAY_H_
+#define XROAR_REPLAY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "delegate.h"
+
+/* Recent machine history is kept as a ring of in-memory checkpoints, taken
+ * every few frames, plus a log of every input the machine received from
+ * outside since the oldest of them.  Any earlier point can then be
+ * reconstructed by restoring a checkpoint and running forward: inputs are
+ * answered from the log instead of the outside world, so execution follows
+ * exactly the path it took the first time.
+ *
+ * Points in history are identified by time in event ticks, counted from
+ * creation and never wrapping.
+ *
+ * While the machine is reviewing history it runs in a private emulation
+ * context, so the rest of the emulator never sees time go backwards: events
+ * scheduled by other modules (tape, disk, sound, etc.) just wait.  Once the
+ * machine catches up with the end of history, the live machine state is
+ * restored and recording carries on.  If the machine is modified while
+ * reviewing history, the recorded future is discarded and the machine goes
+ * live from that point instead.
+ *
+ * Inputs are identified by a number less than REPLAY_MAX_INPUTS.  Only
+ * changes in value are logged.  Reads are polled by the machine, and during
+ * replay are answered from the log.  Signals arrive asynchronously, and
+ * during replay are redelivered at the same time through the signal
+ * delegate.  A signal's effect must depend only on its value, not on how
+ * many times it is delivered.
+ *
+ * Some changes to the machine are made from outside it, in response to its
+ * execution: for example, ROM call intercepts that load from tape.  These
+ * can't be repeated in the past, so the machine logs the change it made as
+ * opaque data, and during replay applies the logged data instead. */
+
+#define REPLAY_MAX_INPUTS (16)
+
+struct machine;
+struct replay;
+
+/* Checkpoint every 'interval' frames, keeping up to 'ncheckpoints'.  Signals
+ * are redelivered by calling 'signal' with input id and value. */
+
+struct replay *replay_new(struct machine *m, unsigned interval, unsigned ncheckpoints,
+			  DELEGATE_T2(void, unsigned, unsigned) signal);
+void replay_free(struct replay *);
+
+// Current position in history.
+uint64_t replay_time(struct replay *);
+
+// True while reviewing history rather than running live.
+_Bool replay_in_past(struct replay *);
+
+// End of recorded history.  Forward execution in the past should not be run
+// beyond this.
+uint64_t replay_end(struct replay *);
+
+// Count a frame towards the next checkpoint.
+void replay_frame(struct replay *);
+
+// Call between CPU runs.  Handles any pending divergence and keeps the time
+// base up to date.
+void replay_sync(struct replay *);
+
+// Call after a CPU run completes uninterrupted.  Takes a checkpoint if one
+// is due.
+void replay_update(struct replay *);
+
+// Log a read input.  Returns the value, or in the past, the value logged.
+unsigned replay_read(struct replay *, unsigned id, unsigned value);
+
+// Log a signal.  Returns true if the signal should be acted on now, false
+// in the past (where it is instead redelivered from the log).
+_Bool replay_signal(struct replay *, unsigned id, unsigned value);
+
+// Log a change made to the machine from outside at the current time.
+// Ignored in the past.
+void replay_log_change(struct replay *, const void *data, size_t size);
+
+// In the past, returns the next change logged at the current time, setting
+// *size, or NULL if there are no more.  Always NULL when live.
+const void *replay_change(struct replay *, size_t *size);
+
+// Restore the latest checkpoint at or before time t, entering the past.
+// Returns false if there is none.
+_Bool replay_seek(struct replay *, uint64_t t);
+
+// Bracket any CPU execution.  In the past, makes the private context current
+// for the duration.  On leaving, if the end of history has been reached, the
+// live machine state is restored.
+void replay_enter(struct replay *);
+void replay_leave(struct replay *);
+
+// The machine was modified.  If in the past, the recorded future no longer
+// applies, and is discarded at the next replay_sync().  May be called from
+// another thread while the machine is stopped.
+void replay_diverge(struct replay *);
+
+// Discard all history, for example on reset.  If in the past, the machine
+// goes live from its current state.
+void replay_clear(struct replay *);
+
+#endif
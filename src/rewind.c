@@ -0,0 +1,365 @@
+/*
+
+Rewind history
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xalloc.h"
+
+#include "logging.h"
+#include "machine.h"
+#include "rewind.h"
+#include "snapshot.h"
+
+// Start a new key snapshot after this many deltas, or once deltas grow past
+// this fraction of a full snapshot.  Discarding history drops a key and its
+// deltas together, so this also sets how finely history is trimmed.
+
+#define MAX_DELTAS (32)
+#define MAX_DELTA_FRACTION (4)
+
+struct rewind_entry {
+	uint64_t frame;
+	// Read sequence position and input log position, counted from the
+	// start of history
+	uint64_t read_pos;
+	uint64_t log_pos;
+	unsigned input[REWIND_MAX_INPUTS];
+	// Entry number of the key this is a delta against, or its own
+	_Bool is_key;
+	uint64_t key;
+	size_t size;
+	uint8_t *data;
+};
+
+struct rewind_log_entry {
+	uint64_t read_pos;
+	unsigned id;
+	unsigned value;
+};
+
+struct rewind {
+	struct machine *machine;
+	unsigned interval;
+	size_t budget;
+	size_t used;
+
+	// Frames counted since creation, and since the last snapshot
+	uint64_t frame;
+	unsigned frames;
+
+	// Snapshot ring.  Entries are numbered from the start of history;
+	// entry n is at index (n % size) while first <= n < first + count.
+	struct rewind_entry *entries;
+	unsigned size;
+	uint64_t first;
+	unsigned count;
+	unsigned ndeltas;
+
+	// Snapshots are written here first, then copied to a right-sized
+	// allocation
+	size_t snap_size;
+	uint8_t *snap;
+
+	// Scratch space for delta encoding and decoding, sized to the key
+	size_t work_size;
+	uint8_t *work;
+
+	// Input log, entries [log_first, log_len) valid.  log_base counts
+	// entries discarded from the front.
+	struct rewind_log_entry *log;
+	unsigned log_size;
+	unsigned log_first;
+	unsigned log_len;
+	uint64_t log_base;
+	uint64_t read_pos;
+	unsigned input[REWIND_MAX_INPUTS];
+
+	// Running forward to target frame
+	_Bool replaying;
+	uint64_t target;
+	unsigned log_next;
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+struct rewind *rewind_new(struct machine *m, unsigned interval, size_t budget) {
+	size_t snap_size = snapshot_mem_size(m);
+	if (snap_size == 0)
+		return NULL;
+	if (budget < 2 * snap_size) {
+		LOG_WARN("Rewind: memory budget too small, need at least %zuK\n",
+			 (2 * snap_size + 1023) / 1024);
+		return NULL;
+	}
+	struct rewind *rw = xmalloc(sizeof(*rw));
+	*rw = (struct rewind){0};
+	rw->machine = m;
+	rw->interval = interval ? interval : 1;
+	rw->budget = budget;
+	rw->snap_size = snap_size;
+	rw->snap = xmalloc(snap_size);
+	LOG_DEBUG(2, "Rewind: snapshot every %u frames, up to %zuK\n",
+		  rw->interval, budget / 1024);
+	return rw;
+}
+
+void rewind_free(struct rewind *rw) {
+	if (!rw)
+		return;
+	rewind_clear(rw);
+	free(rw->entries);
+	free(rw->log);
+	free(rw->snap);
+	free(rw->work);
+	free(rw);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static struct rewind_entry *entry(struct rewind *rw, uint64_t n) {
+	return &rw->entries[n % rw->size];
+}
+
+static void free_entry(struct rewind *rw, struct rewind_entry *e) {
+	rw->used -= sizeof(*e) + e->size;
+	free(e->data);
+	e->data = NULL;
+}
+
+// Discard the oldest key and its deltas.
+
+static void drop_oldest(struct rewind *rw) {
+	do {
+		free_entry(rw, entry(rw, rw->first));
+		rw->first++;
+		rw->count--;
+	} while (rw->count > 0 && !entry(rw, rw->first)->is_key);
+	if (rw->count == 0)
+		return;
+	// Log entries before the new oldest snapshot are no longer needed
+	unsigned keep = entry(rw, rw->first)->log_pos - rw->log_base;
+	rw->log_first = keep;
+	if (rw->log_first > rw->log_size / 2) {
+		memmove(rw->log, rw->log + keep, (rw->log_len - keep) * sizeof(*rw->log));
+		rw->log_len -= keep;
+		rw->log_first = 0;
+		rw->log_base += keep;
+	}
+}
+
+// Discard snapshots numbered 'end' onwards, and log entries from the current
+// read position.
+
+static void drop_future(struct rewind *rw, uint64_t end) {
+	while (rw->first + rw->count > end) {
+		free_entry(rw, entry(rw, rw->first + rw->count - 1));
+		rw->count--;
+	}
+	rw->log_len = rw->log_next;
+	rw->frames = 0;
+	rw->ndeltas = 0;
+	if (rw->count > 0) {
+		// Deltas continue against the latest key
+		struct rewind_entry *last = entry(rw, rw->first + rw->count - 1);
+		rw->frames = rw->frame - last->frame;
+		rw->ndeltas = (rw->first + rw->count) - last->key - 1;
+	}
+}
+
+static void *get_work(struct rewind *rw, struct rewind_entry *key) {
+	if (key->size > rw->work_size) {
+		rw->work = xrealloc(rw->work, key->size);
+		rw->work_size = key->size;
+	}
+	return rw->work;
+}
+
+static size_t save_snapshot(struct rewind *rw, struct rewind_entry *key) {
+	if (!key)
+		return snapshot_mem_save(rw->machine, rw->snap, rw->snap_size, NULL, NULL);
+	return snapshot_mem_save(rw->machine, rw->snap, rw->snap_size, key->data, get_work(rw, key));
+}
+
+void rewind_update(struct rewind *rw) {
+	if (rw->replaying || rw->frames < rw->interval)
+		return;
+	rw->frames = 0;
+
+	// Snapshot size changes if a cartridge is inserted or removed
+	size_t snap_size = snapshot_mem_size(rw->machine);
+	if (snap_size != rw->snap_size) {
+		rw->snap = xrealloc(rw->snap, snap_size);
+		rw->snap_size = snap_size;
+	}
+
+	if (rw->count == rw->size) {
+		unsigned nsize = rw->size ? rw->size * 2 : 64;
+		struct rewind_entry *nentries = xmalloc(nsize * sizeof(*nentries));
+		for (unsigned i = 0; i < rw->count; i++) {
+			uint64_t n = rw->first + i;
+			nentries[n % nsize] = *entry(rw, n);
+		}
+		free(rw->entries);
+		rw->entries = nentries;
+		rw->size = nsize;
+	}
+
+	// Delta against the latest key, unless it's time for a new one
+	struct rewind_entry *key = NULL;
+	uint64_t keyn = rw->first + rw->count;
+	if (rw->count > 0 && rw->ndeltas < MAX_DELTAS) {
+		keyn = entry(rw, rw->first + rw->count - 1)->key;
+		key = entry(rw, keyn);
+	}
+	size_t size = save_snapshot(rw, key);
+	if (key && size > rw->snap_size / MAX_DELTA_FRACTION) {
+		key = NULL;
+		keyn = rw->first + rw->count;
+		size = save_snapshot(rw, NULL);
+	}
+	if (size == 0)
+		return;
+	rw->ndeltas = key ? rw->ndeltas + 1 : 0;
+
+	struct rewind_entry *e = entry(rw, rw->first + rw->count++);
+	*e = (struct rewind_entry){
+		.frame = rw->frame,
+		.read_pos = rw->read_pos,
+		.log_pos = rw->log_base + rw->log_len,
+		.is_key = !key,
+		.key = keyn,
+		.size = size,
+	};
+	memcpy(e->input, rw->input, sizeof(e->input));
+	e->data = xmalloc(size);
+	memcpy(e->data, rw->snap, size);
+	rw->used += sizeof(*e) + size;
+
+	// Always keep at least the newest key and its deltas
+	while (rw->used > rw->budget && rw->first != keyn) {
+		drop_oldest(rw);
+	}
+}
+
+void rewind_clear(struct rewind *rw) {
+	while (rw->count > 0) {
+		free_entry(rw, entry(rw, rw->first + rw->count - 1));
+		rw->count--;
+	}
+	rw->first = 0;
+	rw->log_base += rw->log_len;
+	rw->log_first = rw->log_len = 0;
+	rw->frames = 0;
+	rw->ndeltas = 0;
+	rw->replaying = 0;
+}
+
+_Bool rewind_frame(struct rewind *rw) {
+	rw->frame++;
+	rw->frames++;
+	if (!rw->replaying) {
+		// Stop so that the snapshot is taken at the start of the frame
+		return rw->frames >= rw->interval;
+	}
+	if (rw->frame >= rw->target) {
+		// Snapshots taken at or after this frame are from a future
+		// that no longer applies
+		uint64_t end = rw->first + rw->count;
+		while (end > rw->first && entry(rw, end - 1)->frame >= rw->frame)
+			end--;
+		rw->replaying = 0;
+		drop_future(rw, end);
+		return 1;
+	}
+	return 0;
+}
+
+_Bool rewind_replaying(struct rewind *rw) {
+	return rw->replaying;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Input log
+
+unsigned rewind_read(struct rewind *rw, unsigned id, unsigned value) {
+	if (rw->replaying) {
+		while (rw->log_next < rw->log_len && rw->log[rw->log_next].read_pos <= rw->read_pos) {
+			struct rewind_log_entry *e = &rw->log[rw->log_next++];
+			rw->input[e->id] = e->value;
+		}
+		rw->read_pos++;
+		return rw->input[id];
+	}
+	if (rw->input[id] != value) {
+		rw->input[id] = value;
+		if (rw->count > 0) {
+			if (rw->log_len >= rw->log_size) {
+				rw->log_size = rw->log_size ? rw->log_size * 2 : 1024;
+				rw->log = xrealloc(rw->log, rw->log_size * sizeof(*rw->log));
+			}
+			rw->log[rw->log_len++] = (struct rewind_log_entry){
+				.read_pos = rw->read_pos, .id = id, .value = value
+			};
+		}
+	}
+	rw->read_pos++;
+	return value;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+_Bool rewind_seek(struct rewind *rw, unsigned nframes) {
+	if (rw->count == 0)
+		return 0;
+	uint64_t target = (rw->frame > nframes) ? rw->frame - nframes : 0;
+
+	// Latest snapshot before the target.  Failing that, go as far back
+	// as possible.
+	uint64_t n = rw->first;
+	for (unsigned i = rw->count; i > 0; i--) {
+		if (entry(rw, rw->first + i - 1)->frame < target) {
+			n = rw->first + i - 1;
+			break;
+		}
+	}
+	struct rewind_entry *e = entry(rw, n);
+	if (e->frame >= target)
+		target = e->frame;
+
+	struct rewind_entry *key = entry(rw, e->key);
+	if (!snapshot_mem_restore(rw->machine, e->data, e->size, key->data, get_work(rw, key)))
+		return 0;
+	rw->frame = e->frame;
+	rw->read_pos = e->read_pos;
+	rw->log_next = e->log_pos - rw->log_base;
+	memcpy(rw->input, e->input, sizeof(rw->input));
+	rw->target = target;
+	rw->replaying = (target > rw->frame);
+	if (!rw->replaying)
+		drop_future(rw, n + 1);
+	LOG_DEBUG(2, "Rewind: to frame %" PRIu64 " from snapshot at %" PRIu64 "\n",
+		  target, e->frame);
+	return 1;
+}
@@ -0,0 +1,73 @@
+/*
+
+Rewind history
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifndef XROAR_REWIND_H_
+#define XROAR_REWIND_H_
+
+#include <stddef.h>
+
+/* Recent history is kept as a ring of in-memory snapshots (see snapshot.h),
+ * taken every few frames.  Most are deltas against the latest full "key"
+ * snapshot, and the oldest are discarded to keep within a memory budget.
+ *
+ * Stepping back restores the latest snapshot taken before the target frame,
+ * then the machine runs forward to reach it exactly.  Once there, the
+ * recorded future is discarded and the machine carries on live.
+ *
+ * So that the run forward follows the same path, inputs read from outside
+ * the machine are logged.  Inputs are identified by a number less than
+ * REWIND_MAX_INPUTS.  Only changes are logged, and entries are placed by
+ * position in the sequence of reads rather than by time: the machine is
+ * deterministic, so reads happen in the same order when run again. */
+
+#define REWIND_MAX_INPUTS (8)
+
+struct machine;
+struct rewind;
+
+/* Snapshot every 'interval' frames, keeping up to 'budget' bytes of
+ * history.  Returns NULL if the budget is too small to be useful. */
+
+struct rewind *rewind_new(struct machine *m, unsigned interval, size_t budget);
+void rewind_free(struct rewind *);
+
+// Count a frame, from the start of vertical sync.  Returns true if the
+// caller should stop the CPU: while running forward, once the target frame
+// is reached; otherwise, when a snapshot is due.  Snapshots are thus taken
+// at the first instruction boundary of a frame, so stepping back a frame
+// always lands on the start of one.
+_Bool rewind_frame(struct rewind *);
+
+// Call after a CPU run completes.  Takes a snapshot if one is due.
+void rewind_update(struct rewind *);
+
+// Log a read input.  Returns the value, or while running forward, the value
+// logged.
+unsigned rewind_read(struct rewind *, unsigned id, unsigned value);
+
+// Step back 'nframes' frames.  Restores the snapshot to run forward from,
+// returning false if there is none.  The machine should then run until
+// rewind_frame() returns true.
+_Bool rewind_seek(struct rewind *, unsigned nframes);
+
+// True while running forward to a target frame.
+_Bool rewind_replaying(struct rewind *);
+
+// Discard all history, for example on reset.
+void rewind_clear(struct rewind *);
+
+#endif
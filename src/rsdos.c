@@ -35,6 +35,7 @@ See COPYING.GPL for redistribution conditions.
 #include "cart.h"
 #include "logging.h"
 #include "part.h"
+#include "serialise.h"
 #include "vdrive.h"
 #include "wd279x.h"
 #include "xroar.h"
@@ -67,6 +68,11 @@ static uint8_t rsdos_write(struct cart *c, uint16_t A, _Bool P2, _Bool R2, uint8
 static void rsdos_reset(struct cart *c);
 static void rsdos_detach(struct cart *c);
 static void rsdos_free(struct part *p);
+static size_t rsdos_state_size(struct cart *c);
+static void rsdos_state_save(struct cart *c, void *buf);
+static void rsdos_state_restore(struct cart *c, void const *buf);
+static void rsdos_ser_write(struct cart *c, struct ser_handle *sh);
+static void rsdos_ser_read(struct cart *c, struct ser_handle *sh);
 static _Bool rsdos_has_interface(struct cart *c, const char *ifname);
 static void rsdos_attach_interface(struct cart *c, const char *ifname, void *intf);
 
@@ -96,6 +102,11 @@ static struct cart *rsdos_new(struct cart_config *cc) {
 	c->read = rsdos_read;
 	c->write = rsdos_write;
 	c->reset = rsdos_reset;
+	c->state_size = rsdos_state_size;
+	c->state_save = rsdos_state_save;
+	c->state_restore = rsdos_state_restore;
+	c->ser_write = rsdos_ser_write;
+	c->ser_read = rsdos_ser_read;
 
 	c->has_interface = rsdos_has_interface;
 	c->attach_interface = rsdos_attach_interface;
@@ -122,6 +133,87 @@ static void rsdos_reset(struct cart *c) {
 		becker_reset(d->becker);
 }
 
+// Latches, FDC and drive state follow each other in the buffer.
+
+struct rsdos_state {
+	unsigned latch_old;
+	unsigned latch_drive_select;
+	_Bool latch_density;
+	_Bool drq_flag;
+	_Bool intrq_flag;
+	_Bool halt_enable;
+};
+
+static size_t rsdos_state_size(struct cart *c) {
+	(void)c;
+	return STATE_ALIGN(sizeof(struct rsdos_state)) + STATE_ALIGN(wd279x_state_size())
+	       + vdrive_state_size();
+}
+
+static void rsdos_state_save(struct cart *c, void *buf) {
+	struct rsdos *d = (struct rsdos *)c;
+	struct rsdos_state *st = buf;
+	st->latch_old = d->latch_old;
+	st->latch_drive_select = d->latch_drive_select;
+	st->latch_density = d->latch_density;
+	st->drq_flag = d->drq_flag;
+	st->intrq_flag = d->intrq_flag;
+	st->halt_enable = d->halt_enable;
+	uint8_t *p = (uint8_t *)buf + STATE_ALIGN(sizeof(*st));
+	wd279x_state_save(d->fdc, p);
+	p += STATE_ALIGN(wd279x_state_size());
+	if (d->vdrive_interface) {
+		vdrive_state_save(d->vdrive_interface, p);
+	} else {
+		memset(p, 0, vdrive_state_size());
+	}
+}
+
+static void rsdos_state_restore(struct cart *c, void const *buf) {
+	struct rsdos *d = (struct rsdos *)c;
+	struct rsdos_state const *st = buf;
+	d->latch_old = st->latch_old;
+	d->latch_drive_select = st->latch_drive_select;
+	d->latch_density = st->latch_density;
+	d->drq_flag = st->drq_flag;
+	d->intrq_flag = st->intrq_flag;
+	d->halt_enable = st->halt_enable;
+	uint8_t const *p = (uint8_t const *)buf + STATE_ALIGN(sizeof(*st));
+	if (d->vdrive_interface) {
+		vdrive_state_restore(d->vdrive_interface, p + STATE_ALIGN(wd279x_state_size()));
+	}
+	wd279x_state_restore(d->fdc, p);
+}
+
+// Drive state is read before the FDC's, as for the in-memory state.
+
+static void rsdos_ser_write(struct cart *c, struct ser_handle *sh) {
+	struct rsdos *d = (struct rsdos *)c;
+	ser_write_uint32(sh, d->latch_old);
+	ser_write_uint8(sh, d->latch_drive_select);
+	ser_write_bool(sh, d->latch_density);
+	ser_write_bool(sh, d->drq_flag);
+	ser_write_bool(sh, d->intrq_flag);
+	ser_write_bool(sh, d->halt_enable);
+	ser_write_bool(sh, d->vdrive_interface);
+	if (d->vdrive_interface)
+		vdrive_ser_write(d->vdrive_interface, sh);
+	wd279x_ser_write(d->fdc, sh);
+}
+
+static void rsdos_ser_read(struct cart *c, struct ser_handle *sh) {
+	struct rsdos *d = (struct rsdos *)c;
+	d->latch_old = ser_read_uint32(sh);
+	d->latch_drive_select = ser_read_uint8(sh);
+	d->latch_density = ser_read_bool(sh);
+	d->drq_flag = ser_read_bool(sh);
+	d->intrq_flag = ser_read_bool(sh);
+	d->halt_enable = ser_read_bool(sh);
+	if (ser_read_bool(sh))
+		vdrive_ser_read(d->vdrive_interface, sh);
+	wd279x_ser_read(d->fdc, sh);
+}
+
 static void rsdos_detach(struct cart *c) {
 	struct rsdos *d = (struct rsdos *)c;
 	vdrive_disconnect(d->vdrive_interface);
@@ -21,12 +21,14 @@ See COPYING.GPL for redistribution conditions.
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "delegate.h"
 #include "xalloc.h"
 
 #include "part.h"
 #include "sam.h"
+#include "serialise.h"
 
 // Constants for address multiplexer
 // SAM Data Sheet,
@@ -229,6 +231,25 @@ void sam_mem_cycle(void *sptr, _Bool RnW, uint16_t A) {
 
 }
 
+// Decode an address exactly as sam_mem_cycle() would, but without affecting
+// SAM state or calling the CPU delegate.  Returns S, and sets RAS and (if RAS
+// is set) Z.  Used by machines to build memory lookup tables.
+
+unsigned sam_decode(struct MC6883 *samp, _Bool RnW, uint16_t A, _Bool *RAS, unsigned *Z) {
+	struct MC6883_private *sam = (struct MC6883_private *)samp;
+	if ((A >> 8) == 0xff) {
+		*RAS = 0;
+		return io_S[(A >> 5) & 7];
+	}
+	if ((A & 0x8000) && !sam->map_type_1) {
+		*RAS = 0;
+		return data_S[A >> 13];
+	}
+	*RAS = 1;
+	*Z = RAM_TRANSLATE(A);
+	return RnW ? 0 : data_S[A >> 13];
+}
+
 static void vdg_set_b3_0(struct MC6883_private *sam, uint16_t b3_0);
 
 static void update_b15_5_input(struct MC6883_private *sam) {
@@ -446,6 +467,112 @@ unsigned int sam_get_register(struct MC6883 *samp) {
 	return sam->reg;
 }
 
+// Internal state holds pointers only to itself or static data, so a straight
+// copy restores it to the same instance.
+
+size_t sam_state_size(void) {
+	return sizeof(struct MC6883_private);
+}
+
+void sam_state_save(struct MC6883 *samp, void *buf) {
+	struct MC6883_private *sam = (struct MC6883_private *)samp;
+	memcpy(buf, sam, sizeof(*sam));
+}
+
+void sam_state_restore(struct MC6883 *samp, void const *buf) {
+	struct MC6883_private *sam = (struct MC6883_private *)samp;
+	struct MC6883 public = sam->public;
+	memcpy(sam, buf, sizeof(*sam));
+	sam->public.part = public.part;
+	sam->public.cpu_cycle = public.cpu_cycle;
+}
+
+// Portable state for snapshot files.  Counter inputs are recorded as an
+// index into this list.
+
+static struct vcounter *vcounter_ptr(struct MC6883_private *sam, unsigned i) {
+	struct vcounter *counters[] = {
+		(struct vcounter *)&ground,
+		&sam->vdg.b15_5, &sam->vdg.b4, &sam->vdg.b3_0,
+		&sam->vdg.ydiv4, &sam->vdg.ydiv3, &sam->vdg.ydiv2,
+		&sam->vdg.xdiv3, &sam->vdg.xdiv2,
+	};
+	return (i < 9) ? counters[i] : counters[0];
+}
+
+static void ser_write_vcounter(struct ser_handle *sh, struct MC6883_private *sam,
+			       struct vcounter *vc) {
+	unsigned from = 0;
+	for (unsigned i = 1; i < 9; i++) {
+		if (vc->input_from == vcounter_ptr(sam, i))
+			from = i;
+	}
+	ser_write_bool(sh, vc->input);
+	ser_write_uint16(sh, vc->value);
+	ser_write_bool(sh, vc->output);
+	ser_write_uint8(sh, from);
+}
+
+static void ser_read_vcounter(struct ser_handle *sh, struct MC6883_private *sam,
+			      struct vcounter *vc) {
+	vc->input = ser_read_bool(sh);
+	vc->value = ser_read_uint16(sh);
+	vc->output = ser_read_bool(sh);
+	vc->input_from = vcounter_ptr(sam, ser_read_uint8(sh));
+}
+
+void sam_ser_write(struct MC6883 *samp, struct ser_handle *sh) {
+	struct MC6883_private *sam = (struct MC6883_private *)samp;
+	ser_write_uint8(sh, samp->S);
+	ser_write_uint16(sh, samp->Z);
+	ser_write_uint16(sh, samp->V);
+	ser_write_bool(sh, samp->RAS);
+	ser_write_uint16(sh, sam->reg);
+	ser_write_bool(sh, sam->map_type_1);
+	ser_write_uint16(sh, sam->ram_row_mask);
+	ser_write_uint8(sh, sam->ram_col_shift);
+	ser_write_uint16(sh, sam->ram_col_mask);
+	ser_write_uint16(sh, sam->ram_ras1_bit);
+	ser_write_uint16(sh, sam->ram_ras1);
+	ser_write_uint16(sh, sam->ram_page_bit);
+	ser_write_bool(sh, sam->mpu_rate_fast);
+	ser_write_bool(sh, sam->mpu_rate_ad);
+	ser_write_bool(sh, sam->running_fast);
+	ser_write_bool(sh, sam->extend_slow_cycle);
+	ser_write_uint8(sh, sam->vdg.v);
+	ser_write_uint16(sh, sam->vdg.f);
+	ser_write_uint8(sh, sam->vdg.clr_mode);
+	for (unsigned i = 1; i < 9; i++) {
+		ser_write_vcounter(sh, sam, vcounter_ptr(sam, i));
+	}
+}
+
+void sam_ser_read(struct MC6883 *samp, struct ser_handle *sh) {
+	struct MC6883_private *sam = (struct MC6883_private *)samp;
+	samp->S = ser_read_uint8(sh);
+	samp->Z = ser_read_uint16(sh);
+	samp->V = ser_read_uint16(sh);
+	samp->RAS = ser_read_bool(sh);
+	sam->reg = ser_read_uint16(sh);
+	sam->map_type_1 = ser_read_bool(sh);
+	sam->ram_row_mask = ser_read_uint16(sh);
+	sam->ram_col_shift = ser_read_uint8(sh);
+	sam->ram_col_mask = ser_read_uint16(sh);
+	sam->ram_ras1_bit = ser_read_uint16(sh);
+	sam->ram_ras1 = ser_read_uint16(sh);
+	sam->ram_page_bit = ser_read_uint16(sh);
+	sam->mpu_rate_fast = ser_read_bool(sh);
+	sam->mpu_rate_ad = ser_read_bool(sh);
+	sam->running_fast = ser_read_bool(sh);
+	sam->extend_slow_cycle = ser_read_bool(sh);
+	sam->vdg.v = ser_read_uint8(sh) & 7;
+	sam->vdg.f = ser_read_uint16(sh);
+	sam->vdg.clr_mode = ser_read_uint8(sh);
+	for (unsigned i = 1; i < 9; i++) {
+		ser_read_vcounter(sh, sam, vcounter_ptr(sam, i));
+	}
+}
+
 static void update_from_register(struct MC6883_private *sam) {
 	int old_v = sam->vdg.v;
 
@@ -18,6 +18,7 @@ See COPYING.GPL for redistribution conditions.
 #ifndef XROAR_SAM_H_
 #define XROAR_SAM_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "delegate.h"
@@ -40,10 +41,25 @@ struct MC6883 *sam_new(void);
 
 void sam_reset(struct MC6883 *);
 void sam_mem_cycle(void *, _Bool RnW, uint16_t A);
+unsigned sam_decode(struct MC6883 *, _Bool RnW, uint16_t A, _Bool *RAS, unsigned *Z);
 void sam_vdg_hsync(struct MC6883 *, _Bool level);
 void sam_vdg_fsync(struct MC6883 *, _Bool level);
 int sam_vdg_bytes(struct MC6883 *, int nbytes);
 void sam_set_register(struct MC6883 *, unsigned int value);
 unsigned int sam_get_register(struct MC6883 *);
 
+/* Save and restore internal state, for reverse execution.  The memory cycle
+ * delegate is not affected. */
+
+size_t sam_state_size(void);
+void sam_state_save(struct MC6883 *, void *buf);
+void sam_state_restore(struct MC6883 *, void const *buf);
+
+/* Portable state, for snapshot files. */
+
+struct ser_handle;
+
+void sam_ser_write(struct MC6883 *, struct ser_handle *);
+void sam_ser_read(struct MC6883 *, struct ser_handle *);
+
 #endif
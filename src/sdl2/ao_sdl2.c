@@ -39,6 +39,7 @@ See COPYING.GPL for redistribution conditions.
 #include "logging.h"
 #include "module.h"
 #include "sound.h"
+#include "stats.h"
 #include "xroar.h"
 
 static void *new(void *cfg);
@@ -64,6 +65,8 @@ struct ao_sdl2_interface {
 	SDL_cond *fragment_cv;
 	void *fragment_buffer;
 	_Bool fragment_available;
+	// Times the callback gave up waiting for data
+	unsigned nunderruns;
 
 	Uint32 qbytes_threshold;
 	unsigned qdelay_divisor;
@@ -355,6 +358,11 @@ static void *ao_sdl2_write_buffer(void *sptr, void *buffer) {
 			SDL_CondSignal(aosdl->fragment_cv);
 		}
 
+		// Underruns are noted by the callback, but counted here, in
+		// the emulation thread.
+		STATS_ADD(STATS_AO_UNDERRUN, aosdl->nunderruns);
+		aosdl->nunderruns = 0;
+
 		if (!aosdl->public.sound_interface->ratelimit) {
 			SDL_UnlockMutex(aosdl->fragment_mutex);
 			return NULL;
@@ -375,8 +383,11 @@ static void *ao_sdl2_write_buffer(void *sptr, void *buffer) {
 		if (!aosdl->public.sound_interface->ratelimit) {
 			return NULL;
 		}
-		Uint32 qbytes;
-		if ((qbytes = SDL_GetQueuedAudioSize(aosdl->device)) > aosdl->qbytes_threshold) {
+		Uint32 qbytes = SDL_GetQueuedAudioSize(aosdl->device);
+		if (qbytes == 0) {
+			STATS_ADD(STATS_AO_UNDERRUN, 1);
+		}
+		if (qbytes > aosdl->qbytes_threshold) {
 #ifndef HAVE_WASM
 			int ms = ((qbytes - aosdl->qbytes_threshold) * 1000) / aosdl->qdelay_divisor;
 			if (ms >= 10) {
@@ -413,6 +424,7 @@ static void callback_1(void *userdata, Uint8 *stream, int len) {
 	while (!aosdl->fragment_available) {
 		if (SDL_CondWaitTimeout(aosdl->fragment_cv, aosdl->fragment_mutex, aosdl->timeout_ms) == SDL_MUTEX_TIMEDOUT) {
 			memset(stream, 0, aosdl->fragment_nbytes);
+			aosdl->nunderruns++;
 			SDL_UnlockMutex(aosdl->fragment_mutex);
 			return;
 		}
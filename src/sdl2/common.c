@@ -104,7 +104,7 @@ void run_sdl_event_loop(struct ui_sdl2_interface *uisdl2) {
 			switch(event.window.event) {
 			case SDL_WINDOWEVENT_SIZE_CHANGED:
 			case SDL_WINDOWEVENT_RESIZED:
-				DELEGATE_SAFE_CALL2(xroar_vo_interface->resize, event.window.data1, event.window.data2);
+				DELEGATE_SAFE_CALL2(xroar_context->vo_interface->resize, event.window.data1, event.window.data2);
 				break;
 			}
 			break;
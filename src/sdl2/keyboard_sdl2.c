@@ -182,6 +182,7 @@ static void emulator_command(struct ui_sdl2_interface *uisdl2, int cmdkey, _Bool
 		}
 		return;
 	case 'a': xroar_set_cross_colour(1, XROAR_NEXT); return;
+	case 'b': xroar_rewind(shift); return;
 	case 'q': xroar_quit(); return;
 	case 'e': xroar_toggle_cart(); return;
 	case 'f': xroar_set_fullscreen(1, XROAR_NEXT); return;
@@ -215,7 +216,7 @@ static void emulator_command(struct ui_sdl2_interface *uisdl2, int cmdkey, _Bool
 	case 'm': xroar_set_machine(1, XROAR_NEXT); return;
 	case 'p':
 		     if (shift) {
-			     printer_flush(xroar_printer_interface);
+			     printer_flush(xroar_context->printer_interface);
 		     }
 		     return;
 	case 'r':
@@ -336,10 +337,10 @@ void sdl_keypress(struct ui_sdl2_interface *uisdl2, SDL_Keysym *keysym) {
 
 	switch (sym) {
 	case SDLK_LSHIFT: case SDLK_RSHIFT:
-		KEYBOARD_PRESS_SHIFT(xroar_keyboard_interface);
+		KEYBOARD_PRESS_SHIFT(xroar_context->keyboard_interface);
 		return;
 	case SDLK_CLEAR:
-		KEYBOARD_PRESS_CLEAR(xroar_keyboard_interface);
+		KEYBOARD_PRESS_CLEAR(xroar_context->keyboard_interface);
 		return;
 	case SDLK_LCTRL: case SDLK_RCTRL:
 		return;
@@ -369,7 +370,7 @@ void sdl_keypress(struct ui_sdl2_interface *uisdl2, SDL_Keysym *keysym) {
 
 	// If scancode has priority, never do a unicode lookup.
 	if (uisdl2->keyboard.scancode_priority[scancode]) {
-		keyboard_press(xroar_keyboard_interface, uisdl2->keyboard.scancode_to_dkey[scancode]);
+		keyboard_press(xroar_context->keyboard_interface, uisdl2->keyboard.scancode_to_dkey[scancode]);
 		return;
 	}
 
@@ -385,11 +386,11 @@ void sdl_keypress(struct ui_sdl2_interface *uisdl2, SDL_Keysym *keysym) {
 		if (uisdl2->keyboard.scancode_to_dkey[scancode] == DSCAN_SPACE)
 			unicode = shift ? DKBD_U_PAUSE_OUTPUT : 0x20;
 		uisdl2->keyboard.unicode_last_scancode[scancode] = unicode;
-		keyboard_unicode_press(xroar_keyboard_interface, unicode);
+		keyboard_unicode_press(xroar_context->keyboard_interface, unicode);
 		return;
 	}
 
-	keyboard_press(xroar_keyboard_interface, uisdl2->keyboard.scancode_to_dkey[scancode]);
+	keyboard_press(xroar_context->keyboard_interface, uisdl2->keyboard.scancode_to_dkey[scancode]);
 }
 
 void sdl_keyrelease(struct ui_sdl2_interface *uisdl2, SDL_Keysym *keysym) {
@@ -444,10 +445,10 @@ void sdl_keyrelease(struct ui_sdl2_interface *uisdl2, SDL_Keysym *keysym) {
 	switch (sym) {
 	case SDLK_LSHIFT: case SDLK_RSHIFT:
 		if (!shift)
-			KEYBOARD_RELEASE_SHIFT(xroar_keyboard_interface);
+			KEYBOARD_RELEASE_SHIFT(xroar_context->keyboard_interface);
 		return;
 	case SDLK_CLEAR:
-		KEYBOARD_RELEASE_CLEAR(xroar_keyboard_interface);
+		KEYBOARD_RELEASE_CLEAR(xroar_context->keyboard_interface);
 		return;
 	case SDLK_LCTRL: case SDLK_RCTRL:
 		return;
@@ -460,7 +461,7 @@ void sdl_keyrelease(struct ui_sdl2_interface *uisdl2, SDL_Keysym *keysym) {
 
 	// If scancode has priority, never do a unicode lookup.
 	if (uisdl2->keyboard.scancode_priority[scancode]) {
-		keyboard_release(xroar_keyboard_interface, uisdl2->keyboard.scancode_to_dkey[scancode]);
+		keyboard_release(xroar_context->keyboard_interface, uisdl2->keyboard.scancode_to_dkey[scancode]);
 		return;
 	}
 
@@ -469,16 +470,16 @@ void sdl_keyrelease(struct ui_sdl2_interface *uisdl2, SDL_Keysym *keysym) {
 		if (scancode >= SDL_NUM_SCANCODES)
 			return;
 		unicode = uisdl2->keyboard.unicode_last_scancode[scancode];
-		keyboard_unicode_release(xroar_keyboard_interface, unicode);
+		keyboard_unicode_release(xroar_context->keyboard_interface, unicode);
 		/* Put shift back the way it should be */
 		if (shift)
-			KEYBOARD_PRESS_SHIFT(xroar_keyboard_interface);
+			KEYBOARD_PRESS_SHIFT(xroar_context->keyboard_interface);
 		else
-			KEYBOARD_RELEASE_SHIFT(xroar_keyboard_interface);
+			KEYBOARD_RELEASE_SHIFT(xroar_context->keyboard_interface);
 		return;
 	}
 
-	keyboard_release(xroar_keyboard_interface, uisdl2->keyboard.scancode_to_dkey[scancode]);
+	keyboard_release(xroar_context->keyboard_interface, uisdl2->keyboard.scancode_to_dkey[scancode]);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
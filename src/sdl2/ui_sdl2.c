@@ -183,8 +183,8 @@ static void sdl2_wasm_update_machine_menu(struct ui_sdl2_interface *uisdl2) {
 		struct machine_config *mc = iter->data;
 		EM_ASM_({ ui_add_machine($0, $1); }, mc->id, mc->description);
 	}
-	if (xroar_machine_config) {
-		EM_ASM_({ ui_update_machine($0); }, xroar_machine_config->id);
+	if (xroar_context->machine_config) {
+		EM_ASM_({ ui_update_machine($0); }, xroar_context->machine_config->id);
 	}
 }
 
@@ -109,12 +109,12 @@ static void *new(void *sptr) {
 
 	vo->free = DELEGATE_AS0(void, vo_sdl_free, vo);
 	vo->update_palette = DELEGATE_AS0(void, alloc_colours, vo);
-	vo->refresh = DELEGATE_AS0(void, vo_sdl_refresh, vosdl);
+	vo->refresh = DELEGATE_AS0(void, vo_sdl_refresh, vo);
 	vo->vsync = DELEGATE_AS0(void, vo_sdl_vsync, vo);
-	vo->render_scanline = DELEGATE_AS3(void, uint8cp, ntscburst, unsigned, render_scanline, vo);
 	vo->resize = DELEGATE_AS2(void, unsigned, unsigned, resize, vo);
 	vo->set_fullscreen = DELEGATE_AS1(int, bool, set_fullscreen, vo);
 	vo->set_vo_cmp = DELEGATE_AS1(void, int, set_vo_cmp, vo);
+	set_vo_cmp(vo, VO_CMP_PALETTE);
 
 	Uint32 wflags = SDL_WINDOW_RESIZABLE;
 	if (vo_cfg->fullscreen) {
@@ -142,6 +142,7 @@ static void *new(void *sptr) {
 	vo->window_y = VDG_TOP_BORDER_START + 1;
 	vo->window_w = 640;
 	vo->window_h = 240;
+	generic_invalidate(generic, 0);
 
 	vo_sdl_vsync(vo);
 
@@ -228,6 +229,14 @@ static _Bool create_renderer(struct vo_sdl_interface *vosdl) {
 
 	vo->is_fullscreen = SDL_GetWindowFlags(global_uisdl2->vo_window) & (SDL_WINDOW_FULLSCREEN|SDL_WINDOW_FULLSCREEN_DESKTOP);
 
+	// Used to cap presented frames when not rate limited
+	SDL_DisplayMode mode;
+	if (SDL_GetWindowDisplayMode(global_uisdl2->vo_window, &mode) == 0 && mode.refresh_rate > 0) {
+		vo->refresh_rate = mode.refresh_rate;
+	} else {
+		vo->refresh_rate = 0;
+	}
+
 	_Bool resize_again = 0;
 
 #ifdef WINDOWS32
@@ -304,6 +313,9 @@ static _Bool create_renderer(struct vo_sdl_interface *vosdl) {
 
 	SDL_RenderSetLogicalSize(vosdl->renderer, 640, 480);
 
+	// New texture needs a full upload
+	generic_invalidate((struct vo_generic_interface *)vosdl, 0);
+
 	SDL_RenderClear(vosdl->renderer);
 	SDL_RenderPresent(vosdl->renderer);
 
@@ -326,19 +338,27 @@ static void destroy_renderer(struct vo_sdl_interface *vosdl) {
 }
 
 static void vo_sdl_free(void *sptr) {
-	struct vo_sdl_interface *vosdl = sptr;
+	struct vo_generic_interface *generic = sptr;
+	struct vo_sdl_interface *vosdl = &generic->module;
 	if (vosdl->texture_pixels) {
 		free(vosdl->texture_pixels);
 		vosdl->texture_pixels = NULL;
 	}
 	destroy_renderer(vosdl);
 	destroy_window();
-	free(vosdl);
+	generic_free(generic);
+	free(generic);
 }
 
 static void vo_sdl_refresh(void *sptr) {
-	struct vo_sdl_interface *vosdl = sptr;
-	SDL_UpdateTexture(vosdl->texture, NULL, vosdl->texture_pixels, TEXTURE_WIDTH * sizeof(Pixel));
+	struct vo_generic_interface *generic = sptr;
+	struct vo_sdl_interface *vosdl = &generic->module;
+	// Upload only rows that have changed
+	int first, nrows;
+	if (generic_dirty_rows(generic, &first, &nrows)) {
+		SDL_Rect rect = { .x = 0, .y = first, .w = TEXTURE_WIDTH, .h = nrows };
+		SDL_UpdateTexture(vosdl->texture, &rect, vosdl->texture_pixels + first * TEXTURE_WIDTH, TEXTURE_WIDTH * sizeof(Pixel));
+	}
 	SDL_RenderClear(vosdl->renderer);
 	SDL_RenderCopy(vosdl->renderer, vosdl->texture, NULL, NULL);
 	SDL_RenderPresent(vosdl->renderer);
@@ -348,7 +368,7 @@ static void vo_sdl_vsync(void *sptr) {
 	struct vo_generic_interface *generic = sptr;
 	struct vo_sdl_interface *vosdl = &generic->module;
 	struct vo_interface *vo = &vosdl->public;
-	vo_sdl_refresh(vosdl);
+	vo_sdl_refresh(generic);
 	generic->pixel = vosdl->texture_pixels;
 	generic_vsync(vo);
 }
@@ -0,0 +1,239 @@
+/*
+
+Serialisation of component state
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xalloc.h"
+
+#include "events.h"
+#include "serialise.h"
+
+struct ser_handle {
+	uint8_t *data;
+	size_t size;
+	size_t pos;
+	// Write handles own their buffer
+	_Bool writing;
+	_Bool error;
+};
+
+struct ser_handle *ser_open_write(void) {
+	struct ser_handle *sh = xmalloc(sizeof(*sh));
+	*sh = (struct ser_handle){0};
+	sh->writing = 1;
+	return sh;
+}
+
+struct ser_handle *ser_open_read(void const *data, size_t size) {
+	struct ser_handle *sh = xmalloc(sizeof(*sh));
+	*sh = (struct ser_handle){0};
+	sh->data = (uint8_t *)data;
+	sh->size = size;
+	return sh;
+}
+
+void ser_close(struct ser_handle *sh) {
+	if (!sh)
+		return;
+	if (sh->writing)
+		free(sh->data);
+	free(sh);
+}
+
+void const *ser_data(struct ser_handle *sh, size_t *size) {
+	*size = sh->pos;
+	return sh->data;
+}
+
+size_t ser_remaining(struct ser_handle *sh) {
+	return sh->size - sh->pos;
+}
+
+_Bool ser_error(struct ser_handle *sh) {
+	return sh->error;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static uint8_t *write_space(struct ser_handle *sh, size_t n) {
+	if (sh->pos + n > sh->size) {
+		size_t nsize = sh->size ? sh->size * 2 : 256;
+		while (nsize < sh->pos + n)
+			nsize *= 2;
+		sh->data = xrealloc(sh->data, nsize);
+		sh->size = nsize;
+	}
+	uint8_t *p = sh->data + sh->pos;
+	sh->pos += n;
+	return p;
+}
+
+void ser_write_uint8(struct ser_handle *sh, unsigned v) {
+	uint8_t *p = write_space(sh, 1);
+	p[0] = v;
+}
+
+void ser_write_uint16(struct ser_handle *sh, unsigned v) {
+	uint8_t *p = write_space(sh, 2);
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+void ser_write_uint32(struct ser_handle *sh, uint32_t v) {
+	uint8_t *p = write_space(sh, 4);
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+void ser_write_int32(struct ser_handle *sh, int32_t v) {
+	ser_write_uint32(sh, (uint32_t)v);
+}
+
+void ser_write_bool(struct ser_handle *sh, _Bool v) {
+	ser_write_uint8(sh, v ? 1 : 0);
+}
+
+// Assumes IEEE 754 single precision, as does everything else these days.
+
+void ser_write_float(struct ser_handle *sh, float v) {
+	uint32_t u;
+	memcpy(&u, &v, sizeof(u));
+	ser_write_uint32(sh, u);
+}
+
+void ser_write_bytes(struct ser_handle *sh, void const *p, size_t n) {
+	if (n > 0)
+		memcpy(write_space(sh, n), p, n);
+}
+
+// Strings are written as length+1, so that zero can mean NULL.
+
+void ser_write_string(struct ser_handle *sh, char const *s) {
+	if (!s) {
+		ser_write_uint16(sh, 0);
+		return;
+	}
+	size_t len = strlen(s);
+	if (len > 0xfffe)
+		len = 0xfffe;
+	ser_write_uint16(sh, len + 1);
+	ser_write_bytes(sh, s, len);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static uint8_t const *read_space(struct ser_handle *sh, size_t n) {
+	if (sh->error || n > sh->size - sh->pos) {
+		sh->error = 1;
+		return NULL;
+	}
+	uint8_t const *p = sh->data + sh->pos;
+	sh->pos += n;
+	return p;
+}
+
+unsigned ser_read_uint8(struct ser_handle *sh) {
+	uint8_t const *p = read_space(sh, 1);
+	return p ? p[0] : 0;
+}
+
+unsigned ser_read_uint16(struct ser_handle *sh) {
+	uint8_t const *p = read_space(sh, 2);
+	return p ? (p[0] << 8) | p[1] : 0;
+}
+
+uint32_t ser_read_uint32(struct ser_handle *sh) {
+	uint8_t const *p = read_space(sh, 4);
+	if (!p)
+		return 0;
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+int32_t ser_read_int32(struct ser_handle *sh) {
+	return (int32_t)ser_read_uint32(sh);
+}
+
+_Bool ser_read_bool(struct ser_handle *sh) {
+	return ser_read_uint8(sh) != 0;
+}
+
+float ser_read_float(struct ser_handle *sh) {
+	uint32_t u = ser_read_uint32(sh);
+	float v;
+	memcpy(&v, &u, sizeof(v));
+	return v;
+}
+
+void ser_read_bytes(struct ser_handle *sh, void *p, size_t n) {
+	uint8_t const *src = read_space(sh, n);
+	if (src) {
+		memcpy(p, src, n);
+	} else {
+		memset(p, 0, n);
+	}
+}
+
+char *ser_read_string(struct ser_handle *sh) {
+	unsigned len = ser_read_uint16(sh);
+	if (len == 0)
+		return NULL;
+	uint8_t const *p = read_space(sh, len - 1);
+	if (!p)
+		return NULL;
+	char *s = xmalloc(len);
+	memcpy(s, p, len - 1);
+	s[len - 1] = 0;
+	return s;
+}
+
+void ser_skip(struct ser_handle *sh, size_t n) {
+	(void)read_space(sh, n);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ser_write_event_state(struct ser_handle *sh, struct event_state const *es) {
+	ser_write_int32(sh, (int32_t)es->dt);
+	ser_write_bool(sh, es->queued);
+}
+
+void ser_read_event_state(struct ser_handle *sh, struct event_state *es) {
+	es->dt = (event_ticks)ser_read_int32(sh);
+	es->queued = ser_read_bool(sh);
+	if (sh->error)
+		es->queued = 0;
+}
+
+void ser_write_event(struct ser_handle *sh, struct event const *event) {
+	struct event_state es;
+	event_save_state(event, &es);
+	ser_write_event_state(sh, &es);
+}
+
+void ser_read_event(struct ser_handle *sh, struct event *event, struct event_list *list) {
+	struct event_state es;
+	ser_read_event_state(sh, &es);
+	event_restore_state(event, list, &es);
+}
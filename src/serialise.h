@@ -0,0 +1,81 @@
+/*
+
+Serialisation of component state
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifndef XROAR_SERIALISE_H_
+#define XROAR_SERIALISE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Unlike the in-memory state used for rewind and reverse execution, state
+ * written to snapshot files has to be portable between builds.  Components
+ * write their state field by field into a ser_handle, and read it back in the
+ * same order.  Integers are stored big-endian, like the rest of the snapshot
+ * format.
+ *
+ * Reading past the end of the data returns zeroes and flags an error, so a
+ * component can read all its fields and the caller check once at the end. */
+
+struct event;
+struct event_list;
+struct event_state;
+struct ser_handle;
+
+// Open a handle to write into a growing buffer.
+struct ser_handle *ser_open_write(void);
+// Open a handle to read from existing data.  The data is not copied.
+struct ser_handle *ser_open_read(void const *data, size_t size);
+void ser_close(struct ser_handle *);
+
+// Data written so far.
+void const *ser_data(struct ser_handle *, size_t *size);
+// Bytes left to read.
+size_t ser_remaining(struct ser_handle *);
+// True if a read ran past the end of the data.
+_Bool ser_error(struct ser_handle *);
+
+void ser_write_uint8(struct ser_handle *, unsigned v);
+void ser_write_uint16(struct ser_handle *, unsigned v);
+void ser_write_uint32(struct ser_handle *, uint32_t v);
+void ser_write_int32(struct ser_handle *, int32_t v);
+void ser_write_bool(struct ser_handle *, _Bool v);
+void ser_write_float(struct ser_handle *, float v);
+void ser_write_bytes(struct ser_handle *, void const *p, size_t n);
+// Length-prefixed string.  NULL is distinct from the empty string.
+void ser_write_string(struct ser_handle *, char const *s);
+
+unsigned ser_read_uint8(struct ser_handle *);
+unsigned ser_read_uint16(struct ser_handle *);
+uint32_t ser_read_uint32(struct ser_handle *);
+int32_t ser_read_int32(struct ser_handle *);
+_Bool ser_read_bool(struct ser_handle *);
+float ser_read_float(struct ser_handle *);
+void ser_read_bytes(struct ser_handle *, void *p, size_t n);
+// Returns allocated string, or NULL.
+char *ser_read_string(struct ser_handle *);
+// Skip over data not needed.
+void ser_skip(struct ser_handle *, size_t n);
+
+// Events are written as time relative to the current tick, and whether
+// queued.  Reading requeues the event on list if it was queued.
+void ser_write_event(struct ser_handle *, struct event const *);
+void ser_read_event(struct ser_handle *, struct event *, struct event_list *list);
+// Or where a component's in-memory state has already recorded it.
+void ser_write_event_state(struct ser_handle *, struct event_state const *);
+void ser_read_event_state(struct ser_handle *, struct event_state *);
+
+#endif
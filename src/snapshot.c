@@ -29,6 +29,7 @@ See COPYING.GPL for redistribution conditions.
 #include "xalloc.h"
 
 #include "cart.h"
+#include "events.h"
 #include "fs.h"
 #include "keyboard.h"
 #include "hd6309.h"
@@ -38,7 +39,9 @@ See COPYING.GPL for redistribution conditions.
 #include "mc6821.h"
 #include "mc6847/mc6847.h"
 #include "sam.h"
+#include "serialise.h"
 #include "snapshot.h"
+#include "sound.h"
 #include "tape.h"
 #include "vdisk.h"
 #include "vdrive.h"
@@ -63,9 +66,38 @@ See COPYING.GPL for redistribution conditions.
 #define ID_VDISK_FILE    (10)
 #define ID_HD6309_STATE  (11)
 #define ID_CART          (12)  // as of v1.8
+#define ID_INDEX         (13)  // as of v1.9
+#define ID_MACHINE_STATE (14)  // as of v1.9
+#define ID_SOUND_STATE   (15)  // as of v1.9
+#define ID_TAPE_STATE    (16)  // as of v1.9
+#define ID_CART_STATE    (17)  // as of v1.9
 
 #define SNAPSHOT_VERSION_MAJOR 1
-#define SNAPSHOT_VERSION_MINOR 8
+#define SNAPSHOT_VERSION_MINOR 9
+
+/* From v1.9, an index chunk follows the version chunk.  It lists the id and
+ * file offset of every chunk written after it, so a loader can seek straight
+ * to the chunks it needs.  It has a fixed number of entries, as it is written
+ * before the chunks it describes and filled in at the end; unused entries
+ * have an offset of zero.
+ *
+ * The *_STATE chunks hold the full state of each subsystem, including event
+ * timings, so that a loaded snapshot continues exactly as the original
+ * would have.  Each starts with a format version byte, and is ignored if that
+ * isn't understood.  They follow the older chunks, and are applied after
+ * everything else, once any cartridge is attached, overriding what the older
+ * chunks set. */
+
+#define SNAPSHOT_INDEX_MAX (32)
+#define SNAPSHOT_STATE_VERSION (1)
+
+struct snapshot_index {
+	unsigned n;
+	struct {
+		unsigned id;
+		long offset;
+	} entry[SNAPSHOT_INDEX_MAX];
+};
 
 // Versions < 1.8 used a number for these (add 1 to index)
 static const char *old_cart_type_names[] = {
@@ -104,6 +136,44 @@ static void write_chunk_header(FILE *fd, unsigned id, int size) {
 	fs_write_uint16(fd, size);
 }
 
+static void index_chunk(FILE *fd, struct snapshot_index *idx, unsigned id) {
+	if (idx->n >= SNAPSHOT_INDEX_MAX)
+		return;
+	idx->entry[idx->n].id = id;
+	idx->entry[idx->n].offset = ftell(fd);
+	idx->n++;
+}
+
+static void write_index(FILE *fd, struct snapshot_index const *idx) {
+	write_chunk_header(fd, ID_INDEX, SNAPSHOT_INDEX_MAX * 5);
+	for (unsigned i = 0; i < SNAPSHOT_INDEX_MAX; i++) {
+		if (i < idx->n && idx->entry[i].offset > 0) {
+			fs_write_uint8(fd, idx->entry[i].id);
+			fs_write_uint31(fd, idx->entry[i].offset);
+		} else {
+			fs_write_uint8(fd, 0);
+			fs_write_uint31(fd, 0);
+		}
+	}
+}
+
+// State chunks are serialised into memory first, as the chunk header needs
+// the size.
+
+static void write_state_chunk(FILE *fd, struct snapshot_index *idx, unsigned id,
+			      struct ser_handle *sh) {
+	size_t size;
+	void const *data = ser_data(sh, &size);
+	if (size + 1 > 0xffff) {
+		LOG_WARN("Snapshot: state chunk id=%u too large, not written\n", id);
+		return;
+	}
+	index_chunk(fd, idx, id);
+	write_chunk_header(fd, id, size + 1);
+	fs_write_uint8(fd, SNAPSHOT_STATE_VERSION);
+	fwrite(data, 1, size, fd);
+}
+
 static void write_mc6809(FILE *fd, struct MC6809 *cpu) {
 	write_chunk_header(fd, ID_MC6809_STATE, 20);
 	fs_write_uint8(fd, cpu->reg_cc);
@@ -180,15 +250,20 @@ int write_snapshot(const char *filename) {
 	write_chunk_header(fd, ID_SNAPVERSION, 3);
 	fs_write_uint8(fd, SNAPSHOT_VERSION_MAJOR);
 	fs_write_uint16(fd, SNAPSHOT_VERSION_MINOR);
+	// Index, filled in at the end
+	struct snapshot_index idx = { .n = 0 };
+	long index_offset = ftell(fd);
+	write_index(fd, &idx);
 	// Machine running config
+	index_chunk(fd, &idx, ID_MACHINECONFIG);
 	write_chunk_header(fd, ID_MACHINECONFIG, 8);
-	fs_write_uint8(fd, 0);  // xroar_machine_config->index;
-	fs_write_uint8(fd, xroar_machine_config->architecture);
-	fs_write_uint8(fd, xroar_machine_config->cpu);
-	fs_write_uint8(fd, xroar_machine_config->keymap);
-	fs_write_uint8(fd, xroar_machine_config->tv_standard);
-	fs_write_uint8(fd, xroar_machine_config->ram);
-	struct cart *cart = xroar_machine->get_interface(xroar_machine, "cart");
+	fs_write_uint8(fd, 0);  // xroar_context->machine_config->index;
+	fs_write_uint8(fd, xroar_context->machine_config->architecture);
+	fs_write_uint8(fd, xroar_context->machine_config->cpu);
+	fs_write_uint8(fd, xroar_context->machine_config->keymap);
+	fs_write_uint8(fd, xroar_context->machine_config->tv_standard);
+	fs_write_uint8(fd, xroar_context->machine_config->ram);
+	struct cart *cart = xroar_context->machine->get_interface(xroar_context->machine, "cart");
 	if (cart) {
 		// attempt to keep snapshots >= v1.8 loadable by older versions
 		unsigned old_cart_type = 0;
@@ -202,22 +277,25 @@ int write_snapshot(const char *filename) {
 	} else {
 		fs_write_uint8(fd, 0);
 	}
-	fs_write_uint8(fd, xroar_machine_config->cross_colour_phase);
+	fs_write_uint8(fd, xroar_context->machine_config->cross_colour_phase);
 	// RAM page 0
-	struct machine_memory *ram0 = xroar_machine->get_component(xroar_machine, "RAM0");
+	struct machine_memory *ram0 = xroar_context->machine->get_component(xroar_context->machine, "RAM0");
+	index_chunk(fd, &idx, ID_RAM_PAGE0);
 	write_chunk_header(fd, ID_RAM_PAGE0, ram0->size);
 	fwrite(ram0->data, 1, ram0->size, fd);
 	// RAM page 1
-	struct machine_memory *ram1 = xroar_machine->get_component(xroar_machine, "RAM1");
+	struct machine_memory *ram1 = xroar_context->machine->get_component(xroar_context->machine, "RAM1");
 	if (ram1->size > 0) {
+		index_chunk(fd, &idx, ID_RAM_PAGE1);
 		write_chunk_header(fd, ID_RAM_PAGE1, ram1->size);
 		fwrite(ram1->data, 1, ram1->size, fd);
 	}
 	// PIA state written before CPU state because PIA may have
 	// unacknowledged interrupts pending already cleared in the CPU state
+	index_chunk(fd, &idx, ID_PIA_REGISTERS);
 	write_chunk_header(fd, ID_PIA_REGISTERS, 3 * 4);
 	for (int i = 0; i < 2; i++) {
-		struct MC6821 *pia = xroar_machine->get_component(xroar_machine, pia_component_names[i]);
+		struct MC6821 *pia = xroar_context->machine->get_component(xroar_context->machine, pia_component_names[i]);
 		fs_write_uint8(fd, pia->a.direction_register);
 		fs_write_uint8(fd, pia->a.output_register);
 		fs_write_uint8(fd, pia->a.control_register);
@@ -226,17 +304,20 @@ int write_snapshot(const char *filename) {
 		fs_write_uint8(fd, pia->b.control_register);
 	}
 	// CPU state
-	struct MC6809 *cpu = xroar_machine->get_component(xroar_machine, "CPU0");
-	struct MC6883 *sam = xroar_machine->get_component(xroar_machine, "SAM0");
+	struct MC6809 *cpu = xroar_context->machine->get_component(xroar_context->machine, "CPU0");
+	struct MC6883 *sam = xroar_context->machine->get_component(xroar_context->machine, "SAM0");
 	switch (cpu->variant) {
 	case MC6809_VARIANT_MC6809: default:
+		index_chunk(fd, &idx, ID_MC6809_STATE);
 		write_mc6809(fd, cpu);
 		break;
 	case MC6809_VARIANT_HD6309:
+		index_chunk(fd, &idx, ID_HD6309_STATE);
 		write_hd6309(fd, (struct HD6309 *)cpu);
 		break;
 	}
 	// SAM
+	index_chunk(fd, &idx, ID_SAM_REGISTERS);
 	write_chunk_header(fd, ID_SAM_REGISTERS, 2);
 	fs_write_uint16(fd, sam_get_register(sam));
 
@@ -254,6 +335,7 @@ int write_snapshot(const char *filename) {
 		size_t rom2_len = cc->rom2 ? strlen(cc->rom2) + 1: 1;
 		if (rom2_len > 255) rom2_len = 255;
 		int size = name_len + desc_len + type_len + rom_len + rom2_len + 2;
+		index_chunk(fd, &idx, ID_CART);
 		write_chunk_header(fd, ID_CART, size);
 		fs_write_uint8(fd, name_len);
 		if (cc->name)
@@ -277,16 +359,51 @@ int write_snapshot(const char *filename) {
 	// Attached virtual disk filenames
 	{
 		for (unsigned drive = 0; drive < VDRIVE_MAX_DRIVES; drive++) {
-			struct vdisk *disk = vdrive_disk_in_drive(xroar_vdrive_interface, drive);
+			struct vdisk *disk = vdrive_disk_in_drive(xroar_context->vdrive_interface, drive);
 			if (disk != NULL && disk->filename != NULL) {
 				int length = strlen(disk->filename) + 1;
+				index_chunk(fd, &idx, ID_VDISK_FILE);
 				write_chunk_header(fd, ID_VDISK_FILE, 1 + length);
 				fs_write_uint8(fd, drive);
 				fwrite(disk->filename, 1, length, fd);
 			}
 		}
 	}
+
+	// Full subsystem state
+	if (xroar_context->machine->ser_write) {
+		struct ser_handle *sh = ser_open_write();
+		xroar_context->machine->ser_write(xroar_context->machine, sh);
+		write_state_chunk(fd, &idx, ID_MACHINE_STATE, sh);
+		ser_close(sh);
+	}
+	{
+		struct sound_interface *snd = xroar_context->machine->get_interface(xroar_context->machine, "sound");
+		struct ser_handle *sh = ser_open_write();
+		sound_ser_write(snd, sh);
+		write_state_chunk(fd, &idx, ID_SOUND_STATE, sh);
+		ser_close(sh);
+	}
+	{
+		struct tape_interface *ti = xroar_context->machine->get_interface(xroar_context->machine, "tape");
+		struct ser_handle *sh = ser_open_write();
+		tape_ser_write(ti, sh);
+		write_state_chunk(fd, &idx, ID_TAPE_STATE, sh);
+		ser_close(sh);
+	}
+	if (cart) {
+		// Prefixed with the cartridge name, so it can be checked
+		// against what's attached when loaded
+		struct ser_handle *sh = ser_open_write();
+		ser_write_string(sh, cart->config->name);
+		cart_ser_write(cart, sh);
+		write_state_chunk(fd, &idx, ID_CART_STATE, sh);
+		ser_close(sh);
+	}
+
 	// Finish up
+	fseek(fd, index_offset, SEEK_SET);
+	write_index(fd, &idx);
 	fclose(fd);
 	return 0;
 }
@@ -299,7 +416,7 @@ static const int old_arch_mapping[4] = {
 };
 
 static void old_set_registers(uint8_t *regs) {
-	struct MC6809 *cpu = xroar_machine->get_component(xroar_machine, "CPU0");
+	struct MC6809 *cpu = xroar_context->machine->get_component(xroar_context->machine, "CPU0");
 	cpu->reg_cc = regs[0];
 	MC6809_REG_A(cpu) = regs[1];
 	MC6809_REG_B(cpu) = regs[2];
@@ -338,7 +455,81 @@ static uint16_t *tfm_reg_ptr(struct HD6309 *hcpu, unsigned reg) {
 
 #define sex4(v) (((uint16_t)(v) & 0x07) - ((uint16_t)(v) & 0x08))
 
+// Read the rest of a state chunk into memory.  Returns a handle positioned
+// after the format version byte, or NULL if that version isn't understood.
+
+static struct ser_handle *read_state_chunk(FILE *fd, unsigned id, unsigned *size, uint8_t **buf) {
+	*buf = xmalloc(*size);
+	size_t nread = fread(*buf, 1, *size, fd);
+	*size = 0;
+	if (nread < 1 || (*buf)[0] != SNAPSHOT_STATE_VERSION) {
+		LOG_WARN("Snapshot: unsupported state in chunk id=%u\n", id);
+		free(*buf);
+		*buf = NULL;
+		return NULL;
+	}
+	return ser_open_read(*buf + 1, nread - 1);
+}
+
+static void close_state_chunk(struct ser_handle *sh, unsigned id, uint8_t *buf) {
+	if (ser_error(sh))
+		LOG_WARN("Snapshot: incomplete state in chunk id=%u\n", id);
+	ser_close(sh);
+	free(buf);
+}
+
+static void read_state(FILE *fd, unsigned id, long offset) {
+	if (fseek(fd, offset, SEEK_SET) != 0)
+		return;
+	if (fs_read_uint8(fd) != (int)id)
+		return;
+	unsigned size = fs_read_uint16(fd);
+	if (size == 0) size = 0x10000;
+	uint8_t *buf;
+	struct ser_handle *sh = read_state_chunk(fd, id, &size, &buf);
+	if (!sh)
+		return;
+	switch (id) {
+	case ID_MACHINE_STATE:
+		if (xroar_context->machine->ser_read)
+			xroar_context->machine->ser_read(xroar_context->machine, sh);
+		break;
+	case ID_SOUND_STATE:
+		sound_ser_read(xroar_context->machine->get_interface(xroar_context->machine, "sound"), sh);
+		break;
+	case ID_TAPE_STATE:
+		tape_ser_read(xroar_context->machine->get_interface(xroar_context->machine, "tape"), sh);
+		break;
+	case ID_CART_STATE:
+		{
+			struct cart *cart = xroar_context->machine->get_interface(xroar_context->machine, "cart");
+			char *name = ser_read_string(sh);
+			if (cart && name && strcmp(name, cart->config->name) == 0) {
+				cart_ser_read(cart, sh);
+			} else {
+				LOG_WARN("Snapshot: cartridge '%s' not attached, state not restored\n",
+					 name ? name : "");
+			}
+			free(name);
+		}
+		break;
+	default:
+		break;
+	}
+	close_state_chunk(sh, id, buf);
+}
+
+static int read_snapshot_file(const char *filename, _Bool state_only);
+
 int read_snapshot(const char *filename) {
+	return read_snapshot_file(filename, 0);
+}
+
+int read_snapshot_state(const char *filename) {
+	return read_snapshot_file(filename, 1);
+}
+
+static int read_snapshot_file(const char *filename, _Bool state_only) {
 	FILE *fd;
 	uint8_t buffer[17];
 	int section, tmp;
@@ -353,6 +544,11 @@ int read_snapshot(const char *filename) {
 		return -1;
 	}
 	if (strncmp((char *)buffer, "XRoar snapshot.\012\000", 17)) {
+		if (state_only) {
+			LOG_WARN("Snapshot: no hardware state in '%s'\n", filename);
+			fclose(fd);
+			return -1;
+		}
 		// Very old-style snapshot.  Register dump always came first.
 		// Also, it used to be written out as only taking 12 bytes.
 		if (buffer[0] != ID_REGISTER_DUMP || buffer[1] != 0
@@ -362,20 +558,63 @@ int read_snapshot(const char *filename) {
 			return -1;
 		}
 	}
-	// Default to Dragon 64 for old snapshots
-	struct machine_config *mc = machine_config_by_arch(ARCH_DRAGON64);
-	xroar_configure_machine(mc);
-	xroar_machine->reset(xroar_machine, RESET_HARD);
+	struct machine_config *mc = xroar_context->machine_config;
+	if (!state_only) {
+		// Default to Dragon 64 for old snapshots
+		mc = machine_config_by_arch(ARCH_DRAGON64);
+		xroar_configure_machine(mc);
+		xroar_context->machine->reset(xroar_context->machine, RESET_HARD);
+	}
 	// If old snapshot, buffer contains register dump
 	if (buffer[0] != 'X') {
 		old_set_registers(buffer + 3);
 	}
 	struct cart_config *cart_config = NULL;
+	// Offsets of state chunks, applied after everything else
+	long state_offset[4] = { 0, 0, 0, 0 };
 	while ((section = fs_read_uint8(fd)) >= 0) {
 		unsigned size = fs_read_uint16(fd);
 		if (size == 0) size = 0x10000;
 		LOG_DEBUG(2, "Snapshot read: chunk type %d, size %u\n", section, size);
+		if (state_only) {
+			// Configuration chunks are skipped
+			switch (section) {
+			case ID_ARCHITECTURE: case ID_KEYBOARD_MAP:
+			case ID_MACHINECONFIG: case ID_VDISK_FILE:
+			case ID_CART:
+				section = -1;
+				break;
+			default:
+				break;
+			}
+		}
 		switch (section) {
+			case -1:
+				break;
+
+			case ID_INDEX:
+				// Chunk index.  Only used to find state
+				// chunks, as everything else is read in order.
+				for (; size >= 5; size -= 5) {
+					unsigned id = fs_read_uint8(fd);
+					long offset = fs_read_uint31(fd);
+					if (id >= ID_MACHINE_STATE && id <= ID_CART_STATE && offset > 0)
+						state_offset[id - ID_MACHINE_STATE] = offset;
+				}
+				break;
+
+			case ID_MACHINE_STATE:
+			case ID_SOUND_STATE:
+			case ID_TAPE_STATE:
+			case ID_CART_STATE:
+				// Deferred until the cartridge is attached, as
+				// that resets it and may signal the CPU
+				if (!state_offset[section - ID_MACHINE_STATE])
+					state_offset[section - ID_MACHINE_STATE] = ftell(fd) - 3;
+				if (fseek(fd, size, SEEK_CUR) == 0)
+					size = 0;
+				break;
+
 			case ID_ARCHITECTURE:
 				// Deprecated: Machine architecture
 				if (size < 1) break;
@@ -383,7 +622,7 @@ int read_snapshot(const char *filename) {
 				tmp %= 4;
 				mc->architecture = old_arch_mapping[tmp];
 				xroar_configure_machine(mc);
-				xroar_machine->reset(xroar_machine, RESET_HARD);
+				xroar_context->machine->reset(xroar_context->machine, RESET_HARD);
 				size--;
 				break;
 			case ID_KEYBOARD_MAP:
@@ -404,7 +643,7 @@ int read_snapshot(const char *filename) {
 				{
 					// MC6809 state
 					if (size < 20) break;
-					struct MC6809 *cpu = xroar_machine->get_component(xroar_machine, "CPU0");
+					struct MC6809 *cpu = xroar_context->machine->get_component(xroar_context->machine, "CPU0");
 					if (cpu->variant != MC6809_VARIANT_MC6809) {
 						LOG_WARN("CPU mismatch - skipping MC6809 chunk\n");
 						break;
@@ -464,7 +703,7 @@ int read_snapshot(const char *filename) {
 				{
 					// HD6309 state
 					if (size < 27) break;
-					struct MC6809 *cpu = xroar_machine->get_component(xroar_machine, "CPU0");
+					struct MC6809 *cpu = xroar_context->machine->get_component(xroar_context->machine, "CPU0");
 					if (cpu->variant != MC6809_VARIANT_HD6309) {
 						LOG_WARN("CPU mismatch - skipping HD6309 chunk\n");
 						break;
@@ -537,12 +776,12 @@ int read_snapshot(const char *filename) {
 					size--;
 				}
 				xroar_configure_machine(mc);
-				xroar_machine->reset(xroar_machine, RESET_HARD);
+				xroar_context->machine->reset(xroar_context->machine, RESET_HARD);
 				break;
 
 			case ID_PIA_REGISTERS:
 				for (int i = 0; i < 2; i++) {
-					struct MC6821 *pia = xroar_machine->get_component(xroar_machine, pia_component_names[i]);
+					struct MC6821 *pia = xroar_context->machine->get_component(xroar_context->machine, pia_component_names[i]);
 					if (size < 3) break;
 					pia->a.direction_register = fs_read_uint8(fd);
 					pia->a.output_register = fs_read_uint8(fd);
@@ -559,7 +798,7 @@ int read_snapshot(const char *filename) {
 
 			case ID_RAM_PAGE0:
 				{
-					struct machine_memory *ram0 = xroar_machine->get_component(xroar_machine, "RAM0");
+					struct machine_memory *ram0 = xroar_context->machine->get_component(xroar_context->machine, "RAM0");
 					assert(ram0 != NULL);
 					ram0->size = (size < ram0->max_size) ? size : ram0->max_size;
 					size -= fread(ram0->data, 1, ram0->size, fd);
@@ -567,7 +806,7 @@ int read_snapshot(const char *filename) {
 				break;
 			case ID_RAM_PAGE1:
 				{
-					struct machine_memory *ram1 = xroar_machine->get_component(xroar_machine, "RAM1");
+					struct machine_memory *ram1 = xroar_context->machine->get_component(xroar_context->machine, "RAM1");
 					assert(ram1 != NULL);
 					ram1->size = (size < ram1->max_size) ? size : ram1->max_size;
 					size -= fread(ram1->data, 1, ram1->size, fd);
@@ -579,7 +818,7 @@ int read_snapshot(const char *filename) {
 				tmp = fs_read_uint16(fd);
 				size -= 2;
 				{
-					struct MC6883 *sam = xroar_machine->get_component(xroar_machine, "SAM0");
+					struct MC6883 *sam = xroar_context->machine->get_component(xroar_context->machine, "SAM0");
 					sam_set_register(sam, tmp);
 				}
 				break;
@@ -605,12 +844,12 @@ int read_snapshot(const char *filename) {
 					int drive;
 					size--;
 					drive = fs_read_uint8(fd);
-					vdrive_eject_disk(xroar_vdrive_interface, drive);
+					vdrive_eject_disk(xroar_context->vdrive_interface, drive);
 					if (size > 0) {
 						char *name = malloc(size);
 						if (name != NULL) {
 							size -= fread(name, 1, size, fd);
-							vdrive_insert_disk(xroar_vdrive_interface, drive, vdisk_load(name));
+							vdrive_insert_disk(xroar_context->vdrive_interface, drive, vdisk_load(name));
 						}
 					}
 				}
@@ -661,17 +900,293 @@ int read_snapshot(const char *filename) {
 				break;
 		}
 		if (size > 0) {
-			LOG_WARN("Skipping extra bytes in snapshot chunk id=%d.\n", (int)section);
+			if (section >= 0)
+				LOG_WARN("Skipping extra bytes in snapshot chunk id=%d.\n", (int)section);
 			for (; size; size--)
 				(void)fs_read_uint8(fd);
 		}
 	}
-	fclose(fd);
+	if (state_only && !state_offset[0]) {
+		LOG_WARN("Snapshot: no hardware state in '%s'\n", filename);
+		fclose(fd);
+		return -1;
+	}
 	if (cart_config) {
 		// XXX really we need something to update the UI here, the
 		// embedded cart config may have changed description.  more
 		// importantly, the UI won't know about the id.
 		xroar_set_cart(1, cart_config->name);
 	}
+	for (unsigned i = 0; i < 4; i++) {
+		if (state_offset[i])
+			read_state(fd, ID_MACHINE_STATE + i, state_offset[i]);
+	}
+	fclose(fd);
 	return 0;
 }
+
+/**************************************************************************/
+
+// In-memory snapshots.  The state of the machine and its peripherals is
+// gathered into one "raw" block: machine state, then sound, tape and any
+// cartridge, each aligned.  A snapshot holds either the raw block, or a delta
+// against a full snapshot of the same size.
+//
+// A delta is the raw block XORed with the base's raw block, run-length
+// encoded as a sequence of pairs: a count of zero (unchanged) bytes, then a
+// count of literal bytes followed by those bytes.  Counts are written as
+// LEB128 varints.  Between frames, most of RAM and nearly all peripheral
+// state is unchanged, so deltas are usually very small.
+
+#define MEM_SNAPSHOT_MAGIC (0x58536e70)  // "XSnp"
+#define MEM_SNAPSHOT_F_DELTA (1 << 0)
+
+// Shortest run of unchanged bytes worth ending a literal span for
+#define MIN_ZERO_RUN (4)
+
+struct mem_snapshot_header {
+	uint32_t magic;
+	uint32_t flags;
+	size_t raw_size;
+	size_t data_size;
+	size_t cart_size;
+};
+
+#define MEM_SNAPSHOT_HEADER_SIZE STATE_ALIGN(sizeof(struct mem_snapshot_header))
+
+static struct cart *mem_snapshot_cart(struct machine *m) {
+	struct cart *c = m->get_interface ? m->get_interface(m, "cart") : NULL;
+	if (c && c->state_size && c->state_save && c->state_restore)
+		return c;
+	return NULL;
+}
+
+static size_t raw_state_size(struct machine *m, size_t *cart_size) {
+	struct cart *c = mem_snapshot_cart(m);
+	*cart_size = c ? c->state_size(c) : 0;
+	return STATE_ALIGN(m->state_size(m)) + STATE_ALIGN(sound_state_size())
+	       + STATE_ALIGN(tape_state_size()) + STATE_ALIGN(*cart_size);
+}
+
+static void raw_state_save(struct machine *m, uint8_t *p) {
+	struct sound_interface *snd = m->get_interface(m, "sound");
+	struct tape_interface *ti = m->get_interface(m, "tape");
+	struct cart *c = mem_snapshot_cart(m);
+	m->state_save(m, p);
+	p += STATE_ALIGN(m->state_size(m));
+	sound_state_save(snd, p);
+	p += STATE_ALIGN(sound_state_size());
+	tape_state_save(ti, p);
+	p += STATE_ALIGN(tape_state_size());
+	if (c)
+		c->state_save(c, p);
+}
+
+static void raw_state_restore(struct machine *m, uint8_t const *p, size_t cart_size) {
+	struct sound_interface *snd = m->get_interface(m, "sound");
+	struct tape_interface *ti = m->get_interface(m, "tape");
+	struct cart *c = mem_snapshot_cart(m);
+	m->state_restore(m, p);
+	p += STATE_ALIGN(m->state_size(m));
+	sound_state_restore(snd, p);
+	p += STATE_ALIGN(sound_state_size());
+	tape_state_restore(ti, p);
+	p += STATE_ALIGN(tape_state_size());
+	// Cartridge state is only applied if the same sort of cartridge
+	// appears to be attached.
+	if (c && cart_size && c->state_size(c) == cart_size)
+		c->state_restore(c, p);
+}
+
+static _Bool is_full_snapshot(void const *base, size_t raw_size) {
+	struct mem_snapshot_header const *bh = base;
+	return bh && bh->magic == MEM_SNAPSHOT_MAGIC
+	       && !(bh->flags & MEM_SNAPSHOT_F_DELTA) && bh->raw_size == raw_size;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Delta encoding helpers.  The encoder returns 0 if the output would not fit.
+
+static uint8_t *put_varint(uint8_t *p, uint8_t *end, size_t v) {
+	do {
+		if (p >= end)
+			return NULL;
+		uint8_t b = v & 0x7f;
+		v >>= 7;
+		*(p++) = b | (v ? 0x80 : 0);
+	} while (v);
+	return p;
+}
+
+static uint8_t const *get_varint(uint8_t const *p, uint8_t const *end, size_t *v) {
+	size_t r = 0;
+	for (unsigned shift = 0; p < end && shift < sizeof(size_t) * 8; shift += 7) {
+		uint8_t b = *(p++);
+		r |= (size_t)(b & 0x7f) << shift;
+		if (!(b & 0x80)) {
+			*v = r;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+// Count matching bytes from position i, a word at a time where possible.
+
+static size_t match_length(uint8_t const *a, uint8_t const *b, size_t i, size_t n) {
+	size_t start = i;
+	while (i + sizeof(uint64_t) <= n) {
+		uint64_t wa, wb;
+		memcpy(&wa, a + i, sizeof(wa));
+		memcpy(&wb, b + i, sizeof(wb));
+		if (wa != wb)
+			break;
+		i += sizeof(uint64_t);
+	}
+	while (i < n && a[i] == b[i])
+		i++;
+	return i - start;
+}
+
+static size_t delta_encode(uint8_t const *raw, uint8_t const *base, size_t n,
+			   uint8_t *out, size_t out_size) {
+	uint8_t *p = out;
+	uint8_t *end = out + out_size;
+	size_t i = 0;
+	while (i < n) {
+		size_t zrun = match_length(raw, base, i, n);
+		i += zrun;
+		// Literal span extends until the next worthwhile run of
+		// unchanged bytes, or the end.
+		size_t lstart = i;
+		while (i < n) {
+			if (raw[i] == base[i]) {
+				size_t m = match_length(raw, base, i, n);
+				if (m >= MIN_ZERO_RUN || i + m == n)
+					break;
+				i += m;
+			} else {
+				i++;
+			}
+		}
+		size_t nlit = i - lstart;
+		if (!(p = put_varint(p, end, zrun)))
+			return 0;
+		if (!(p = put_varint(p, end, nlit)))
+			return 0;
+		if ((size_t)(end - p) < nlit)
+			return 0;
+		for (size_t j = lstart; j < i; j++)
+			*(p++) = raw[j] ^ base[j];
+	}
+	return p - out;
+}
+
+static _Bool delta_decode(uint8_t const *in, size_t in_size, uint8_t const *base,
+			  uint8_t *raw, size_t n) {
+	uint8_t const *p = in;
+	uint8_t const *end = in + in_size;
+	size_t i = 0;
+	while (p < end) {
+		size_t zrun, nlit;
+		if (!(p = get_varint(p, end, &zrun)) || zrun > n - i)
+			return 0;
+		memcpy(raw + i, base + i, zrun);
+		i += zrun;
+		if (!(p = get_varint(p, end, &nlit)) || nlit > n - i
+		    || nlit > (size_t)(end - p))
+			return 0;
+		for (size_t j = 0; j < nlit; j++, i++)
+			raw[i] = base[i] ^ *(p++);
+	}
+	return i == n;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+size_t snapshot_mem_size(struct machine *m) {
+	if (!m->state_size)
+		return 0;
+	size_t cart_size;
+	return MEM_SNAPSHOT_HEADER_SIZE + raw_state_size(m, &cart_size);
+}
+
+size_t snapshot_mem_save(struct machine *m, void *buf, size_t size, void const *base, void *work) {
+	if (!m->state_size || !m->state_save)
+		return 0;
+	size_t cart_size;
+	size_t raw_size = raw_state_size(m, &cart_size);
+	if (size < MEM_SNAPSHOT_HEADER_SIZE)
+		return 0;
+	struct mem_snapshot_header *h = buf;
+	uint8_t *data = (uint8_t *)buf + MEM_SNAPSHOT_HEADER_SIZE;
+	size_t avail = size - MEM_SNAPSHOT_HEADER_SIZE;
+	*h = (struct mem_snapshot_header){
+		.magic = MEM_SNAPSHOT_MAGIC,
+		.raw_size = raw_size,
+		.cart_size = cart_size,
+	};
+
+	if (work && is_full_snapshot(base, raw_size)) {
+		uint8_t *raw = work;
+		raw_state_save(m, raw);
+		uint8_t const *base_raw = (uint8_t const *)base + MEM_SNAPSHOT_HEADER_SIZE;
+		// Never bother with a delta bigger than the full state
+		size_t limit = avail < raw_size ? avail : raw_size;
+		size_t dsize = delta_encode(raw, base_raw, raw_size, data, limit);
+		if (dsize > 0) {
+			h->flags = MEM_SNAPSHOT_F_DELTA;
+			h->data_size = dsize;
+			return MEM_SNAPSHOT_HEADER_SIZE + dsize;
+		}
+		if (avail < raw_size)
+			return 0;
+		memcpy(data, raw, raw_size);
+	} else {
+		if (avail < raw_size)
+			return 0;
+		raw_state_save(m, data);
+	}
+	h->data_size = raw_size;
+	return MEM_SNAPSHOT_HEADER_SIZE + raw_size;
+}
+
+_Bool snapshot_mem_restore(struct machine *m, void const *buf, size_t size, void const *base, void *work) {
+	if (!m->state_size || !m->state_restore)
+		return 0;
+	struct mem_snapshot_header const *h = buf;
+	if (size < MEM_SNAPSHOT_HEADER_SIZE || h->magic != MEM_SNAPSHOT_MAGIC
+	    || h->data_size > size - MEM_SNAPSHOT_HEADER_SIZE) {
+		LOG_WARN("Snapshot: invalid in-memory snapshot\n");
+		return 0;
+	}
+	// Machine state size depends only on the machine type, so a size
+	// mismatch here (allowing for cartridge state) means a different
+	// machine.
+	size_t cart_size;
+	size_t raw_size = raw_state_size(m, &cart_size);
+	if (h->raw_size - STATE_ALIGN(h->cart_size) != raw_size - STATE_ALIGN(cart_size)) {
+		LOG_WARN("Snapshot: in-memory snapshot is for a different machine\n");
+		return 0;
+	}
+	uint8_t const *data = (uint8_t const *)buf + MEM_SNAPSHOT_HEADER_SIZE;
+	if (!(h->flags & MEM_SNAPSHOT_F_DELTA)) {
+		if (h->data_size != h->raw_size)
+			return 0;
+		raw_state_restore(m, data, h->cart_size);
+		return 1;
+	}
+	if (!work || !is_full_snapshot(base, h->raw_size)) {
+		LOG_WARN("Snapshot: delta snapshot needs matching base\n");
+		return 0;
+	}
+	uint8_t *raw = work;
+	uint8_t const *base_raw = (uint8_t const *)base + MEM_SNAPSHOT_HEADER_SIZE;
+	if (!delta_decode(data, h->data_size, base_raw, raw, h->raw_size)) {
+		LOG_WARN("Snapshot: corrupt delta snapshot\n");
+		return 0;
+	}
+	raw_state_restore(m, raw, h->cart_size);
+	return 1;
+}
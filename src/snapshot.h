@@ -18,7 +18,40 @@ See COPYING.GPL for redistribution conditions.
 #ifndef XROAR_SNAPSHOT_H_
 #define XROAR_SNAPSHOT_H_
 
+#include <stddef.h>
+
+struct machine;
+
 int write_snapshot(const char *filename);
 int read_snapshot(const char *filename);
 
+/* Read only RAM and hardware state from a snapshot, into the machine as
+ * currently configured.  Machine and cartridge configuration and disk
+ * filenames are ignored.  Fails unless the snapshot includes full hardware
+ * state (v1.9 or later). */
+
+int read_snapshot_state(const char *filename);
+
+/* In-memory snapshots, for quick save and restore of the running machine.
+ * Includes machine, sound, tape position and cartridge state, but not disk
+ * contents or tape output.
+ *
+ * snapshot_mem_size() returns the buffer size needed to hold a full
+ * snapshot.
+ *
+ * snapshot_mem_save() writes a snapshot into buf and returns the number of
+ * bytes used, or 0 if it would not fit.  If base is a full snapshot of the
+ * same machine, a delta against it is written instead where that is smaller.
+ *
+ * snapshot_mem_restore() restores from a snapshot.  A delta snapshot needs
+ * the same base it was written against.  Returns false on failure, leaving
+ * the machine untouched.
+ *
+ * Working with deltas needs scratch space (work) at least as large as the
+ * base snapshot.  It is unused, and may be NULL, without a base. */
+
+size_t snapshot_mem_size(struct machine *m);
+size_t snapshot_mem_save(struct machine *m, void *buf, size_t size, void const *base, void *work);
+_Bool snapshot_mem_restore(struct machine *m, void const *buf, size_t size, void const *base, void *work);
+
 #endif
@@ -32,9 +32,12 @@ Dragon/CoCo-specific means to write to it.
 #include "xalloc.h"
 
 #include "events.h"
+#include "frameskip.h"
 #include "logging.h"
 #include "module.h"
+#include "serialise.h"
 #include "sound.h"
+#include "stats.h"
 #include "tape.h"
 #include "xroar.h"
 
@@ -68,7 +71,7 @@ struct sound_interface_private {
 	float tape_level;
 
 	// Audio circuit state
-	struct {
+	struct sound_circuit {
 		// Single-bit sound
 		_Bool sbs_enabled;
 		_Bool sbs_level;
@@ -225,10 +228,11 @@ struct sound_interface *sound_interface_new(void *buf, enum sound_fmt fmt, unsig
 		}
 	}
 
-	snd->last_cycle = event_current_tick;
+	snd->last_cycle = xroar_context->current_tick;
 
 	event_init(&snd->flush_event, DELEGATE_AS0(void, flush_buffer, snd));
-	snd->flush_event.at_tick = event_current_tick;
+	STATS_EVENT_TYPE(&snd->flush_event, STATS_EVENT_SOUND);
+	snd->flush_event.at_tick = xroar_context->current_tick;
 	// process zero frames, but set up buffer flusher:
 	flush_buffer(snd);
 
@@ -285,7 +289,11 @@ static void send_buffer(struct sound_interface_private *snd) {
 			break;
 		}
 	}
+	STATS_ENTER(STATS_AO_WRITE);
+	frameskip_audio_enter();
 	snd->output_buffer = DELEGATE_CALL1(snd->public.write_buffer, snd->output_buffer);
+	frameskip_audio_leave();
+	STATS_LEAVE();
 	snd->buffer_frame = 0;
 }
 
@@ -293,16 +301,17 @@ static void send_buffer(struct sound_interface_private *snd) {
 
 void sound_update(struct sound_interface *sndp) {
 	struct sound_interface_private *snd = (struct sound_interface_private *)sndp;
+	STATS_ENTER(STATS_SOUND_UPDATE);
 
 	unsigned nframes = 0;
-	int64_t elapsed = event_tick_delta(event_current_tick, snd->last_cycle);
+	int64_t elapsed = event_tick_delta(xroar_context->current_tick, snd->last_cycle);
 	if (elapsed > 0) {
 		int64_t fe = snd->frameerror + elapsed * sndp->framerate;
 		nframes = fe / EVENT_TICK_RATE;
 		fe -= nframes * EVENT_TICK_RATE;
 		snd->frameerror = fe;
 	}
-	snd->last_cycle = event_current_tick;
+	snd->last_cycle = xroar_context->current_tick;
 
 	// TODO: add a flag to the delegates to indicate whether result is
 	// used.  may save some calls to sample-rate conversion / low-pass
@@ -318,9 +327,9 @@ void sound_update(struct sound_interface *sndp) {
 	// only use one of them.
 	if (DELEGATE_DEFINED(sndp->get_tape_audio)) {
 		if (mux_source == SOURCE_TAPE && sndp->ratelimit) {
-			snd->mux_input_raw[SOURCE_TAPE] = DELEGATE_CALL3(sndp->get_tape_audio, event_current_tick, nframes, snd->mux_input[SOURCE_TAPE]);
+			snd->mux_input_raw[SOURCE_TAPE] = DELEGATE_CALL3(sndp->get_tape_audio, xroar_context->current_tick, nframes, snd->mux_input[SOURCE_TAPE]);
 		} else {
-			snd->mux_input_raw[SOURCE_TAPE] = DELEGATE_CALL3(sndp->get_tape_audio, event_current_tick, nframes, NULL);
+			snd->mux_input_raw[SOURCE_TAPE] = DELEGATE_CALL3(sndp->get_tape_audio, xroar_context->current_tick, nframes, NULL);
 			if (mux_source == SOURCE_TAPE) {
 				mux_source = SOURCE_NONE;
 			}
@@ -336,9 +345,9 @@ void sound_update(struct sound_interface *sndp) {
 
 	if (DELEGATE_DEFINED(sndp->get_cart_audio)) {
 		if (mux_source == SOURCE_CART && sndp->ratelimit) {
-			snd->mux_input_raw[SOURCE_CART] = DELEGATE_CALL3(sndp->get_cart_audio, event_current_tick, nframes, snd->mux_input[SOURCE_CART]);
+			snd->mux_input_raw[SOURCE_CART] = DELEGATE_CALL3(sndp->get_cart_audio, xroar_context->current_tick, nframes, snd->mux_input[SOURCE_CART]);
 		} else {
-			snd->mux_input_raw[SOURCE_CART] = DELEGATE_CALL3(sndp->get_cart_audio, event_current_tick, nframes, NULL);
+			snd->mux_input_raw[SOURCE_CART] = DELEGATE_CALL3(sndp->get_cart_audio, xroar_context->current_tick, nframes, NULL);
 			if (mux_source == SOURCE_CART) {
 				mux_source = SOURCE_NONE;
 			}
@@ -418,8 +427,106 @@ void sound_update(struct sound_interface *sndp) {
 	float bus_level = (mux_output_raw * snd->mux_gain) + snd->bus_offset;
 	DELEGATE_SAFE_CALL1(snd->public.sbs_feedback, snd->current.sbs_enabled || bus_level >= 1.414);
 
+	STATS_LEAVE();
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Only the state of the emulated audio circuit is saved.  Output buffering
+// carries on regardless, so restoring never causes a gap or repeat.
+
+struct sound_state {
+	float dac_level;
+	float tape_level;
+	struct sound_circuit current, next;
+	float mux_input_raw[4];
+	float mux_gain;
+	float bus_offset;
+};
+
+size_t sound_state_size(void) {
+	return sizeof(struct sound_state);
+}
+
+void sound_state_save(struct sound_interface *sndp, void *buf) {
+	struct sound_interface_private *snd = (struct sound_interface_private *)sndp;
+	struct sound_state *st = buf;
+	st->dac_level = snd->dac_level;
+	st->tape_level = snd->tape_level;
+	st->current = snd->current;
+	st->next = snd->next;
+	for (unsigned i = 0; i < 4; i++) {
+		st->mux_input_raw[i] = snd->mux_input_raw[i];
+	}
+	st->mux_gain = snd->mux_gain;
+	st->bus_offset = snd->bus_offset;
+}
+
+void sound_state_restore(struct sound_interface *sndp, void const *buf) {
+	struct sound_interface_private *snd = (struct sound_interface_private *)sndp;
+	struct sound_state const *st = buf;
+	// Output up to now with the old state
+	sound_update(sndp);
+	snd->dac_level = st->dac_level;
+	snd->tape_level = st->tape_level;
+	snd->current = st->current;
+	snd->next = st->next;
+	for (unsigned i = 0; i < 4; i++) {
+		snd->mux_input_raw[i] = st->mux_input_raw[i];
+	}
+	snd->mux_gain = st->mux_gain;
+	snd->bus_offset = st->bus_offset;
+}
+
+// Portable state for snapshot files.  The same fields as above.
+
+static void ser_write_circuit(struct ser_handle *sh, struct sound_circuit const *sc) {
+	ser_write_bool(sh, sc->sbs_enabled);
+	ser_write_bool(sh, sc->sbs_level);
+	ser_write_bool(sh, sc->mux_enabled);
+	ser_write_uint8(sh, sc->mux_source);
+	ser_write_float(sh, sc->external[0]);
+	ser_write_float(sh, sc->external[1]);
+}
+
+static void ser_read_circuit(struct ser_handle *sh, struct sound_circuit *sc) {
+	sc->sbs_enabled = ser_read_bool(sh);
+	sc->sbs_level = ser_read_bool(sh);
+	sc->mux_enabled = ser_read_bool(sh);
+	sc->mux_source = ser_read_uint8(sh) & 3;
+	sc->external[0] = ser_read_float(sh);
+	sc->external[1] = ser_read_float(sh);
+}
+
+void sound_ser_write(struct sound_interface *sndp, struct ser_handle *sh) {
+	struct sound_interface_private *snd = (struct sound_interface_private *)sndp;
+	ser_write_float(sh, snd->dac_level);
+	ser_write_float(sh, snd->tape_level);
+	ser_write_circuit(sh, &snd->current);
+	ser_write_circuit(sh, &snd->next);
+	for (unsigned i = 0; i < 4; i++) {
+		ser_write_float(sh, snd->mux_input_raw[i]);
+	}
+	ser_write_float(sh, snd->mux_gain);
+	ser_write_float(sh, snd->bus_offset);
+}
+
+void sound_ser_read(struct sound_interface *sndp, struct ser_handle *sh) {
+	struct sound_interface_private *snd = (struct sound_interface_private *)sndp;
+	sound_update(sndp);
+	snd->dac_level = ser_read_float(sh);
+	snd->tape_level = ser_read_float(sh);
+	ser_read_circuit(sh, &snd->current);
+	ser_read_circuit(sh, &snd->next);
+	for (unsigned i = 0; i < 4; i++) {
+		snd->mux_input_raw[i] = ser_read_float(sh);
+	}
+	snd->mux_gain = ser_read_float(sh);
+	snd->bus_offset = ser_read_float(sh);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 // Rate limit control
 void sound_set_ratelimit(struct sound_interface *sndp, _Bool ratelimit) {
 	sndp->ratelimit = ratelimit;
@@ -511,5 +618,5 @@ static void flush_buffer(void *sptr) {
 	fe -= nticks * sndp->framerate;
 	snd->buferror = fe;
 	snd->flush_event.at_tick = snd->last_cycle + nticks;
-	event_queue(&MACHINE_EVENT_LIST, &snd->flush_event);
+	event_queue(&xroar_context->machine_events, &snd->flush_event);
 }
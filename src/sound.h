@@ -21,6 +21,8 @@ Dragon/CoCo-specific means to write to it.
 #ifndef XROAR_SOUND_H_
 #define XROAR_SOUND_H_
 
+#include <stddef.h>
+
 #include "delegate.h"
 
 enum sound_fmt {
@@ -56,6 +58,15 @@ void sound_update(struct sound_interface *sndp);
 // Rate limit control
 void sound_set_ratelimit(struct sound_interface *sndp, _Bool ratelimit);
 
+// In-memory state of the audio circuit, for snapshots.
+size_t sound_state_size(void);
+void sound_state_save(struct sound_interface *sndp, void *buf);
+void sound_state_restore(struct sound_interface *sndp, void const *buf);
+// Portable state, for snapshot files.
+struct ser_handle;
+void sound_ser_write(struct sound_interface *sndp, struct ser_handle *sh);
+void sound_ser_read(struct sound_interface *sndp, struct ser_handle *sh);
+
 // Dragon/CoCo-specific manipulation
 void sound_set_sbs(struct sound_interface *sndp, _Bool enabled, _Bool level);
 void sound_set_mux_enabled(struct sound_interface *sndp, _Bool enabled);
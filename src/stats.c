@@ -0,0 +1,237 @@
+/*
+
+Performance statistics
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+
+#include "pl-thread.h"
+
+#include "events.h"
+#include "hosttime.h"
+#include "logging.h"
+#include "stats.h"
+
+#define STATS_MAX_DEPTH (16)
+
+static const char * const stats_name[STATS_NUM_IDS] = {
+	[STATS_OTHER] = "other",
+	[STATS_CPU] = "cpu",
+	[STATS_VDG_RENDER] = "vdg render",
+	[STATS_VO_RENDER] = "vo render",
+	[STATS_VO_VSYNC] = "vo vsync",
+	[STATS_SOUND_UPDATE] = "sound update",
+	[STATS_AO_WRITE] = "audio write",
+	[STATS_EVENT_OTHER] = "event: other",
+	[STATS_EVENT_VDG] = "event: vdg",
+	[STATS_EVENT_SOUND] = "event: sound",
+	[STATS_EVENT_TAPE] = "event: tape",
+	[STATS_EVENT_FDC] = "event: fdc",
+	[STATS_EVENT_PIA] = "event: pia",
+	[STATS_EVENT_PRINTER] = "event: printer",
+};
+
+struct stats_counters {
+	uint64_t count[STATS_NUM_IDS];
+	uint64_t time_ns[STATS_NUM_IDS];
+	// Total CPU cycles in complete frames
+	uint64_t frame_cycles;
+	uint64_t emulated_ticks;
+	uint64_t wall_ns;
+};
+
+struct stats_thread {
+	struct stats_counters total;
+	// Copy of the totals when the last periodic report was printed
+	struct stats_counters last;
+
+	// Stack of nested timed sections
+	enum stats_id stack[STATS_MAX_DEPTH];
+	unsigned depth;
+	unsigned overflow;
+	uint64_t last_ns;
+
+	// Cycles per frame
+	uint64_t frame_start;
+	uint64_t frame_min, frame_max;
+	uint64_t total_frame_min, total_frame_max;
+
+	// Latest automatic frameskip
+	unsigned frameskip_auto;
+};
+
+static THREAD_LOCAL struct stats_thread st;
+
+static _Bool report_at_exit = 0;
+static uint64_t report_interval_ns = 0;
+static uint64_t start_ns;
+static uint64_t next_report_ns;
+
+// Charge time since the last transition to the current section.
+
+static void charge(void) {
+	uint64_t now = hosttime_ns();
+	if (st.last_ns != 0)
+		st.total.time_ns[st.stack[st.depth]] += now - st.last_ns;
+	st.last_ns = now;
+}
+
+void stats_init(_Bool at_exit, int interval_s) {
+	report_at_exit = at_exit;
+	report_interval_ns = (interval_s > 0) ? (uint64_t)interval_s * 1000000000 : 0;
+
+	start_ns = hosttime_ns();
+	next_report_ns = start_ns + report_interval_ns;
+	st.last_ns = start_ns;
+}
+
+void stats_enter(enum stats_id id) {
+	st.total.count[id]++;
+	charge();
+	if (st.overflow || st.depth >= STATS_MAX_DEPTH - 1) {
+		st.overflow++;
+		return;
+	}
+	st.stack[++st.depth] = id;
+}
+
+void stats_leave(void) {
+	charge();
+	if (st.overflow) {
+		st.overflow--;
+		return;
+	}
+	if (st.depth > 0)
+		st.depth--;
+}
+
+void stats_add(enum stats_id id, unsigned n) {
+	st.total.count[id] += n;
+}
+
+
+
+void stats_frame(void) {
+	uint64_t ncycles = st.total.count[STATS_MEM_CYCLE] - st.frame_start;
+	_Bool first = (st.frame_start == 0);
+	st.frame_start = st.total.count[STATS_MEM_CYCLE];
+	// The first frame seen is incomplete, so is not counted.
+	if (first)
+		return;
+	st.total.count[STATS_FRAME]++;
+	st.total.frame_cycles += ncycles;
+	if (st.frame_min == 0 || ncycles < st.frame_min)
+		st.frame_min = ncycles;
+	if (ncycles > st.frame_max)
+		st.frame_max = ncycles;
+	if (st.total_frame_min == 0 || ncycles < st.total_frame_min)
+		st.total_frame_min = ncycles;
+	if (ncycles > st.total_frame_max)
+		st.total_frame_max = ncycles;
+}
+
+void stats_emulated(unsigned ticks) {
+	st.total.emulated_ticks += ticks;
+}
+
+void stats_frameskip_auto(unsigned skip) {
+	st.total.count[STATS_FRAMESKIP_AUTO]++;
+	st.total.count[STATS_FRAMESKIP_AUTO_SUM] += skip;
+	st.frameskip_auto = skip;
+}
+
+static void report(const char *title, struct stats_counters *cur,
+		   struct stats_counters *prev, uint64_t fmin, uint64_t fmax) {
+	struct stats_counters d;
+	for (int i = 0; i < STATS_NUM_IDS; i++) {
+		d.count[i] = cur->count[i] - prev->count[i];
+		d.time_ns[i] = cur->time_ns[i] - prev->time_ns[i];
+	}
+	d.frame_cycles = cur->frame_cycles - prev->frame_cycles;
+	d.emulated_ticks = cur->emulated_ticks - prev->emulated_ticks;
+	d.wall_ns = cur->wall_ns - prev->wall_ns;
+
+	double wall_s = (double)d.wall_ns / 1e9;
+	double emulated_s = (double)d.emulated_ticks / EVENT_TICK_RATE;
+	uint64_t nframes = d.count[STATS_FRAME];
+
+	LOG_PRINT("Stats (%s): %.2fs wall, %.2fs emulated (%.1f%% speed)\n",
+		  title, wall_s, emulated_s,
+		  (wall_s > 0.) ? 100. * emulated_s / wall_s : 0.);
+	if (nframes > 0) {
+		LOG_PRINT("\t%llu frames (%.1f/s), %llu cycles/frame (min %llu, max %llu)\n",
+			  (unsigned long long)nframes,
+			  (wall_s > 0.) ? nframes / wall_s : 0.,
+			  (unsigned long long)(d.frame_cycles / nframes),
+			  (unsigned long long)fmin, (unsigned long long)fmax);
+		LOG_PRINT("\t%llu frames skipped (%.1f%%)\n",
+			  (unsigned long long)d.count[STATS_FRAME_SKIPPED],
+			  100. * d.count[STATS_FRAME_SKIPPED] / nframes);
+	}
+	if (d.count[STATS_FRAMESKIP_AUTO] > 0) {
+		LOG_PRINT("\tautomatic frameskip %u, average %.2f\n",
+			  st.frameskip_auto,
+			  (double)d.count[STATS_FRAMESKIP_AUTO_SUM] / d.count[STATS_FRAMESKIP_AUTO]);
+	}
+	if (d.count[STATS_MEM_CYCLE] > 0) {
+		LOG_PRINT("\t%llu CPU cycles, %.1f ns/cycle\n",
+			  (unsigned long long)d.count[STATS_MEM_CYCLE],
+			  (double)d.time_ns[STATS_CPU] / d.count[STATS_MEM_CYCLE]);
+	}
+	LOG_PRINT("\t%llu audio underruns\n", (unsigned long long)d.count[STATS_AO_UNDERRUN]);
+	if (d.count[STATS_VO_LINE_DIRTY] > 0 || d.count[STATS_VO_LINE_CLEAN] > 0) {
+		LOG_PRINT("\t%llu lines rendered, %llu unchanged\n",
+			  (unsigned long long)d.count[STATS_VO_LINE_DIRTY],
+			  (unsigned long long)d.count[STATS_VO_LINE_CLEAN]);
+	}
+	LOG_PRINT("\t%-16s %12s %10s %6s %8s\n", "section", "calls", "ms", "host%", "ns/call");
+	for (int i = 0; i < STATS_MEM_CYCLE; i++) {
+		if (d.count[i] == 0 && d.time_ns[i] == 0)
+			continue;
+		LOG_PRINT("\t%-16s %12llu %10.1f %6.1f", stats_name[i],
+			  (unsigned long long)d.count[i], d.time_ns[i] / 1e6,
+			  (d.wall_ns > 0) ? 100. * d.time_ns[i] / d.wall_ns : 0.);
+		if (d.count[i] > 0)
+			LOG_PRINT(" %8.1f", (double)d.time_ns[i] / d.count[i]);
+		LOG_PRINT("\n");
+	}
+}
+
+void stats_poll(void) {
+	if (!report_interval_ns)
+		return;
+	uint64_t now = hosttime_ns();
+	if (now < next_report_ns)
+		return;
+	next_report_ns = now + report_interval_ns;
+	charge();
+	st.total.wall_ns = now - start_ns;
+	report("interval", &st.total, &st.last, st.frame_min, st.frame_max);
+	st.last = st.total;
+	st.frame_min = st.frame_max = 0;
+}
+
+void stats_shutdown(void) {
+	if (!report_at_exit)
+		return;
+	charge();
+	st.total.wall_ns = hosttime_ns() - start_ns;
+	struct stats_counters zero = {0};
+	report("total", &st.total, &zero, st.total_frame_min, st.total_frame_max);
+}
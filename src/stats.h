@@ -0,0 +1,107 @@
+/*
+
+Performance statistics
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifndef XROAR_STATS_H_
+#define XROAR_STATS_H_
+
+/* Host time and call counts per subsystem, only compiled in if configured
+ * with --enable-stats.  Otherwise the STATS_* macros expand to nothing.
+ *
+ * Timed sections nest: time is charged to the innermost section, so an event
+ * handler dispatched from within a CPU memory cycle is not also counted
+ * against the CPU.  Counters are per-thread and only cover the thread that
+ * runs the emulation. */
+
+enum stats_id {
+	// Time outside any other section: UI, idle waits, etc.
+	STATS_OTHER = 0,
+	// Timed sections
+	STATS_CPU,
+	STATS_VDG_RENDER,
+	STATS_VO_RENDER,
+	STATS_VO_VSYNC,
+	STATS_SOUND_UPDATE,
+	STATS_AO_WRITE,
+	// Event handlers, by type
+	STATS_EVENT_OTHER,
+	STATS_EVENT_VDG,
+	STATS_EVENT_SOUND,
+	STATS_EVENT_TAPE,
+	STATS_EVENT_FDC,
+	STATS_EVENT_PIA,
+	STATS_EVENT_PRINTER,
+	// Counters only.  Memory cycles are far too frequent to time: reading
+	// the clock would take as long as the cycle itself.  Their host time
+	// is included in STATS_CPU.
+	STATS_MEM_CYCLE,
+	STATS_FRAME,
+	STATS_AO_UNDERRUN,
+	// Emulated frames not presented
+	STATS_FRAME_SKIPPED,
+	// Frames under automatic frameskip control, and the sum of the
+	// frameskip chosen for each.
+	STATS_FRAMESKIP_AUTO,
+	STATS_FRAMESKIP_AUTO_SUM,
+	// Rows of the video window rendered, or skipped as unchanged.
+	STATS_VO_LINE_DIRTY,
+	STATS_VO_LINE_CLEAN,
+	STATS_NUM_IDS
+};
+
+#ifdef WANT_STATS
+
+void stats_init(_Bool at_exit, int interval_s);
+void stats_shutdown(void);
+
+// Called regularly from the main loop: prints a report if one is due.
+void stats_poll(void);
+
+void stats_enter(enum stats_id id);
+void stats_leave(void);
+void stats_add(enum stats_id id, unsigned n);
+
+// Call once per emulated video frame.  Cycles per frame are derived from the
+// count of STATS_MEM_CYCLE.
+void stats_frame(void);
+
+// Account for emulated time that has passed.
+void stats_emulated(unsigned ticks);
+
+// Call once per frame under automatic frameskip with the current setting.
+void stats_frameskip_auto(unsigned skip);
+
+#define STATS_ENTER(id) stats_enter(id)
+#define STATS_LEAVE() stats_leave()
+#define STATS_ADD(id,n) stats_add(id, n)
+#define STATS_FRAME() stats_frame()
+#define STATS_EMULATED(t) stats_emulated(t)
+#define STATS_FRAMESKIP_AUTO(n) stats_frameskip_auto(n)
+#define STATS_EVENT_TYPE(e,id) ((e)->stats_id = (id))
+
+#else
+
+#define STATS_ENTER(id) do {} while (0)
+#define STATS_LEAVE() do {} while (0)
+#define STATS_ADD(id,n) do {} while (0)
+#define STATS_FRAME() do {} while (0)
+#define STATS_EMULATED(t) do {} while (0)
+#define STATS_FRAMESKIP_AUTO(n) do {} while (0)
+#define STATS_EVENT_TYPE(e,id) do {} while (0)
+
+#endif
+
+#endif
@@ -21,6 +21,7 @@ See COPYING.GPL for redistribution conditions.
 
 #include <assert.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -36,8 +37,10 @@ See COPYING.GPL for redistribution conditions.
 #include "logging.h"
 #include "machine.h"
 #include "mc6809.h"
+#include "serialise.h"
 #include "snapshot.h"
 #include "sound.h"
+#include "stats.h"
 #include "tape.h"
 #include "ui.h"
 #include "xroar.h"
@@ -170,6 +173,8 @@ struct tape_interface *tape_interface_new(struct ui_interface *ui) {
 
 	event_init(&tip->waggle_event, DELEGATE_AS0(void, waggle_bit, tip));
 	event_init(&tip->flush_event, DELEGATE_AS0(void, flush_output, tip));
+	STATS_EVENT_TYPE(&tip->waggle_event, STATS_EVENT_TAPE);
+	STATS_EVENT_TYPE(&tip->flush_event, STATS_EVENT_TAPE);
 
 	return &tip->public;
 }
@@ -436,6 +441,100 @@ void tape_set_ao_rate(struct tape_interface *ti, int rate) {
 		tip->ao_rate = 9600;
 }
 
+/**************************************************************************/
+
+// Snapshot state.  The input tape position is recorded so that loading can
+// be rewound along with the machine; output is never rewound.
+
+struct tape_state {
+	long input_offset;
+	int in_pulse;
+	int in_pulse_width;
+	int cpuskip;
+	uint8_t last_tape_output;
+	_Bool motor;
+	struct event_state waggle_event;
+	struct event_state flush_event;
+};
+
+size_t tape_state_size(void) {
+	return sizeof(struct tape_state);
+}
+
+void tape_state_save(struct tape_interface *ti, void *buf) {
+	struct tape_interface_private *tip = (struct tape_interface_private *)ti;
+	struct tape_state *st = buf;
+	*st = (struct tape_state){0};
+	st->input_offset = ti->tape_input ? tape_tell(ti->tape_input) : -1;
+	st->in_pulse = tip->in_pulse;
+	st->in_pulse_width = tip->in_pulse_width;
+	st->cpuskip = tip->cpuskip;
+	st->last_tape_output = tip->last_tape_output;
+	st->motor = tip->motor;
+	event_save_state(&tip->waggle_event, &st->waggle_event);
+	event_save_state(&tip->flush_event, &st->flush_event);
+}
+
+void tape_state_restore(struct tape_interface *ti, void const *buf) {
+	struct tape_interface_private *tip = (struct tape_interface_private *)ti;
+	struct tape_state const *st = buf;
+	// Seek the module directly: tape_seek() would act on the motor state
+	if (ti->tape_input && st->input_offset >= 0) {
+		ti->tape_input->module->seek(ti->tape_input, st->input_offset, SEEK_SET);
+	}
+	tip->in_pulse = st->in_pulse;
+	tip->in_pulse_width = st->in_pulse_width;
+	tip->cpuskip = st->cpuskip;
+	tip->last_tape_output = st->last_tape_output;
+	tip->motor = st->motor;
+	if (ti->tape_input) {
+		event_restore_state(&tip->waggle_event, &xroar_context->machine_events, &st->waggle_event);
+	} else {
+		event_dequeue(&tip->waggle_event);
+	}
+	if (ti->tape_output) {
+		event_restore_state(&tip->flush_event, &xroar_context->machine_events, &st->flush_event);
+	} else {
+		event_dequeue(&tip->flush_event);
+	}
+	set_breakpoints(tip);
+}
+
+// Portable state for snapshot files.  As above, the tape itself is not
+// recorded: the position only applies to whichever tape is inserted.
+
+void tape_ser_write(struct tape_interface *ti, struct ser_handle *sh) {
+	struct tape_interface_private *tip = (struct tape_interface_private *)ti;
+	ser_write_int32(sh, ti->tape_input ? tape_tell(ti->tape_input) : -1);
+	ser_write_int32(sh, tip->in_pulse);
+	ser_write_int32(sh, tip->in_pulse_width);
+	ser_write_int32(sh, tip->cpuskip);
+	ser_write_uint8(sh, tip->last_tape_output);
+	ser_write_bool(sh, tip->motor);
+	ser_write_event(sh, &tip->waggle_event);
+	ser_write_event(sh, &tip->flush_event);
+}
+
+void tape_ser_read(struct tape_interface *ti, struct ser_handle *sh) {
+	struct tape_interface_private *tip = (struct tape_interface_private *)ti;
+	long input_offset = ser_read_int32(sh);
+	if (ti->tape_input && input_offset >= 0) {
+		ti->tape_input->module->seek(ti->tape_input, input_offset, SEEK_SET);
+	}
+	tip->in_pulse = ser_read_int32(sh);
+	tip->in_pulse_width = ser_read_int32(sh);
+	tip->cpuskip = ser_read_int32(sh);
+	tip->last_tape_output = ser_read_uint8(sh);
+	tip->motor = ser_read_bool(sh);
+	ser_read_event(sh, &tip->waggle_event, &xroar_context->machine_events);
+	ser_read_event(sh, &tip->flush_event, &xroar_context->machine_events);
+	if (!ti->tape_input)
+		event_dequeue(&tip->waggle_event);
+	if (!ti->tape_output)
+		event_dequeue(&tip->flush_event);
+	set_breakpoints(tip);
+}
+
 int tape_open_reading(struct tape_interface *ti, const char *filename) {
 	struct tape_interface_private *tip = (struct tape_interface_private *)ti;
 	tape_close_reading(ti);
@@ -618,13 +717,13 @@ void tape_update_motor(struct tape_interface *ti, _Bool state) {
 		if (ti->tape_input && !tip->waggle_event.queued) {
 			/* If motor turned on and tape file attached,
 			 * enable the tape input bit waggler */
-			tip->waggle_event.at_tick = event_current_tick;
+			tip->waggle_event.at_tick = xroar_context->current_tick;
 			waggle_bit(tip);
 		}
 		if (ti->tape_output && !tip->flush_event.queued) {
-			tip->flush_event.at_tick = event_current_tick + EVENT_MS(500);
-			event_queue(&MACHINE_EVENT_LIST, &tip->flush_event);
-			ti->tape_output->last_write_cycle = event_current_tick;
+			tip->flush_event.at_tick = xroar_context->current_tick + EVENT_MS(500);
+			event_queue(&xroar_context->machine_events, &tip->flush_event);
+			ti->tape_output->last_write_cycle = xroar_context->current_tick;
 		}
 	} else {
 		event_dequeue(&tip->waggle_event);
@@ -659,9 +758,9 @@ void tape_update_motor(struct tape_interface *ti, _Bool state) {
 void tape_update_output(struct tape_interface *ti, uint8_t value) {
 	struct tape_interface_private *tip = (struct tape_interface_private *)ti;
 	if (tip->motor && ti->tape_output && !tip->tape_rewrite) {
-		int length = event_current_tick - ti->tape_output->last_write_cycle;
+		int length = xroar_context->current_tick - ti->tape_output->last_write_cycle;
 		ti->tape_output->module->sample_out(ti->tape_output, tip->last_tape_output, length);
-		ti->tape_output->last_write_cycle = event_current_tick;
+		ti->tape_output->last_write_cycle = xroar_context->current_tick;
 	}
 	tip->last_tape_output = value;
 }
@@ -686,7 +785,7 @@ static void waggle_bit(void *sptr) {
 		break;
 	}
 	tip->waggle_event.at_tick += tip->in_pulse_width;
-	event_queue(&MACHINE_EVENT_LIST, &tip->waggle_event);
+	event_queue(&xroar_context->machine_events, &tip->waggle_event);
 }
 
 // Ensure any "pulse" over 1/2 second long is flushed to output, so it doesn't
@@ -698,7 +797,7 @@ static void flush_output(void *sptr) {
 	tape_update_output(ti, tip->last_tape_output);
 	if (tip->motor) {
 		tip->flush_event.at_tick += EVENT_MS(500);
-		event_queue(&MACHINE_EVENT_LIST, &tip->flush_event);
+		event_queue(&xroar_context->machine_events, &tip->flush_event);
 	}
 }
 
@@ -723,8 +822,8 @@ static void advance_read_time(struct tape_interface_private *tip, int skip) {
 		}
 	}
 	tip->in_pulse_width -= skip;
-	tip->waggle_event.at_tick = event_current_tick + tip->in_pulse_width;
-	event_queue(&MACHINE_EVENT_LIST, &tip->waggle_event);
+	tip->waggle_event.at_tick = xroar_context->current_tick + tip->in_pulse_width;
+	event_queue(&xroar_context->machine_events, &tip->waggle_event);
 	DELEGATE_CALL1(ti->update_audio, tip->in_pulse ? 1.0 : 0.0);
 }
 
@@ -738,7 +837,7 @@ static void do_skip_read_time(struct tape_interface_private *tip) {
 // Update read time based on how far into current pulse we are
 
 static void update_read_time(struct tape_interface_private *tip) {
-	event_ticks skip = tip->waggle_event.at_tick - event_current_tick;
+	event_ticks skip = tip->waggle_event.at_tick - xroar_context->current_tick;
 	int s = event_tick_delta(tip->in_pulse_width, skip);
 	if (s >= 0) {
 		advance_read_time(tip, s);
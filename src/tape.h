@@ -18,6 +18,7 @@ See COPYING.GPL for redistribution conditions.
 #ifndef XROAR_TAPE_H_
 #define XROAR_TAPE_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "delegate.h"
@@ -116,6 +117,17 @@ void tape_reset(struct tape_interface *ti);
 /* Only affects libsndfile output */
 void tape_set_ao_rate(struct tape_interface *ti, int);
 
+/* In-memory state, for snapshots.  Includes the input tape position, but
+ * not tape contents. */
+size_t tape_state_size(void);
+void tape_state_save(struct tape_interface *ti, void *buf);
+void tape_state_restore(struct tape_interface *ti, void const *buf);
+
+/* Portable state, for snapshot files. */
+struct ser_handle;
+void tape_ser_write(struct tape_interface *ti, struct ser_handle *sh);
+void tape_ser_read(struct tape_interface *ti, struct ser_handle *sh);
+
 int tape_open_reading(struct tape_interface *ti, const char *filename);
 void tape_close_reading(struct tape_interface *ti);
 int tape_open_writing(struct tape_interface *ti, const char *filename);
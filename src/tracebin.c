@@ -0,0 +1,328 @@
+/*
+
+Binary instruction trace
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xalloc.h"
+
+#include "logging.h"
+#include "tracebin.h"
+
+#define TRACEBIN_BLOCK_SIZE (64 * 1024)
+// A block is finished once fewer than this many bytes remain.  Must exceed
+// the largest possible record.
+#define TRACEBIN_MAX_RECORD (64)
+
+enum tracebin_block_state {
+	BLOCK_FREE = 0,
+	BLOCK_FILLING,
+	BLOCK_FULL,
+};
+
+struct tracebin_block {
+	enum tracebin_block_state state;
+	uint32_t seq;
+	uint32_t nbytes;
+	uint32_t nrecords;
+	uint32_t base_tick;
+	uint8_t *data;
+};
+
+struct tracebin {
+	FILE *fd;
+	int cpu_type;
+	unsigned nregs;
+	_Bool keep_last;
+	const uint32_t *clock;
+
+	unsigned nblocks;
+	struct tracebin_block *blocks;
+	uint8_t *ring;
+
+	// Block being filled
+	unsigned cur;
+	uint32_t seq;
+	uint8_t *ptr;
+	uint8_t *limit;
+
+	// Encoder state: what the decoder will know after the previous record
+	_Bool block_start;
+	uint32_t last_tick;
+	uint16_t next_pc;
+	uint16_t regs[TRACEBIN_MAX_REGS];
+
+	// Writer thread (streaming mode only)
+	pthread_t writer;
+	pthread_mutex_t mt;
+	pthread_cond_t cv;
+	unsigned write_next;
+	_Bool quit;
+};
+
+static void start_block(struct tracebin *tb);
+static void finish_block(struct tracebin *tb);
+static void *writer_thread(void *sptr);
+static void write_block(struct tracebin *tb, struct tracebin_block *blk);
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void put16(uint8_t *p, unsigned v) {
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+struct tracebin *tracebin_new(const char *filename, int cpu_type,
+			      unsigned ring_size, _Bool keep_last,
+			      const uint32_t *clock) {
+	FILE *fd = fopen(filename, "wb");
+	if (!fd) {
+		LOG_WARN("trace: can't open '%s' for writing\n", filename);
+		return NULL;
+	}
+
+	struct tracebin *tb = xmalloc(sizeof(*tb));
+	*tb = (struct tracebin){0};
+	tb->fd = fd;
+	tb->cpu_type = cpu_type;
+	tb->nregs = (cpu_type == TRACEBIN_CPU_HD6309) ? 12 : 8;
+	tb->keep_last = keep_last;
+	tb->clock = clock;
+
+	tb->nblocks = ring_size / TRACEBIN_BLOCK_SIZE;
+	if (tb->nblocks < 2)
+		tb->nblocks = 2;
+	tb->blocks = xmalloc(tb->nblocks * sizeof(*tb->blocks));
+	tb->ring = xmalloc(tb->nblocks * TRACEBIN_BLOCK_SIZE);
+	for (unsigned i = 0; i < tb->nblocks; i++) {
+		tb->blocks[i] = (struct tracebin_block){0};
+		tb->blocks[i].data = tb->ring + i * TRACEBIN_BLOCK_SIZE;
+	}
+
+	uint8_t header[TRACEBIN_FILE_HEADER_SIZE] = TRACEBIN_MAGIC;
+	header[8] = cpu_type;
+	header[9] = tb->nregs;
+	put32(header + 12, TRACEBIN_BLOCK_SIZE);
+	fwrite(header, sizeof(header), 1, fd);
+
+	if (!keep_last) {
+		pthread_mutex_init(&tb->mt, NULL);
+		pthread_cond_init(&tb->cv, NULL);
+		pthread_create(&tb->writer, NULL, writer_thread, tb);
+	}
+
+	tb->cur = 0;
+	start_block(tb);
+	LOG_DEBUG(1, "Binary trace: %s, %u x %uK blocks%s\n", filename,
+		  tb->nblocks, TRACEBIN_BLOCK_SIZE / 1024,
+		  keep_last ? ", keeping last" : "");
+	return tb;
+}
+
+void tracebin_free(struct tracebin *tb) {
+	if (!tb)
+		return;
+	finish_block(tb);
+	if (tb->keep_last) {
+		// Oldest block follows the one just finished
+		for (unsigned i = 1; i <= tb->nblocks; i++) {
+			struct tracebin_block *blk = &tb->blocks[(tb->cur + i) % tb->nblocks];
+			if (blk->state == BLOCK_FULL)
+				write_block(tb, blk);
+		}
+	} else {
+		pthread_mutex_lock(&tb->mt);
+		tb->quit = 1;
+		pthread_cond_broadcast(&tb->cv);
+		pthread_mutex_unlock(&tb->mt);
+		pthread_join(tb->writer, NULL);
+		pthread_cond_destroy(&tb->cv);
+		pthread_mutex_destroy(&tb->mt);
+	}
+	fclose(tb->fd);
+	free(tb->ring);
+	free(tb->blocks);
+	free(tb);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Called with tb->cur selecting a block free for reuse.
+
+static void start_block(struct tracebin *tb) {
+	struct tracebin_block *blk = &tb->blocks[tb->cur];
+	blk->state = BLOCK_FILLING;
+	blk->seq = tb->seq++;
+	blk->nbytes = 0;
+	blk->nrecords = 0;
+	blk->base_tick = *tb->clock;
+	tb->ptr = blk->data;
+	tb->limit = blk->data + TRACEBIN_BLOCK_SIZE - TRACEBIN_MAX_RECORD;
+	tb->block_start = 1;
+	tb->last_tick = blk->base_tick;
+}
+
+// Mark the current block full.  Empty blocks are discarded.
+
+static void finish_block(struct tracebin *tb) {
+	struct tracebin_block *blk = &tb->blocks[tb->cur];
+	blk->nbytes = tb->ptr - blk->data;
+	enum tracebin_block_state state = blk->nrecords ? BLOCK_FULL : BLOCK_FREE;
+	if (tb->keep_last) {
+		blk->state = state;
+		return;
+	}
+	pthread_mutex_lock(&tb->mt);
+	blk->state = state;
+	pthread_cond_broadcast(&tb->cv);
+	pthread_mutex_unlock(&tb->mt);
+}
+
+static void next_block(struct tracebin *tb) {
+	finish_block(tb);
+	tb->cur = (tb->cur + 1) % tb->nblocks;
+	if (!tb->keep_last) {
+		// Only waits if the writer has fallen a whole ring behind
+		pthread_mutex_lock(&tb->mt);
+		while (tb->blocks[tb->cur].state != BLOCK_FREE) {
+			pthread_cond_wait(&tb->cv, &tb->mt);
+		}
+		pthread_mutex_unlock(&tb->mt);
+	}
+	start_block(tb);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void tracebin_record(struct tracebin *tb, unsigned flags, unsigned pc,
+		     const uint8_t *bytes, unsigned nbytes,
+		     const uint16_t *regs) {
+	if (tb->ptr >= tb->limit)
+		next_block(tb);
+
+	uint8_t *p = tb->ptr;
+	unsigned tag = (nbytes & TRACEBIN_F_NBYTES) | (flags & TRACEBIN_F_IRQ);
+	uint8_t *tagp = p++;
+
+	// Time stamp delta
+	uint32_t now = *tb->clock;
+	uint32_t dt = now - tb->last_tick;
+	tb->last_tick = now;
+	while (dt >= 0x80) {
+		*(p++) = (dt & 0x7f) | 0x80;
+		dt >>= 7;
+	}
+	*(p++) = dt;
+
+	pc &= 0xffff;
+	if (tb->block_start || pc != tb->next_pc) {
+		tag |= TRACEBIN_F_PC;
+		put16(p, pc);
+		p += 2;
+	}
+	tb->next_pc = pc + nbytes;
+
+	for (unsigned i = 0; i < nbytes; i++) {
+		*(p++) = bytes[i];
+	}
+
+	// Changed registers
+	unsigned mask = 0;
+	for (unsigned i = 0; i < tb->nregs; i++) {
+		if (tb->block_start || regs[i] != tb->regs[i])
+			mask |= (1 << i);
+	}
+	if (mask & 0xff) {
+		tag |= TRACEBIN_F_REGS;
+		*(p++) = mask;
+	}
+	if (mask >> 8) {
+		tag |= TRACEBIN_F_REGS2;
+		*(p++) = mask >> 8;
+	}
+	for (unsigned i = 0; mask; i++, mask >>= 1) {
+		if (!(mask & 1))
+			continue;
+		tb->regs[i] = regs[i];
+		if (TRACEBIN_REG_IS16(i)) {
+			put16(p, regs[i]);
+			p += 2;
+		} else {
+			*(p++) = regs[i];
+		}
+	}
+
+	*tagp = tag;
+	tb->ptr = p;
+	tb->block_start = 0;
+	tb->blocks[tb->cur].nrecords++;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void write_block(struct tracebin *tb, struct tracebin_block *blk) {
+	uint8_t header[TRACEBIN_BLOCK_HEADER_SIZE];
+	put32(header, blk->seq);
+	put32(header + 4, blk->nbytes);
+	put32(header + 8, blk->nrecords);
+	put32(header + 12, blk->base_tick);
+	if (fwrite(header, sizeof(header), 1, tb->fd) != 1 ||
+	    fwrite(blk->data, blk->nbytes, 1, tb->fd) != 1) {
+		LOG_WARN("trace: write error\n");
+	}
+}
+
+// Writes full blocks in ring order, freeing each for reuse.  On quit, drains
+// any remaining full blocks first.
+
+static void *writer_thread(void *sptr) {
+	struct tracebin *tb = sptr;
+	pthread_mutex_lock(&tb->mt);
+	for (;;) {
+		struct tracebin_block *blk = &tb->blocks[tb->write_next];
+		if (blk->state == BLOCK_FULL) {
+			pthread_mutex_unlock(&tb->mt);
+			write_block(tb, blk);
+			pthread_mutex_lock(&tb->mt);
+			blk->state = BLOCK_FREE;
+			tb->write_next = (tb->write_next + 1) % tb->nblocks;
+			pthread_cond_broadcast(&tb->cv);
+			continue;
+		}
+		if (tb->quit)
+			break;
+		pthread_cond_wait(&tb->cv, &tb->mt);
+	}
+	pthread_mutex_unlock(&tb->mt);
+	return NULL;
+}
@@ -0,0 +1,106 @@
+/*
+
+Binary instruction trace
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifndef XROAR_TRACEBIN_H_
+#define XROAR_TRACEBIN_H_
+
+#include <stdint.h>
+
+/* A compact alternative to the text trace.  Each instruction is recorded as
+ * its opcode bytes, a time stamp and only those registers that changed, into
+ * a ring of fixed-size blocks in memory.  Either a background thread streams
+ * full blocks to a file, or (in "last" mode) old blocks are simply overwritten
+ * and the ring is written out when the trace is closed.
+ *
+ * tools/tracedump turns a trace file back into the usual text format.
+ *
+ * File format, all values little-endian:
+ *
+ *     File header (16 bytes):
+ *         "XRTRACE\0"  magic
+ *         uint8        CPU type (TRACEBIN_CPU_*)
+ *         uint8        number of registers recorded
+ *         uint16       reserved (0)
+ *         uint32       block size
+ *
+ *     Then any number of blocks, each with a 16-byte header:
+ *         uint32       sequence number
+ *         uint32       bytes of record data following
+ *         uint32       number of records
+ *         uint32       base time (ticks)
+ *
+ * Each block is self-contained: its first record always carries PC and every
+ * register.  A record is:
+ *
+ *     uint8            tag: bits 0-2 opcode byte count, then TRACEBIN_F_*
+ *     ULEB128          ticks since previous record (or block base time)
+ *     uint16           PC, if TRACEBIN_F_PC (else it follows on from the
+ *                      previous record's PC and byte count)
+ *     uint8[n]         opcode bytes (for an interrupt, the vector fetched)
+ *     uint8            register mask (registers 0-7), if TRACEBIN_F_REGS
+ *     uint8            register mask (registers 8-11), if TRACEBIN_F_REGS2
+ *     ...              changed register values, in index order
+ *
+ * Registers are, by index: CC A B DP X Y U S, then for HD6309: E F V MD.
+ * X, Y, U, S and V are 16-bit, the rest 8-bit. */
+
+#define TRACEBIN_MAGIC "XRTRACE"
+#define TRACEBIN_FILE_HEADER_SIZE (16)
+#define TRACEBIN_BLOCK_HEADER_SIZE (16)
+
+#define TRACEBIN_CPU_MC6809 (0)
+#define TRACEBIN_CPU_HD6309 (1)
+
+#define TRACEBIN_MAX_REGS (12)
+
+#define TRACEBIN_F_NBYTES (0x07)
+#define TRACEBIN_F_PC (0x08)
+#define TRACEBIN_F_IRQ (0x10)  // interrupt vector fetch, not an instruction
+#define TRACEBIN_F_REGS (0x20)
+#define TRACEBIN_F_REGS2 (0x40)
+
+enum {
+	TRACEBIN_REG_CC, TRACEBIN_REG_A, TRACEBIN_REG_B, TRACEBIN_REG_DP,
+	TRACEBIN_REG_X, TRACEBIN_REG_Y, TRACEBIN_REG_U, TRACEBIN_REG_S,
+	TRACEBIN_REG_E, TRACEBIN_REG_F, TRACEBIN_REG_V, TRACEBIN_REG_MD,
+};
+
+// Non-zero for the 16-bit registers
+#define TRACEBIN_REG_IS16(r) ((r) == TRACEBIN_REG_V || ((r) >= TRACEBIN_REG_X && (r) <= TRACEBIN_REG_S))
+
+struct tracebin;
+
+/* Open a trace.  ring_size is the memory to use, in bytes.  If keep_last is
+ * set, nothing is written until tracebin_free(), at which point the most
+ * recent ring_size bytes (approximately) of trace are saved.  Time stamps are
+ * read from *clock. */
+
+struct tracebin *tracebin_new(const char *filename, int cpu_type,
+			      unsigned ring_size, _Bool keep_last,
+			      const uint32_t *clock);
+
+// Flushes any remaining trace to file and closes it.
+void tracebin_free(struct tracebin *);
+
+// Record an instruction (or with TRACEBIN_F_IRQ, an interrupt).  regs must
+// hold the number of registers appropriate to the CPU type.
+
+void tracebin_record(struct tracebin *, unsigned flags, unsigned pc,
+		     const uint8_t *bytes, unsigned nbytes,
+		     const uint16_t *regs);
+
+#endif
@@ -28,6 +28,8 @@ See COPYING.GPL for redistribution conditions.
 
 #include "events.h"
 #include "logging.h"
+#include "serialise.h"
+#include "stats.h"
 #include "vdisk.h"
 #include "vdrive.h"
 #include "xroar.h"
@@ -142,6 +144,8 @@ struct vdrive_interface *vdrive_interface_new(void) {
 	vdrive_set_drive(vi, 0);
 	event_init(&vip->index_pulse_event, DELEGATE_AS0(void, do_index_pulse, vip));
 	event_init(&vip->reset_index_pulse_event, DELEGATE_AS0(void, do_reset_index_pulse, vip));
+	STATS_EVENT_TYPE(&vip->index_pulse_event, STATS_EVENT_FDC);
+	STATS_EVENT_TYPE(&vip->reset_index_pulse_event, STATS_EVENT_FDC);
 	return vi;
 }
 
@@ -197,6 +201,131 @@ struct vdisk *vdrive_disk_in_drive(struct vdrive_interface *vi, unsigned drive)
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+struct vdrive_state {
+	unsigned current_cyl[MAX_DRIVES];
+	int cur_direction;
+	unsigned cur_drive_number;
+	unsigned cur_head;
+	unsigned cur_density;
+	unsigned head_incr;
+	unsigned head_pos;
+	_Bool index_state;
+	int last_update_dt;
+	int track_start_dt;
+	struct event_state index_pulse_event;
+	struct event_state reset_index_pulse_event;
+};
+
+size_t vdrive_state_size(void) {
+	return sizeof(struct vdrive_state);
+}
+
+void vdrive_state_save(struct vdrive_interface *vi, void *buf) {
+	struct vdrive_interface_private *vip = (struct vdrive_interface_private *)vi;
+	struct vdrive_state *st = buf;
+	for (unsigned i = 0; i < MAX_DRIVES; i++) {
+		st->current_cyl[i] = vip->drives[i].current_cyl;
+	}
+	st->cur_direction = vip->cur_direction;
+	st->cur_drive_number = vip->cur_drive_number;
+	st->cur_head = vip->cur_head;
+	st->cur_density = vip->cur_density;
+	st->head_incr = vip->head_incr;
+	st->head_pos = vip->head_pos;
+	st->index_state = vip->index_state;
+	st->last_update_dt = vip->last_update_cycle - xroar_context->current_tick;
+	st->track_start_dt = vip->track_start_cycle - xroar_context->current_tick;
+	event_save_state(&vip->index_pulse_event, &st->index_pulse_event);
+	event_save_state(&vip->reset_index_pulse_event, &st->reset_index_pulse_event);
+}
+
+// Track pointers and signal states are recomputed for the restored drive and
+// head, but not signalled: the controller's own state is restored separately.
+// The index pulse is only rescheduled if there is a disk to rotate.
+
+void vdrive_state_restore(struct vdrive_interface *vi, void const *buf) {
+	struct vdrive_interface_private *vip = (struct vdrive_interface_private *)vi;
+	struct vdrive_state const *st = buf;
+	for (unsigned i = 0; i < MAX_DRIVES; i++) {
+		vip->drives[i].current_cyl = st->current_cyl[i];
+	}
+	vip->cur_direction = st->cur_direction;
+	vip->cur_drive_number = st->cur_drive_number % MAX_DRIVES;
+	vip->current_drive = &vip->drives[vip->cur_drive_number];
+	vip->cur_head = st->cur_head;
+	vip->cur_density = st->cur_density;
+	vip->head_incr = st->head_incr;
+	vip->head_pos = st->head_pos;
+	vip->last_update_cycle = xroar_context->current_tick + st->last_update_dt;
+	vip->track_start_cycle = xroar_context->current_tick + st->track_start_dt;
+	event_dequeue(&vip->index_pulse_event);
+	event_dequeue(&vip->reset_index_pulse_event);
+	if (vip->current_drive->disk) {
+		event_restore_state(&vip->index_pulse_event, &xroar_context->machine_events, &st->index_pulse_event);
+		event_restore_state(&vip->reset_index_pulse_event, &xroar_context->machine_events, &st->reset_index_pulse_event);
+	}
+	struct vdisk *disk = vip->current_drive->disk;
+	vip->ready_state = (disk != NULL);
+	vip->tr00_state = (vip->current_drive->current_cyl == 0);
+	vip->index_state = st->index_state;
+	vip->write_protect_state = disk ? disk->write_protect : 0;
+	if (disk && vip->cur_head < disk->num_heads) {
+		vip->idamptr = vdisk_track_base(disk, vip->current_drive->current_cyl, vip->cur_head);
+	} else {
+		vip->idamptr = NULL;
+	}
+	vip->track_base = (uint8_t *)vip->idamptr;
+	DELEGATE_SAFE_CALL3(vi->update_drive_cyl_head, vip->cur_drive_number, vip->current_drive->current_cyl, vip->cur_head);
+}
+
+// Portable state for snapshot files, via the in-memory state above.
+
+void vdrive_ser_write(struct vdrive_interface *vi, struct ser_handle *sh) {
+	struct vdrive_state st;
+	vdrive_state_save(vi, &st);
+	ser_write_uint8(sh, MAX_DRIVES);
+	for (unsigned i = 0; i < MAX_DRIVES; i++) {
+		ser_write_uint16(sh, st.current_cyl[i]);
+	}
+	ser_write_int32(sh, st.cur_direction);
+	ser_write_uint8(sh, st.cur_drive_number);
+	ser_write_uint8(sh, st.cur_head);
+	ser_write_uint8(sh, st.cur_density);
+	ser_write_uint8(sh, st.head_incr);
+	ser_write_uint32(sh, st.head_pos);
+	ser_write_bool(sh, st.index_state);
+	ser_write_int32(sh, st.last_update_dt);
+	ser_write_int32(sh, st.track_start_dt);
+	ser_write_event_state(sh, &st.index_pulse_event);
+	ser_write_event_state(sh, &st.reset_index_pulse_event);
+}
+
+void vdrive_ser_read(struct vdrive_interface *vi, struct ser_handle *sh) {
+	struct vdrive_state st = {0};
+	unsigned ndrives = ser_read_uint8(sh);
+	for (unsigned i = 0; i < ndrives; i++) {
+		unsigned cyl = ser_read_uint16(sh);
+		if (i < MAX_DRIVES)
+			st.current_cyl[i] = cyl;
+	}
+	st.cur_direction = ser_read_int32(sh);
+	st.cur_drive_number = ser_read_uint8(sh);
+	st.cur_head = ser_read_uint8(sh);
+	st.cur_density = ser_read_uint8(sh);
+	st.head_incr = ser_read_uint8(sh);
+	st.head_pos = ser_read_uint32(sh);
+	st.index_state = ser_read_bool(sh);
+	st.last_update_dt = ser_read_int32(sh);
+	st.track_start_dt = ser_read_int32(sh);
+	ser_read_event_state(sh, &st.index_pulse_event);
+	ser_read_event_state(sh, &st.reset_index_pulse_event);
+	// Read even if nothing to restore into, to skip over the data
+	if (vi && !ser_error(sh))
+		vdrive_state_restore(vi, &st);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 /* Signals to all drives */
 
 static void vdrive_set_dirc(void *sptr, int direction) {
@@ -322,7 +451,7 @@ void vdrive_write_idam(void *sptr) {
 unsigned vdrive_time_to_next_byte(void *sptr) {
 	struct vdrive_interface_private *vip = sptr;
 	event_ticks next_cycle = vip->track_start_cycle + (vip->head_pos - 128) * BYTE_TIME;
-	int to_time = event_tick_delta(next_cycle, event_current_tick);
+	int to_time = event_tick_delta(next_cycle, xroar_context->current_tick);
 	if (to_time < 0) {
 		LOG_DEBUG(3, "Negative time to next byte!\n");
 		return 1;
@@ -339,7 +468,7 @@ unsigned vdrive_time_to_next_idam(void *sptr) {
 	if (!vip->ready_state)
 		return EVENT_MS(200);
 	/* Update head_pos based on time elapsed since track start */
-	vip->head_pos = 128 + ((event_current_tick - vip->track_start_cycle) / BYTE_TIME);
+	vip->head_pos = 128 + ((xroar_context->current_tick - vip->track_start_cycle) / BYTE_TIME);
 	unsigned next_head_pos = vip->current_drive->disk->track_length;
 	if (vip->idamptr) {
 		for (unsigned i = 0; i < 64; i++) {
@@ -351,10 +480,10 @@ unsigned vdrive_time_to_next_idam(void *sptr) {
 		}
 	}
 	if (next_head_pos >= vip->current_drive->disk->track_length) {
-		return vip->index_pulse_event.at_tick - event_current_tick;
+		return vip->index_pulse_event.at_tick - xroar_context->current_tick;
 	}
 	next_cycle = vip->track_start_cycle + (next_head_pos - 128) * BYTE_TIME;
-	int to_time = event_tick_delta(next_cycle, event_current_tick);
+	int to_time = event_tick_delta(next_cycle, xroar_context->current_tick);
 	if (to_time < 0) {
 		LOG_DEBUG(3, "Negative time to next IDAM!\n");
 		return 1;
@@ -453,9 +582,9 @@ static void update_signals(struct vdrive_interface_private *vip) {
 	vip->track_base = (uint8_t *)vip->idamptr;
 	if (!vip->index_pulse_event.queued) {
 		vip->head_pos = 128;
-		vip->track_start_cycle = event_current_tick;
+		vip->track_start_cycle = xroar_context->current_tick;
 		vip->index_pulse_event.at_tick = vip->track_start_cycle + (vip->current_drive->disk->track_length - 128) * BYTE_TIME;
-		event_queue(&MACHINE_EVENT_LIST, &vip->index_pulse_event);
+		event_queue(&xroar_context->machine_events, &vip->index_pulse_event);
 	}
 }
 
@@ -486,9 +615,9 @@ static void do_index_pulse(void *sptr) {
 	vip->last_update_cycle = vip->index_pulse_event.at_tick;
 	vip->track_start_cycle = vip->index_pulse_event.at_tick;
 	vip->index_pulse_event.at_tick = vip->track_start_cycle + (vip->current_drive->disk->track_length - 128) * BYTE_TIME;
-	event_queue(&MACHINE_EVENT_LIST, &vip->index_pulse_event);
+	event_queue(&xroar_context->machine_events, &vip->index_pulse_event);
 	vip->reset_index_pulse_event.at_tick = vip->track_start_cycle + ((vip->current_drive->disk->track_length - 128)/100) * BYTE_TIME;
-	event_queue(&MACHINE_EVENT_LIST, &vip->reset_index_pulse_event);
+	event_queue(&xroar_context->machine_events, &vip->reset_index_pulse_event);
 }
 
 static void do_reset_index_pulse(void *sptr) {
@@ -20,6 +20,7 @@ See COPYING.GPL for redistribution conditions.
 #ifndef XROAR_VDRIVE_H_
 #define XROAR_VDRIVE_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "delegate.h"
@@ -69,4 +70,15 @@ void vdrive_insert_disk(struct vdrive_interface *vi, unsigned drive, struct vdis
 void vdrive_eject_disk(struct vdrive_interface *vi, unsigned drive);
 struct vdisk *vdrive_disk_in_drive(struct vdrive_interface *vi, unsigned drive);
 
+/* In-memory state, for snapshots: drive selection, head positions and
+ * rotation.  Disk contents are not included. */
+size_t vdrive_state_size(void);
+void vdrive_state_save(struct vdrive_interface *vi, void *buf);
+void vdrive_state_restore(struct vdrive_interface *vi, void const *buf);
+
+/* Portable state, for snapshot files. */
+struct ser_handle;
+void vdrive_ser_write(struct vdrive_interface *vi, struct ser_handle *sh);
+void vdrive_ser_read(struct vdrive_interface *vi, struct ser_handle *sh);
+
 #endif
@@ -61,6 +61,7 @@ struct vo_interface {
 	int window_x, window_y;
 	int window_w, window_h;
 	_Bool is_fullscreen;
+	unsigned refresh_rate;  // Hz, 0 if unknown
 
 	DELEGATE_T0(void) free;
 
@@ -71,6 +72,11 @@ struct vo_interface {
 	DELEGATE_T0(void) vsync;
 	DELEGATE_T0(void) refresh;
 	DELEGATE_T1(void, int) set_vo_cmp;
+
+	// Waits for any scanlines still being rendered elsewhere.  Modules
+	// call this before changing render state from outside the delegates
+	// above, e.g. from a toolkit's window event handler.
+	DELEGATE_T0(void) sync;
 };
 
 extern struct module * const *vo_module_list;
@@ -24,6 +24,7 @@ in those files (eg, LOCK_SURFACE and XSTEP)
 #include "machine.h"
 #include "module.h"
 #include "ntsc.h"
+#include "stats.h"
 #include "vdg_palette.h"
 #include "mc6847/mc6847.h"
 
@@ -42,6 +43,13 @@ in those files (eg, LOCK_SURFACE and XSTEP)
 
 #endif
 
+// Simulated NTSC lines are decoded this many pixels at a time
+#define NTSC_LINE_CHUNK (128)
+
+// Renderers may read this many elements of scanline data either side of the
+// window, so this much extra is compared when checking for changed lines.
+#define LINE_CACHE_MARGIN (8)
+
 // - - - - - - -
 
 struct vo_generic_interface {
@@ -58,8 +66,31 @@ struct vo_generic_interface {
 
 	// Gamma LUT
 	uint8_t ntsc_ungamma[256];
+
+	// Renderer for the selected cross-colour mode
+	void (*render_line)(void *, uint8_t const *, struct ntsc_burst *, unsigned);
+
+	// Scanline data for each row of the window as last rendered.  Rows
+	// whose data, burst and phase match are left as they are.  Bursts are
+	// compared by offset rather than by pointer, as a reconfigured machine
+	// may allocate a different burst at the same address.
+	struct {
+		unsigned nrows;
+		unsigned width;
+		uint8_t *data;
+		struct line_cache_key {
+			_Bool valid;
+			int burst_offset;
+			unsigned phase;
+		} *key;
+	} line_cache;
+
+	// Rows rendered since last uploaded by the video module
+	int dirty_first, dirty_last;
 };
 
+static void line_cache_invalidate(struct vo_generic_interface *generic);
+
 /* Map VDG palette entry */
 static Pixel map_palette_entry(struct vo_generic_interface *generic, int i) {
 	(void)generic;
@@ -78,6 +109,7 @@ static void alloc_colours(void *sptr) {
 #ifdef RESET_PALETTE
 	RESET_PALETTE();
 #endif
+	line_cache_invalidate(generic);
 	for (int j = 0; j < 12; j++) {
 		generic->vdg_colour[j] = map_palette_entry(generic, j);
 	}
@@ -299,38 +331,146 @@ static void render_ntsc(void *sptr, uint8_t const *scanline_data, struct ntsc_bu
 	const uint8_t *v = (scanline_data + vo->window_x) - 3;
 	ntsc_phase = ((phase + vo->window_x) + 3) & 3;
 	LOCK_SURFACE(generic);
-	for (int j = vo->window_w; j; j--) {
-		struct ntsc_xyz rgb = ntsc_decode(burst, v++);
+	for (int j = vo->window_w; j > 0; j -= NTSC_LINE_CHUNK) {
+		unsigned n = (j < NTSC_LINE_CHUNK) ? j : NTSC_LINE_CHUNK;
+		uint8_t x[NTSC_LINE_CHUNK], y[NTSC_LINE_CHUNK], z[NTSC_LINE_CHUNK];
 		// 40 is a reasonable value for brightness
 		// TODO: make this adjustable
-		int R = generic->ntsc_ungamma[clamp_uint8(rgb.x+40)];
-		int G = generic->ntsc_ungamma[clamp_uint8(rgb.y+40)];
-		int B = generic->ntsc_ungamma[clamp_uint8(rgb.z+40)];
-		*(generic->pixel) = MAPCOLOUR(generic, R, G, B);
-		generic->pixel += XSTEP;
+		ntsc_decode_line(burst, v, n, 40, x, y, z);
+		v += n;
+		for (unsigned i = 0; i < n; i++) {
+			int R = generic->ntsc_ungamma[x[i]];
+			int G = generic->ntsc_ungamma[y[i]];
+			int B = generic->ntsc_ungamma[z[i]];
+			*(generic->pixel) = MAPCOLOUR(generic, R, G, B);
+			generic->pixel += XSTEP;
+		}
 	}
 	UNLOCK_SURFACE(generic);
 	generic->pixel += NEXTLINE;
 }
 
+/* Skip rendering of lines that haven't changed since the previous frame */
+
+static void line_cache_invalidate(struct vo_generic_interface *generic) {
+	for (unsigned i = 0; i < generic->line_cache.nrows; i++) {
+		generic->line_cache.key[i].valid = 0;
+	}
+}
+
+// Returns true if the row already holds the rendered result of this data.
+// Otherwise records the data as what the row is about to be rendered from.
+
+static _Bool line_cache_match(struct vo_generic_interface *generic, unsigned row,
+			      uint8_t const *data, struct ntsc_burst *burst, unsigned phase) {
+	VO_MODULE_INTERFACE *vom = &generic->module;
+	struct vo_interface *vo = &vom->public;
+	unsigned nrows = vo->window_h;
+	unsigned width = vo->window_w / SCALE_PIXELS + 2*LINE_CACHE_MARGIN;
+	if (nrows != generic->line_cache.nrows || width != generic->line_cache.width) {
+		generic->line_cache.nrows = nrows;
+		generic->line_cache.width = width;
+		generic->line_cache.data = xrealloc(generic->line_cache.data, nrows * width);
+		generic->line_cache.key = xrealloc(generic->line_cache.key, nrows * sizeof(*generic->line_cache.key));
+		line_cache_invalidate(generic);
+	}
+	data += vo->window_x / SCALE_PIXELS - LINE_CACHE_MARGIN;
+	uint8_t *cached = generic->line_cache.data + row * width;
+	struct line_cache_key *key = &generic->line_cache.key[row];
+	int burst_offset = burst ? burst->offset : -1;
+	if (key->valid && key->burst_offset == burst_offset && key->phase == phase &&
+	    memcmp(cached, data, width) == 0) {
+		return 1;
+	}
+	memcpy(cached, data, width);
+	key->valid = 1;
+	key->burst_offset = burst_offset;
+	key->phase = phase;
+	return 0;
+}
+
+static void render_line(void *sptr, uint8_t const *scanline_data, struct ntsc_burst *burst, unsigned phase) {
+	struct vo_generic_interface *generic = sptr;
+	VO_MODULE_INTERFACE *vom = &generic->module;
+	struct vo_interface *vo = &vom->public;
+	if (generic->scanline < vo->window_y ||
+	    generic->scanline >= (vo->window_y + vo->window_h)) {
+		generic->scanline++;
+		return;
+	}
+	int row = generic->scanline - vo->window_y;
+	if (line_cache_match(generic, row, scanline_data, burst, phase)) {
+		STATS_ADD(STATS_VO_LINE_CLEAN, 1);
+		generic->scanline++;
+		generic->pixel += (vo->window_w / SCALE_PIXELS) * XSTEP + NEXTLINE;
+		return;
+	}
+	STATS_ADD(STATS_VO_LINE_DIRTY, 1);
+	if (generic->dirty_first >= generic->dirty_last) {
+		generic->dirty_first = row;
+		generic->dirty_last = row + 1;
+	} else {
+		if (row < generic->dirty_first)
+			generic->dirty_first = row;
+		if (row >= generic->dirty_last)
+			generic->dirty_last = row + 1;
+	}
+	generic->render_line(generic, scanline_data, burst, phase);
+}
+
+// Fetch the range of rows rendered since the last call, for the video module
+// to upload.  Returns false if there are none.
+
+static _Bool generic_dirty_rows(struct vo_generic_interface *generic, int *first, int *nrows) {
+	if (generic->dirty_first >= generic->dirty_last)
+		return 0;
+	*first = generic->dirty_first;
+	*nrows = generic->dirty_last - generic->dirty_first;
+	generic->dirty_first = generic->dirty_last = 0;
+	return 1;
+}
+
+// Video module lost its copy of the rendered image (e.g. texture recreated).
+// If the render buffer was also disturbed, everything must be re-rendered.
+
+static void generic_invalidate(struct vo_generic_interface *generic, _Bool rerender) {
+	VO_MODULE_INTERFACE *vom = &generic->module;
+	struct vo_interface *vo = &vom->public;
+	if (rerender)
+		line_cache_invalidate(generic);
+	generic->dirty_first = 0;
+	generic->dirty_last = vo->window_h;
+}
+
+static void generic_free(struct vo_generic_interface *generic) {
+	free(generic->line_cache.data);
+	free(generic->line_cache.key);
+	generic->line_cache.data = NULL;
+	generic->line_cache.key = NULL;
+	generic->line_cache.nrows = 0;
+}
+
 static void set_vo_cmp(void *sptr, int mode) {
 	struct vo_generic_interface *generic = sptr;
 	VO_MODULE_INTERFACE *vom = &generic->module;
 	struct vo_interface *vo = &vom->public;
 	switch (mode) {
+	default:
 	case VO_CMP_PALETTE:
-		vo->render_scanline = DELEGATE_AS3(void, uint8cp, ntscburst, unsigned, render_scanline, vo);
+		generic->render_line = render_scanline;
 		break;
 	case VO_CMP_2BIT:
-		vo->render_scanline = DELEGATE_AS3(void, uint8cp, ntscburst, unsigned, render_ccr_simple, vo);
+		generic->render_line = render_ccr_simple;
 		break;
 	case VO_CMP_5BIT:
-		vo->render_scanline = DELEGATE_AS3(void, uint8cp, ntscburst, unsigned, render_ccr_5bit, vo);
+		generic->render_line = render_ccr_5bit;
 		break;
 	case VO_CMP_SIMULATED:
-		vo->render_scanline = DELEGATE_AS3(void, uint8cp, ntscburst, unsigned, render_ntsc, vo);
+		generic->render_line = render_ntsc;
 		break;
 	}
+	line_cache_invalidate(generic);
+	vo->render_scanline = DELEGATE_AS3(void, uint8cp, ntscburst, unsigned, render_line, vo);
 }
 
 static void generic_vsync(void *sptr) {
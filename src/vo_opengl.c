@@ -107,7 +107,6 @@ struct vo_interface *vo_opengl_new(struct vo_cfg *vo_cfg) {
 	vo->update_palette = DELEGATE_AS0(void, alloc_colours, vo);
 	vo->resize = DELEGATE_AS2(void, unsigned, unsigned, vo_opengl_set_window_size, vo);
 	vo->vsync = DELEGATE_AS0(void, vo_opengl_vsync, vo);
-	vo->render_scanline = DELEGATE_AS3(void, uint8cp, ntscburst, unsigned, render_scanline, vo);
 	vo->refresh = DELEGATE_AS0(void, vo_opengl_refresh, vo);
 	vo->set_vo_cmp = DELEGATE_AS1(void, int, vo_opengl_set_vo_cmp, vo);
 
@@ -117,6 +116,7 @@ struct vo_interface *vo_opengl_new(struct vo_cfg *vo_cfg) {
 	vogl->vo_opengl_x = vogl->vo_opengl_y = 0;
 	vogl->filter = vo_cfg->gl_filter;
 	alloc_colours(vo);
+	set_vo_cmp(vo, VO_CMP_PALETTE);
 	generic_vsync(generic);
 	vo->window_x = VDG_ACTIVE_LINE_START - 64;
 	vo->window_y = VDG_TOP_BORDER_START + 1;
@@ -135,14 +135,17 @@ void vo_opengl_get_display_rect(struct vo_interface *vo, struct vo_rect *disp) {
 }
 
 static void vo_opengl_free(void *sptr) {
-	struct vo_opengl_interface *vogl = sptr;
+	struct vo_generic_interface *generic = sptr;
+	struct vo_opengl_interface *vogl = &generic->module;
 	glDeleteTextures(1, &vogl->texnum);
 	free(vogl->texture_pixels);
-	free(vogl);
+	generic_free(generic);
+	free(generic);
 }
 
 static void vo_opengl_set_window_size(void *sptr, unsigned w, unsigned h) {
-	struct vo_opengl_interface *vogl = sptr;
+	struct vo_generic_interface *generic = sptr;
+	struct vo_opengl_interface *vogl = &generic->module;
 	vogl->window_width = w;
 	vogl->window_height = h;
 
@@ -195,6 +198,9 @@ static void vo_opengl_set_window_size(void *sptr, unsigned w, unsigned h) {
 			GL_RGB, GL_UNSIGNED_SHORT_5_6_5, vogl->texture_pixels);
 	glTexSubImage2D(GL_TEXTURE_2D, 0,   0, 240, TEXTURE_PITCH,   1,
 			GL_RGB, GL_UNSIGNED_SHORT_5_6_5, vogl->texture_pixels);
+	// New texture needs a full upload, and the above clobbered the first
+	// rows of the render buffer.
+	generic_invalidate(generic, 1);
 
 	glColor4f(1.0, 1.0, 1.0, 1.0);
 
@@ -214,12 +220,16 @@ static void vo_opengl_set_window_size(void *sptr, unsigned w, unsigned h) {
 }
 
 static void vo_opengl_refresh(void *sptr) {
-	struct vo_opengl_interface *vogl = sptr;
+	struct vo_generic_interface *generic = sptr;
+	struct vo_opengl_interface *vogl = &generic->module;
 	glClear(GL_COLOR_BUFFER_BIT);
-	/* Draw main window */
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
-			TEXTURE_WIDTH, 240, GL_RGB,
-			GL_UNSIGNED_SHORT_5_6_5, vogl->texture_pixels);
+	/* Draw main window, uploading only rows that have changed */
+	int first, nrows;
+	if (generic_dirty_rows(generic, &first, &nrows)) {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first,
+				TEXTURE_WIDTH, nrows, GL_RGB,
+				GL_UNSIGNED_SHORT_5_6_5, vogl->texture_pixels + first * TEXTURE_WIDTH);
+	}
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 	/* Video module should now do whatever's required to swap buffers */
 }
@@ -227,7 +237,7 @@ static void vo_opengl_refresh(void *sptr) {
 static void vo_opengl_vsync(void *sptr) {
 	struct vo_generic_interface *generic = sptr;
 	struct vo_opengl_interface *vogl = &generic->module;
-	vo_opengl_refresh(vogl);
+	vo_opengl_refresh(generic);
 	generic->pixel = vogl->texture_pixels;
 	generic_vsync(generic);
 }
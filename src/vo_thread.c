@@ -0,0 +1,291 @@
+/*
+
+Threaded video rendering
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+Scanline data is copied into a single-producer, single-consumer ring buffer.
+Only the render thread calls the module's render_scanline().  Everything else
+is called on the emulator thread once the ring is empty: OpenGL contexts and
+SDL renderers are tied to the thread that created them, so presentation has to
+stay where it was.
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "delegate.h"
+#include "xalloc.h"
+
+#include "logging.h"
+#include "mc6847/mc6847.h"
+#include "vo.h"
+#include "vo_thread.h"
+
+// Scanlines queued before the emulator waits for the render thread.  Must be
+// a power of two.
+#define RING_SIZE (512)
+
+// Size of the scanline buffer passed by the VDG
+#define LINE_SIZE (VDG_LINE_DURATION + 8)
+
+struct ring_entry {
+	struct ntsc_burst *burst;
+	unsigned phase;
+	uint8_t data[LINE_SIZE];
+};
+
+struct vo_thread {
+	struct vo_interface *vo;
+
+	// The module's own delegates
+	DELEGATE_T3(void, uint8cp, ntscburst, unsigned) render_scanline;
+	DELEGATE_T0(void) update_palette;
+	DELEGATE_T2(void, unsigned, unsigned) resize;
+	DELEGATE_T1(int, bool) set_fullscreen;
+	DELEGATE_T0(void) vsync;
+	DELEGATE_T0(void) refresh;
+	DELEGATE_T1(void, int) set_vo_cmp;
+	DELEGATE_T0(void) sync;
+
+	pthread_t thread;
+	pthread_mutex_t mt;
+	pthread_cond_t cv;
+	atomic_bool quit;
+
+	// Set by either side before sleeping on cv
+	atomic_bool render_waiting;
+	atomic_bool emulator_waiting;
+
+	// Free-running indices.  Entries from tail to head are queued.
+	atomic_uint head;
+	atomic_uint tail;
+	struct ring_entry ring[RING_SIZE];
+};
+
+static void *render_thread(void *sptr);
+
+static void thread_render_scanline(void *sptr, uint8_t const *data, struct ntsc_burst *burst, unsigned phase);
+static void thread_update_palette(void *sptr);
+static void thread_resize(void *sptr, unsigned w, unsigned h);
+static int thread_set_fullscreen(void *sptr, _Bool fullscreen);
+static void thread_vsync(void *sptr);
+static void thread_refresh(void *sptr);
+static void thread_set_vo_cmp(void *sptr, int mode);
+static void thread_sync(void *sptr);
+
+struct vo_thread *vo_thread_new(struct vo_interface *vo) {
+	if (!vo)
+		return NULL;
+	struct vo_thread *vt = xmalloc(sizeof(*vt));
+	*vt = (struct vo_thread){0};
+	vt->vo = vo;
+	atomic_init(&vt->quit, 0);
+	atomic_init(&vt->render_waiting, 0);
+	atomic_init(&vt->emulator_waiting, 0);
+	atomic_init(&vt->head, 0);
+	atomic_init(&vt->tail, 0);
+	pthread_mutex_init(&vt->mt, NULL);
+	pthread_cond_init(&vt->cv, NULL);
+	if (pthread_create(&vt->thread, NULL, render_thread, vt) != 0) {
+		LOG_WARN("Failed to create video render thread\n");
+		pthread_cond_destroy(&vt->cv);
+		pthread_mutex_destroy(&vt->mt);
+		free(vt);
+		return NULL;
+	}
+
+	vt->render_scanline = vo->render_scanline;
+	vt->update_palette = vo->update_palette;
+	vt->resize = vo->resize;
+	vt->set_fullscreen = vo->set_fullscreen;
+	vt->vsync = vo->vsync;
+	vt->refresh = vo->refresh;
+	vt->set_vo_cmp = vo->set_vo_cmp;
+	vt->sync = vo->sync;
+
+	vo->render_scanline = DELEGATE_AS3(void, uint8cp, ntscburst, unsigned, thread_render_scanline, vt);
+	if (DELEGATE_DEFINED(vo->update_palette))
+		vo->update_palette = DELEGATE_AS0(void, thread_update_palette, vt);
+	if (DELEGATE_DEFINED(vo->resize))
+		vo->resize = DELEGATE_AS2(void, unsigned, unsigned, thread_resize, vt);
+	if (DELEGATE_DEFINED(vo->set_fullscreen))
+		vo->set_fullscreen = DELEGATE_AS1(int, bool, thread_set_fullscreen, vt);
+	if (DELEGATE_DEFINED(vo->vsync))
+		vo->vsync = DELEGATE_AS0(void, thread_vsync, vt);
+	if (DELEGATE_DEFINED(vo->refresh))
+		vo->refresh = DELEGATE_AS0(void, thread_refresh, vt);
+	if (DELEGATE_DEFINED(vo->set_vo_cmp))
+		vo->set_vo_cmp = DELEGATE_AS1(void, int, thread_set_vo_cmp, vt);
+	vo->sync = DELEGATE_AS0(void, thread_sync, vt);
+	return vt;
+}
+
+void vo_thread_free(struct vo_thread *vt) {
+	if (!vt)
+		return;
+	vo_thread_flush(vt);
+	pthread_mutex_lock(&vt->mt);
+	atomic_store(&vt->quit, 1);
+	pthread_cond_broadcast(&vt->cv);
+	pthread_mutex_unlock(&vt->mt);
+	pthread_join(vt->thread, NULL);
+	pthread_cond_destroy(&vt->cv);
+	pthread_mutex_destroy(&vt->mt);
+
+	struct vo_interface *vo = vt->vo;
+	vo->render_scanline = vt->render_scanline;
+	vo->update_palette = vt->update_palette;
+	vo->resize = vt->resize;
+	vo->set_fullscreen = vt->set_fullscreen;
+	vo->vsync = vt->vsync;
+	vo->refresh = vt->refresh;
+	vo->set_vo_cmp = vt->set_vo_cmp;
+	vo->sync = vt->sync;
+	free(vt);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Each side publishes its index before checking whether the other is
+// waiting, and sets its waiting flag before re-checking the index under the
+// mutex, so a wakeup can't be missed.
+
+static void wake(struct vo_thread *vt, atomic_bool *waiting) {
+	if (!atomic_load(waiting))
+		return;
+	pthread_mutex_lock(&vt->mt);
+	pthread_cond_broadcast(&vt->cv);
+	pthread_mutex_unlock(&vt->mt);
+}
+
+static void wait_until(struct vo_thread *vt, atomic_bool *waiting,
+		       _Bool (*ready)(struct vo_thread *)) {
+	pthread_mutex_lock(&vt->mt);
+	atomic_store(waiting, 1);
+	while (!ready(vt) && !atomic_load(&vt->quit))
+		pthread_cond_wait(&vt->cv, &vt->mt);
+	atomic_store(waiting, 0);
+	pthread_mutex_unlock(&vt->mt);
+}
+
+static _Bool ring_not_empty(struct vo_thread *vt) {
+	return atomic_load(&vt->head) != atomic_load(&vt->tail);
+}
+
+static _Bool ring_not_full(struct vo_thread *vt) {
+	return (atomic_load(&vt->head) - atomic_load(&vt->tail)) < RING_SIZE;
+}
+
+static _Bool ring_empty(struct vo_thread *vt) {
+	return atomic_load(&vt->head) == atomic_load(&vt->tail);
+}
+
+static void *render_thread(void *sptr) {
+	struct vo_thread *vt = sptr;
+	for (;;) {
+		unsigned tail = atomic_load_explicit(&vt->tail, memory_order_relaxed);
+		if (tail == atomic_load(&vt->head)) {
+			if (atomic_load(&vt->quit))
+				break;
+			wait_until(vt, &vt->render_waiting, ring_not_empty);
+			continue;
+		}
+		struct ring_entry *entry = &vt->ring[tail & (RING_SIZE - 1)];
+		DELEGATE_CALL3(vt->render_scanline, entry->data, entry->burst, entry->phase);
+		atomic_store(&vt->tail, tail + 1);
+		wake(vt, &vt->emulator_waiting);
+	}
+	return NULL;
+}
+
+void vo_thread_flush(struct vo_thread *vt) {
+	if (!vt)
+		return;
+	if (!ring_empty(vt))
+		wait_until(vt, &vt->emulator_waiting, ring_empty);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void thread_render_scanline(void *sptr, uint8_t const *data, struct ntsc_burst *burst, unsigned phase) {
+	struct vo_thread *vt = sptr;
+	unsigned head = atomic_load_explicit(&vt->head, memory_order_relaxed);
+	if (!ring_not_full(vt))
+		wait_until(vt, &vt->emulator_waiting, ring_not_full);
+	struct ring_entry *entry = &vt->ring[head & (RING_SIZE - 1)];
+	memcpy(entry->data, data, LINE_SIZE);
+	entry->burst = burst;
+	entry->phase = phase;
+	atomic_store(&vt->head, head + 1);
+	wake(vt, &vt->render_waiting);
+}
+
+static void thread_update_palette(void *sptr) {
+	struct vo_thread *vt = sptr;
+	vo_thread_flush(vt);
+	DELEGATE_CALL0(vt->update_palette);
+}
+
+static void thread_resize(void *sptr, unsigned w, unsigned h) {
+	struct vo_thread *vt = sptr;
+	vo_thread_flush(vt);
+	DELEGATE_CALL2(vt->resize, w, h);
+}
+
+static int thread_set_fullscreen(void *sptr, _Bool fullscreen) {
+	struct vo_thread *vt = sptr;
+	vo_thread_flush(vt);
+	return DELEGATE_CALL1(vt->set_fullscreen, fullscreen);
+}
+
+// Frames are presented on this thread once all their scanlines are rendered.
+
+static void thread_vsync(void *sptr) {
+	struct vo_thread *vt = sptr;
+	vo_thread_flush(vt);
+	DELEGATE_CALL0(vt->vsync);
+}
+
+static void thread_refresh(void *sptr) {
+	struct vo_thread *vt = sptr;
+	vo_thread_flush(vt);
+	DELEGATE_CALL0(vt->refresh);
+}
+
+// Modules select a renderer by replacing their render_scanline delegate, so
+// take whatever it's been set to and put ours back.
+
+static void thread_set_vo_cmp(void *sptr, int mode) {
+	struct vo_thread *vt = sptr;
+	struct vo_interface *vo = vt->vo;
+	vo_thread_flush(vt);
+	DELEGATE_CALL1(vt->set_vo_cmp, mode);
+	if (vo->render_scanline.func != thread_render_scanline) {
+		vt->render_scanline = vo->render_scanline;
+		vo->render_scanline = DELEGATE_AS3(void, uint8cp, ntscburst, unsigned, thread_render_scanline, vt);
+	}
+}
+
+static void thread_sync(void *sptr) {
+	struct vo_thread *vt = sptr;
+	vo_thread_flush(vt);
+	DELEGATE_SAFE_CALL0(vt->sync);
+}
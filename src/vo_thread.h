@@ -0,0 +1,42 @@
+/*
+
+Threaded video rendering
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+*/
+
+#ifndef XROAR_VO_THREAD_H_
+#define XROAR_VO_THREAD_H_
+
+struct vo_interface;
+struct vo_thread;
+
+/* Move scanline rendering for a video module onto its own thread.  The
+ * module's delegates are replaced with ones that queue scanlines for the
+ * render thread, and that wait for it to catch up before anything else
+ * (including vsync) is passed through on the calling thread.  Scanlines are
+ * rendered in the order they were submitted, so output is the same as
+ * without the thread. */
+
+struct vo_thread *vo_thread_new(struct vo_interface *vo);
+
+/* Wait for the render thread to finish all queued scanlines, e.g. before the
+ * machine that submitted them (and its NTSC burst data) is freed. */
+
+void vo_thread_flush(struct vo_thread *vt);
+
+/* Stop the render thread and restore the module's own delegates. */
+
+void vo_thread_free(struct vo_thread *vt);
+
+#endif
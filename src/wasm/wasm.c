@@ -92,7 +92,7 @@ void wasm_ui_run(void *sptr) {
 	// Calculate number of ticks to run based on time delta.
 	tickerr += (14318180. * (dt / 1000.));
 	int nticks = (int)tickerr;
-	event_ticks last_tick = event_current_tick;
+	event_ticks last_tick = xroar_context->current_tick;
 
 	// Poll SDL events (need to refactor this).
 	run_sdl_event_loop(global_uisdl2);
@@ -101,7 +101,7 @@ void wasm_ui_run(void *sptr) {
 	xroar_run(nticks);
 
 	// Record time offset based on actual number of ticks run.
-	int dtick = event_current_tick - last_tick;
+	int dtick = xroar_context->current_tick - last_tick;
 	tickerr -= (double)dtick;
 }
 
@@ -318,7 +318,7 @@ _Bool wasm_ui_prepare_machine(struct machine_config *mc) {
 	if (wasm_waiting_files == 0) {
 		return 1;
 	}
-	event_queue_auto(&UI_EVENT_LIST, DELEGATE_AS0(void, do_wasm_set_machine, (void *)(intptr_t)mc->id), 0);
+	event_queue_auto(&xroar_context->ui_events, DELEGATE_AS0(void, do_wasm_set_machine, (void *)(intptr_t)mc->id), 0);
 	return 0;
 }
 
@@ -334,7 +334,7 @@ _Bool wasm_ui_prepare_cartridge(struct cart_config *cc) {
 	if (wasm_waiting_files == 0) {
 		return 1;
 	}
-	event_queue_auto(&UI_EVENT_LIST, DELEGATE_AS0(void, do_wasm_set_cartridge, (void *)(intptr_t)cc->id), 0);
+	event_queue_auto(&xroar_context->ui_events, DELEGATE_AS0(void, do_wasm_set_cartridge, (void *)(intptr_t)cc->id), 0);
 	return 0;
 }
 
@@ -371,7 +371,7 @@ void wasm_set_machine_cart(const char *machine, const char *cart,
 		}
 		wasm_ui_prepare_cartridge(cc);
 	}
-	event_queue_auto(&UI_EVENT_LIST, DELEGATE_AS0(void, do_wasm_set_machine, (void *)(intptr_t)mc->id), 0);
+	event_queue_auto(&xroar_context->ui_events, DELEGATE_AS0(void, do_wasm_set_machine, (void *)(intptr_t)mc->id), 0);
 }
 
 // Load (and optionally autorun) file from web
@@ -413,7 +413,7 @@ void wasm_load_file(const char *filename, int type, int drive) {
 	ev->type = type;
 	ev->drive = drive;
 	wasm_wget(filename);
-	event_queue_auto(&UI_EVENT_LIST, DELEGATE_AS0(void, do_wasm_load_file, ev), 0);
+	event_queue_auto(&xroar_context->ui_events, DELEGATE_AS0(void, do_wasm_load_file, ev), 0);
 }
 
 // Configure joystick ports
@@ -434,20 +434,20 @@ void wasm_set_joystick(int port, const char *value) {
 	struct wasm_event_set_joystick *ev = xmalloc(sizeof(*ev));
 	ev->port = port;
 	ev->value = xstrdup(value);
-	event_queue_auto(&UI_EVENT_LIST, DELEGATE_AS0(void, do_wasm_set_joystick, ev), 0);
+	event_queue_auto(&xroar_context->ui_events, DELEGATE_AS0(void, do_wasm_set_joystick, ev), 0);
 }
 
 // Submit BASIC commands
 
 static void do_wasm_queue_basic(void *sptr) {
 	char *text = sptr;
-	keyboard_queue_basic(xroar_keyboard_interface, text);
+	keyboard_queue_basic(xroar_context->keyboard_interface, text);
 	free(text);
 }
 
 void wasm_queue_basic(const char *string) {
 	char *text = xstrdup(string);
-	event_queue_auto(&UI_EVENT_LIST, DELEGATE_AS0(void, do_wasm_queue_basic, text), 0);
+	event_queue_auto(&xroar_context->ui_events, DELEGATE_AS0(void, do_wasm_queue_basic, text), 0);
 }
 
 // Update window size.  Browser handles knowing what size things should be,
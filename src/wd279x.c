@@ -35,6 +35,8 @@ See COPYING.GPL for redistribution conditions.
 #include "events.h"
 #include "logging.h"
 #include "part.h"
+#include "serialise.h"
+#include "stats.h"
 #include "vdrive.h"
 #include "wd279x.h"
 #include "xroar.h"
@@ -71,8 +73,8 @@ See COPYING.GPL for redistribution conditions.
 
 #define NEXT_STATE(f,t) do { \
 		fdc->state = f; \
-		fdc->state_event.at_tick = event_current_tick + t; \
-		event_queue(&MACHINE_EVENT_LIST, &fdc->state_event); \
+		fdc->state_event.at_tick = xroar_context->current_tick + t; \
+		event_queue(&xroar_context->machine_events, &fdc->state_event); \
 	} while (0)
 #define GOTO_STATE(f) fdc->state = f; continue
 
@@ -146,6 +148,7 @@ WD279X *wd279x_new(enum WD279X_type type) {
 
 	fdc->state = WD279X_state_accept_command;
 	event_init(&fdc->state_event, DELEGATE_AS0(void, state_machine, fdc));
+	STATS_EVENT_TYPE(&fdc->state_event, STATS_EVENT_FDC);
 
 	return fdc;
 }
@@ -187,6 +190,168 @@ void wd279x_reset(WD279X *fdc) {
 	SET_SIDE(0);
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+struct wd279x_state {
+	uint8_t status_register;
+	uint8_t track_register;
+	uint8_t sector_register;
+	uint8_t data_register;
+	uint8_t command_register;
+	enum WD279X_state state;
+	struct event_state state_event;
+	int direction;
+	int side;
+	int step_delay;
+	_Bool double_density;
+	_Bool ready_state;
+	_Bool tr00_state;
+	_Bool index_state;
+	_Bool write_protect_state;
+	_Bool status_type1;
+	_Bool intrq_nready_to_ready;
+	_Bool intrq_ready_to_nready;
+	_Bool intrq_index_pulse;
+	_Bool intrq_immediate;
+	_Bool is_step_cmd;
+	uint16_t crc;
+	int dam;
+	int bytes_left;
+	int index_holes_count;
+	uint8_t track_register_tmp;
+};
+
+size_t wd279x_state_size(void) {
+	return sizeof(struct wd279x_state);
+}
+
+void wd279x_state_save(WD279X *fdc, void *buf) {
+	struct wd279x_state *st = buf;
+	st->status_register = fdc->status_register;
+	st->track_register = fdc->track_register;
+	st->sector_register = fdc->sector_register;
+	st->data_register = fdc->data_register;
+	st->command_register = fdc->command_register;
+	st->state = fdc->state;
+	event_save_state(&fdc->state_event, &st->state_event);
+	st->direction = fdc->direction;
+	st->side = fdc->side;
+	st->step_delay = fdc->step_delay;
+	st->double_density = fdc->double_density;
+	st->ready_state = fdc->ready_state;
+	st->tr00_state = fdc->tr00_state;
+	st->index_state = fdc->index_state;
+	st->write_protect_state = fdc->write_protect_state;
+	st->status_type1 = fdc->status_type1;
+	st->intrq_nready_to_ready = fdc->intrq_nready_to_ready;
+	st->intrq_ready_to_nready = fdc->intrq_ready_to_nready;
+	st->intrq_index_pulse = fdc->intrq_index_pulse;
+	st->intrq_immediate = fdc->intrq_immediate;
+	st->is_step_cmd = fdc->is_step_cmd;
+	st->crc = fdc->crc;
+	st->dam = fdc->dam;
+	st->bytes_left = fdc->bytes_left;
+	st->index_holes_count = fdc->index_holes_count;
+	st->track_register_tmp = fdc->track_register_tmp;
+}
+
+void wd279x_state_restore(WD279X *fdc, void const *buf) {
+	struct wd279x_state const *st = buf;
+	fdc->status_register = st->status_register;
+	fdc->track_register = st->track_register;
+	fdc->sector_register = st->sector_register;
+	fdc->data_register = st->data_register;
+	fdc->command_register = st->command_register;
+	fdc->state = st->state;
+	event_restore_state(&fdc->state_event, &xroar_context->machine_events, &st->state_event);
+	fdc->direction = st->direction;
+	fdc->side = st->side;
+	fdc->step_delay = st->step_delay;
+	fdc->double_density = st->double_density;
+	fdc->ready_state = st->ready_state;
+	fdc->tr00_state = st->tr00_state;
+	fdc->index_state = st->index_state;
+	fdc->write_protect_state = st->write_protect_state;
+	fdc->status_type1 = st->status_type1;
+	fdc->intrq_nready_to_ready = st->intrq_nready_to_ready;
+	fdc->intrq_ready_to_nready = st->intrq_ready_to_nready;
+	fdc->intrq_index_pulse = st->intrq_index_pulse;
+	fdc->intrq_immediate = st->intrq_immediate;
+	fdc->is_step_cmd = st->is_step_cmd;
+	fdc->crc = st->crc;
+	fdc->dam = st->dam;
+	fdc->bytes_left = st->bytes_left;
+	fdc->index_holes_count = st->index_holes_count;
+	fdc->track_register_tmp = st->track_register_tmp;
+}
+
+// Portable state for snapshot files, via the in-memory state above.
+
+void wd279x_ser_write(WD279X *fdc, struct ser_handle *sh) {
+	struct wd279x_state st;
+	wd279x_state_save(fdc, &st);
+	ser_write_uint8(sh, st.status_register);
+	ser_write_uint8(sh, st.track_register);
+	ser_write_uint8(sh, st.sector_register);
+	ser_write_uint8(sh, st.data_register);
+	ser_write_uint8(sh, st.command_register);
+	ser_write_uint8(sh, st.state);
+	ser_write_event_state(sh, &st.state_event);
+	ser_write_int32(sh, st.direction);
+	ser_write_int32(sh, st.side);
+	ser_write_int32(sh, st.step_delay);
+	ser_write_bool(sh, st.double_density);
+	ser_write_bool(sh, st.ready_state);
+	ser_write_bool(sh, st.tr00_state);
+	ser_write_bool(sh, st.index_state);
+	ser_write_bool(sh, st.write_protect_state);
+	ser_write_bool(sh, st.status_type1);
+	ser_write_bool(sh, st.intrq_nready_to_ready);
+	ser_write_bool(sh, st.intrq_ready_to_nready);
+	ser_write_bool(sh, st.intrq_index_pulse);
+	ser_write_bool(sh, st.intrq_immediate);
+	ser_write_bool(sh, st.is_step_cmd);
+	ser_write_uint16(sh, st.crc);
+	ser_write_int32(sh, st.dam);
+	ser_write_int32(sh, st.bytes_left);
+	ser_write_int32(sh, st.index_holes_count);
+	ser_write_uint8(sh, st.track_register_tmp);
+}
+
+void wd279x_ser_read(WD279X *fdc, struct ser_handle *sh) {
+	struct wd279x_state st;
+	st.status_register = ser_read_uint8(sh);
+	st.track_register = ser_read_uint8(sh);
+	st.sector_register = ser_read_uint8(sh);
+	st.data_register = ser_read_uint8(sh);
+	st.command_register = ser_read_uint8(sh);
+	st.state = ser_read_uint8(sh);
+	ser_read_event_state(sh, &st.state_event);
+	st.direction = ser_read_int32(sh);
+	st.side = ser_read_int32(sh);
+	st.step_delay = ser_read_int32(sh);
+	st.double_density = ser_read_bool(sh);
+	st.ready_state = ser_read_bool(sh);
+	st.tr00_state = ser_read_bool(sh);
+	st.index_state = ser_read_bool(sh);
+	st.write_protect_state = ser_read_bool(sh);
+	st.status_type1 = ser_read_bool(sh);
+	st.intrq_nready_to_ready = ser_read_bool(sh);
+	st.intrq_ready_to_nready = ser_read_bool(sh);
+	st.intrq_index_pulse = ser_read_bool(sh);
+	st.intrq_immediate = ser_read_bool(sh);
+	st.is_step_cmd = ser_read_bool(sh);
+	st.crc = ser_read_uint16(sh);
+	st.dam = ser_read_int32(sh);
+	st.bytes_left = ser_read_int32(sh);
+	st.index_holes_count = ser_read_int32(sh);
+	st.track_register_tmp = ser_read_uint8(sh);
+	if (!ser_error(sh))
+		wd279x_state_restore(fdc, &st);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 void wd279x_ready(void *sptr, _Bool state) {
 	WD279X *fdc = sptr;
 	if (fdc->ready_state == state)
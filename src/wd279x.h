@@ -131,6 +131,17 @@ void wd279x_disconnect(WD279X *fdc);
 /* Signal all connected delegates */
 void wd279x_update_connection(WD279X *fdc);
 
+/* In-memory state, for snapshots.  Registers and command state only:
+ * connections are unaffected. */
+size_t wd279x_state_size(void);
+void wd279x_state_save(WD279X *fdc, void *buf);
+void wd279x_state_restore(WD279X *fdc, void const *buf);
+
+/* Portable state, for snapshot files. */
+struct ser_handle;
+void wd279x_ser_write(WD279X *fdc, struct ser_handle *sh);
+void wd279x_ser_read(WD279X *fdc, struct ser_handle *sh);
+
 void wd279x_ready(void *sptr, _Bool state);
 void wd279x_tr00(void *sptr, _Bool state);
 void wd279x_index_pulse(void *sptr, _Bool state);
@@ -87,9 +87,9 @@ static char *load_filename(void *sptr, char const * const *extensions) {
 	int was_fullscreen;
 
 	(void)extensions;  /* unused */
-	was_fullscreen = xroar_vo_interface->is_fullscreen;
+	was_fullscreen = xroar_context->vo_interface->is_fullscreen;
 	if (was_fullscreen)
-		DELEGATE_SAFE_CALL1(xroar_vo_interface->set_fullscreen, 0);
+		DELEGATE_SAFE_CALL1(xroar_context->vo_interface->set_fullscreen, 0);
 
 	memset(&ofn, 0, sizeof(ofn));
 	ofn.lStructSize = sizeof(ofn);
@@ -112,7 +112,7 @@ static char *load_filename(void *sptr, char const * const *extensions) {
 		frw32->filename = xstrdup(ofn.lpstrFile);
 	}
 	if (was_fullscreen)
-		DELEGATE_SAFE_CALL1(xroar_vo_interface->set_fullscreen, 1);
+		DELEGATE_SAFE_CALL1(xroar_context->vo_interface->set_fullscreen, 1);
 	return frw32->filename;
 }
 
@@ -123,9 +123,9 @@ static char *save_filename(void *sptr, char const * const *extensions) {
 	int was_fullscreen;
 
 	(void)extensions;  /* unused */
-	was_fullscreen = xroar_vo_interface->is_fullscreen;
+	was_fullscreen = xroar_context->vo_interface->is_fullscreen;
 	if (was_fullscreen)
-		DELEGATE_SAFE_CALL1(xroar_vo_interface->set_fullscreen, 0);
+		DELEGATE_SAFE_CALL1(xroar_context->vo_interface->set_fullscreen, 0);
 
 	memset(&ofn, 0, sizeof(ofn));
 	ofn.lStructSize = sizeof(ofn);
@@ -148,6 +148,6 @@ static char *save_filename(void *sptr, char const * const *extensions) {
 		frw32->filename = xstrdup(ofn.lpstrFile);
 	}
 	if (was_fullscreen)
-		DELEGATE_SAFE_CALL1(xroar_vo_interface->set_fullscreen, 1);
+		DELEGATE_SAFE_CALL1(xroar_context->vo_interface->set_fullscreen, 1);
 	return frw32->filename;
 }
@@ -245,8 +245,8 @@ static void setup_hardware_menu(struct ui_sdl2_interface *uisdl2) {
 
 	AppendMenu(top_menu, MF_STRING | MF_POPUP, (uintptr_t)hardware_menu, "&Hardware");
 
-	windows32_ui_set_state(uisdl2, ui_tag_machine, xroar_machine_config ? xroar_machine_config->id : 0, NULL);
-	struct cart *cart = xroar_machine ? xroar_machine->get_interface(xroar_machine, "cart") : NULL;
+	windows32_ui_set_state(uisdl2, ui_tag_machine, xroar_context->machine_config ? xroar_context->machine_config->id : 0, NULL);
+	struct cart *cart = xroar_context->machine ? xroar_context->machine->get_interface(xroar_context->machine, "cart") : NULL;
 	windows32_ui_set_state(uisdl2, ui_tag_cartridge, cart ? cart->config->id : 0, NULL);
 }
 
@@ -319,15 +319,15 @@ void sdl_windows32_handle_syswmevent(SDL_SysWMmsg *wmmsg) {
 			xroar_insert_input_tape();
 			break;
 		case ui_action_tape_input_rewind:
-			if (xroar_tape_interface && xroar_tape_interface->tape_input)
-				tape_rewind(xroar_tape_interface->tape_input);
+			if (xroar_context->tape_interface && xroar_context->tape_interface->tape_input)
+				tape_rewind(xroar_context->tape_interface->tape_input);
 			break;
 		case ui_action_tape_output:
 			xroar_insert_output_tape();
 			break;
 		case ui_action_tape_output_rewind:
-			if (xroar_tape_interface && xroar_tape_interface->tape_output)
-				tape_rewind(xroar_tape_interface->tape_output);
+			if (xroar_context->tape_interface && xroar_context->tape_interface->tape_output)
+				tape_rewind(xroar_context->tape_interface->tape_output);
 			break;
 		case ui_action_zoom_in:
 			sdl_zoom_in(global_uisdl2);
@@ -358,7 +358,7 @@ void sdl_windows32_handle_syswmevent(SDL_SysWMmsg *wmmsg) {
 
 	// Cassettes:
 	case ui_tag_tape_flags:
-		tape_select_state(xroar_tape_interface, tape_get_state(xroar_tape_interface) ^ tag_value);
+		tape_select_state(xroar_context->tape_interface, tape_get_state(xroar_context->tape_interface) ^ tag_value);
 		break;
 
 	// Disks:
@@ -582,7 +582,7 @@ static LRESULT CALLBACK window_proc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM l
 		break;
 
 	case WM_UNINITMENUPOPUP:
-		DELEGATE_SAFE_CALL0(xroar_vo_interface->refresh);
+		DELEGATE_SAFE_CALL0(xroar_context->vo_interface->refresh);
 		return CallWindowProc(sdl_window_proc, hwnd, msg, wParam, lParam);
 
 	default:
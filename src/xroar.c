@@ -43,7 +43,9 @@ See COPYING.GPL for redistribution conditions.
 #include "xalloc.h"
 
 #include "ao.h"
+#include "batch.h"
 #include "becker.h"
+#include "bootcache.h"
 #include "cart.h"
 #include "crclist.h"
 #include "dkbd.h"
@@ -66,12 +68,14 @@ See COPYING.GPL for redistribution conditions.
 #include "sam.h"
 #include "snapshot.h"
 #include "sound.h"
+#include "stats.h"
 #include "tape.h"
 #include "ui.h"
 #include "vdg_palette.h"
 #include "vdisk.h"
 #include "vdrive.h"
 #include "vo.h"
+#include "vo_thread.h"
 #include "wasm/wasm.h"
 #include "xconfig.h"
 #include "xroar.h"
@@ -87,6 +91,10 @@ See COPYING.GPL for redistribution conditions.
 struct xroar_cfg xroar_cfg = {
 	.disk_auto_os9 = 1,
 	.disk_auto_sd = 1,
+	.rewind_interval = 5,
+	.rewind_memory = ANY_AUTO,
+	.gdb_checkpoint = 50,
+	.gdb_history = 60,
 };
 
 // Private
@@ -134,12 +142,14 @@ struct private_cfg {
 	char *ui;
 	char *filereq;
 	char *ao;
+	_Bool vo_thread;
 	int volume;
 	double gain;
 	char *joy_right;
 	char *joy_left;
 	char *joy_virtual;
 	char *joy_desc;
+	char *rewind_step;
 	int tape_fast;
 	int tape_pad_auto;
 	int tape_rewrite;
@@ -151,6 +161,13 @@ struct private_cfg {
 	_Bool config_print;
 	_Bool config_print_all;
 	char *timeout;
+	_Bool stats;
+	int stats_interval;
+
+	/* Batch mode */
+	char *batch;
+	char *batch_output;
+	int batch_jobs;
 };
 
 static struct private_cfg private_cfg = {
@@ -180,6 +197,10 @@ static struct ui_cfg xroar_ui_cfg = {
 
 static int ccr = UI_CCR_5BIT;
 
+#ifdef HAVE_PTHREADS
+static struct vo_thread *vo_thread = NULL;
+#endif
+
 /* Helper functions used by configuration */
 static void set_machine(const char *name);
 static void set_pal(void);
@@ -187,6 +208,7 @@ static void set_ntsc(void);
 static void set_cart(const char *name);
 static void set_cart_type(const char *name);
 static void set_gain(double gain);
+static void set_frameskip(const char *arg);
 static void set_joystick(const char *name);
 static void set_joystick_axis(const char *spec);
 static void set_joystick_button(const char *spec);
@@ -215,19 +237,9 @@ static struct xroar_state xroar_state = {
 
 static struct ui_interface *xroar_ui_interface;
 static struct filereq_interface *xroar_filereq_interface;
-struct vo_interface *xroar_vo_interface;
-struct ao_interface *xroar_ao_interface;
-
-struct machine_config *xroar_machine_config;
-struct machine *xroar_machine;
-struct tape_interface *xroar_tape_interface;
-struct keyboard_interface *xroar_keyboard_interface;
-struct printer_interface *xroar_printer_interface;
 static struct cart_config *selected_cart_config;
 struct vdg_palette *xroar_vdg_palette;
 
-struct vdrive_interface *xroar_vdrive_interface;
-
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 /* Default configuration */
@@ -449,9 +461,6 @@ static char const * const default_config[] = {
 const char *xroar_conf_path = NULL;
 const char *xroar_rom_path = NULL;
 
-struct event *xroar_ui_events = NULL;
-struct event *xroar_machine_events = NULL;
-
 static struct event load_file_event;
 static void do_load_file(void *);
 //static char *load_file = NULL;
@@ -562,7 +571,7 @@ struct ui_interface *xroar_init(int argc, char **argv) {
 		set_machine(NULL);
 		set_cart(NULL);
 		set_joystick(NULL);
-		xroar_machine_config = NULL;
+		xroar_context->machine_config = NULL;
 		selected_cart_config = NULL;
 		cur_joy_config = NULL;
 	}
@@ -581,7 +590,7 @@ struct ui_interface *xroar_init(int argc, char **argv) {
 	set_cart(NULL);
 	set_joystick(NULL);
 	// Don't auto-select last machine or cart in config file.
-	xroar_machine_config = NULL;
+	xroar_context->machine_config = NULL;
 	selected_cart_config = NULL;
 	cur_joy_config = NULL;
 
@@ -599,12 +608,12 @@ struct ui_interface *xroar_init(int argc, char **argv) {
 			xroar_rom_path = xstrdup(env);
 	}
 	// If no machine specified on command line, get default.
-	if (!xroar_machine_config && private_cfg.default_machine) {
-		xroar_machine_config = machine_config_by_name(private_cfg.default_machine);
+	if (!xroar_context->machine_config && private_cfg.default_machine) {
+		xroar_context->machine_config = machine_config_by_name(private_cfg.default_machine);
 	}
 	// If that didn't work, just find the first one that will work.
-	if (!xroar_machine_config) {
-		xroar_machine_config = machine_config_first_working();
+	if (!xroar_context->machine_config) {
+		xroar_context->machine_config = machine_config_first_working();
 	}
 	// Finish any machine or cart config on command line.
 	set_machine(NULL);
@@ -627,10 +636,22 @@ struct ui_interface *xroar_init(int argc, char **argv) {
 		exit(EXIT_SUCCESS);
 	}
 
-	assert(xroar_machine_config != NULL);
+	assert(xroar_context->machine_config != NULL);
+
+#ifdef HAVE_PTHREADS
+	// Batch mode is headless, and only results go to standard out.
+	if (private_cfg.batch) {
+		if (!private_cfg.batch_output)
+			batch_claim_stdout();
+		free(private_cfg.ui);
+		private_cfg.ui = xstrdup("null");
+		free(private_cfg.ao);
+		private_cfg.ao = xstrdup("null");
+	}
+#endif
 
 	/* New vdrive interface */
-	xroar_vdrive_interface = vdrive_interface_new();
+	xroar_context->vdrive_interface = vdrive_interface_new();
 
 	// Select a UI module.
 	struct ui_module *ui_module = (struct ui_module *)module_select_by_arg((struct module * const *)ui_module_list, private_cfg.ui);
@@ -657,8 +678,14 @@ struct ui_interface *xroar_init(int argc, char **argv) {
 	struct module *ao_module = module_select_by_arg((struct module * const *)ao_module_list, private_cfg.ao);
 	ui_joystick_module_list = ui_module->joystick_module_list;
 
+	// Rewind is only ever requested from the UI, so don't keep history
+	// by default without one.
+	if (xroar_cfg.rewind_memory == ANY_AUTO) {
+		xroar_cfg.rewind_memory = (0 == strcmp(ui_module->common.name, "null")) ? 0 : 8192;
+	}
+
 	/* Check other command-line options */
-	if (xroar_cfg.frameskip < 0)
+	if (xroar_cfg.frameskip < 0 && xroar_cfg.frameskip != ANY_AUTO)
 		xroar_cfg.frameskip = 0;
 
 	// Remaining command line arguments are files.
@@ -687,7 +714,7 @@ struct ui_interface *xroar_init(int argc, char **argv) {
 	private_cfg.tape_fast = private_cfg.tape_fast ? TAPE_FAST : 0;
 	private_cfg.tape_rewrite = private_cfg.tape_rewrite ? TAPE_REWRITE : 0;
 
-	_Bool no_auto_dos = xroar_machine_config->nodos;
+	_Bool no_auto_dos = xroar_context->machine_config->nodos;
 	_Bool definitely_dos = 0;
 	for (struct slist *tmp_list = private_cfg.load_list; tmp_list; tmp_list = tmp_list->next) {
 		char *load_file = tmp_list->data;
@@ -707,7 +734,7 @@ struct ui_interface *xroar_init(int argc, char **argv) {
 		case FILETYPE_OS9:
 		case FILETYPE_DMK:
 			// unless explicitly disabled
-			if (!xroar_machine_config->nodos)
+			if (!xroar_context->machine_config->nodos)
 				definitely_dos = 1;
 			break;
 		// for cartridge ROMs, create a cart as machine default
@@ -726,7 +753,7 @@ struct ui_interface *xroar_init(int argc, char **argv) {
 	 * arch if not already chosen. */
 	if (private_cfg.dos_option) {
 		if (!selected_cart_config) {
-			if (xroar_machine_config->architecture == ARCH_COCO) {
+			if (xroar_context->machine_config->architecture == ARCH_COCO) {
 				selected_cart_config = cart_config_by_name("rsdos");
 			} else {
 				selected_cart_config = cart_config_by_name("dragondos");
@@ -742,39 +769,44 @@ struct ui_interface *xroar_init(int argc, char **argv) {
 
 	// Disable cart if necessary.
 	if (!selected_cart_config && no_auto_dos) {
-		xroar_machine_config->cart_enabled = 0;
+		xroar_context->machine_config->cart_enabled = 0;
 	}
 	// If any cart still configured, make it default for machine.
 	if (selected_cart_config) {
-		if (xroar_machine_config->default_cart)
-			free(xroar_machine_config->default_cart);
-		xroar_machine_config->default_cart = xstrdup(selected_cart_config->name);
+		if (xroar_context->machine_config->default_cart)
+			free(xroar_context->machine_config->default_cart);
+		xroar_context->machine_config->default_cart = xstrdup(selected_cart_config->name);
 	}
 
 	/* Initial palette */
 	xroar_vdg_palette = get_machine_palette();
 
 	/* Initialise everything */
-	event_current_tick = 0;
+	xroar_context->current_tick = 0;
 	/* ... modules */
 	xroar_ui_interface = module_init((struct module *)ui_module, &xroar_ui_cfg);
 	if (!xroar_ui_interface) {
 		LOG_ERROR("No UI module initialised.\n");
 		return NULL;
 	}
-	xroar_vo_interface = xroar_ui_interface->vo_interface;
+	xroar_context->vo_interface = xroar_ui_interface->vo_interface;
+#ifdef HAVE_PTHREADS
+	if (private_cfg.vo_thread && !private_cfg.batch) {
+		vo_thread = vo_thread_new(xroar_context->vo_interface);
+	}
+#endif
 	xroar_filereq_interface = module_init(filereq_module, NULL);
 	if (filereq_module == NULL && filereq_module_list != NULL) {
 		LOG_WARN("No file requester module initialised.\n");
 	}
-	if (!(xroar_ao_interface = module_init_from_list(ao_module_list, ao_module, NULL))) {
+	if (!(xroar_context->ao_interface = module_init_from_list(ao_module_list, ao_module, NULL))) {
 		LOG_ERROR("No audio module initialised.\n");
 		return NULL;
 	}
 	if (private_cfg.volume >= 0) {
-		sound_set_volume(xroar_ao_interface->sound_interface, private_cfg.volume);
+		sound_set_volume(xroar_context->ao_interface->sound_interface, private_cfg.volume);
 	} else {
-		sound_set_gain(xroar_ao_interface->sound_interface, private_cfg.gain);
+		sound_set_gain(xroar_context->ao_interface->sound_interface, private_cfg.gain);
 	}
 	/* ... subsystems */
 	joystick_init();
@@ -800,20 +832,34 @@ struct ui_interface *xroar_init(int argc, char **argv) {
 	DELEGATE_CALL3(xroar_ui_interface->set_state, ui_tag_fullscreen, xroar_ui_cfg.vo_cfg.fullscreen, NULL);
 	xroar_set_kbd_translate(1, xroar_cfg.kbd_translate);
 
-	xroar_tape_interface = tape_interface_new(xroar_ui_interface);
+	xroar_context->tape_interface = tape_interface_new(xroar_ui_interface);
 	if (private_cfg.tape_ao_rate > 0)
-		tape_set_ao_rate(xroar_tape_interface, private_cfg.tape_ao_rate);
+		tape_set_ao_rate(xroar_context->tape_interface, private_cfg.tape_ao_rate);
+
+#ifdef HAVE_PTHREADS
+	// Batch jobs each set up their own machine
+	if (private_cfg.batch) {
+#ifdef WANT_STATS
+		stats_init(private_cfg.stats, private_cfg.stats_interval);
+#endif
+		int status = batch_run(private_cfg.batch, private_cfg.batch_output,
+				       private_cfg.batch_jobs, xroar_ui_interface);
+		exit(status ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+#endif
 
 	/* Configure machine */
-	xroar_configure_machine(xroar_machine_config);
-	if (xroar_machine_config->cart_enabled) {
-		xroar_set_cart(1, xroar_machine_config->default_cart);
+	xroar_configure_machine(xroar_context->machine_config);
+	if (xroar_context->machine_config->cart_enabled) {
+		xroar_set_cart(1, xroar_context->machine_config->default_cart);
 	} else {
 		xroar_set_cart(1, NULL);
 	}
 	/* Reset everything */
 	xroar_hard_reset();
-	tape_select_state(xroar_tape_interface, private_cfg.tape_fast | private_cfg.tape_pad_auto | private_cfg.tape_rewrite);
+	// Skip ROM initialisation if state at the BASIC prompt is cached
+	_Bool booted = bootcache_boot(xroar_context->machine, xroar_cfg.boot_cache);
+	tape_select_state(xroar_context->tape_interface, private_cfg.tape_fast | private_cfg.tape_pad_auto | private_cfg.tape_rewrite);
 
 	load_disk_to_drive = 0;
 	while (private_cfg.load_list) {
@@ -826,12 +872,12 @@ struct ui_interface *xroar_init(int argc, char **argv) {
 		case FILETYPE_ROM:
 			sdsfree(load_file);
 			break;
-		// delay loading binary files by 2s
+		// delay loading binary files by 2s, unless already booted
 		case FILETYPE_BIN:
 		case FILETYPE_HEX:
 			event_init(&load_file_event, DELEGATE_AS0(void, do_load_file, load_file));
-			load_file_event.at_tick = event_current_tick + EVENT_MS(2000);
-			event_queue(&UI_EVENT_LIST, &load_file_event);
+			load_file_event.at_tick = xroar_context->current_tick + (booted ? 0 : EVENT_MS(2000));
+			event_queue(&xroar_context->ui_events, &load_file_event);
 			autorun_loaded_file = autorun;
 			break;
 		// load disks then advice drive number
@@ -860,7 +906,7 @@ struct ui_interface *xroar_init(int argc, char **argv) {
 		switch (write_file_type) {
 			case FILETYPE_CAS:
 			case FILETYPE_WAV:
-				tape_open_writing(xroar_tape_interface, private_cfg.tape_write);
+				tape_open_writing(xroar_context->tape_interface, private_cfg.tape_write);
 				DELEGATE_CALL3(xroar_ui_interface->set_state, ui_tag_tape_output_filename, 0, private_cfg.tape_write);
 				break;
 			default:
@@ -868,6 +914,10 @@ struct ui_interface *xroar_init(int argc, char **argv) {
 		}
 	}
 
+	// A binary trace is recorded in trace mode, so asking for one starts
+	// with trace mode on.  Toggling it pauses and resumes recording.
+	if (xroar_cfg.trace_file)
+		xroar_cfg.trace_enabled = 1;
 	xroar_set_trace(xroar_cfg.trace_enabled);
 	xroar_set_vdg_inverted_text(1, xroar_cfg.vdg_inverted_text);
 	xroar_set_ratelimit_latch(1, XROAR_ON);
@@ -878,19 +928,22 @@ struct ui_interface *xroar_init(int argc, char **argv) {
 
 	while (private_cfg.type_list) {
 		sds data = private_cfg.type_list->data;
-		keyboard_queue_basic_sds(xroar_keyboard_interface, data);
+		keyboard_queue_basic_sds(xroar_context->keyboard_interface, data);
 		private_cfg.type_list = slist_remove(private_cfg.type_list, data);
 		sdsfree(data);
 	}
 	if (private_cfg.lp_file) {
-		printer_open_file(xroar_printer_interface, private_cfg.lp_file);
+		printer_open_file(xroar_context->printer_interface, private_cfg.lp_file);
 	} else if (private_cfg.lp_pipe) {
-		printer_open_pipe(xroar_printer_interface, private_cfg.lp_pipe);
+		printer_open_pipe(xroar_context->printer_interface, private_cfg.lp_pipe);
 	}
 #ifdef HAVE_WASM
-	if (xroar_machine_config) {
-		xroar_set_machine(1, xroar_machine_config->id);
+	if (xroar_context->machine_config) {
+		xroar_set_machine(1, xroar_context->machine_config->id);
 	}
+#endif
+#ifdef WANT_STATS
+	stats_init(private_cfg.stats, private_cfg.stats_interval);
 #endif
 	return xroar_ui_interface;
 }
@@ -900,20 +953,30 @@ void xroar_shutdown(void) {
 	if (shutting_down)
 		return;
 	shutting_down = 1;
-	if (xroar_machine) {
-		part_free((struct part *)xroar_machine);
-		xroar_machine = NULL;
+#ifdef WANT_STATS
+	stats_shutdown();
+#endif
+	if (xroar_context->machine) {
+#ifdef HAVE_PTHREADS
+		vo_thread_flush(vo_thread);
+#endif
+		part_free((struct part *)xroar_context->machine);
+		xroar_context->machine = NULL;
 	}
 	joystick_shutdown();
 	cart_shutdown();
 	mpi_shutdown();
 	machine_shutdown();
-	xroar_machine_config = NULL;
-	if (xroar_ao_interface) {
-		DELEGATE_SAFE_CALL0(xroar_ao_interface->free);
+	xroar_context->machine_config = NULL;
+	if (xroar_context->ao_interface) {
+		DELEGATE_SAFE_CALL0(xroar_context->ao_interface->free);
 	}
-	if (xroar_vo_interface) {
-		DELEGATE_SAFE_CALL0(xroar_vo_interface->free);
+#ifdef HAVE_PTHREADS
+	vo_thread_free(vo_thread);
+	vo_thread = NULL;
+#endif
+	if (xroar_context->vo_interface) {
+		DELEGATE_SAFE_CALL0(xroar_context->vo_interface->free);
 	}
 	if (xroar_filereq_interface) {
 		DELEGATE_SAFE_CALL0(xroar_filereq_interface->free);
@@ -934,14 +997,16 @@ void xroar_shutdown(void) {
 		if (private_cfg.joy_button[i])
 			free(private_cfg.joy_button[i]);
 	}
-	vdrive_interface_free(xroar_vdrive_interface);
-	tape_interface_free(xroar_tape_interface);
+	vdrive_interface_free(xroar_context->vdrive_interface);
+	tape_interface_free(xroar_context->tape_interface);
+	event_list_free(&xroar_context->ui_events);
+	event_list_free(&xroar_context->machine_events);
 	xconfig_shutdown(xroar_options);
 }
 
 static struct vdg_palette *get_machine_palette(void) {
 	struct vdg_palette *vp;
-	vp = vdg_palette_by_name(xroar_machine_config->vdg_palette);
+	vp = vdg_palette_by_name(xroar_context->machine_config->vdg_palette);
 	if (!vp) {
 		vp = vdg_palette_by_name("ideal");
 		if (!vp) {
@@ -957,12 +1022,20 @@ static struct vdg_palette *get_machine_palette(void) {
 // UI event queue, then runs the machine for specified number of cycles.
 
 void xroar_run(int ncycles) {
-	event_run_queue(&UI_EVENT_LIST);
-	if (!xroar_machine)
+	event_run_queue(&xroar_context->ui_events);
+	if (!xroar_context->machine)
 		return;
-	switch (xroar_machine->run(xroar_machine, ncycles)) {
+#ifdef WANT_STATS
+	stats_poll();
+	event_ticks start_tick = xroar_context->current_tick;
+#endif
+	STATS_ENTER(STATS_CPU);
+	enum machine_run_state run_state = xroar_context->machine->run(xroar_context->machine, ncycles);
+	STATS_LEAVE();
+	STATS_EMULATED(xroar_context->current_tick - start_tick);
+	switch (run_state) {
 	case machine_run_state_stopped:
-		DELEGATE_SAFE_CALL0(xroar_vo_interface->refresh);
+		DELEGATE_SAFE_CALL0(xroar_context->vo_interface->refresh);
 		break;
 	case machine_run_state_ok:
 	default:
@@ -996,15 +1069,15 @@ int xroar_load_file_by_type(const char *filename, int autorun) {
 		case FILETYPE_OS9:
 		case FILETYPE_DMK:
 			xroar_insert_disk_file(load_disk_to_drive, filename);
-			if (autorun && vdrive_disk_in_drive(xroar_vdrive_interface, 0)) {
+			if (autorun && vdrive_disk_in_drive(xroar_context->vdrive_interface, 0)) {
 				/* TODO: more intelligent recognition of the type of DOS
 				 * we're talking to */
-				switch (xroar_machine->config->architecture) {
+				switch (xroar_context->machine->config->architecture) {
 				case ARCH_COCO:
-					keyboard_queue_basic(xroar_keyboard_interface, "\\eDOS\\r");
+					keyboard_queue_basic(xroar_context->keyboard_interface, "\\eDOS\\r");
 					break;
 				default:
-					keyboard_queue_basic(xroar_keyboard_interface, "\\eBOOT\\r");
+					keyboard_queue_basic(xroar_context->keyboard_interface, "\\eBOOT\\r");
 					break;
 				}
 				return 0;
@@ -1018,7 +1091,7 @@ int xroar_load_file_by_type(const char *filename, int autorun) {
 			return read_snapshot(filename);
 		case FILETYPE_ROM: {
 			struct cart_config *cc;
-			xroar_machine->remove_cart(xroar_machine);
+			xroar_context->machine->remove_cart(xroar_context->machine);
 			cc = cart_config_by_name(filename);
 			if (cc) {
 				cc->autorun = autorun;
@@ -1034,9 +1107,9 @@ int xroar_load_file_by_type(const char *filename, int autorun) {
 		case FILETYPE_WAV:
 		default:
 			if (autorun) {
-				ret = tape_autorun(xroar_tape_interface, filename);
+				ret = tape_autorun(xroar_context->tape_interface, filename);
 			} else {
-				ret = tape_open_reading(xroar_tape_interface, filename);
+				ret = tape_open_reading(xroar_context->tape_interface, filename);
 			}
 			if (ret != -1) {
 				DELEGATE_CALL3(xroar_ui_interface->set_state, ui_tag_tape_input_filename, 0, filename);
@@ -1069,16 +1142,16 @@ static void handle_timeout_event(void *sptr) {
 	}
 	timeout->seconds--;
 	if (timeout->seconds) {
-		timeout->event.at_tick = event_current_tick + EVENT_S(1);
+		timeout->event.at_tick = xroar_context->current_tick + EVENT_S(1);
 	} else {
 		if (timeout->cycles == 0) {
 			free(timeout);
 			xroar_quit();
 			return;
 		}
-		timeout->event.at_tick = event_current_tick + timeout->cycles;
+		timeout->event.at_tick = xroar_context->current_tick + timeout->cycles;
 	}
-	event_queue(&MACHINE_EVENT_LIST, &timeout->event);
+	event_queue(&xroar_context->machine_events, &timeout->event);
 }
 
 /* Configure a timeout (period after which emulator will exit). */
@@ -1121,7 +1194,7 @@ void xroar_set_trace(int mode) {
 		set_to = 2;
 		break;
 	}
-	xroar_cfg.trace_enabled = xroar_machine->set_trace(xroar_machine, set_to);
+	xroar_cfg.trace_enabled = xroar_context->machine->set_trace(xroar_context->machine, set_to);
 #endif
 }
 
@@ -1150,7 +1223,7 @@ void xroar_new_disk(int drive) {
 	new_disk->filetype = filetype;
 	new_disk->filename = xstrdup(filename);
 	new_disk->write_back = 1;
-	vdrive_insert_disk(xroar_vdrive_interface, drive, new_disk);
+	vdrive_insert_disk(xroar_context->vdrive_interface, drive, new_disk);
 	if (xroar_ui_interface) {
 		DELEGATE_CALL3(xroar_ui_interface->set_state, ui_tag_disk_data, drive, new_disk);
 	}
@@ -1159,7 +1232,7 @@ void xroar_new_disk(int drive) {
 void xroar_insert_disk_file(int drive, const char *filename) {
 	if (!filename) return;
 	struct vdisk *disk = vdisk_load(filename);
-	vdrive_insert_disk(xroar_vdrive_interface, drive, disk);
+	vdrive_insert_disk(xroar_context->vdrive_interface, drive, disk);
 	if (xroar_ui_interface) {
 		DELEGATE_CALL3(xroar_ui_interface->set_state, ui_tag_disk_data, drive, disk);
 	}
@@ -1171,7 +1244,7 @@ void xroar_insert_disk(int drive) {
 }
 
 void xroar_eject_disk(int drive) {
-	vdrive_eject_disk(xroar_vdrive_interface, drive);
+	vdrive_eject_disk(xroar_context->vdrive_interface, drive);
 	if (xroar_ui_interface) {
 		DELEGATE_CALL3(xroar_ui_interface->set_state, ui_tag_disk_data, drive, NULL);
 	}
@@ -1179,7 +1252,7 @@ void xroar_eject_disk(int drive) {
 
 _Bool xroar_set_write_enable(_Bool notify, int drive, int action) {
 	assert(drive >= 0 && drive < 4);
-	struct vdisk *vd = vdrive_disk_in_drive(xroar_vdrive_interface, drive);
+	struct vdisk *vd = vdrive_disk_in_drive(xroar_context->vdrive_interface, drive);
 	if (!vd)
 		return 0;
 	_Bool new_we = !vd->write_protect;
@@ -1200,7 +1273,7 @@ _Bool xroar_set_write_enable(_Bool notify, int drive, int action) {
 
 _Bool xroar_set_write_back(_Bool notify, int drive, int action) {
 	assert(drive >= 0 && drive < 4);
-	struct vdisk *vd = vdrive_disk_in_drive(xroar_vdrive_interface, drive);
+	struct vdisk *vd = vdrive_disk_in_drive(xroar_context->vdrive_interface, drive);
 	if (!vd)
 		return 0;
 	_Bool new_wb = vd->write_back;
@@ -1230,7 +1303,7 @@ void xroar_set_cross_colour_renderer(_Bool notify, int action) {
 		ccr = UI_CCR_5BIT;
 		break;
 	}
-	xroar_set_cross_colour(0, xroar_machine_config->cross_colour_phase);
+	xroar_set_cross_colour(0, xroar_context->machine_config->cross_colour_phase);
 	if (notify) {
 		DELEGATE_CALL3(xroar_ui_interface->set_state, ui_tag_ccr, ccr, NULL);
 	}
@@ -1239,52 +1312,52 @@ void xroar_set_cross_colour_renderer(_Bool notify, int action) {
 void xroar_set_cross_colour(_Bool notify, int action) {
 	switch (action) {
 	case XROAR_NEXT:
-		xroar_machine_config->cross_colour_phase++;
-		xroar_machine_config->cross_colour_phase %= NUM_VO_PHASES;
+		xroar_context->machine_config->cross_colour_phase++;
+		xroar_context->machine_config->cross_colour_phase %= NUM_VO_PHASES;
 		break;
 	default:
-		xroar_machine_config->cross_colour_phase = action;
+		xroar_context->machine_config->cross_colour_phase = action;
 		break;
 	}
-	if (xroar_machine->set_vo_cmp) {
-		if (xroar_machine_config->cross_colour_phase == VO_PHASE_OFF) {
-			xroar_machine->set_vo_cmp(xroar_machine, VO_CMP_PALETTE);
-			DELEGATE_SAFE_CALL1(xroar_vo_interface->set_vo_cmp, VO_CMP_PALETTE);
+	if (xroar_context->machine->set_vo_cmp) {
+		if (xroar_context->machine_config->cross_colour_phase == VO_PHASE_OFF) {
+			xroar_context->machine->set_vo_cmp(xroar_context->machine, VO_CMP_PALETTE);
+			DELEGATE_SAFE_CALL1(xroar_context->vo_interface->set_vo_cmp, VO_CMP_PALETTE);
 		} else {
 			switch (ccr) {
 			default:
-				xroar_machine->set_vo_cmp(xroar_machine, VO_CMP_PALETTE);
-				DELEGATE_SAFE_CALL1(xroar_vo_interface->set_vo_cmp, VO_CMP_PALETTE);
+				xroar_context->machine->set_vo_cmp(xroar_context->machine, VO_CMP_PALETTE);
+				DELEGATE_SAFE_CALL1(xroar_context->vo_interface->set_vo_cmp, VO_CMP_PALETTE);
 				break;
 			case UI_CCR_SIMPLE:
-				xroar_machine->set_vo_cmp(xroar_machine, VO_CMP_PALETTE);
-				DELEGATE_SAFE_CALL1(xroar_vo_interface->set_vo_cmp, VO_CMP_2BIT);
+				xroar_context->machine->set_vo_cmp(xroar_context->machine, VO_CMP_PALETTE);
+				DELEGATE_SAFE_CALL1(xroar_context->vo_interface->set_vo_cmp, VO_CMP_2BIT);
 				break;
 			case UI_CCR_5BIT:
-				xroar_machine->set_vo_cmp(xroar_machine, VO_CMP_PALETTE);
-				DELEGATE_SAFE_CALL1(xroar_vo_interface->set_vo_cmp, VO_CMP_5BIT);
+				xroar_context->machine->set_vo_cmp(xroar_context->machine, VO_CMP_PALETTE);
+				DELEGATE_SAFE_CALL1(xroar_context->vo_interface->set_vo_cmp, VO_CMP_5BIT);
 				break;
 			case UI_CCR_SIMULATED:
-				xroar_machine->set_vo_cmp(xroar_machine, VO_CMP_SIMULATED);
-				DELEGATE_SAFE_CALL1(xroar_vo_interface->set_vo_cmp, VO_CMP_SIMULATED);
+				xroar_context->machine->set_vo_cmp(xroar_context->machine, VO_CMP_SIMULATED);
+				DELEGATE_SAFE_CALL1(xroar_context->vo_interface->set_vo_cmp, VO_CMP_SIMULATED);
 				break;
 			}
 		}
 	}
 	if (notify) {
-		DELEGATE_CALL3(xroar_ui_interface->set_state, ui_tag_cross_colour, xroar_machine_config->cross_colour_phase, NULL);
+		DELEGATE_CALL3(xroar_ui_interface->set_state, ui_tag_cross_colour, xroar_context->machine_config->cross_colour_phase, NULL);
 	}
 }
 
 void xroar_set_vdg_inverted_text(_Bool notify, int action) {
-	_Bool state = xroar_machine->set_inverted_text(xroar_machine, action);
+	_Bool state = xroar_context->machine->set_inverted_text(xroar_context->machine, action);
 	if (notify) {
 		DELEGATE_CALL3(xroar_ui_interface->set_state, ui_tag_vdg_inverse, state, NULL);
 	}
 }
 
 void xroar_set_fast_sound(_Bool notify, int action) {
-	_Bool state = xroar_machine->set_fast_sound(xroar_machine, action);
+	_Bool state = xroar_context->machine->set_fast_sound(xroar_context->machine, action);
 	if (notify) {
 		DELEGATE_CALL3(xroar_ui_interface->set_state, ui_tag_fast_sound, state, NULL);
 	}
@@ -1294,11 +1367,11 @@ void xroar_set_ratelimit(int action) {
 	if (xroar_state.noratelimit_latch)
 		return;
 	if (action) {
-		xroar_machine->set_frameskip(xroar_machine, xroar_cfg.frameskip);
-		xroar_machine->set_ratelimit(xroar_machine, 1);
+		xroar_context->machine->set_frameskip(xroar_context->machine, xroar_cfg.frameskip);
+		xroar_context->machine->set_ratelimit(xroar_context->machine, 1);
 	} else {
-		xroar_machine->set_frameskip(xroar_machine, 10);
-		xroar_machine->set_ratelimit(xroar_machine, 0);
+		xroar_context->machine->set_frameskip(xroar_context->machine, ANY_AUTO);
+		xroar_context->machine->set_ratelimit(xroar_context->machine, 0);
 	}
 }
 
@@ -1318,11 +1391,11 @@ void xroar_set_ratelimit_latch(_Bool notify, int action) {
 	}
 	xroar_state.noratelimit_latch = !state;
 	if (state) {
-		xroar_machine->set_frameskip(xroar_machine, xroar_cfg.frameskip);
-		xroar_machine->set_ratelimit(xroar_machine, 1);
+		xroar_context->machine->set_frameskip(xroar_context->machine, xroar_cfg.frameskip);
+		xroar_context->machine->set_ratelimit(xroar_context->machine, 1);
 	} else {
-		xroar_machine->set_frameskip(xroar_machine, 10);
-		xroar_machine->set_ratelimit(xroar_machine, 0);
+		xroar_context->machine->set_frameskip(xroar_context->machine, ANY_AUTO);
+		xroar_context->machine->set_ratelimit(xroar_context->machine, 0);
 	}
 	if (notify) {
 		DELEGATE_CALL3(xroar_ui_interface->set_state, ui_tag_ratelimit, state, NULL);
@@ -1330,7 +1403,7 @@ void xroar_set_ratelimit_latch(_Bool notify, int action) {
 }
 
 void xroar_set_pause(_Bool notify, int action) {
-	_Bool state = xroar_machine->set_pause(xroar_machine, action);
+	_Bool state = xroar_context->machine->set_pause(xroar_context->machine, action);
 	// TODO: UI indication of paused state
 	(void)notify;
 	(void)state;
@@ -1352,10 +1425,10 @@ void xroar_set_fullscreen(_Bool notify, int action) {
 			break;
 		case XROAR_NEXT:
 		default:
-			set_to = !xroar_vo_interface->is_fullscreen;
+			set_to = !xroar_context->vo_interface->is_fullscreen;
 			break;
 	}
-	DELEGATE_SAFE_CALL1(xroar_vo_interface->set_fullscreen, set_to);
+	DELEGATE_SAFE_CALL1(xroar_context->vo_interface->set_fullscreen, set_to);
 	if (notify) {
 		DELEGATE_CALL3(xroar_ui_interface->set_state, ui_tag_fullscreen, set_to, NULL);
 	}
@@ -1380,7 +1453,7 @@ void xroar_set_keymap(_Bool notify, int map) {
 	switch (map) {
 		case XROAR_NEXT:
 			// fudge the cycle order...
-			switch (xroar_machine_config->keymap) {
+			switch (xroar_context->machine_config->keymap) {
 			case dkbd_layout_dragon:
 				new = dkbd_layout_dragon200e;
 				break;
@@ -1398,7 +1471,7 @@ void xroar_set_keymap(_Bool notify, int map) {
 			break;
 	}
 	if (new >= 0 && new < NUM_KEYMAPS) {
-		keyboard_set_keymap(xroar_keyboard_interface, new);
+		keyboard_set_keymap(xroar_context->keyboard_interface, new);
 		if (notify) {
 			DELEGATE_CALL3(xroar_ui_interface->set_state, ui_tag_keymap, new, NULL);
 		}
@@ -1456,14 +1529,19 @@ void xroar_cycle_joysticks(_Bool notify) {
 }
 
 void xroar_configure_machine(struct machine_config *mc) {
-	if (xroar_machine) {
-		part_free((struct part *)xroar_machine);
-	}
-	xroar_machine_config = mc;
-	xroar_machine = machine_new(mc, xroar_vo_interface, xroar_ao_interface->sound_interface, xroar_tape_interface);
-	tape_interface_connect_machine(xroar_tape_interface, xroar_machine);
-	xroar_keyboard_interface = xroar_machine->get_interface(xroar_machine, "keyboard");
-	xroar_printer_interface = xroar_machine->get_interface(xroar_machine, "printer");
+	if (xroar_context->machine) {
+#ifdef HAVE_PTHREADS
+		// Queued scanlines refer to the old machine's NTSC bursts
+		vo_thread_flush(vo_thread);
+#endif
+		part_free((struct part *)xroar_context->machine);
+	}
+	xroar_context->machine_config = mc;
+	xroar_context->machine = machine_new(mc, xroar_context->vo_interface, xroar_context->ao_interface->sound_interface, xroar_context->tape_interface);
+	tape_interface_connect_machine(xroar_context->tape_interface, xroar_context->machine);
+	xroar_context->keyboard_interface = xroar_context->machine->get_interface(xroar_context->machine, "keyboard");
+	xroar_context->printer_interface = xroar_context->machine->get_interface(xroar_context->machine, "printer");
+	xroar_context->machine->set_frameskip(xroar_context->machine, xroar_state.noratelimit_latch ? ANY_AUTO : xroar_cfg.frameskip);
 	if (xroar_ui_interface) {
 		DELEGATE_CALL3(xroar_ui_interface->set_state, ui_tag_cartridge, -1, NULL);
 	}
@@ -1482,12 +1560,12 @@ void xroar_configure_machine(struct machine_config *mc) {
 }
 
 void xroar_set_machine(_Bool notify, int id) {
-	int new = xroar_machine_config->id;
+	int new = xroar_context->machine_config->id;
 	struct slist *mcl, *mcc;
 	switch (id) {
 		case XROAR_NEXT:
 			mcl = machine_config_list();
-			mcc = slist_find(mcl, xroar_machine_config);
+			mcc = slist_find(mcl, xroar_context->machine_config);
 			if (mcc && mcc->next) {
 				new = ((struct machine_config *)mcc->next->data)->id;
 			} else {
@@ -1515,7 +1593,7 @@ void xroar_set_machine(_Bool notify, int id) {
 		xroar_set_cart(1, NULL);
 	}
 	xroar_vdg_palette = get_machine_palette();
-	DELEGATE_SAFE_CALL0(xroar_vo_interface->update_palette);
+	DELEGATE_SAFE_CALL0(xroar_context->vo_interface->update_palette);
 	xroar_hard_reset();
 	if (notify) {
 		DELEGATE_CALL3(xroar_ui_interface->set_state, ui_tag_machine, new, NULL);
@@ -1523,10 +1601,10 @@ void xroar_set_machine(_Bool notify, int id) {
 }
 
 void xroar_toggle_cart(void) {
-	assert(xroar_machine_config != NULL);
-	xroar_machine_config->cart_enabled = !xroar_machine_config->cart_enabled;
-	if (xroar_machine_config->cart_enabled) {
-		xroar_set_cart(1, xroar_machine_config->default_cart);
+	assert(xroar_context->machine_config != NULL);
+	xroar_context->machine_config->cart_enabled = !xroar_context->machine_config->cart_enabled;
+	if (xroar_context->machine_config->cart_enabled) {
+		xroar_set_cart(1, xroar_context->machine_config->default_cart);
 	} else {
 		xroar_set_cart(1, NULL);
 	}
@@ -1544,35 +1622,35 @@ void xroar_set_cart_by_id(_Bool notify, int id) {
 }
 
 void xroar_set_cart(_Bool notify, const char *cc_name) {
-	assert(xroar_machine_config != NULL);
+	assert(xroar_context->machine_config != NULL);
 
-	struct cart *old_cart = xroar_machine->get_interface(xroar_machine, "cart");
+	struct cart *old_cart = xroar_context->machine->get_interface(xroar_context->machine, "cart");
 	if (!old_cart && !cc_name)
 		return;
 	// This trips GCC-10's static analyser at the moment, as it doesn't
 	// seem to account for the short-circuit "&&".
 	if (old_cart && cc_name && 0 == strcmp(cc_name, old_cart->config->name))
 		return;
-	xroar_machine->remove_cart(xroar_machine);
+	xroar_context->machine->remove_cart(xroar_context->machine);
 
 	struct cart *new_cart = NULL;
 	if (!cc_name) {
-		xroar_machine_config->cart_enabled = 0;
+		xroar_context->machine_config->cart_enabled = 0;
 	} else {
-		if (xroar_machine_config->default_cart != cc_name) {
-			free(xroar_machine_config->default_cart);
-			xroar_machine_config->default_cart = xstrdup(cc_name);
+		if (xroar_context->machine_config->default_cart != cc_name) {
+			free(xroar_context->machine_config->default_cart);
+			xroar_context->machine_config->default_cart = xstrdup(cc_name);
 		}
-		xroar_machine_config->cart_enabled = 1;
+		xroar_context->machine_config->cart_enabled = 1;
 		new_cart = cart_new_named(cc_name);
 		if (new_cart) {
-			xroar_machine->insert_cart(xroar_machine, new_cart);
+			xroar_context->machine->insert_cart(xroar_context->machine, new_cart);
 			if (new_cart->has_interface) {
 				if (new_cart->has_interface(new_cart, "floppy")) {
-					new_cart->attach_interface(new_cart, "floppy", xroar_vdrive_interface);
+					new_cart->attach_interface(new_cart, "floppy", xroar_context->vdrive_interface);
 				}
 				if (new_cart->has_interface(new_cart, "sound")) {
-					new_cart->attach_interface(new_cart, "sound", xroar_ao_interface->sound_interface);
+					new_cart->attach_interface(new_cart, "sound", xroar_context->ao_interface->sound_interface);
 				}
 			}
 			// Reset the cart once all interfaces are attached
@@ -1611,9 +1689,30 @@ void xroar_save_snapshot(void) {
 	}
 }
 
+/* Step back through rewind history, either by one frame or by the amount
+ * configured with -rewind-step. */
+
+void xroar_rewind(_Bool single_frame) {
+	if (!xroar_context->machine || !xroar_context->machine->rewind)
+		return;
+	unsigned nframes = 1;
+	if (!single_frame) {
+		unsigned fps = (xroar_context->machine_config->tv_standard == TV_PAL) ? 50 : 60;
+		const char *step = private_cfg.rewind_step ? private_cfg.rewind_step : "1s";
+		char *end;
+		double t = strtod(step, &end);
+		if (*end == 's' || *end == 'S')
+			t *= fps;
+		nframes = (t >= 1.0) ? (unsigned)(t + 0.5) : 1;
+	}
+	if (!xroar_context->machine->rewind(xroar_context->machine, nframes)) {
+		LOG_DEBUG(1, "Rewind: no history\n");
+	}
+}
+
 void xroar_insert_input_tape_file(const char *filename) {
 	if (!filename) return;
-	tape_open_reading(xroar_tape_interface, filename);
+	tape_open_reading(xroar_context->tape_interface, filename);
 	DELEGATE_CALL3(xroar_ui_interface->set_state, ui_tag_tape_input_filename, 0, filename);
 }
 
@@ -1623,13 +1722,13 @@ void xroar_insert_input_tape(void) {
 }
 
 void xroar_eject_input_tape(void) {
-	tape_close_reading(xroar_tape_interface);
+	tape_close_reading(xroar_context->tape_interface);
 	DELEGATE_CALL3(xroar_ui_interface->set_state, ui_tag_tape_input_filename, 0, NULL);
 }
 
 void xroar_insert_output_tape_file(const char *filename) {
 	if (!filename) return;
-	tape_open_writing(xroar_tape_interface, filename);
+	tape_open_writing(xroar_context->tape_interface, filename);
 	DELEGATE_CALL3(xroar_ui_interface->set_state, ui_tag_tape_output_filename, 0, filename);
 }
 
@@ -1639,18 +1738,18 @@ void xroar_insert_output_tape(void) {
 }
 
 void xroar_eject_output_tape(void) {
-	tape_close_writing(xroar_tape_interface);
+	tape_close_writing(xroar_context->tape_interface);
 	DELEGATE_CALL3(xroar_ui_interface->set_state, ui_tag_tape_output_filename, 0, NULL);
 }
 
 void xroar_soft_reset(void) {
-	xroar_machine->reset(xroar_machine, RESET_SOFT);
-	tape_reset(xroar_tape_interface);
+	xroar_context->machine->reset(xroar_context->machine, RESET_SOFT);
+	tape_reset(xroar_context->tape_interface);
 }
 
 void xroar_hard_reset(void) {
-	xroar_machine->reset(xroar_machine, RESET_HARD);
-	tape_reset(xroar_tape_interface);
+	xroar_context->machine->reset(xroar_context->machine, RESET_HARD);
+	tape_reset(xroar_context->tape_interface);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -1681,21 +1780,21 @@ static void set_machine(const char *name) {
 	}
 #endif
 
-	if (xroar_machine_config) {
+	if (xroar_context->machine_config) {
 		if (private_cfg.machine_arch != ANY_AUTO) {
-			xroar_machine_config->architecture = private_cfg.machine_arch;
+			xroar_context->machine_config->architecture = private_cfg.machine_arch;
 			private_cfg.machine_arch = ANY_AUTO;
 		}
 		if (private_cfg.machine_keymap != ANY_AUTO) {
-			xroar_machine_config->keymap = private_cfg.machine_keymap;
+			xroar_context->machine_config->keymap = private_cfg.machine_keymap;
 			private_cfg.machine_keymap = ANY_AUTO;
 		}
-		xroar_machine_config->cpu = private_cfg.machine_cpu;
+		xroar_context->machine_config->cpu = private_cfg.machine_cpu;
 		if (private_cfg.machine_cpu == CPU_HD6309) {
 			LOG_WARN("Hitachi HD6309 support is UNVERIFIED!\n");
 		}
 		if (private_cfg.machine_desc) {
-			xroar_machine_config->description = private_cfg.machine_desc;
+			xroar_context->machine_config->description = private_cfg.machine_desc;
 			private_cfg.machine_desc = NULL;
 		}
 #ifdef LOGGING
@@ -1710,77 +1809,77 @@ static void set_machine(const char *name) {
 		}
 #endif
 		if (private_cfg.machine_palette) {
-			xroar_machine_config->vdg_palette = private_cfg.machine_palette;
+			xroar_context->machine_config->vdg_palette = private_cfg.machine_palette;
 			private_cfg.machine_palette = NULL;
 		}
 		if (private_cfg.tv != ANY_AUTO) {
-			xroar_machine_config->tv_standard = private_cfg.tv;
+			xroar_context->machine_config->tv_standard = private_cfg.tv;
 			private_cfg.tv = ANY_AUTO;
 		}
 		if (private_cfg.vdg_type != -1) {
-			xroar_machine_config->vdg_type = private_cfg.vdg_type;
+			xroar_context->machine_config->vdg_type = private_cfg.vdg_type;
 			private_cfg.vdg_type = -1;
 		}
 		if (private_cfg.ram > 0) {
-			xroar_machine_config->ram = private_cfg.ram;
+			xroar_context->machine_config->ram = private_cfg.ram;
 			private_cfg.ram = 0;
 		}
 		if (private_cfg.nobas != -1)
-			xroar_machine_config->nobas = private_cfg.nobas;
+			xroar_context->machine_config->nobas = private_cfg.nobas;
 		if (private_cfg.noextbas != -1)
-			xroar_machine_config->noextbas = private_cfg.noextbas;
+			xroar_context->machine_config->noextbas = private_cfg.noextbas;
 		if (private_cfg.noaltbas != -1)
-			xroar_machine_config->noaltbas = private_cfg.noaltbas;
+			xroar_context->machine_config->noaltbas = private_cfg.noaltbas;
 		private_cfg.nobas = private_cfg.noextbas = private_cfg.noaltbas = -1;
 		if (private_cfg.bas) {
-			if (xroar_machine_config->bas_rom) {
-				free(xroar_machine_config->bas_rom);
+			if (xroar_context->machine_config->bas_rom) {
+				free(xroar_context->machine_config->bas_rom);
 			}
-			xroar_machine_config->bas_rom = private_cfg.bas;
-			xroar_machine_config->nobas = 0;
+			xroar_context->machine_config->bas_rom = private_cfg.bas;
+			xroar_context->machine_config->nobas = 0;
 			private_cfg.bas = NULL;
 		}
 		if (private_cfg.extbas) {
-			if (xroar_machine_config->extbas_rom) {
-				free(xroar_machine_config->extbas_rom);
+			if (xroar_context->machine_config->extbas_rom) {
+				free(xroar_context->machine_config->extbas_rom);
 			}
-			xroar_machine_config->extbas_rom = private_cfg.extbas;
-			xroar_machine_config->noextbas = 0;
+			xroar_context->machine_config->extbas_rom = private_cfg.extbas;
+			xroar_context->machine_config->noextbas = 0;
 			private_cfg.extbas = NULL;
 		}
 		if (private_cfg.altbas) {
-			if (xroar_machine_config->altbas_rom) {
-				free(xroar_machine_config->altbas_rom);
+			if (xroar_context->machine_config->altbas_rom) {
+				free(xroar_context->machine_config->altbas_rom);
 			}
-			xroar_machine_config->altbas_rom = private_cfg.altbas;
-			xroar_machine_config->noaltbas = 0;
+			xroar_context->machine_config->altbas_rom = private_cfg.altbas;
+			xroar_context->machine_config->noaltbas = 0;
 			private_cfg.altbas = NULL;
 		}
 		if (private_cfg.ext_charset) {
-			if (xroar_machine_config->ext_charset_rom) {
-				free(xroar_machine_config->ext_charset_rom);
+			if (xroar_context->machine_config->ext_charset_rom) {
+				free(xroar_context->machine_config->ext_charset_rom);
 			}
-			xroar_machine_config->ext_charset_rom = private_cfg.ext_charset;
+			xroar_context->machine_config->ext_charset_rom = private_cfg.ext_charset;
 			private_cfg.ext_charset = NULL;
 		}
 		if (private_cfg.machine_cart) {
-			if (xroar_machine_config->default_cart) {
-				free(xroar_machine_config->default_cart);
+			if (xroar_context->machine_config->default_cart) {
+				free(xroar_context->machine_config->default_cart);
 			}
-			xroar_machine_config->default_cart = private_cfg.machine_cart;
+			xroar_context->machine_config->default_cart = private_cfg.machine_cart;
 			private_cfg.machine_cart = NULL;
 		}
 		if (private_cfg.nodos != -1) {
-			xroar_machine_config->nodos = private_cfg.nodos;
+			xroar_context->machine_config->nodos = private_cfg.nodos;
 			private_cfg.nodos = -1;
 		}
-		machine_config_complete(xroar_machine_config);
+		machine_config_complete(xroar_context->machine_config);
 	}
 	if (name) {
-		xroar_machine_config = machine_config_by_name(name);
-		if (!xroar_machine_config) {
-			xroar_machine_config = machine_config_new();
-			xroar_machine_config->name = xstrdup(name);
+		xroar_context->machine_config = machine_config_by_name(name);
+		if (!xroar_context->machine_config) {
+			xroar_context->machine_config = machine_config_new();
+			xroar_context->machine_config->name = xstrdup(name);
 		}
 	}
 }
@@ -1805,8 +1904,8 @@ static void set_cart(const char *name) {
 	struct cart_config *cc = NULL;
 	if (selected_cart_config) {
 		cc = selected_cart_config;
-	} else if (xroar_machine_config) {
-		cc = cart_config_by_name(xroar_machine_config->default_cart);
+	} else if (xroar_context->machine_config) {
+		cc = cart_config_by_name(xroar_context->machine_config->default_cart);
 	}
 	if (cc) {
 		if (private_cfg.cart_desc) {
@@ -1866,6 +1965,16 @@ static void set_gain(double gain) {
 	private_cfg.volume = -1;
 }
 
+static void set_frameskip(const char *arg) {
+	if (!arg)
+		return;
+	if (0 == strcmp(arg, "auto")) {
+		xroar_cfg.frameskip = ANY_AUTO;
+	} else {
+		xroar_cfg.frameskip = strtol(arg, NULL, 0);
+	}
+}
+
 static void cfg_mpi_slot(int slot) {
 	mpi_set_initial(slot);
 }
@@ -1992,6 +2101,11 @@ static union {
 static struct xconfig_option const xroar_options[] = {
 	/* Machines: */
 	{ XC_SET_STRING("default-machine", &private_cfg.default_machine) },
+	{ XC_SET_BOOL("idle-skip", &xroar_cfg.idle_skip) },
+	{ XC_SET_INT("rewind-interval", &xroar_cfg.rewind_interval) },
+	{ XC_SET_INT("rewind-memory", &xroar_cfg.rewind_memory) },
+	{ XC_SET_STRING("rewind-step", &private_cfg.rewind_step) },
+	{ XC_SET_STRING_F("boot-cache", &xroar_cfg.boot_cache) },
 	{ XC_CALL_STRING("machine", &set_machine) },
 	{ XC_SET_STRING("machine-desc", &private_cfg.machine_desc) },
 	{ XC_SET_ENUM("machine-arch", &private_cfg.machine_arch, machine_arch_list) },
@@ -2080,12 +2194,15 @@ static struct xconfig_option const xroar_options[] = {
 	/* Video: */
 	{ XC_SET_STRING("vo", &xroar_ui_cfg.vo) },
 	{ XC_SET_BOOL("fs", &xroar_ui_cfg.vo_cfg.fullscreen) },
-	{ XC_SET_INT("fskip", &xroar_cfg.frameskip) },
+	{ XC_CALL_STRING("fskip", &set_frameskip) },
 	{ XC_SET_ENUM("ccr", &ccr, ui_ccr_list) },
 	{ XC_SET_ENUM("gl-filter", &xroar_ui_cfg.vo_cfg.gl_filter, ui_gl_filter_list) },
 	{ XC_SET_STRING("geometry", &xroar_ui_cfg.vo_cfg.geometry) },
 	{ XC_SET_STRING("g", &xroar_ui_cfg.vo_cfg.geometry) },
 	{ XC_SET_BOOL("invert-text", &xroar_cfg.vdg_inverted_text) },
+#ifdef HAVE_PTHREADS
+	{ XC_SET_BOOL("vo-thread", &private_cfg.vo_thread) },
+#endif
 
 	/* Audio: */
 	{ XC_SET_STRING("ao", &private_cfg.ao) },
@@ -2127,9 +2244,21 @@ static struct xconfig_option const xroar_options[] = {
 	{ XC_SET_BOOL("gdb", &xroar_cfg.gdb) },
 	{ XC_SET_STRING("gdb-ip", &xroar_cfg.gdb_ip) },
 	{ XC_SET_STRING("gdb-port", &xroar_cfg.gdb_port) },
+	{ XC_SET_INT("gdb-checkpoint", &xroar_cfg.gdb_checkpoint) },
+	{ XC_SET_INT("gdb-history", &xroar_cfg.gdb_history) },
 #endif
 #ifdef TRACE
 	{ XC_SET_INT1("trace", &xroar_cfg.trace_enabled) },
+	{ XC_SET_STRING_F("trace-file", &xroar_cfg.trace_file) },
+	{ XC_SET_INT("trace-buffer", &xroar_cfg.trace_buffer) },
+	{ XC_SET_BOOL("trace-last", &xroar_cfg.trace_last) },
+#endif
+	{ XC_SET_STRING_LIST("bp", &xroar_cfg.bp_list) },
+	{ XC_SET_STRING_F("profile", &xroar_cfg.profile_file) },
+	{ XC_SET_STRING_F("profile-symbols", &xroar_cfg.profile_symbols) },
+#ifdef WANT_STATS
+	{ XC_SET_BOOL("stats", &private_cfg.stats) },
+	{ XC_SET_INT("stats-interval", &private_cfg.stats_interval) },
 #endif
 	{ XC_SET_INT("debug-ui", &xroar_cfg.debug_ui) },
 	{ XC_SET_INT("debug-file", &xroar_cfg.debug_file) },
@@ -2141,6 +2270,13 @@ static struct xconfig_option const xroar_options[] = {
 	{ XC_SET_STRING("timeout-motoroff", &xroar_cfg.timeout_motoroff) },
 	{ XC_SET_STRING("snap-motoroff", &xroar_cfg.snap_motoroff) },
 
+#ifdef HAVE_PTHREADS
+	/* Batch mode: */
+	{ XC_SET_STRING_F("batch", &private_cfg.batch) },
+	{ XC_SET_STRING_F("batch-output", &private_cfg.batch_output) },
+	{ XC_SET_INT("batch-jobs", &private_cfg.batch_jobs) },
+#endif
+
 	/* Other options: */
 	{ XC_SET_BOOL("config-print", &private_cfg.config_print) },
 	{ XC_SET_BOOL("config-print-all", &private_cfg.config_print_all) },
@@ -2174,6 +2310,12 @@ static void helptext(void) {
 
 "\n Machines:\n"
 "  -default-machine NAME   default machine on startup\n"
+"  -idle-skip              fast-forward while CPU waits for an interrupt\n"
+"  -rewind-interval F      snapshot for rewind every F frames [5]\n"
+"  -rewind-memory K        keep up to K kilobytes of rewind history, 0 to disable\n"
+"                            [8192, or 0 with -ui null]\n"
+"  -rewind-step T          rewind by T frames, or T seconds if suffixed 's' [1s]\n"
+"  -boot-cache DIR         save state at BASIC prompt in DIR, restore on startup\n"
 "  -machine NAME           configure named machine (-machine help for list)\n"
 "    -machine-desc TEXT      machine description\n"
 "    -machine-arch ARCH      machine architecture (-machine-arch help for list)\n"
@@ -2242,11 +2384,14 @@ static void helptext(void) {
 "\n Video:\n"
 "  -vo MODULE            video module (-vo help for list)\n"
 "  -fs                   start emulator full-screen if possible\n"
-"  -fskip FRAMES         frameskip (default: 0)\n"
+"  -fskip FRAMES         frameskip, or 'auto' (default: 0)\n"
 "  -ccr RENDERER         cross-colour renderer (-ccr help for list)\n"
 "  -gl-filter FILTER     OpenGL texture filter (-gl-filter help for list)\n"
 "  -geometry WxH+X+Y     initial emulator geometry\n"
 "  -invert-text          start with text mode inverted\n"
+#ifdef HAVE_PTHREADS
+"  -vo-thread            render scanlines on a separate thread\n"
+#endif
 
 "\n Audio:\n"
 "  -ao MODULE            audio module (-ao help for list)\n"
@@ -2288,9 +2433,22 @@ static void helptext(void) {
 "  -gdb                  enable GDB target\n"
 "  -gdb-ip ADDRESS       address of interface for GDB target [" GDB_IP_DEFAULT "]\n"
 "  -gdb-port PORT        port for GDB target to listen on [" GDB_PORT_DEFAULT "]\n"
+"  -gdb-checkpoint F     checkpoint for reverse execution every F frames [50]\n"
+"  -gdb-history S        keep about S seconds of history, 0 to disable [60]\n"
 #endif
 #ifdef TRACE
 "  -trace                start with trace mode on\n"
+"  -trace-file FILE      write trace to FILE in binary (see tools/tracedump)\n"
+"                          and start with trace mode on\n"
+"  -trace-buffer MB      binary trace buffer size [16]\n"
+"  -trace-last           only save the last buffer's worth of binary trace\n"
+#endif
+"  -bp COMMAND           add breakpoint, watchpoint or tracepoint (-bp help)\n"
+"  -profile FILE         profile guest code, writing callgrind output to FILE\n"
+"  -profile-symbols FILE name profiled routines from symbol FILE\n"
+#ifdef WANT_STATS
+"  -stats                print performance statistics on exit\n"
+"  -stats-interval S     print performance statistics every S seconds\n"
 #endif
 "  -debug-ui FLAGS       UI debugging (see manual, or -1 for all)\n"
 "  -debug-file FLAGS     file debugging (see manual, or -1 for all)\n"
@@ -2302,6 +2460,13 @@ static void helptext(void) {
 "  -timeout-motoroff S   quit S seconds after tape motor switches off\n"
 "  -snap-motoroff FILE   write a snapshot each time tape motor switches off\n"
 
+#ifdef HAVE_PTHREADS
+"\n Batch mode:\n"
+"  -batch FILE           run headless jobs listed in manifest FILE, then quit\n"
+"  -batch-output FILE    write JSON lines results to FILE [standard out]\n"
+"  -batch-jobs N         number of jobs to run in parallel [one per CPU]\n"
+#endif
+
 "\n Other options:\n"
 "  -config-print       print configuration to standard out\n"
 "  -config-print-all   print configuration to standard out, including defaults\n"
@@ -2354,6 +2519,15 @@ static void versiontext(void) {
 static void config_print_all(FILE *f, _Bool all) {
 	fputs("# Machines\n\n", f);
 	xroar_cfg_print_string(f, all, "default-machine", private_cfg.default_machine, NULL);
+	xroar_cfg_print_bool(f, all, "idle-skip", xroar_cfg.idle_skip, 0);
+	xroar_cfg_print_int(f, all, "rewind-interval", xroar_cfg.rewind_interval, 5);
+	if (xroar_cfg.rewind_memory == ANY_AUTO) {
+		xroar_cfg_print_string(f, all, "rewind-memory", NULL, NULL);
+	} else {
+		xroar_cfg_print_int(f, all, "rewind-memory", xroar_cfg.rewind_memory, 8192);
+	}
+	xroar_cfg_print_string(f, all, "rewind-step", private_cfg.rewind_step, NULL);
+	xroar_cfg_print_string(f, all, "boot-cache", xroar_cfg.boot_cache, NULL);
 	fputs("\n", f);
 	machine_config_print_all(f, all);
 
@@ -2401,11 +2575,18 @@ static void config_print_all(FILE *f, _Bool all) {
 	fputs("# Video\n", f);
 	xroar_cfg_print_string(f, all, "vo", xroar_ui_cfg.vo, NULL);
 	xroar_cfg_print_bool(f, all, "fs", xroar_ui_cfg.vo_cfg.fullscreen, 0);
-	xroar_cfg_print_int_nz(f, all, "fskip", xroar_cfg.frameskip);
+	if (xroar_cfg.frameskip == ANY_AUTO) {
+		xroar_cfg_print_string(f, all, "fskip", "auto", NULL);
+	} else {
+		xroar_cfg_print_int_nz(f, all, "fskip", xroar_cfg.frameskip);
+	}
 	xroar_cfg_print_enum(f, all, "ccr", ccr, UI_CCR_5BIT, ui_ccr_list);
 	xroar_cfg_print_enum(f, all, "gl-filter", xroar_ui_cfg.vo_cfg.gl_filter, ANY_AUTO, ui_gl_filter_list);
 	xroar_cfg_print_string(f, all, "geometry", xroar_ui_cfg.vo_cfg.geometry, NULL);
 	xroar_cfg_print_bool(f, all, "invert-text", xroar_cfg.vdg_inverted_text, 0);
+#ifdef HAVE_PTHREADS
+	xroar_cfg_print_bool(f, all, "vo-thread", private_cfg.vo_thread, 0);
+#endif
 	fputs("\n", f);
 
 	fputs("# Audio\n", f);
@@ -2451,9 +2632,21 @@ static void config_print_all(FILE *f, _Bool all) {
 	xroar_cfg_print_bool(f, all, "gdb", xroar_cfg.gdb, 0);
 	xroar_cfg_print_string(f, all, "gdb-ip", xroar_cfg.gdb_ip, GDB_IP_DEFAULT);
 	xroar_cfg_print_string(f, all, "gdb-port", xroar_cfg.gdb_port, GDB_PORT_DEFAULT);
+	xroar_cfg_print_int(f, all, "gdb-checkpoint", xroar_cfg.gdb_checkpoint, 50);
+	xroar_cfg_print_int(f, all, "gdb-history", xroar_cfg.gdb_history, 60);
 #endif
 #ifdef TRACE
 	xroar_cfg_print_bool(f, all, "trace", xroar_cfg.trace_enabled, 0);
+	xroar_cfg_print_string(f, all, "trace-file", xroar_cfg.trace_file, NULL);
+	xroar_cfg_print_int_nz(f, all, "trace-buffer", xroar_cfg.trace_buffer);
+	xroar_cfg_print_bool(f, all, "trace-last", xroar_cfg.trace_last, 0);
+#endif
+	xroar_cfg_print_string_list(f, all, "bp", xroar_cfg.bp_list);
+	xroar_cfg_print_string(f, all, "profile", xroar_cfg.profile_file, NULL);
+	xroar_cfg_print_string(f, all, "profile-symbols", xroar_cfg.profile_symbols, NULL);
+#ifdef WANT_STATS
+	xroar_cfg_print_bool(f, all, "stats", private_cfg.stats, 0);
+	xroar_cfg_print_int_nz(f, all, "stats-interval", private_cfg.stats_interval);
 #endif
 	xroar_cfg_print_flags(f, all, "debug-ui", xroar_cfg.debug_ui);
 	xroar_cfg_print_flags(f, all, "debug-file", xroar_cfg.debug_file);
@@ -2465,6 +2658,14 @@ static void config_print_all(FILE *f, _Bool all) {
 	xroar_cfg_print_string(f, all, "timeout-motoroff", xroar_cfg.timeout_motoroff, NULL);
 	xroar_cfg_print_string(f, all, "snap-motoroff", xroar_cfg.snap_motoroff, NULL);
 	fputs("\n", f);
+
+#ifdef HAVE_PTHREADS
+	fputs("# Batch mode\n", f);
+	xroar_cfg_print_string(f, all, "batch", private_cfg.batch, NULL);
+	xroar_cfg_print_string(f, all, "batch-output", private_cfg.batch_output, NULL);
+	xroar_cfg_print_int_nz(f, all, "batch-jobs", private_cfg.batch_jobs);
+	fputs("\n", f);
+#endif
 }
 
 /* Helper functions for config printing */
@@ -21,12 +21,13 @@ See COPYING.GPL for redistribution conditions.
 #include <stdint.h>
 #include <stdio.h>
 
+#include "events.h"
 #include "ui.h"
 #include "xconfig.h"
 
 struct ao_interface;
 struct cart;
-struct event;
+struct event_list;
 struct machine_config;
 struct slist;
 struct vdg_palette;
@@ -89,12 +90,25 @@ struct xroar_cfg {
 	_Bool disk_auto_sd;
 	// CRC lists
 	_Bool force_crc_match;
+	// Emulation
+	_Bool idle_skip;
+	int rewind_interval;
+	int rewind_memory;
+	char *boot_cache;
 	// Debugging
 	_Bool gdb;
 	char *gdb_ip;
 	char *gdb_port;
+	int gdb_checkpoint;
+	int gdb_history;
 	unsigned debug_gdb;
 	_Bool trace_enabled;
+	char *trace_file;
+	int trace_buffer;
+	_Bool trace_last;
+	char *profile_file;
+	char *profile_symbols;
+	struct slist *bp_list;
 	unsigned debug_ui;
 	unsigned debug_file;
 	unsigned debug_fdc;
@@ -109,23 +123,8 @@ extern struct xroar_cfg xroar_cfg;
 
 extern const char *xroar_rom_path;
 
-#define UI_EVENT_LIST xroar_ui_events
-#define MACHINE_EVENT_LIST xroar_machine_events
-extern struct event *xroar_ui_events;
-extern struct event *xroar_machine_events;
-
-extern struct vo_interface *xroar_vo_interface;
-extern struct ao_interface *xroar_ao_interface;
-
-extern struct machine_config *xroar_machine_config;
-extern struct machine *xroar_machine;
-extern struct tape_interface *xroar_tape_interface;
-extern struct keyboard_interface *xroar_keyboard_interface;
-extern struct printer_interface *xroar_printer_interface;
 extern struct vdg_palette *xroar_vdg_palette;
 
-extern struct vdrive_interface *xroar_vdrive_interface;
-
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 // Debug flags
 
@@ -192,6 +191,7 @@ void xroar_set_cart(_Bool notify, const char *cc_name);
 void xroar_set_cart_by_id(_Bool notify, int id);
 void xroar_set_dos(int dos_type);  /* for old snapshots only */
 void xroar_save_snapshot(void);
+void xroar_rewind(_Bool single_frame);
 void xroar_insert_input_tape_file(const char *filename);
 void xroar_insert_input_tape(void);
 void xroar_eject_input_tape(void);
@@ -0,0 +1,140 @@
+/*
+
+CPU core throughput benchmark
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+Runs a short loop of typical 6809 code (indexed loads & stores, direct
+page read-modify-write, MUL, subroutine calls, stack operations) against
+a flat 64K of RAM, and reports instructions and cycles per second.  No
+machine is attached, so this measures the CPU core alone.
+
+Built as cpubench_predecode, the predecode cache is enabled, with every
+page of RAM cacheable.
+
+Usage: cpubench [-6309] [CYCLES]
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "delegate.h"
+
+#include "hd6309.h"
+#include "mc6809.h"
+#include "part.h"
+
+static uint8_t ram[0x10000];
+#ifdef WANT_PREDECODE
+// Flat RAM, so physical address is CPU address
+static int32_t predecode_page[256];
+#endif
+static long cycles_left;
+static unsigned long ninstructions;
+
+static const uint8_t bench_code[] = {
+	0x10, 0xce, 0x80, 0x00,  // 0100 LDS #$8000
+	0x8e, 0x04, 0x00,        // 0104 LDX #$0400
+	0x10, 0x8e, 0x20, 0x00,  // 0107 LDY #$2000
+	0x86, 0x40,              // 010B LDA #$40
+	0x97, 0x10,              // 010D STA <$10
+	0xa6, 0x80,              // 010F LDA ,X+
+	0xab, 0xa0,              // 0111 ADDA ,Y+
+	0xa7, 0x1f,              // 0113 STA -1,X
+	0x3d,                    // 0115 MUL
+	0x8d, 0x07,              // 0116 BSR $011F
+	0x0a, 0x10,              // 0118 DEC <$10
+	0x26, 0xf3,              // 011A BNE $010F
+	0x7e, 0x01, 0x04,        // 011C JMP $0104
+	0x34, 0x06,              // 011F PSHS D
+	0x30, 0x01,              // 0121 LEAX 1,X
+	0x35, 0x06,              // 0123 PULS D
+	0x39,                    // 0125 RTS
+};
+
+static void bench_mem_cycle(void *sptr, _Bool RnW, uint16_t A) {
+	struct MC6809 *cpu = sptr;
+	if (RnW) {
+		cpu->D = ram[A];
+	} else {
+		ram[A] = cpu->D;
+#ifdef WANT_PREDECODE
+		MC6809_PREDECODE_INVALIDATE(cpu, A);
+#endif
+	}
+	if (--cycles_left <= 0)
+		cpu->running = 0;
+}
+
+static void bench_instruction_hook(void *sptr) {
+	(void)sptr;
+	ninstructions++;
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+	_Bool hd6309 = 0;
+	long ncycles = 100000000;
+	for (int i = 1; i < argc; i++) {
+		if (0 == strcmp(argv[i], "-6309")) {
+			hd6309 = 1;
+		} else {
+			ncycles = strtol(argv[i], NULL, 0);
+		}
+	}
+	if (ncycles < 1)
+		ncycles = 1;
+
+	memcpy(ram + 0x0100, bench_code, sizeof(bench_code));
+	ram[0xfffe] = 0x01;
+	ram[0xffff] = 0x00;
+
+	struct MC6809 *cpu = hd6309 ? hd6309_new() : mc6809_new();
+	cpu->mem_cycle = DELEGATE_AS2(void, bool, uint16, bench_mem_cycle, cpu);
+	cpu->instruction_hook = DELEGATE_AS0(void, bench_instruction_hook, cpu);
+#ifdef WANT_PREDECODE
+	for (unsigned page = 0; page < 256; page++)
+		predecode_page[page] = page << 8;
+	cpu->predecode_page = predecode_page;
+#endif
+	cpu->reset(cpu);
+
+	cycles_left = ncycles;
+	double t0 = now();
+	cpu->running = 1;
+	cpu->run(cpu);
+	double t = now() - t0;
+
+	printf("%s: %lu instructions, %ld cycles in %.3fs\n",
+	       hd6309 ? "HD6309" : "MC6809", ninstructions, ncycles, t);
+	printf("%.2f M instructions/s, %.2f M cycles/s (%.1fx real time)\n",
+	       ninstructions / t / 1e6, ncycles / t / 1e6,
+	       ncycles / t / 894886.25);
+
+	part_free((struct part *)cpu);
+	return EXIT_SUCCESS;
+}
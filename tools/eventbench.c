@@ -0,0 +1,122 @@
+/*
+
+Event queue microbenchmark
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+Exercises the event scheduler with a mix of periodic events (as generated
+by the VDG, sound, tape, etc.) and frequent requeue/dequeue churn (as
+generated by FDC state changes and cartridge interrupts).
+
+Usage: eventbench [NEVENTS [NDISPATCH]]
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "delegate.h"
+
+#include "events.h"
+
+static struct event_list bench_events;
+
+struct bench_event {
+	struct event event;
+	event_ticks period;
+	unsigned ndispatched;
+};
+
+static uint32_t rand_state = 1;
+
+static uint32_t bench_rand(void) {
+	rand_state = rand_state * 1103515245 + 12345;
+	return rand_state >> 8;
+}
+
+static void bench_handler(void *sptr) {
+	struct bench_event *be = sptr;
+	be->ndispatched++;
+	be->event.at_tick += be->period;
+	event_queue(&bench_events, &be->event);
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+	unsigned nevents = (argc > 1) ? strtoul(argv[1], NULL, 0) : 12;
+	unsigned long ndispatch = (argc > 2) ? strtoul(argv[2], NULL, 0) : 10000000;
+	if (nevents < 1)
+		nevents = 1;
+
+	struct xroar_context *ctx = xroar_context;
+	bench_events.ctx = ctx;
+
+	struct bench_event *events = calloc(nevents, sizeof(*events));
+	if (!events) {
+		perror(NULL);
+		exit(EXIT_FAILURE);
+	}
+	for (unsigned i = 0; i < nevents; i++) {
+		event_init(&events[i].event, DELEGATE_AS0(void, bench_handler, &events[i]));
+		events[i].period = 16 + (bench_rand() % 4096);
+		events[i].event.at_tick = ctx->current_tick + events[i].period;
+		event_queue(&bench_events, &events[i].event);
+	}
+
+	// Dispatch: advance time as the CPU would, in small steps, running
+	// any pending events.
+	unsigned long ndone = 0;
+	double t0 = now();
+	while (ndone < ndispatch) {
+		ctx->current_tick += 8 + (bench_rand() & 15);
+		while (event_pending(&bench_events)) {
+			event_dispatch_next(&bench_events);
+			ndone++;
+		}
+	}
+	double dispatch_time = now() - t0;
+
+	// Churn: requeue random events to random points in the future, and
+	// occasionally dequeue and requeue.
+	unsigned long nchurn = ndispatch;
+	t0 = now();
+	for (unsigned long i = 0; i < nchurn; i++) {
+		struct bench_event *be = &events[bench_rand() % nevents];
+		if ((i & 7) == 0) {
+			event_dequeue(&be->event);
+		}
+		be->event.at_tick = ctx->current_tick + (bench_rand() % 65536);
+		event_queue(&bench_events, &be->event);
+	}
+	double churn_time = now() - t0;
+
+	printf("%u events queued\n", nevents);
+	printf("dispatch: %lu events in %.3fs (%.2f M/s)\n", ndone, dispatch_time, ndone / dispatch_time / 1e6);
+	printf("churn:    %lu requeues in %.3fs (%.2f M/s)\n", nchurn, churn_time, nchurn / churn_time / 1e6);
+
+	event_list_free(&bench_events);
+	free(events);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,169 @@
+/*
+
+NTSC line decoder check & benchmark
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+Every line decoder usable on this host is checked against ntsc_decode(),
+one pixel at a time, for each of the bursts used by the machines, every
+starting phase, and a range of lengths, alignments and offsets.  Then each
+is timed decoding full width lines.  Exits with failure on any mismatch.
+
+Usage: ntscbench [LINES]
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ntsc.h"
+#include "vo.h"
+
+extern inline int clamp_uint8(int v);
+
+// Burst offsets, as used by the machines
+static const int burst_offset[] = { -33, 0, 33, 66 };
+#define NBURSTS (int)(sizeof(burst_offset) / sizeof(burst_offset[0]))
+
+// Random lines checked per burst, phase and pattern
+#define NCHECKS (500)
+
+// Longest line checked, and width of a benchmarked line
+#define MAX_LINE (700)
+#define BENCH_LINE (640)
+
+// Decoding reads 6 samples beyond the last pixel
+#define NSAMPLES (MAX_LINE + 16)
+
+static uint32_t rand_state = 1;
+
+static uint32_t bench_rand(void) {
+	rand_state = rand_state * 1103515245 + 12345;
+	return rand_state >> 8;
+}
+
+// Sample patterns: noise, full swing, alternating pixels, and a ramp.
+
+static void fill_samples(uint8_t *buf, int pattern, int seed) {
+	for (int i = 0; i < NSAMPLES; i++) {
+		switch (pattern) {
+		case 0: default:
+			buf[i] = bench_rand();
+			break;
+		case 1:
+			buf[i] = (bench_rand() & 1) ? 255 : 0;
+			break;
+		case 2:
+			buf[i] = (i & 1) ? 255 : 0;
+			break;
+		case 3:
+			buf[i] = i * 7 + seed;
+			break;
+		}
+	}
+}
+
+// Decode with the reference, one pixel at a time.
+
+static void decode_reference(const struct ntsc_burst *nb, const uint8_t *ntsc,
+			     unsigned n, int offset, uint8_t *x, uint8_t *y, uint8_t *z) {
+	for (unsigned i = 0; i < n; i++) {
+		struct ntsc_xyz rgb = ntsc_decode(nb, ntsc + i);
+		x[i] = clamp_uint8(rgb.x + offset);
+		y[i] = clamp_uint8(rgb.y + offset);
+		z[i] = clamp_uint8(rgb.z + offset);
+	}
+}
+
+static unsigned check(ntsc_decode_line_func f, struct ntsc_burst **nb) {
+	static uint8_t buf[NSAMPLES];
+	uint8_t x0[MAX_LINE], y0[MAX_LINE], z0[MAX_LINE];
+	uint8_t x1[MAX_LINE], y1[MAX_LINE], z1[MAX_LINE];
+	unsigned nbad = 0;
+	for (int b = 0; b < NBURSTS; b++) {
+		for (unsigned phase = 0; phase < NTSC_NPHASES; phase++) {
+			for (int iter = 0; iter < NCHECKS; iter++) {
+				fill_samples(buf, iter & 3, iter);
+				unsigned align = bench_rand() % 8;
+				unsigned n = bench_rand() % (MAX_LINE - 8 + 1);
+				int offset = (int)(bench_rand() % 121) - 60;
+				ntsc_phase = phase;
+				decode_reference(nb[b], buf + align, n, offset, x0, y0, z0);
+				unsigned phase0 = ntsc_phase;
+				ntsc_phase = phase;
+				f(nb[b], buf + align, n, offset, x1, y1, z1);
+				if (ntsc_phase != phase0 || memcmp(x0, x1, n) != 0
+				    || memcmp(y0, y1, n) != 0 || memcmp(z0, z1, n) != 0) {
+					nbad++;
+				}
+			}
+		}
+	}
+	return nbad;
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double bench(ntsc_decode_line_func f, struct ntsc_burst *nb, long nlines) {
+	static uint8_t buf[NSAMPLES];
+	uint8_t x[BENCH_LINE], y[BENCH_LINE], z[BENCH_LINE];
+	fill_samples(buf, 0, 0);
+	double t0 = now();
+	for (long l = 0; l < nlines; l++) {
+		f(nb, buf + (l & 7), BENCH_LINE, 40, x, y, z);
+	}
+	return now() - t0;
+}
+
+int main(int argc, char **argv) {
+	long nlines = 100000;
+	if (argc > 1)
+		nlines = strtol(argv[1], NULL, 0);
+	if (nlines < 1)
+		nlines = 1;
+
+	struct ntsc_burst *nb[NBURSTS];
+	for (int b = 0; b < NBURSTS; b++)
+		nb[b] = ntsc_burst_new(burst_offset[b]);
+
+	unsigned nfailed = 0;
+	const char *name;
+	ntsc_decode_line_func f;
+	for (unsigned i = 0; (f = ntsc_decode_line_variant(i, &name)); i++) {
+		unsigned nbad = check(f, nb);
+		double t = bench(f, nb[1], nlines);
+		printf("%-8s %s, %.0f lines/s\n", name,
+		       nbad ? "MISMATCH" : "exact", nlines / t);
+		if (nbad) {
+			printf("\t%u of %d lines differ\n", nbad,
+			       NBURSTS * NTSC_NPHASES * NCHECKS);
+			nfailed++;
+		}
+	}
+
+	for (int b = 0; b < NBURSTS; b++)
+		ntsc_burst_free(nb[b]);
+	return nfailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,320 @@
+/*
+
+Binary trace decoder
+
+Copyright 2020 Ciaran Anscomb
+
+This file is part of XRoar.
+
+XRoar is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+See COPYING.GPL for redistribution conditions.
+
+Reads a binary trace written with "xroar -trace -trace-file FILE" and prints
+it in the same text format as "xroar -trace".  The CPU trace code is reused
+to disassemble, so output is identical.
+
+Usage: tracedump [-c] [-pc FROM-TO] [-t FROM-TO] FILE
+
+  -c            prefix each line with its time stamp in CPU cycles
+  -pc FROM-TO   only show records with PC in this range (hex)
+  -t FROM-TO    only show records in this time window (CPU cycles, counted
+                from the start of the trace; either end may be omitted)
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hd6309.h"
+#include "hd6309_trace.h"
+#include "mc6809.h"
+#include "mc6809_trace.h"
+#include "tracebin.h"
+
+static struct {
+	_Bool print_time;
+	unsigned pc_from, pc_to;
+	uint64_t t_from, t_to;
+} opt = { .pc_to = 0xffff, .t_to = UINT64_MAX };
+
+static uint32_t get16(const uint8_t *p) {
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Bounds checked reads from a block.  Each returns false, consuming nothing,
+// if fewer than the required bytes remain.
+
+struct cursor {
+	const uint8_t *p;
+	const uint8_t *end;
+};
+
+static _Bool read_bytes(struct cursor *c, size_t n, const uint8_t **out) {
+	if ((size_t)(c->end - c->p) < n)
+		return 0;
+	*out = c->p;
+	c->p += n;
+	return 1;
+}
+
+static _Bool read8(struct cursor *c, unsigned *v) {
+	const uint8_t *b;
+	if (!read_bytes(c, 1, &b))
+		return 0;
+	*v = b[0];
+	return 1;
+}
+
+static _Bool read16(struct cursor *c, unsigned *v) {
+	const uint8_t *b;
+	if (!read_bytes(c, 2, &b))
+		return 0;
+	*v = get16(b);
+	return 1;
+}
+
+// Unsigned LEB128, at most 32 bits.
+
+static _Bool read_uleb(struct cursor *c, uint32_t *v) {
+	const uint8_t *p = c->p;
+	uint32_t value = 0;
+	for (int shift = 0; shift < 32; shift += 7) {
+		if (p >= c->end)
+			return 0;
+		uint8_t b = *(p++);
+		if (shift == 28 && (b & 0x70))
+			return 0;
+		value |= (uint32_t)(b & 0x7f) << shift;
+		if (!(b & 0x80)) {
+			c->p = p;
+			*v = value;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void usage(void) {
+	fprintf(stderr, "usage: tracedump [-c] [-pc FROM-TO] [-t FROM-TO] FILE\n");
+	exit(EXIT_FAILURE);
+}
+
+// Parse "FROM-TO", either part optional.
+
+static void parse_range(const char *s, int base, uint64_t *from, uint64_t *to) {
+	char *end;
+	if (*s != '-') {
+		*from = strtoull(s, &end, base);
+		s = end;
+	}
+	if (*s == '-') {
+		s++;
+		if (*s) {
+			*to = strtoull(s, &end, base);
+			s = end;
+		}
+	} else {
+		*to = *from;
+	}
+	if (*s)
+		usage();
+}
+
+int main(int argc, char **argv) {
+	const char *filename = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (0 == strcmp(argv[i], "-c")) {
+			opt.print_time = 1;
+		} else if (0 == strcmp(argv[i], "-pc") && i+1 < argc) {
+			uint64_t from = opt.pc_from, to = opt.pc_to;
+			parse_range(argv[++i], 16, &from, &to);
+			opt.pc_from = from;
+			opt.pc_to = to;
+		} else if (0 == strcmp(argv[i], "-t") && i+1 < argc) {
+			parse_range(argv[++i], 10, &opt.t_from, &opt.t_to);
+		} else if (argv[i][0] == '-' || filename) {
+			usage();
+		} else {
+			filename = argv[i];
+		}
+	}
+	if (!filename)
+		usage();
+
+	FILE *fd = fopen(filename, "rb");
+	if (!fd) {
+		perror(filename);
+		return EXIT_FAILURE;
+	}
+
+	uint8_t header[TRACEBIN_FILE_HEADER_SIZE];
+	if (fread(header, sizeof(header), 1, fd) != 1 ||
+	    memcmp(header, TRACEBIN_MAGIC, sizeof(TRACEBIN_MAGIC)) != 0) {
+		fprintf(stderr, "%s: not an XRoar binary trace\n", filename);
+		return EXIT_FAILURE;
+	}
+	int cpu_type = header[8];
+	unsigned nregs = header[9];
+	uint32_t block_size = get32(header + 12);
+	if (nregs > TRACEBIN_MAX_REGS) {
+		fprintf(stderr, "%s: bad register count\n", filename);
+		return EXIT_FAILURE;
+	}
+
+	// The CPU structs are never run, only used to hold register values
+	// for the trace code to print.
+	struct HD6309 hcpu = {0};
+	struct MC6809 *cpu = &hcpu.mc6809;
+	struct mc6809_trace *mtracer = NULL;
+	struct hd6309_trace *htracer = NULL;
+	if (cpu_type == TRACEBIN_CPU_HD6309) {
+		htracer = hd6309_trace_new(&hcpu);
+	} else {
+		mtracer = mc6809_trace_new(cpu);
+	}
+
+	uint8_t *data = malloc(block_size);
+	if (!data) {
+		perror(NULL);
+		return EXIT_FAILURE;
+	}
+
+	uint16_t regs[TRACEBIN_MAX_REGS] = {0};
+	uint64_t t = 0;  // ticks since start of trace
+	uint32_t last_tick = 0;
+	_Bool first_block = 1;
+	uint16_t next_pc = 0;
+	uint32_t last_seq = 0;
+
+	int status = EXIT_SUCCESS;
+	uint8_t bheader[TRACEBIN_BLOCK_HEADER_SIZE];
+	size_t nread;
+	while ((nread = fread(bheader, 1, sizeof(bheader), fd)) > 0) {
+		if (nread < sizeof(bheader)) {
+			fprintf(stderr, "%s: truncated block header\n", filename);
+			status = EXIT_FAILURE;
+			break;
+		}
+		uint32_t seq = get32(bheader);
+		uint32_t nbytes = get32(bheader + 4);
+		uint32_t nrecords = get32(bheader + 8);
+		uint32_t base_tick = get32(bheader + 12);
+		if (nbytes > block_size || fread(data, nbytes, 1, fd) != 1) {
+			fprintf(stderr, "%s: truncated block %" PRIu32 "\n", filename, seq);
+			status = EXIT_FAILURE;
+			break;
+		}
+		if (!first_block && seq != last_seq + 1) {
+			fprintf(stderr, "%s: gap in trace before block %" PRIu32 "\n", filename, seq);
+		}
+		if (!first_block)
+			t += (uint32_t)(base_tick - last_tick);
+		last_tick = base_tick;
+		last_seq = seq;
+		first_block = 0;
+
+		struct cursor c = { .p = data, .end = data + nbytes };
+		for (uint32_t r = 0; r < nrecords; r++) {
+			unsigned tag;
+			uint32_t dt;
+			if (!read8(&c, &tag) || !read_uleb(&c, &dt))
+				goto corrupt;
+			t += dt;
+			last_tick += dt;
+
+			unsigned pc = next_pc;
+			if ((tag & TRACEBIN_F_PC) && !read16(&c, &pc))
+				goto corrupt;
+			unsigned n = tag & TRACEBIN_F_NBYTES;
+			const uint8_t *bytes;
+			if (!read_bytes(&c, n, &bytes))
+				goto corrupt;
+			next_pc = pc + n;
+
+			unsigned mask = 0, mask2 = 0;
+			if ((tag & TRACEBIN_F_REGS) && !read8(&c, &mask))
+				goto corrupt;
+			if ((tag & TRACEBIN_F_REGS2) && !read8(&c, &mask2))
+				goto corrupt;
+			mask |= mask2 << 8;
+			for (unsigned i = 0; i < nregs; i++) {
+				if (!(mask & (1 << i)))
+					continue;
+				unsigned v;
+				if (TRACEBIN_REG_IS16(i) ? !read16(&c, &v) : !read8(&c, &v))
+					goto corrupt;
+				regs[i] = v;
+			}
+
+			uint64_t cycles = t / 16;
+			if (pc < opt.pc_from || pc > opt.pc_to ||
+			    cycles < opt.t_from || cycles > opt.t_to)
+				continue;
+
+			cpu->reg_cc = regs[TRACEBIN_REG_CC];
+			cpu->reg_d = (regs[TRACEBIN_REG_A] << 8) | regs[TRACEBIN_REG_B];
+			cpu->reg_dp = regs[TRACEBIN_REG_DP];
+			cpu->reg_x = regs[TRACEBIN_REG_X];
+			cpu->reg_y = regs[TRACEBIN_REG_Y];
+			cpu->reg_u = regs[TRACEBIN_REG_U];
+			cpu->reg_s = regs[TRACEBIN_REG_S];
+			hcpu.reg_w = (regs[TRACEBIN_REG_E] << 8) | regs[TRACEBIN_REG_F];
+			hcpu.reg_v = regs[TRACEBIN_REG_V];
+			hcpu.reg_md = regs[TRACEBIN_REG_MD];
+
+			if (opt.print_time)
+				printf("%10" PRIu64 " ", cycles);
+
+			// Replay the bytes through the trace code
+			if (htracer) {
+				if (tag & TRACEBIN_F_IRQ)
+					hd6309_trace_irq(htracer, pc);
+				for (unsigned i = 0; i < n; i++)
+					hd6309_trace_byte(htracer, bytes[i], pc + i);
+				if (!(tag & TRACEBIN_F_IRQ))
+					hd6309_trace_print(htracer);
+			} else {
+				if (tag & TRACEBIN_F_IRQ)
+					mc6809_trace_irq(mtracer, pc);
+				for (unsigned i = 0; i < n; i++)
+					mc6809_trace_byte(mtracer, bytes[i], pc + i);
+				if (!(tag & TRACEBIN_F_IRQ))
+					mc6809_trace_print(mtracer);
+			}
+			continue;
+corrupt:
+			fprintf(stderr, "%s: corrupt record %" PRIu32 " in block %" PRIu32 "\n", filename, r, seq);
+			status = EXIT_FAILURE;
+			break;
+		}
+		if (status == EXIT_SUCCESS && c.p != c.end) {
+			fprintf(stderr, "%s: trailing data in block %" PRIu32 "\n", filename, seq);
+			status = EXIT_FAILURE;
+		}
+		if (status != EXIT_SUCCESS)
+			break;
+	}
+
+	free(data);
+	if (htracer)
+		hd6309_trace_free(htracer);
+	if (mtracer)
+		mc6809_trace_free(mtracer);
+	fclose(fd);
+	return status;
+}